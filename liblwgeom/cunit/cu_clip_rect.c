@@ -0,0 +1,235 @@
+/**********************************************************************
+ *
+ * PostGIS - Spatial Types for PostgreSQL
+ * http://postgis.refractions.net
+ *
+ * This is free software; you can redistribute and/or modify it under
+ * the terms of the GNU General Public Licence. See the COPYING file.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "CUnit/Basic.h"
+
+#include "liblwgeom_internal.h"
+#include "cu_tester.h"
+
+static void
+do_clip_by_rect(char *in, double x0, double y0, double x1, double y1, char *expected)
+{
+	LWGEOM *g, *c;
+	char *wkt;
+
+	g = lwgeom_from_wkt(in, LW_PARSER_CHECK_NONE);
+	c = lwgeom_clip_by_rect(g, x0, y0, x1, y1);
+	wkt = lwgeom_to_ewkt(c);
+	if ( strcmp(wkt, expected) )
+		fprintf(stderr, "\nIn:   %s\nExp:  %s\nObt:  %s\n", in, expected, wkt);
+	CU_ASSERT_STRING_EQUAL(wkt, expected);
+	lwfree(wkt);
+	lwgeom_free(c);
+	lwgeom_free(g);
+}
+
+static void
+do_clip_gbox(LWGEOM* (*clipper)(const LWGEOM*, const GBOX*), char *in, double x0, double y0, double x1, double y1, char *expected)
+{
+	LWGEOM *g, *c;
+	GBOX box;
+	char *wkt;
+
+	box.xmin = x0; box.ymin = y0;
+	box.xmax = x1; box.ymax = y1;
+	g = lwgeom_from_wkt(in, LW_PARSER_CHECK_NONE);
+	c = clipper(g, &box);
+	if ( ! expected )
+	{
+		CU_ASSERT_PTR_NULL(c);
+		if ( c ) lwgeom_free(c);
+	}
+	else
+	{
+		CU_ASSERT_PTR_NOT_NULL_FATAL(c);
+		wkt = lwgeom_to_ewkt(c);
+		if ( strcmp(wkt, expected) )
+			fprintf(stderr, "\nIn:   %s\nExp:  %s\nObt:  %s\n", in, expected, wkt);
+		CU_ASSERT_STRING_EQUAL(wkt, expected);
+		lwfree(wkt);
+		lwgeom_free(c);
+	}
+	lwgeom_free(g);
+}
+
+static void
+do_clip_exact(char *in, double x0, double y0, double x1, double y1, char *expected)
+{
+	do_clip_gbox(lwgeom_clip_to_gbox_exact, in, x0, y0, x1, y1, expected);
+}
+
+static void
+do_clip_trivial(char *in, double x0, double y0, double x1, double y1, char *expected)
+{
+	do_clip_gbox(lwgeom_clip_to_gbox_trivial, in, x0, y0, x1, y1, expected);
+}
+
+static void
+test_clip_points(void)
+{
+	do_clip_by_rect("POINT(5 5)", 0, 0, 10, 10, "POINT(5 5)");
+	do_clip_by_rect("POINT(10 10)", 0, 0, 10, 10, "POINT(10 10)");
+	do_clip_by_rect("POINT(11 5)", 0, 0, 10, 10, "POINT EMPTY");
+	do_clip_by_rect("MULTIPOINT(0 0,5 5,15 5,10 10)", 10, 10, 0, 0, "MULTIPOINT(0 0,5 5,10 10)");
+	do_clip_by_rect("MULTIPOINT(20 20,30 30)", 0, 0, 10, 10, "MULTIPOINT EMPTY");
+	do_clip_by_rect("SRID=4326;POINT(5 5)", 0, 0, 10, 10, "SRID=4326;POINT(5 5)");
+}
+
+static void
+test_clip_lines(void)
+{
+	/* Straight through */
+	do_clip_by_rect("LINESTRING(-5 5,15 5)", 0, 0, 10, 10, "LINESTRING(0 5,10 5)");
+	/* Out and back in again */
+	do_clip_by_rect("LINESTRING(-5 5,5 5,5 15,8 15,8 -5)", 0, 0, 10, 10,
+	                "MULTILINESTRING((0 5,5 5,5 10),(8 10,8 0))");
+	/* Along the edge */
+	do_clip_by_rect("LINESTRING(-5 0,15 0)", 0, 0, 10, 10, "LINESTRING(0 0,10 0)");
+	/* Just touching a corner */
+	do_clip_by_rect("LINESTRING(-5 5,5 15)", 0, 0, 10, 10, "LINESTRING EMPTY");
+	/* Ending on the edge and carrying on */
+	do_clip_by_rect("LINESTRING(5 5,10 5,15 5,15 8,10 8,5 8)", 0, 0, 10, 10,
+	                "MULTILINESTRING((5 5,10 5),(10 8,5 8))");
+	/* Z and M are interpolated */
+	do_clip_by_rect("LINESTRING ZM (-10 0 0 10,10 0 20 30)", -5, -5, 5, 5,
+	                "LINESTRING(-5 0 5 15,5 0 15 25)");
+	do_clip_by_rect("MULTILINESTRING((-5 5,15 5),(20 20,30 30))", 0, 0, 10, 10,
+	                "MULTILINESTRING((0 5,10 5))");
+}
+
+static void
+test_clip_polygons(void)
+{
+	/* Box inside the polygon */
+	do_clip_by_rect("POLYGON((-5 -5,15 -5,15 15,-5 15,-5 -5))", 0, 0, 10, 10,
+	                "POLYGON((10 10,0 10,0 0,10 0,10 10))");
+	/* Polygon inside the box */
+	do_clip_by_rect("POLYGON((2 2,8 2,8 8,2 8,2 2))", 0, 0, 10, 10,
+	                "POLYGON((2 2,8 2,8 8,2 8,2 2))");
+	/* Polygon outside the box */
+	do_clip_by_rect("POLYGON((20 20,30 20,30 30,20 20))", 0, 0, 10, 10, "POLYGON EMPTY");
+	/* Triangle across a corner */
+	do_clip_by_rect("POLYGON((5 5,15 5,5 15,5 5))", 0, 0, 10, 10,
+	                "POLYGON((5 10,5 5,10 5,10 10,5 10))");
+	/* Holes are clipped too, and dropped when outside */
+	do_clip_by_rect("POLYGON((-5 -5,15 -5,15 15,-5 15,-5 -5),(2 2,2 4,4 4,4 2,2 2),(8 -2,8 2,12 2,12 -2,8 -2),(-4 -4,-4 -2,-2 -2,-2 -4,-4 -4))",
+	                0, 0, 10, 10,
+	                "POLYGON((10 10,0 10,0 0,10 0,10 10),(2 2,2 4,4 4,4 2,2 2),(8 0,8 2,10 2,10 0,8 0))");
+	/* Only touching the box */
+	do_clip_by_rect("POLYGON((10 0,20 0,20 10,10 10,10 0))", 0, 0, 10, 10, "POLYGON EMPTY");
+	/* A concave polygon cut in two comes out joined along the box edge */
+	do_clip_by_rect("POLYGON((0 0,10 0,10 10,8 10,8 2,2 2,2 10,0 10,0 0))", 0, 5, 10, 10,
+	                "POLYGON((8 5,2 5,2 10,0 10,0 5,10 5,10 10,8 10,8 5))");
+	do_clip_by_rect("MULTIPOLYGON(((0 0,4 0,4 4,0 4,0 0)),((6 6,9 6,9 9,6 9,6 6)))", 5, 5, 10, 10,
+	                "MULTIPOLYGON(((6 6,9 6,9 9,6 9,6 6)))");
+}
+
+static void
+test_clip_collections(void)
+{
+	LWGEOM *g, *c;
+
+	do_clip_by_rect("GEOMETRYCOLLECTION(POINT(5 5),LINESTRING(-5 5,15 5),POINT(20 20))", 0, 0, 10, 10,
+	                "GEOMETRYCOLLECTION(POINT(5 5),LINESTRING(0 5,10 5))");
+	do_clip_by_rect("GEOMETRYCOLLECTION(POINT(20 20))", 0, 0, 10, 10, "GEOMETRYCOLLECTION EMPTY");
+	do_clip_by_rect("GEOMETRYCOLLECTION EMPTY", 0, 0, 10, 10, "GEOMETRYCOLLECTION EMPTY");
+
+	g = lwgeom_from_wkt("CIRCULARSTRING(0 0,1 1,2 0)", LW_PARSER_CHECK_NONE);
+	cu_error_msg_reset();
+	c = lwgeom_clip_by_rect(g, 0, 0, 10, 10);
+	CU_ASSERT_STRING_EQUAL(cu_error_msg, "lwgeom_clip_by_rect: unsupported geometry type: CircularString");
+	if ( c ) lwgeom_free(c);
+	lwgeom_free(g);
+}
+
+static void
+test_clip_exact(void)
+{
+	do_clip_exact("MULTIPOINT(0 0,5 5,15 5)", 0, 0, 10, 10, "MULTIPOINT(0 0,5 5)");
+	do_clip_exact("MULTIPOINT(5 5,15 5)", 0, 0, 10, 10, "POINT(5 5)");
+	do_clip_exact("POINT(15 5)", 0, 0, 10, 10, "GEOMETRYCOLLECTION EMPTY");
+	do_clip_exact("LINESTRING(-5 5,5 5,5 15,8 15,8 -5)", 0, 0, 10, 10,
+	              "MULTILINESTRING((0 5,5 5,5 10),(8 10,8 0))");
+	do_clip_exact("MULTIPOLYGON(((0 0,4 0,4 4,0 4,0 0)),((6 6,12 6,12 12,6 12,6 6)))", 5, 5, 10, 10,
+	              "POLYGON((6 10,6 6,10 6,10 10,6 10))");
+	/* Where GEOS would give a point */
+	do_clip_exact("LINESTRING(-5 5,5 15)", 0, 0, 10, 10, NULL);
+	do_clip_exact("POLYGON((10 0,20 0,20 10,10 10,10 0))", 0, 0, 10, 10, NULL);
+	/* Concave, or holes across the edge */
+	do_clip_exact("POLYGON((0 0,10 0,10 10,8 10,8 2,2 2,2 10,0 10,0 0))", 0, 5, 10, 10, NULL);
+	do_clip_exact("POLYGON((-5 -5,15 -5,15 15,-5 15,-5 -5),(8 -2,8 2,12 2,12 -2,8 -2))", 0, 0, 10, 10, NULL);
+	/* A star turns the same way all round but is not convex */
+	do_clip_exact("POLYGON((0 0,4 10,8 0,-2 6,10 6,0 0))", 1, 1, 7, 7, NULL);
+	/* M, and collections */
+	do_clip_exact("LINESTRING M (-5 5 1,15 5 2)", 0, 0, 10, 10, NULL);
+	do_clip_exact("GEOMETRYCOLLECTION(POINT(5 5))", 0, 0, 10, 10, NULL);
+}
+
+static void
+test_clip_trivial(void)
+{
+	do_clip_trivial("POINT(5 5)", 0, 0, 10, 10, "POINT(5 5)");
+	do_clip_trivial("SRID=4326;POINT Z (10 5 1)", 0, 0, 10, 10, "SRID=4326;POINT(10 5 1)");
+	do_clip_trivial("POINT(15 5)", 0, 0, 10, 10, "GEOMETRYCOLLECTION EMPTY");
+	do_clip_trivial("POLYGON((20 0,30 0,30 10,20 10,20 0))", 0, 0, 10, 10, "GEOMETRYCOLLECTION EMPTY");
+	do_clip_trivial("LINESTRING Z (20 20 1,30 30 2)", 0, 0, 10, 10, "GEOMETRYCOLLECTION EMPTY");
+	/* GEOS would drop the M, dedupe or node what lies inside, or cut it */
+	do_clip_trivial("POINT M (5 5 1)", 0, 0, 10, 10, NULL);
+	do_clip_trivial("MULTIPOINT(5 5,5 5)", 0, 0, 10, 10, NULL);
+	do_clip_trivial("LINESTRING(1 1,3 3,1 3,3 1)", 0, 0, 10, 10, NULL);
+	do_clip_trivial("LINESTRING(-5 5,15 5)", 0, 0, 10, 10, NULL);
+	do_clip_trivial("POLYGON EMPTY", 0, 0, 10, 10, NULL);
+}
+
+static void
+test_is_rectangle(void)
+{
+	LWGEOM *g;
+	GBOX box;
+
+	g = lwgeom_from_wkt("POLYGON((0 0,0 10,20 10,20 0,0 0))", LW_PARSER_CHECK_NONE);
+	CU_ASSERT(lwgeom_is_rectangle_2d(g, &box));
+	CU_ASSERT_DOUBLE_EQUAL(box.xmin, 0, 0);
+	CU_ASSERT_DOUBLE_EQUAL(box.ymin, 0, 0);
+	CU_ASSERT_DOUBLE_EQUAL(box.xmax, 20, 0);
+	CU_ASSERT_DOUBLE_EQUAL(box.ymax, 10, 0);
+	lwgeom_free(g);
+
+	g = lwgeom_from_wkt("POLYGON((0 0,10 10,20 0,10 -10,0 0))", LW_PARSER_CHECK_NONE);
+	CU_ASSERT(! lwgeom_is_rectangle_2d(g, &box));
+	lwgeom_free(g);
+
+	g = lwgeom_from_wkt("POLYGON((0 0,0 10,0 10,20 10,0 0))", LW_PARSER_CHECK_NONE);
+	CU_ASSERT(! lwgeom_is_rectangle_2d(g, &box));
+	lwgeom_free(g);
+
+	g = lwgeom_from_wkt("POLYGON Z ((0 0 1,0 10 1,20 10 1,20 0 1,0 0 1))", LW_PARSER_CHECK_NONE);
+	CU_ASSERT(! lwgeom_is_rectangle_2d(g, &box));
+	lwgeom_free(g);
+}
+
+/*
+** Used by test harness to register the tests in this file.
+*/
+CU_TestInfo clip_rect_tests[] =
+{
+	PG_TEST(test_clip_points),
+	PG_TEST(test_clip_lines),
+	PG_TEST(test_clip_polygons),
+	PG_TEST(test_clip_collections),
+	PG_TEST(test_clip_exact),
+	PG_TEST(test_clip_trivial),
+	PG_TEST(test_is_rectangle),
+	CU_TEST_INFO_NULL
+};
+CU_SuiteInfo clip_rect_suite = {"clip_rect",  NULL,  NULL, clip_rect_tests};
@@ -13,6 +13,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include "CUnit/Basic.h"
 
 #include "lwgeom_geos.h"
@@ -65,12 +66,74 @@ static void test_geos_noop(void)
 }
 
 
+static void test_geos_subdivide(void)
+{
+	char wkt[4096];
+	char *p = wkt;
+	LWGEOM *geom;
+	LWCOLLECTION *col;
+	double area = 0.0;
+	int i, nvertices = 0;
+
+	/* A 64-gon, cut up in pieces of up to 10 vertices */
+	p += sprintf(p, "POLYGON((");
+	for ( i = 0; i < 64; i++ )
+		p += sprintf(p, "%g %g,", 10 * cos(i * M_PI / 32), 10 * sin(i * M_PI / 32));
+	sprintf(p, "%g %g))", 10.0, 0.0);
+
+	geom = lwgeom_from_wkt(wkt, LW_PARSER_CHECK_NONE);
+	col = lwgeom_subdivide(geom, 10);
+	CU_ASSERT(col->ngeoms > 1);
+	for ( i = 0; i < col->ngeoms; i++ )
+	{
+		CU_ASSERT_EQUAL(col->geoms[i]->type, POLYGONTYPE);
+		CU_ASSERT(lwgeom_count_vertices(col->geoms[i]) <= 10);
+		area += lwgeom_area(col->geoms[i]);
+	}
+	CU_ASSERT_DOUBLE_EQUAL(area, lwgeom_area(geom), 0.000001);
+	lwcollection_free(col);
+	lwgeom_free(geom);
+
+	/* Points are shared out, none lost, none made up */
+	p = wkt;
+	p += sprintf(p, "MULTIPOINT(");
+	for ( i = 0; i < 100; i++ )
+		p += sprintf(p, "%s%d %d", i ? "," : "", i % 10, i / 10);
+	sprintf(p, ")");
+
+	geom = lwgeom_from_wkt(wkt, LW_PARSER_CHECK_NONE);
+	col = lwgeom_subdivide(geom, 8);
+	for ( i = 0; i < col->ngeoms; i++ )
+	{
+		CU_ASSERT(lwgeom_count_vertices(col->geoms[i]) <= 8);
+		nvertices += lwgeom_count_vertices(col->geoms[i]);
+	}
+	CU_ASSERT_EQUAL(nvertices, 100);
+	lwcollection_free(col);
+	lwgeom_free(geom);
+
+	/* Small geometries come back as they are */
+	geom = lwgeom_from_wkt("LINESTRING(0 0,1 1,2 0)", LW_PARSER_CHECK_NONE);
+	col = lwgeom_subdivide(geom, 8);
+	CU_ASSERT_EQUAL(col->ngeoms, 1);
+	CU_ASSERT(lwgeom_same(col->geoms[0], geom));
+	lwcollection_free(col);
+
+	/* Too small a budget */
+	cu_error_msg_reset();
+	col = lwgeom_subdivide(geom, 4);
+	CU_ASSERT_STRING_EQUAL(cu_error_msg, "lwgeom_subdivide: cannot subdivide to fewer than 8 vertices per piece");
+	lwgeom_free(geom);
+}
+
+
 /*
 ** Used by test harness to register the tests in this file.
 */
 CU_TestInfo geos_tests[] =
 {
 	PG_TEST(test_geos_noop),
+	PG_TEST(test_geos_subdivide),
 	CU_TEST_INFO_NULL
 };
 CU_SuiteInfo geos_suite = {"GEOS",  NULL,  NULL, geos_tests};
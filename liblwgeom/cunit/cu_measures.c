@@ -399,6 +399,323 @@ static void test_rect_tree_intersects_tree(void)
 
 }
 
+#define RECTTREEDISTTEST(str1, str2, res) do_test_rect_tree_distance_tree(str1, str2, res, __LINE__)
+
+static void do_test_rect_tree_distance_tree(char *in1, char *in2, double expected_res, int line)
+{
+	LWGEOM *lw1 = lwgeom_from_wkt(in1, LW_PARSER_CHECK_NONE);
+	LWGEOM *lw2 = lwgeom_from_wkt(in2, LW_PARSER_CHECK_NONE);
+	RECT_NODE *tree1 = rect_tree_from_lwgeom(lw1);
+	RECT_NODE *tree2 = rect_tree_from_lwgeom(lw2);
+	double distance = rect_tree_distance_tree(tree1, tree2, 0.0);
+
+	if ( fabs(distance - expected_res) > 0.00001 )
+		printf("test_rect_tree_distance_tree failed (got %g expected %g) at line %d\n", distance, expected_res, line);
+	CU_ASSERT_DOUBLE_EQUAL(distance, expected_res, 0.00001);
+
+	/* The brute force answer must agree */
+	CU_ASSERT_DOUBLE_EQUAL(distance, lwgeom_mindistance2d_tolerance(lw1, lw2, 0.0), 0.00001);
+
+	rect_tree_free(tree1);
+	rect_tree_free(tree2);
+	lwgeom_free(lw1);
+	lwgeom_free(lw2);
+}
+
+static void test_rect_tree_distance_tree(void)
+{
+	LWGEOM *lw1, *lw2;
+	RECT_NODE *tree1, *tree2;
+	double distance;
+
+	RECTTREEDISTTEST("POINT(0 0)", "POINT(3 4)", 5.0);
+	RECTTREEDISTTEST("POINT(0 0)", "MULTIPOINT(0 1.5,0 2,0 2.5)", 1.5);
+	RECTTREEDISTTEST("POINT(0 0)", "LINESTRING(-2 1,2 1)", 1.0);
+	RECTTREEDISTTEST("LINESTRING(0 0,0 0)", "LINESTRING(3 0,3 4)", 3.0);
+	RECTTREEDISTTEST("LINESTRING(0 0,2 2)", "LINESTRING(0 2,2 0)", 0.0);
+	RECTTREEDISTTEST("MULTILINESTRING((0 0,1 0),(10 0,11 0))", "LINESTRING(5 3,10.5 1)", 1.0);
+	/* Zig-zag comb against a box hiding between its tines, edges only */
+	RECTTREEDISTTEST("POLYGON((0 0, 3 1, 0 2, 3 3, 0 4, 3 5, 0 6, 5 6, 5 0, 0 0))", "POLYGON((0.3 0.7, 0.3 0.8, 0.4 0.8, 0.4 0.7, 0.3 0.7))", 0.537587);
+	RECTTREEDISTTEST("MULTIPOLYGON(((0 0,0 1,1 1,1 0,0 0)),((10 10,10 11,11 11,11 10,10 10)))", "POLYGON((4 12,4 13,5 13,5 12,4 12))", 5.0990195);
+
+	/* Empties and unsupported types do not get a tree */
+	lw1 = lwgeom_from_wkt("POLYGON EMPTY", LW_PARSER_CHECK_NONE);
+	CU_ASSERT_PTR_NULL(rect_tree_from_lwgeom(lw1));
+	lwgeom_free(lw1);
+	lw1 = lwgeom_from_wkt("CIRCULARSTRING(0 0,1 1,2 0)", LW_PARSER_CHECK_NONE);
+	CU_ASSERT_PTR_NULL(rect_tree_from_lwgeom(lw1));
+	lwgeom_free(lw1);
+
+	/* A threshold stops the search once something close enough is found */
+	lw1 = lwgeom_from_wkt("LINESTRING(0 0,10 0)", LW_PARSER_CHECK_NONE);
+	lw2 = lwgeom_from_wkt("MULTIPOINT(0 5,5 1,10 3)", LW_PARSER_CHECK_NONE);
+	tree1 = rect_tree_from_lwgeom(lw1);
+	tree2 = rect_tree_from_lwgeom(lw2);
+	distance = rect_tree_distance_tree(tree1, tree2, 6.0);
+	CU_ASSERT(distance <= 6.0);
+	distance = rect_tree_distance_tree(tree1, tree2, 0.5);
+	CU_ASSERT_DOUBLE_EQUAL(distance, 1.0, 0.00001);
+	rect_tree_free(tree1);
+	rect_tree_free(tree2);
+	lwgeom_free(lw1);
+	lwgeom_free(lw2);
+}
+
+#define RECTTREECLOSESTTEST(str1, str2) do_test_rect_tree_closest_points(str1, str2, __LINE__)
+
+static void do_test_rect_tree_closest_points(char *in1, char *in2, int line)
+{
+	LWGEOM *lw1 = lwgeom_from_wkt(in1, LW_PARSER_CHECK_NONE);
+	LWGEOM *lw2 = lwgeom_from_wkt(in2, LW_PARSER_CHECK_NONE);
+	RECT_NODE *tree1 = rect_tree_from_lwgeom(lw1);
+	RECT_NODE *tree2 = rect_tree_from_lwgeom(lw2);
+	LWLINE *brute = (LWLINE*)lw_dist2d_distanceline(lw1, lw2, 0, DIST_MIN);
+	POINT2D p1, p2, b1, b2;
+	double distance = rect_tree_closest_points(tree1, tree2, 0.0, &p1, &p2);
+
+	/* Same pair as the brute force, in the same order */
+	getPoint2d_p(brute->points, 0, &b1);
+	getPoint2d_p(brute->points, 1, &b2);
+	if ( fabs(p1.x - b1.x) > 0.00001 || fabs(p1.y - b1.y) > 0.00001 ||
+	     fabs(p2.x - b2.x) > 0.00001 || fabs(p2.y - b2.y) > 0.00001 )
+		printf("test_rect_tree_closest_points failed (got %g %g,%g %g expected %g %g,%g %g) at line %d\n", p1.x, p1.y, p2.x, p2.y, b1.x, b1.y, b2.x, b2.y, line);
+	CU_ASSERT_DOUBLE_EQUAL(p1.x, b1.x, 0.00001);
+	CU_ASSERT_DOUBLE_EQUAL(p1.y, b1.y, 0.00001);
+	CU_ASSERT_DOUBLE_EQUAL(p2.x, b2.x, 0.00001);
+	CU_ASSERT_DOUBLE_EQUAL(p2.y, b2.y, 0.00001);
+	CU_ASSERT_DOUBLE_EQUAL(distance, distance2d_pt_pt(&p1, &p2), 0.00001);
+
+	lwline_free(brute);
+	rect_tree_free(tree1);
+	rect_tree_free(tree2);
+	lwgeom_free(lw1);
+	lwgeom_free(lw2);
+}
+
+static void test_rect_tree_closest_points(void)
+{
+	RECTTREECLOSESTTEST("POINT(0 0)", "POINT(3 4)");
+	RECTTREECLOSESTTEST("POINT(0 0)", "LINESTRING(-2 1,3 1)");
+	RECTTREECLOSESTTEST("LINESTRING(-2 1,3 1)", "POINT(0 0)");
+	RECTTREECLOSESTTEST("LINESTRING(0 0,2 2)", "LINESTRING(0 2,2 0)");
+	RECTTREECLOSESTTEST("MULTILINESTRING((0 0,1 0),(10 0,11 0))", "LINESTRING(5 3,10.5 1)");
+	RECTTREECLOSESTTEST("LINESTRING(5 3,10.5 1)", "MULTILINESTRING((0 0,1 0),(10 0,11 0))");
+	RECTTREECLOSESTTEST("POLYGON((0 0, 3 1, 0 2, 3 3, 0 4, 3 5, 0 6, 5 6, 5 0, 0 0))", "POLYGON((0.3 0.7, 0.3 0.8, 0.4 0.8, 0.4 0.7, 0.3 0.7))");
+	RECTTREECLOSESTTEST("MULTIPOLYGON(((0 0,0 1,1 1,1 0,0 0)),((10 10,10 11,11 11,11 10,10 10)))", "POLYGON((4 12,4 13,5 13,5 12,4 12))");
+}
+
+static void test_rect_tree_area_contains(void)
+{
+	LWGEOM *poly, *lw;
+	RECT_NODE *tree;
+	POINT2D p;
+
+	/* Two squares, the first with a hole */
+	poly = lwgeom_from_wkt("MULTIPOLYGON(((0 0,0 10,10 10,10 0,0 0),(2 2,8 2,8 8,2 8,2 2)),((20 0,20 10,30 10,30 0,20 0)))", LW_PARSER_CHECK_NONE);
+	tree = rect_tree_from_lwgeom(poly);
+
+	p.x = 1.0; p.y = 5.0;
+	CU_ASSERT_EQUAL(rect_tree_area_contains_point(tree, &p), LW_TRUE);
+	p.x = 5.0; p.y = 5.0;
+	CU_ASSERT_EQUAL(rect_tree_area_contains_point(tree, &p), LW_FALSE);
+	p.x = 15.0; p.y = 5.0;
+	CU_ASSERT_EQUAL(rect_tree_area_contains_point(tree, &p), LW_FALSE);
+	p.x = 25.0; p.y = 5.0;
+	CU_ASSERT_EQUAL(rect_tree_area_contains_point(tree, &p), LW_TRUE);
+	/* Ray passing exactly through vertices */
+	p.x = -5.0; p.y = 10.0;
+	CU_ASSERT_EQUAL(rect_tree_area_contains_point(tree, &p), LW_FALSE);
+	p.x = 5.0; p.y = 2.0;
+	CU_ASSERT_EQUAL(rect_tree_area_contains_point(tree, &p), LW_FALSE);
+	p.x = 1.0; p.y = 2.0;
+	CU_ASSERT_EQUAL(rect_tree_area_contains_point(tree, &p), LW_TRUE);
+
+	/* Any one part inside is enough */
+	lw = lwgeom_from_wkt("MULTIPOINT(15 5,40 40,25 5)", LW_PARSER_CHECK_NONE);
+	CU_ASSERT_EQUAL(rect_tree_area_contains_lwgeom(tree, lw), LW_TRUE);
+	lwgeom_free(lw);
+	lw = lwgeom_from_wkt("LINESTRING(4 4,6 6)", LW_PARSER_CHECK_NONE);
+	CU_ASSERT_EQUAL(rect_tree_area_contains_lwgeom(tree, lw), LW_FALSE);
+	lwgeom_free(lw);
+	lw = lwgeom_from_wkt("POLYGON((21 1,21 2,22 2,21 1))", LW_PARSER_CHECK_NONE);
+	CU_ASSERT_EQUAL(rect_tree_area_contains_lwgeom(tree, lw), LW_TRUE);
+	lwgeom_free(lw);
+
+	rect_tree_free(tree);
+	lwgeom_free(poly);
+}
+
+/*
+* Random walk of npoints vertices starting at x y, the same on every platform
+*/
+static LWGEOM* random_walk(int npoints, double x, double y, unsigned int *seed)
+{
+	POINTARRAY *pa = ptarray_construct_empty(0, 0, npoints);
+	POINT4D pt;
+	int i;
+
+	pt.x = x; pt.y = y; pt.z = pt.m = 0.0;
+	for ( i = 0; i < npoints; i++ )
+	{
+		ptarray_append_point(pa, &pt, LW_TRUE);
+		*seed = *seed * 1103515245 + 12345;
+		pt.x += ((*seed >> 16) & 0x7fff) / 16384.0 - 1.0;
+		*seed = *seed * 1103515245 + 12345;
+		pt.y += ((*seed >> 16) & 0x7fff) / 16384.0 - 1.0;
+	}
+	return lwline_as_lwgeom(lwline_construct(SRID_UNKNOWN, NULL, pa));
+}
+
+static void test_lw_dist2d_tree(void)
+{
+	LWGEOM *lw1, *lw2, *lw, *col;
+	LWLINE *line;
+	DISTPTS dl;
+	POINT2D p1, p2;
+	unsigned int seed = 1;
+	int i;
+
+	/* Large walks, apart and tangled, against the segment by segment answer */
+	for ( i = 0; i < 20; i++ )
+	{
+		lw1 = random_walk(300, 0.0, 0.0, &seed);
+		lw2 = random_walk(200, i, i % 3, &seed);
+		CU_ASSERT(lw_dist2d_tree_applies(lw1, lw2));
+
+		lw_dist2d_distpts_init(&dl, DIST_MIN);
+		dl.twisted = 1;
+		lw_dist2d_ptarray_ptarray(((LWLINE*)lw1)->points, ((LWLINE*)lw2)->points, &dl);
+		CU_ASSERT_DOUBLE_EQUAL(lwgeom_mindistance2d(lw1, lw2), dl.distance, 0.000001);
+
+		line = (LWLINE*)lw_dist2d_distanceline(lw1, lw2, SRID_UNKNOWN, DIST_MIN);
+		getPoint2d_p(line->points, 0, &p1);
+		getPoint2d_p(line->points, 1, &p2);
+		CU_ASSERT_DOUBLE_EQUAL(distance2d_pt_pt(&p1, &p2), dl.distance, 0.000001);
+		lwline_free(line);
+
+		lw_dist2d_distpts_init(&dl, DIST_MAX);
+		dl.twisted = 1;
+		lw_dist2d_ptarray_ptarray(((LWLINE*)lw1)->points, ((LWLINE*)lw2)->points, &dl);
+		CU_ASSERT_DOUBLE_EQUAL(lwgeom_maxdistance2d(lw1, lw2), dl.distance, 0.000001);
+
+		lwgeom_free(lw1);
+		lwgeom_free(lw2);
+	}
+
+	/* Polygon with a hole, densified well past the tree threshold */
+	lw = lwgeom_from_wkt("POLYGON((0 0,0 100,100 100,100 0,0 0),(40 40,60 40,60 60,40 60,40 40))", LW_PARSER_CHECK_NONE);
+	lw1 = lwgeom_segmentize2d(lw, 1.0);
+	lwgeom_free(lw);
+
+	/* Inside the hole */
+	lw = lwgeom_from_wkt("LINESTRING(45 50,55 50)", LW_PARSER_CHECK_NONE);
+	lw2 = lwgeom_segmentize2d(lw, 0.05);
+	lwgeom_free(lw);
+	CU_ASSERT(lw_dist2d_tree_applies(lw1, lw2));
+	CU_ASSERT_DOUBLE_EQUAL(lwgeom_mindistance2d(lw1, lw2), 5.0, 0.000001);
+	CU_ASSERT_DOUBLE_EQUAL(lwgeom_mindistance2d(lw2, lw1), 5.0, 0.000001);
+	CU_ASSERT_DOUBLE_EQUAL(lwgeom_mindistance2d_tolerance(lw1, lw2, 6.0), 5.0, 0.000001);
+	CU_ASSERT_DOUBLE_EQUAL(lwgeom_maxdistance2d(lw1, lw2), sqrt(55*55 + 50*50), 0.000001);
+
+	/* Same, one level down in a collection */
+	col = lwcollection_as_lwgeom(lwcollection_construct_empty(COLLECTIONTYPE, SRID_UNKNOWN, 0, 0));
+	lwcollection_add_lwgeom((LWCOLLECTION*)col, lwgeom_clone_deep(lw1));
+	CU_ASSERT_DOUBLE_EQUAL(lwgeom_mindistance2d(col, lw2), 5.0, 0.000001);
+	lwgeom_free(lw2);
+
+	/* Inside the ring, not touching any edge */
+	lw = lwgeom_from_wkt("LINESTRING(10 10,10 30)", LW_PARSER_CHECK_NONE);
+	lw2 = lwgeom_segmentize2d(lw, 0.1);
+	lwgeom_free(lw);
+	CU_ASSERT_DOUBLE_EQUAL(lwgeom_mindistance2d(lw1, lw2), 0.0, 0.000001);
+	CU_ASSERT_DOUBLE_EQUAL(lwgeom_mindistance2d(lw2, lw1), 0.0, 0.000001);
+	CU_ASSERT_DOUBLE_EQUAL(lwgeom_mindistance2d(col, lw2), 0.0, 0.000001);
+	line = (LWLINE*)lw_dist2d_distanceline(lw2, lw1, SRID_UNKNOWN, DIST_MIN);
+	getPoint2d_p(line->points, 0, &p1);
+	CU_ASSERT_DOUBLE_EQUAL(p1.x, 10.0, 0.000001);
+	CU_ASSERT_DOUBLE_EQUAL(p1.y, 10.0, 0.000001);
+	lwline_free(line);
+	lwgeom_free(lw2);
+
+	/* Small inputs keep the segment by segment path */
+	lw = lwgeom_from_wkt("POINT(50 50)", LW_PARSER_CHECK_NONE);
+	CU_ASSERT(! lw_dist2d_tree_applies(lw1, lw));
+	lwgeom_free(lw);
+
+	lwgeom_free(col);
+	lwgeom_free(lw1);
+}
+
+static void test_lw_dist2d_pt_ptarray_simd(void)
+{
+	LWGEOM *lw;
+	POINTARRAY *pa;
+	DISTPTS dl, dl_scalar;
+	POINT4D pt4;
+	POINT2D p;
+	unsigned int seed = 5;
+	int best = lw_simd_level();
+	int i, j, level;
+	double tolerance[] = { 0.0, 0.5 };
+
+	for ( i = 0; i < 40; i++ )
+	{
+		/* Walks with 2, 3 and 4 ordinates, on a grid half the time */
+		lw = random_walk(3 + i * 7, 0.0, 0.0, &seed);
+		pa = ptarray_construct_empty(i % 3 > 0, i % 3 > 1, 0);
+		for ( j = 0; j < ((LWLINE*)lw)->points->npoints; j++ )
+		{
+			getPoint4d_p(((LWLINE*)lw)->points, j, &pt4);
+			if ( i % 2 )
+			{
+				pt4.x = floor(pt4.x * 2);
+				pt4.y = floor(pt4.y * 2);
+			}
+			ptarray_append_point(pa, &pt4, LW_TRUE);
+		}
+		lwgeom_free(lw);
+
+		for ( j = 0; j < 200; j++ )
+		{
+			/* Vertices, midpoints of edges and points around */
+			if ( j < pa->npoints )
+				getPoint2d_p(pa, j, &p);
+			else if ( j < 2 * pa->npoints - 1 )
+			{
+				POINT2D a, b;
+				getPoint2d_p(pa, j - pa->npoints, &a);
+				getPoint2d_p(pa, j - pa->npoints + 1, &b);
+				p.x = (a.x + b.x) / 2;
+				p.y = (a.y + b.y) / 2;
+			}
+			else
+			{
+				seed = seed * 1103515245 + 12345;
+				p.x = ((seed >> 16) & 0x7fff) / 1024.0 - 16.0;
+				seed = seed * 1103515245 + 12345;
+				p.y = ((seed >> 16) & 0x7fff) / 1024.0 - 16.0;
+			}
+
+			lw_simd_set_level(LW_SIMD_NONE);
+			lw_dist2d_distpts_init(&dl_scalar, DIST_MIN);
+			dl_scalar.tolerance = tolerance[j % 2];
+			lw_dist2d_pt_ptarray(&p, pa, &dl_scalar);
+			for ( level = LW_SIMD_SSE2; level <= best; level++ )
+			{
+				lw_simd_set_level(level);
+				lw_dist2d_distpts_init(&dl, DIST_MIN);
+				dl.tolerance = tolerance[j % 2];
+				lw_dist2d_pt_ptarray(&p, pa, &dl);
+				CU_ASSERT_EQUAL(memcmp(&dl.distance, &dl_scalar.distance, sizeof(double)), 0);
+				CU_ASSERT_EQUAL(memcmp(&dl.p1, &dl_scalar.p1, sizeof(POINT2D)), 0);
+				CU_ASSERT_EQUAL(memcmp(&dl.p2, &dl_scalar.p2, sizeof(POINT2D)), 0);
+			}
+		}
+		ptarray_free(pa);
+	}
+	lw_simd_set_level(best);
+}
+
 static void
 test_lwgeom_segmentize2d(void)
 {
@@ -804,6 +1121,11 @@ CU_TestInfo measures_tests[] =
 	PG_TEST(test_mindistance2d_tolerance),
 	PG_TEST(test_rect_tree_contains_point),
 	PG_TEST(test_rect_tree_intersects_tree),
+	PG_TEST(test_rect_tree_distance_tree),
+	PG_TEST(test_rect_tree_closest_points),
+	PG_TEST(test_rect_tree_area_contains),
+	PG_TEST(test_lw_dist2d_tree),
+	PG_TEST(test_lw_dist2d_pt_ptarray_simd),
 	PG_TEST(test_lwgeom_segmentize2d),
 	PG_TEST(test_lwgeom_locate_along),
 	PG_TEST(test_lw_dist2d_pt_arc),
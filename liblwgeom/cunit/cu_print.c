@@ -13,6 +13,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include "CUnit/Basic.h"
 
 #include "liblwgeom_internal.h"
@@ -159,6 +160,97 @@ static void test_lwprint_bad_formats(void)
 	test_lwprint_assert_error("POINT(1.23456 7.89012)", "DD.DDD jjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjjj");
 }
 
+/*
+* Reference output of the formatters lwprint_double() replaced.
+*/
+static void test_lwprint_double_reference(double d, int precision, char *buf)
+{
+	if (fabs(d) < OUT_MAX_DOUBLE)
+	{
+		sprintf(buf, "%.*f", precision, d);
+		trim_trailing_zeros(buf);
+	}
+	else
+	{
+		sprintf(buf, "%g", d);
+	}
+}
+
+static void test_lwprint_double_assert(double d, int precision)
+{
+	char expected[OUT_DOUBLE_BUFFER_SIZE + 64];
+	char actual[OUT_DOUBLE_BUFFER_SIZE + 64];
+	int len;
+
+	test_lwprint_double_reference(d, precision, expected);
+	len = lwprint_double(d, precision, actual, sizeof(actual));
+	if (strcmp(expected, actual) != 0)
+		printf("\n%.17g at %d: expected %s got %s\n", d, precision, expected, actual);
+	CU_ASSERT_STRING_EQUAL(actual, expected);
+	CU_ASSERT_EQUAL(len, strlen(expected));
+
+	sprintf(expected, "%.*g", precision, d);
+	len = lwprint_double_significant(d, precision, actual, sizeof(actual));
+	if (strcmp(expected, actual) != 0)
+		printf("\n%.17g at %d: expected %s got %s\n", d, precision, expected, actual);
+	CU_ASSERT_STRING_EQUAL(actual, expected);
+	CU_ASSERT_EQUAL(len, strlen(expected));
+}
+
+/* Small deterministic generator, so failures are reproducible */
+static uint64_t test_lwprint_seed = 88172645463325252ULL;
+
+static double test_lwprint_random_double(void)
+{
+	uint64_t u;
+	test_lwprint_seed ^= test_lwprint_seed << 13;
+	test_lwprint_seed ^= test_lwprint_seed >> 7;
+	test_lwprint_seed ^= test_lwprint_seed << 17;
+	u = test_lwprint_seed;
+	/* Mantissa in [0,1), scaled by 10^-12 .. 10^16, either sign */
+	return ((u >> 11) * (1.0 / 9007199254740992.0)) *
+	       pow(10.0, (int)(u % 29) - 12) * ((u & 0x400) ? -1 : 1);
+}
+
+static void test_lwprint_double(void)
+{
+	static const double values[] =
+	{
+		0.0, -0.0, 1.0, -1.0, 0.5, 1.5, 2.5, -2.5, 0.125, 0.375,
+		0.1, 0.2, 0.3, 0.7, 1.05, 1.005, 2.675, 1.45, -1.45, 1e-5,
+		0.05, 0.005, 0.0005, 9.5, 99.5, 999.95, 9.999999999999999,
+		0.9999999999999999, 123456789.123456789, -98765.4321,
+		0.000123456, 1e-4, 9.9999e-5, 1e-300, 4.9e-324, 1e14,
+		999999999999999.9, 1e15, -1e15, 1.5e20, 1e100, -3.4e38,
+		1234567890123.456, 40.7127837, -74.0059413, 151.2092955,
+		-33.8688197, 6378137.0, 20037508.342789244, 0.015625
+	};
+	int i, p;
+
+	for (i = 0; i < sizeof(values) / sizeof(double); i++)
+		for (p = 0; p <= OUT_MAX_DOUBLE_PRECISION; p++)
+			test_lwprint_double_assert(values[i], p);
+
+	for (i = 0; i < 20000; i++)
+	{
+		double d = test_lwprint_random_double();
+		for (p = 0; p <= OUT_MAX_DOUBLE_PRECISION; p++)
+			test_lwprint_double_assert(d, p);
+	}
+
+	/* Decimals beyond the exact path go through sprintf */
+	test_lwprint_double_assert(0.1, 20);
+	test_lwprint_double_assert(1.0/3, 25);
+	test_lwprint_double_assert(2.5, -1);
+
+	/* Output is cut at the buffer size, snprintf-style */
+	{
+		char buf[4];
+		CU_ASSERT_EQUAL(lwprint_double(-12.3456, 4, buf, sizeof(buf)), 8);
+		CU_ASSERT_STRING_EQUAL(buf, "-12");
+	}
+}
+
 /*
 ** Used by the test harness to register the tests in this file.
 */
@@ -169,6 +261,7 @@ CU_TestInfo print_tests[] =
 	PG_TEST(test_lwprint_optional_format),
 	PG_TEST(test_lwprint_oddball_formats),
 	PG_TEST(test_lwprint_bad_formats),
+	PG_TEST(test_lwprint_double),
 	CU_TEST_INFO_NULL
 };
 CU_SuiteInfo print_suite = {"print_suite", NULL, NULL, print_tests };
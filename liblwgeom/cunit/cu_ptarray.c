@@ -496,6 +496,64 @@ static void test_ptarray_contains_point()
 	lwline_free(lwline);
 }
 
+/*
+* Ring of n vertices on a coarse grid, so that test points land on
+* vertices and edges, with some repeated vertices
+*/
+static POINTARRAY* grid_ring(int n, int hasz, unsigned int *seed)
+{
+	POINTARRAY *pa = ptarray_construct_empty(hasz, 0, n + 1);
+	POINT4D pt, first;
+	int i;
+
+	pt.z = pt.m = 0.0;
+	for ( i = 0; i < n; i++ )
+	{
+		double a = 2 * M_PI * i / n;
+		*seed = *seed * 1103515245 + 12345;
+		pt.x = floor((5 + ((*seed >> 16) % 10)) * cos(a) * 2) / 2;
+		pt.y = floor((5 + ((*seed >> 16) % 10)) * sin(a) * 2) / 2;
+		if ( i == 0 ) first = pt;
+		ptarray_append_point(pa, &pt, LW_TRUE);
+		if ( (*seed >> 20) % 7 == 0 )
+			ptarray_append_point(pa, &pt, LW_TRUE);
+	}
+	ptarray_append_point(pa, &first, LW_TRUE);
+	return pa;
+}
+
+static void test_ptarray_contains_point_simd(void)
+{
+	POINTARRAY *pa;
+	POINT2D pt;
+	unsigned int seed = 3;
+	int best = lw_simd_level();
+	int i, level, rv, wn, rv_scalar, wn_scalar;
+
+	for ( i = 0; i < 30; i++ )
+	{
+		pa = grid_ring(5 + 3 * i, i % 2, &seed);
+		for ( pt.x = -15; pt.x <= 15; pt.x += 0.5 )
+		{
+			for ( pt.y = -15; pt.y <= 15; pt.y += 0.5 )
+			{
+				lw_simd_set_level(LW_SIMD_NONE);
+				rv_scalar = ptarray_contains_point_partial(pa, &pt, LW_TRUE, &wn_scalar);
+				for ( level = LW_SIMD_SSE2; level <= best; level++ )
+				{
+					lw_simd_set_level(level);
+					rv = ptarray_contains_point_partial(pa, &pt, LW_TRUE, &wn);
+					CU_ASSERT_EQUAL(rv, rv_scalar);
+					if ( rv != LW_BOUNDARY )
+						CU_ASSERT_EQUAL(wn, wn_scalar);
+				}
+			}
+		}
+		ptarray_free(pa);
+	}
+	lw_simd_set_level(best);
+}
+
 static void test_ptarrayarc_contains_point() 
 {
 	/* int ptarrayarc_contains_point(const POINTARRAY *pa, const POINT2D *pt) */
@@ -648,6 +706,7 @@ CU_TestInfo ptarray_tests[] =
 	PG_TEST(test_ptarray_desegmentize),
 	PG_TEST(test_ptarray_insert_point),
 	PG_TEST(test_ptarray_contains_point),
+	PG_TEST(test_ptarray_contains_point_simd),
 	PG_TEST(test_ptarrayarc_contains_point),
 	CU_TEST_INFO_NULL
 };
@@ -34,8 +34,10 @@ extern CU_SuiteInfo wkt_out_suite;
 extern CU_SuiteInfo wkt_in_suite;
 extern CU_SuiteInfo wkb_out_suite;
 extern CU_SuiteInfo wkb_in_suite;
+extern CU_SuiteInfo twkb_suite;
 extern CU_SuiteInfo libgeom_suite;
 extern CU_SuiteInfo split_suite;
+extern CU_SuiteInfo clip_rect_suite;
 extern CU_SuiteInfo geodetic_suite;
 extern CU_SuiteInfo geos_suite;
 extern CU_SuiteInfo sfcgal_suite;
@@ -74,8 +76,10 @@ int main(int argc, char *argv[])
 		wkt_in_suite,
 		wkb_out_suite,
 		wkb_in_suite,
+		twkb_suite,
 		libgeom_suite,
 		split_suite,
+		clip_rect_suite,
 		geodetic_suite,
 		geos_suite,
 #if HAVE_SFCGAL
@@ -0,0 +1,229 @@
+/**********************************************************************
+ *
+ * PostGIS - Spatial Types for PostgreSQL
+ * http://postgis.refractions.net
+ *
+ * This is free software; you can redistribute and/or modify it under
+ * the terms of the GNU General Public Licence. See the COPYING file.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "CUnit/Basic.h"
+
+#include "liblwgeom_internal.h"
+#include "varint.h"
+#include "cu_tester.h"
+
+static void
+do_twkb_out(char *wkt, int64_t *ids, uint8_t variant, int prec_xy, int prec_z, int prec_m, char *expected)
+{
+	LWGEOM *g = lwgeom_from_wkt(wkt, LW_PARSER_CHECK_NONE);
+	uint8_t *twkb;
+	size_t size;
+	char *hex;
+
+	twkb = lwgeom_to_twkb_with_idlist(g, ids, variant, prec_xy, prec_z, prec_m, &size);
+	hex = hexbytes_from_bytes(twkb, size);
+	if ( strcmp(hex, expected) )
+		fprintf(stderr, "\nIn:   %s\nExp:  %s\nObt:  %s\n", wkt, expected, hex);
+	CU_ASSERT_STRING_EQUAL(hex, expected);
+	lwfree(hex);
+	lwfree(twkb);
+	lwgeom_free(g);
+}
+
+/* Write wkt out and read it back in */
+static void
+do_twkb_roundtrip(char *wkt, uint8_t variant, int prec_xy, int prec_z, int prec_m, char *expected)
+{
+	LWGEOM *g = lwgeom_from_wkt(wkt, LW_PARSER_CHECK_NONE);
+	LWGEOM *h;
+	uint8_t *twkb;
+	size_t size;
+	char *out;
+
+	twkb = lwgeom_to_twkb(g, variant, prec_xy, prec_z, prec_m, &size);
+	h = lwgeom_from_twkb(twkb, size, LW_PARSER_CHECK_NONE);
+	out = lwgeom_to_ewkt(h);
+	if ( strcmp(out, expected) )
+		fprintf(stderr, "\nIn:   %s\nExp:  %s\nObt:  %s\n", wkt, expected, out);
+	CU_ASSERT_STRING_EQUAL(out, expected);
+	lwfree(out);
+	lwfree(twkb);
+	lwgeom_free(h);
+	lwgeom_free(g);
+}
+
+static void
+test_varint(void)
+{
+	uint8_t buf[VARINT_MAX_SIZE];
+	size_t size;
+
+	CU_ASSERT_EQUAL(varint_u64_encode_buf(0, buf), 1);
+	CU_ASSERT_EQUAL(buf[0], 0);
+	CU_ASSERT_EQUAL(varint_u64_encode_buf(300, buf), 2);
+	CU_ASSERT_EQUAL(buf[0], 0xAC);
+	CU_ASSERT_EQUAL(buf[1], 0x02);
+	CU_ASSERT_EQUAL(varint_u64_decode(buf, buf + 2, &size), 300);
+	CU_ASSERT_EQUAL(size, 2);
+
+	CU_ASSERT_EQUAL(varint_u64_encode_buf(UINT64_MAX, buf), VARINT_MAX_SIZE);
+	CU_ASSERT(varint_u64_decode(buf, buf + VARINT_MAX_SIZE, &size) == UINT64_MAX);
+
+	CU_ASSERT_EQUAL(varint_s64_encode_buf(-1, buf), 1);
+	CU_ASSERT_EQUAL(buf[0], 1);
+	CU_ASSERT_EQUAL(varint_s64_encode_buf(-65, buf), 2);
+	CU_ASSERT_EQUAL(varint_s64_decode(buf, buf + 2, &size), -65);
+	CU_ASSERT(unzigzag64(zigzag64(INT64_MIN)) == INT64_MIN);
+	CU_ASSERT(unzigzag64(zigzag64(INT64_MAX)) == INT64_MAX);
+
+	/* Truncated */
+	varint_u64_encode_buf(300, buf);
+	cu_error_msg_reset();
+	varint_u64_decode(buf, buf + 1, &size);
+	CU_ASSERT_STRING_EQUAL(cu_error_msg, "varint_u64_decode: varint is truncated or too long");
+}
+
+static void
+test_twkb_out_point(void)
+{
+	do_twkb_out("POINT(1 2)", NULL, 0, 0, 0, 0, "01000204");
+	do_twkb_out("POINT(1.25 -2.5)", NULL, 0, 1, 0, 0, "21001A31");
+	do_twkb_out("POINT(123 456)", NULL, 0, -1, 0, 0, "1100185C");
+	do_twkb_out("POINT(1 2 3)", NULL, 0, 0, 1, 0, "01080502043C");
+	do_twkb_out("POINTM(1 2 3)", NULL, 0, 0, 0, 2, "0108420204D804");
+	do_twkb_out("POINT EMPTY", NULL, 0, 0, 0, 0, "0110");
+	/* No box for a single point */
+	do_twkb_out("POINT(1 2)", NULL, TWKB_BBOX, 0, 0, 0, "01000204");
+}
+
+static void
+test_twkb_out_linestring(void)
+{
+	do_twkb_out("LINESTRING(1 1,5 5)", NULL, 0, 0, 0, 0, "02000202020808");
+	do_twkb_out("LINESTRING(1 1,5 5)", NULL, TWKB_BBOX, 0, 0, 0, "0201020802080202020808");
+	do_twkb_out("LINESTRING(1 1,5 5)", NULL, TWKB_SIZE, 0, 0, 0, "0202050202020808");
+	do_twkb_out("LINESTRING(1 1,5 5)", NULL, TWKB_SIZE | TWKB_BBOX, 0, 0, 0, "020309020802080202020808");
+	do_twkb_out("LINESTRING EMPTY", NULL, TWKB_SIZE | TWKB_BBOX, 0, 0, 0, "021200");
+	/* Points that round onto the one before are dropped */
+	do_twkb_out("LINESTRING(0 0,0.1 0,1 1,1.1 1)", NULL, 0, 0, 0, 0, "020003000002020000");
+	/* But not below two */
+	do_twkb_out("LINESTRING(0 0,0.1 0)", NULL, 0, 0, 0, 0, "02000200000000");
+}
+
+static void
+test_twkb_out_polygon(void)
+{
+	do_twkb_out("POLYGON((0 0,2 0,2 2,0 2,0 0))", NULL, 0, 0, 0, 0, "0300010500000400000403000003");
+	do_twkb_out("POLYGON((0 0,2 0,2 2,0 2,0 0),(1 1,1 1.2,1.2 1.2,1 1))", NULL, 0, 0, 0, 0,
+	            "0300020500000400000403000003040202000000000000");
+}
+
+static void
+test_twkb_out_collection(void)
+{
+	int64_t ids[] = {10, 20, -1};
+
+	do_twkb_out("MULTIPOINT(0 0,1 1)", ids, 0, 0, 0, 0, "040402142800000202");
+	do_twkb_out("MULTIPOINT(0 0,1 1)", NULL, 0, 0, 0, 0, "04000200000202");
+	do_twkb_out("MULTILINESTRING((0 0,1 1),(2 2,3 3))", ids, TWKB_BBOX, 0, 0, 0,
+	            "05050006000602142802000002020202020202");
+	do_twkb_out("GEOMETRYCOLLECTION(POINT(1 1),LINESTRING(1 1,2 2))", ids, TWKB_BBOX, 0, 0, 0,
+	            "070502020202021428010002020201020202020202020202");
+	do_twkb_out("GEOMETRYCOLLECTION EMPTY", ids, TWKB_BBOX, 0, 0, 0, "0710");
+}
+
+static void
+test_twkb_out_errors(void)
+{
+	LWGEOM *g = lwgeom_from_wkt("CIRCULARSTRING(0 0,1 1,2 0)", LW_PARSER_CHECK_NONE);
+	uint8_t *twkb;
+
+	cu_error_msg_reset();
+	twkb = lwgeom_to_twkb(g, 0, 0, 0, 0, NULL);
+	CU_ASSERT_STRING_EQUAL(cu_error_msg, "lwgeom_to_twkb: Unsupported geometry type: CircularString");
+	if ( twkb ) lwfree(twkb);
+
+	cu_error_msg_reset();
+	twkb = lwgeom_to_twkb(g, 0, 8, 0, 0, NULL);
+	CU_ASSERT_STRING_EQUAL(cu_error_msg, "lwgeom_to_twkb: X/Y precision must be between -7 and 7");
+	if ( twkb ) lwfree(twkb);
+
+	cu_error_msg_reset();
+	twkb = lwgeom_to_twkb(g, 0, 0, -1, 0, NULL);
+	CU_ASSERT_STRING_EQUAL(cu_error_msg, "lwgeom_to_twkb: Z precision must be between 0 and 7");
+	if ( twkb ) lwfree(twkb);
+
+	lwgeom_free(g);
+}
+
+static void
+test_twkb_in(void)
+{
+	do_twkb_roundtrip("POINT(1 2)", 0, 0, 0, 0, "POINT(1 2)");
+	do_twkb_roundtrip("POINT(1.25 -2.5)", 0, 1, 0, 0, "POINT(1.3 -2.5)");
+	do_twkb_roundtrip("POINT(123 456)", 0, -1, 0, 0, "POINT(120 460)");
+	do_twkb_roundtrip("POINT(1 2 3.14159)", TWKB_SIZE, 0, 2, 0, "POINT(1 2 3.14)");
+	do_twkb_roundtrip("POINT(1 2 3 4)", TWKB_BBOX, 0, 0, 0, "POINT(1 2 3 4)");
+	do_twkb_roundtrip("POINT EMPTY", 0, 0, 0, 0, "POINT EMPTY");
+	do_twkb_roundtrip("LINESTRING(0.12 0.34,5.67 8.91)", TWKB_BBOX | TWKB_SIZE, 1, 0, 0, "LINESTRING(0.1 0.3,5.7 8.9)");
+	do_twkb_roundtrip("LINESTRINGM(0 0 1,1 1 2)", 0, 0, 0, 0, "LINESTRINGM(0 0 1,1 1 2)");
+	do_twkb_roundtrip("POLYGON((0 0,10 0,10 10,0 10,0 0),(2 2,2 4,4 4,4 2,2 2))", TWKB_BBOX, 0, 0, 0,
+	                  "POLYGON((0 0,10 0,10 10,0 10,0 0),(2 2,2 4,4 4,4 2,2 2))");
+	do_twkb_roundtrip("MULTIPOINT(0 0,-1 -1,1000000 1000000)", 0, 0, 0, 0, "MULTIPOINT(0 0,-1 -1,1000000 1000000)");
+	do_twkb_roundtrip("MULTILINESTRING((0 0,1 1),(2 2,3 3))", TWKB_SIZE, 0, 0, 0, "MULTILINESTRING((0 0,1 1),(2 2,3 3))");
+	do_twkb_roundtrip("MULTIPOLYGON(((0 0,1 0,1 1,0 0)),((5 5,6 5,6 6,5 5)))", TWKB_BBOX | TWKB_SIZE, 0, 0, 0,
+	                  "MULTIPOLYGON(((0 0,1 0,1 1,0 0)),((5 5,6 5,6 6,5 5)))");
+	do_twkb_roundtrip("GEOMETRYCOLLECTION(POINT(1 1),GEOMETRYCOLLECTION(LINESTRING(1 1,2 2)),POLYGON EMPTY)",
+	                  TWKB_BBOX | TWKB_SIZE, 0, 0, 0,
+	                  "GEOMETRYCOLLECTION(POINT(1 1),GEOMETRYCOLLECTION(LINESTRING(1 1,2 2)),POLYGON EMPTY)");
+	do_twkb_roundtrip("GEOMETRYCOLLECTION EMPTY", 0, 0, 0, 0, "GEOMETRYCOLLECTION EMPTY");
+}
+
+static void
+test_twkb_in_malformed(void)
+{
+	/* Line claiming more points than there are bytes */
+	uint8_t line[] = {0x02, 0x00, 0x7F, 0x02, 0x02};
+	/* Truncated varint */
+	uint8_t point[] = {0x01, 0x00, 0x02, 0x84};
+	/* Unknown type */
+	uint8_t curve[] = {0x08, 0x00, 0x00};
+	LWGEOM *g;
+
+	cu_error_msg_reset();
+	g = lwgeom_from_twkb(line, sizeof(line), LW_PARSER_CHECK_NONE);
+	CU_ASSERT_STRING_EQUAL(cu_error_msg, "TWKB structure does not match expected size!");
+	if ( g ) lwgeom_free(g);
+
+	cu_error_msg_reset();
+	g = lwgeom_from_twkb(point, sizeof(point), LW_PARSER_CHECK_NONE);
+	CU_ASSERT_STRING_EQUAL(cu_error_msg, "varint_u64_decode: varint is truncated or too long");
+	if ( g ) lwgeom_free(g);
+
+	cu_error_msg_reset();
+	g = lwgeom_from_twkb(curve, sizeof(curve), LW_PARSER_CHECK_NONE);
+	CU_ASSERT_STRING_EQUAL(cu_error_msg, "Unsupported TWKB geometry type: 8");
+	if ( g ) lwgeom_free(g);
+}
+
+/*
+** Used by test harness to register the tests in this file.
+*/
+CU_TestInfo twkb_tests[] =
+{
+	PG_TEST(test_varint),
+	PG_TEST(test_twkb_out_point),
+	PG_TEST(test_twkb_out_linestring),
+	PG_TEST(test_twkb_out_polygon),
+	PG_TEST(test_twkb_out_collection),
+	PG_TEST(test_twkb_out_errors),
+	PG_TEST(test_twkb_in),
+	PG_TEST(test_twkb_in_malformed),
+	CU_TEST_INFO_NULL
+};
+CU_SuiteInfo twkb_suite = {"twkb",  NULL,  NULL, twkb_tests};
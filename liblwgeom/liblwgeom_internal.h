@@ -113,6 +113,20 @@
 #define WKB_TIN_TYPE 16
 #define WKB_TRIANGLE_TYPE 17
 
+/**
+* Tiny WKB (TWKB) metadata header flags
+*/
+#define TWKB_META_BBOX 0x01
+#define TWKB_META_SIZE 0x02
+#define TWKB_META_IDLIST 0x04
+#define TWKB_META_EXTDIMS 0x08
+#define TWKB_META_EMPTY 0x10
+
+/**
+* TWKB precisions fit in four (xy) and three (z, m) bits
+*/
+#define TWKB_MAX_PRECISION 7
+
 /**
 * Macro for reading the size from the GSERIALIZED size attribute.
 * Cribbed from PgSQL, top 30 bits are size. Use VARSIZE() when working
@@ -133,6 +147,7 @@
 #define OUT_SHOW_DIGS_DOUBLE 20
 #define OUT_MAX_DOUBLE_PRECISION 15
 #define OUT_MAX_DIGS_DOUBLE (OUT_SHOW_DIGS_DOUBLE + 2) /* +2 mean add dot and sign */
+#define OUT_DOUBLE_BUFFER_SIZE (OUT_MAX_DIGS_DOUBLE + OUT_MAX_DOUBLE_PRECISION + 1)
 
 
 /**
@@ -388,6 +403,18 @@ int ptarrayarc_contains_point_partial(const POINTARRAY *pa, const POINT2D *pt, i
 int lwcompound_contains_point(const LWCOMPOUND *comp, const POINT2D *pt);
 int lwgeom_contains_point(const LWGEOM *geom, const POINT2D *pt);
 
+/*
+* Batched segment kernels, see ptarray_simd.c
+*/
+#define LW_SEG_BATCH 8
+#define LW_SIMD_NONE 0
+#define LW_SIMD_SSE2 1
+#define LW_SIMD_AVX2 2
+int lw_simd_level(void);
+int lw_simd_set_level(int level);
+void ptarray_dist2d_pt_segs(const POINTARRAY *pa, int first, int n, const POINT2D *p, double *dist);
+int ptarray_segs_span_y(const POINTARRAY *pa, int first, int n, double y);
+
 /**
 * Split a line by a point and push components to the provided multiline.
 * If the point doesn't split the line, push nothing to the container.
@@ -406,6 +433,15 @@ void lwcollection_reserve(LWCOLLECTION *col, int ngeoms);
 /** Check if subtype is allowed in collectiontype */
 extern int lwcollection_allows_subtype(int collectiontype, int subtype);
 
+/**
+* Rectangle clipping, see lwgeom_rectclip.c. lwgeom_clip_to_gbox_trivial
+* returns NULL unless the result is the GEOS intersection, and
+* lwgeom_clip_to_gbox_exact when it might not be valid.
+*/
+int lwgeom_is_rectangle_2d(const LWGEOM *geom, GBOX *box);
+LWGEOM* lwgeom_clip_to_gbox_trivial(const LWGEOM *geom, const GBOX *box);
+LWGEOM* lwgeom_clip_to_gbox_exact(const LWGEOM *geom, const GBOX *box);
+
 /** GBOX utility functions to figure out coverage/location on the globe */
 double gbox_angular_height(const GBOX* gbox);
 double gbox_angular_width(const GBOX* gbox);
@@ -413,6 +449,8 @@ int gbox_centroid(const GBOX* gbox, POINT2D* out);
 
 /* Utilities */
 extern void trim_trailing_zeros(char *num);
+extern int lwprint_double(double d, int maxdd, char *buf, size_t bufsize);
+extern int lwprint_double_significant(double d, int sigdigits, char *buf, size_t bufsize);
 
 
 #endif /* _LIBLWGEOM_INTERNAL_H */
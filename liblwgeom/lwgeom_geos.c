@@ -461,6 +461,7 @@ lwgeom_intersection(const LWGEOM *geom1, const LWGEOM *geom2)
 {
 	LWGEOM *result ;
 	GEOSGeometry *g1, *g2, *g3 ;
+	GBOX box ;
 	int is3d ;
 	int srid ;
 
@@ -476,6 +477,12 @@ lwgeom_intersection(const LWGEOM *geom1, const LWGEOM *geom2)
 	srid = (int)(geom1->srid);
 	error_if_srid_mismatch(srid, (int)(geom2->srid));
 
+	/* Points and geometries clear of a rectangle don't need GEOS */
+	if ( lwgeom_is_rectangle_2d(geom2, &box) && (result = lwgeom_clip_to_gbox_trivial(geom1, &box)) )
+		return result;
+	if ( lwgeom_is_rectangle_2d(geom1, &box) && (result = lwgeom_clip_to_gbox_trivial(geom2, &box)) )
+		return result;
+
 	is3d = (FLAGS_GET_Z(geom1->flags) || FLAGS_GET_Z(geom2->flags)) ;
 
 	initGEOS(lwnotice, lwgeom_geos_error);
@@ -1424,3 +1431,192 @@ LWGEOM* lwgeom_delaunay_triangulation(const LWGEOM *lwgeom_in, double tolerance,
 	
 #endif /* POSTGIS_GEOS_VERSION < 34 */
 }
+
+/**
+ * Polygon covering the 2D extent of a box
+ */
+static LWGEOM *
+lwgeom_from_gbox_2d(const GBOX *box, int srid)
+{
+	POINTARRAY **rings;
+	POINT4D p;
+
+	rings = lwalloc(sizeof(POINTARRAY*));
+	rings[0] = ptarray_construct_empty(0, 0, 5);
+	p.z = p.m = 0.0;
+	p.x = box->xmin; p.y = box->ymin; ptarray_append_point(rings[0], &p, LW_TRUE);
+	p.x = box->xmin; p.y = box->ymax; ptarray_append_point(rings[0], &p, LW_TRUE);
+	p.x = box->xmax; p.y = box->ymax; ptarray_append_point(rings[0], &p, LW_TRUE);
+	p.x = box->xmax; p.y = box->ymin; ptarray_append_point(rings[0], &p, LW_TRUE);
+	p.x = box->xmin; p.y = box->ymin; ptarray_append_point(rings[0], &p, LW_TRUE);
+
+	return (LWGEOM*)lwpoly_construct(srid, NULL, 1, rings);
+}
+
+/**
+ * Part of a geometry within a box: NULL when they don't
+ * interact, a copy when the geometry is all inside, the
+ * intersection otherwise.
+ */
+static LWGEOM *
+lwgeom_clip_to_gbox_2d(const LWGEOM *geom, const GBOX *box)
+{
+	LWGEOM *boxgeom, *result;
+	GBOX gbox;
+
+	if ( lwgeom_calculate_gbox(geom, &gbox) == LW_FAILURE )
+		return NULL;
+
+	if ( ! gbox_overlaps_2d(&gbox, box) )
+		return NULL;
+
+	if ( gbox.xmin >= box->xmin && gbox.xmax <= box->xmax &&
+	     gbox.ymin >= box->ymin && gbox.ymax <= box->ymax )
+		return lwgeom_clone_deep(geom);
+
+	result = lwgeom_clip_to_gbox_exact(geom, box);
+	if ( ! result )
+	{
+		boxgeom = lwgeom_from_gbox_2d(box, geom->srid);
+		result = lwgeom_intersection(geom, boxgeom);
+		lwgeom_free(boxgeom);
+	}
+
+	if ( result && lwgeom_is_empty(result) )
+	{
+		lwgeom_free(result);
+		return NULL;
+	}
+	return result;
+}
+
+/**
+ * Recursive worker for lwgeom_subdivide. Adds the pieces of geom
+ * (which lies within clip) to col and returns how many it added.
+ * Pieces of lower dimension than the input part they come from
+ * (slivers the cuts leave on polygon edges) are dropped; dim is
+ * that dimension, or -1 while still walking the input collection.
+ */
+static int
+lwgeom_subdivide_recursive(const LWGEOM *geom, int dim, int maxvertices, int depth, LWCOLLECTION *col, const GBOX *clip)
+{
+	double width = clip->xmax - clip->xmin;
+	double height = clip->ymax - clip->ymin;
+	GBOX subbox1, subbox2;
+	LWGEOM *clipped;
+	int i, n = 0;
+
+	/* Always just recurse into collections, but keep multipoints together */
+	if ( lwgeom_is_collection(geom) && geom->type != MULTIPOINTTYPE )
+	{
+		const LWCOLLECTION *incol = (const LWCOLLECTION*)geom;
+		for ( i = 0; i < incol->ngeoms; i++ )
+			n += lwgeom_subdivide_recursive(incol->geoms[i], dim, maxvertices, depth, col, clip);
+		return n;
+	}
+
+	if ( lwgeom_is_empty(geom) )
+		return 0;
+
+	if ( dim < 0 )
+		dim = lwgeom_dimension(geom);
+	else if ( lwgeom_dimension(geom) < dim )
+		return 0;
+
+	/*
+	 * Small enough, or can't be cut any further: vertices piled up on
+	 * one coordinate stay together however small the box gets, so such
+	 * pieces go out over budget.
+	 */
+	if ( lwgeom_count_vertices(geom) <= maxvertices || depth > LW_SUBDIVIDE_MAX_DEPTH ||
+	     ( width == 0.0 && height == 0.0 ) )
+	{
+		lwcollection_add_lwgeom(col, lwgeom_clone_deep(geom));
+		return 1;
+	}
+
+	/* Cut the box in two across its longer side */
+	subbox1 = subbox2 = *clip;
+	if ( width > height )
+		subbox1.xmax = subbox2.xmin = (clip->xmin + clip->xmax) / 2.0;
+	else
+		subbox1.ymax = subbox2.ymin = (clip->ymin + clip->ymax) / 2.0;
+
+	/*
+	 * Multipoints we share out ourselves, so a point falling on
+	 * the cut goes to one side only
+	 */
+	if ( geom->type == MULTIPOINTTYPE )
+	{
+		const LWMPOINT *mpoint = (const LWMPOINT*)geom;
+		LWMPOINT *half[2];
+		int j;
+
+		half[0] = lwmpoint_construct_empty(geom->srid, FLAGS_GET_Z(geom->flags), FLAGS_GET_M(geom->flags));
+		half[1] = lwmpoint_construct_empty(geom->srid, FLAGS_GET_Z(geom->flags), FLAGS_GET_M(geom->flags));
+		for ( i = 0; i < mpoint->ngeoms; i++ )
+		{
+			POINT2D pt;
+			getPoint2d_p(mpoint->geoms[i]->point, 0, &pt);
+			j = ( width > height ) ? pt.x >= subbox2.xmin : pt.y >= subbox2.ymin;
+			lwmpoint_add_lwpoint(half[j], (LWPOINT*)lwgeom_clone_deep((LWGEOM*)mpoint->geoms[i]));
+		}
+		n += lwgeom_subdivide_recursive((LWGEOM*)half[0], dim, maxvertices, depth + 1, col, &subbox1);
+		n += lwgeom_subdivide_recursive((LWGEOM*)half[1], dim, maxvertices, depth + 1, col, &subbox2);
+		lwgeom_free((LWGEOM*)half[0]);
+		lwgeom_free((LWGEOM*)half[1]);
+		return n;
+	}
+
+	clipped = lwgeom_clip_to_gbox_2d(geom, &subbox1);
+	if ( clipped )
+	{
+		n += lwgeom_subdivide_recursive(clipped, dim, maxvertices, depth + 1, col, &subbox1);
+		lwgeom_free(clipped);
+	}
+
+	clipped = lwgeom_clip_to_gbox_2d(geom, &subbox2);
+	if ( clipped )
+	{
+		n += lwgeom_subdivide_recursive(clipped, dim, maxvertices, depth + 1, col, &subbox2);
+		lwgeom_free(clipped);
+	}
+
+	return n;
+}
+
+/**
+ * Cut a geometry into pieces having no more than maxvertices
+ * vertices each, by recursively halving its bounding box.
+ * Collections are taken apart first, so no piece is a collection
+ * other than a multipoint. Pieces that can't be cut any further are
+ * kept whole, even when over budget.
+ * Returns a (possibly empty) GEOMETRYCOLLECTION of the pieces.
+ */
+LWCOLLECTION *
+lwgeom_subdivide(const LWGEOM *geom, int maxvertices)
+{
+	LWCOLLECTION *col;
+	GBOX clip;
+
+	if ( maxvertices < LW_SUBDIVIDE_MIN_VERTICES )
+	{
+		lwerror("%s: cannot subdivide to fewer than %d vertices per piece", "lwgeom_subdivide", LW_SUBDIVIDE_MIN_VERTICES);
+		return NULL;
+	}
+
+	if ( geom->type == POLYHEDRALSURFACETYPE || geom->type == TINTYPE )
+	{
+		lwerror("%s: unsupported geometry type '%s'", "lwgeom_subdivide", lwtype_name(geom->type));
+		return NULL;
+	}
+
+	col = lwcollection_construct_empty(COLLECTIONTYPE, geom->srid, lwgeom_has_z(geom), lwgeom_has_m(geom));
+
+	if ( lwgeom_is_empty(geom) || lwgeom_calculate_gbox(geom, &clip) == LW_FAILURE )
+		return col;
+
+	lwgeom_subdivide_recursive(geom, -1, maxvertices, 0, col, &clip);
+
+	return col;
+}
@@ -0,0 +1,682 @@
+/**********************************************************************
+ *
+ * PostGIS - Spatial Types for PostgreSQL
+ * http://postgis.refractions.net
+ *
+ * This is free software; you can redistribute and/or modify it under
+ * the terms of the GNU General Public Licence. See the COPYING file.
+ *
+ **********************************************************************
+ *
+ * Clipping of geometries by an axis-aligned rectangle, without GEOS.
+ * Lines are clipped segment by segment (Liang-Barsky), polygon rings
+ * against each side of the rectangle in turn (Sutherland-Hodgman).
+ *
+ **********************************************************************/
+
+#include "liblwgeom_internal.h"
+#include "lwgeom_log.h"
+
+typedef struct
+{
+	GBOX box;    /* the clip rectangle, only x and y are used */
+	int exact;   /* only succeed when the result is the one GEOS gives */
+	int failed;  /* set when exact and that cannot be promised */
+} RECTCLIP;
+
+static inline int
+rectclip_contains(const GBOX *box, double x, double y)
+{
+	return x >= box->xmin && x <= box->xmax && y >= box->ymin && y <= box->ymax;
+}
+
+/*
+ * Point at t along p1-p2, with the ends returned exactly.
+ */
+static void
+rectclip_interpolate(const POINT4D *p1, const POINT4D *p2, double t, POINT4D *pn)
+{
+	if ( t <= 0.0 )
+	{
+		*pn = *p1;
+		return;
+	}
+	if ( t >= 1.0 )
+	{
+		*pn = *p2;
+		return;
+	}
+	pn->x = p1->x + t * (p2->x - p1->x);
+	pn->y = p1->y + t * (p2->y - p1->y);
+	pn->z = p1->z + t * (p2->z - p1->z);
+	pn->m = p1->m + t * (p2->m - p1->m);
+}
+
+/* Stop rounding from putting a computed point outside the box */
+static inline void
+rectclip_clamp(const GBOX *box, POINT4D *p)
+{
+	p->x = FP_MAX(box->xmin, FP_MIN(box->xmax, p->x));
+	p->y = FP_MAX(box->ymin, FP_MIN(box->ymax, p->y));
+}
+
+/*
+ * Liang-Barsky: the part of p1-p2 within the box is the one
+ * between t0 and t1. Returns LW_FALSE if the segment misses it.
+ */
+static int
+rectclip_segment(const GBOX *box, const POINT4D *p1, const POINT4D *p2, double *t0, double *t1)
+{
+	double dx = p2->x - p1->x;
+	double dy = p2->y - p1->y;
+	double p[4], q[4], r;
+	int i;
+
+	p[0] = -dx; q[0] = p1->x - box->xmin;
+	p[1] =  dx; q[1] = box->xmax - p1->x;
+	p[2] = -dy; q[2] = p1->y - box->ymin;
+	p[3] =  dy; q[3] = box->ymax - p1->y;
+
+	*t0 = 0.0;
+	*t1 = 1.0;
+	for ( i = 0; i < 4; i++ )
+	{
+		if ( p[i] == 0.0 )
+		{
+			/* Parallel to this side, and outside of it */
+			if ( q[i] < 0.0 )
+				return LW_FALSE;
+			continue;
+		}
+		r = q[i] / p[i];
+		if ( p[i] < 0.0 )
+		{
+			if ( r > *t1 ) return LW_FALSE;
+			if ( r > *t0 ) *t0 = r;
+		}
+		else
+		{
+			if ( r < *t0 ) return LW_FALSE;
+			if ( r < *t1 ) *t1 = r;
+		}
+	}
+	return LW_TRUE;
+}
+
+/*
+ * Turn a finished run of clipped points into a line. A run of
+ * a single point is where the line just touches the box: GEOS
+ * would return that as a point, so it is dropped here.
+ */
+static void
+rectclip_end_run(RECTCLIP *clip, POINTARRAY **run, int srid, LWCOLLECTION *out)
+{
+	if ( ! *run )
+		return;
+
+	if ( (*run)->npoints < 2 )
+	{
+		clip->failed = LW_TRUE;
+		ptarray_free(*run);
+	}
+	else
+	{
+		lwcollection_add_lwgeom(out, (LWGEOM*)lwline_construct(srid, NULL, *run));
+	}
+	*run = NULL;
+}
+
+static void
+rectclip_line(RECTCLIP *clip, const LWLINE *line, LWCOLLECTION *out)
+{
+	const POINTARRAY *pa = line->points;
+	POINTARRAY *run = NULL;
+	POINT4D p1, p2, pn;
+	double t0, t1;
+	int i;
+
+	/* Not a valid line, leave it to GEOS to complain about */
+	if ( pa->npoints < 2 )
+	{
+		clip->failed = LW_TRUE;
+		return;
+	}
+
+	getPoint4d_p(pa, 0, &p1);
+	for ( i = 1; i < pa->npoints; i++ )
+	{
+		getPoint4d_p(pa, i, &p2);
+		if ( ! rectclip_segment(&clip->box, &p1, &p2, &t0, &t1) )
+		{
+			rectclip_end_run(clip, &run, line->srid, out);
+			p1 = p2;
+			continue;
+		}
+
+		/* Start a new run unless carrying on from the last segment */
+		if ( ! run || t0 > 0.0 )
+		{
+			rectclip_end_run(clip, &run, line->srid, out);
+			run = ptarray_construct_empty(FLAGS_GET_Z(pa->flags), FLAGS_GET_M(pa->flags), 8);
+			rectclip_interpolate(&p1, &p2, t0, &pn);
+			rectclip_clamp(&clip->box, &pn);
+			ptarray_append_point(run, &pn, LW_FALSE);
+		}
+
+		rectclip_interpolate(&p1, &p2, t1, &pn);
+		rectclip_clamp(&clip->box, &pn);
+		ptarray_append_point(run, &pn, LW_FALSE);
+
+		/* Left the box part way along */
+		if ( t1 < 1.0 )
+			rectclip_end_run(clip, &run, line->srid, out);
+
+		p1 = p2;
+	}
+	rectclip_end_run(clip, &run, line->srid, out);
+}
+
+static inline double
+rectclip_ord(const POINT4D *p, int ord)
+{
+	return ord ? p->y : p->x;
+}
+
+/*
+ * One Sutherland-Hodgman pass: keep the part of a closed ring on
+ * the inner side of the line x = val (ord 0) or y = val (ord 1).
+ * side is -1 to keep what is below val, 1 to keep what is above.
+ */
+static POINTARRAY *
+rectclip_ring_side(const POINTARRAY *in, int ord, double val, int side)
+{
+	POINTARRAY *out;
+	POINT4D s, e, pn;
+	int i, sin, ein;
+
+	out = ptarray_construct_empty(FLAGS_GET_Z(in->flags), FLAGS_GET_M(in->flags), in->npoints + 2);
+	if ( in->npoints < 2 )
+		return out;
+
+	getPoint4d_p(in, 0, &s);
+	sin = side * (rectclip_ord(&s, ord) - val) >= 0.0;
+	for ( i = 1; i < in->npoints; i++ )
+	{
+		getPoint4d_p(in, i, &e);
+		ein = side * (rectclip_ord(&e, ord) - val) >= 0.0;
+		if ( sin != ein )
+		{
+			double t = (val - rectclip_ord(&s, ord)) / (rectclip_ord(&e, ord) - rectclip_ord(&s, ord));
+			rectclip_interpolate(&s, &e, t, &pn);
+			if ( ord ) pn.y = val;
+			else pn.x = val;
+			ptarray_append_point(out, &pn, LW_FALSE);
+		}
+		if ( ein )
+			ptarray_append_point(out, &e, LW_FALSE);
+		s = e;
+		sin = ein;
+	}
+
+	/* Close it up again */
+	if ( out->npoints > 0 )
+	{
+		POINT4D first, last;
+		getPoint4d_p(out, 0, &first);
+		getPoint4d_p(out, out->npoints - 1, &last);
+		if ( first.x != last.x || first.y != last.y )
+			ptarray_append_point(out, &first, LW_TRUE);
+	}
+	return out;
+}
+
+/*
+ * Clip a ring to the box. Returns NULL if nothing of any
+ * area is left.
+ */
+static POINTARRAY *
+rectclip_ring(const GBOX *box, const POINTARRAY *ring)
+{
+	POINTARRAY *pa, *tmp;
+	POINT4D p;
+	int i;
+
+	pa = rectclip_ring_side(ring, 0, box->xmin, 1);
+	tmp = rectclip_ring_side(pa, 0, box->xmax, -1);
+	ptarray_free(pa);
+	pa = rectclip_ring_side(tmp, 1, box->ymin, 1);
+	ptarray_free(tmp);
+	tmp = rectclip_ring_side(pa, 1, box->ymax, -1);
+	ptarray_free(pa);
+	pa = tmp;
+
+	for ( i = 0; i < pa->npoints; i++ )
+	{
+		getPoint4d_p(pa, i, &p);
+		rectclip_clamp(box, &p);
+		ptarray_set_point4d(pa, i, &p);
+	}
+
+	if ( pa->npoints < 4 || ptarray_signed_area(pa) == 0.0 )
+	{
+		ptarray_free(pa);
+		return NULL;
+	}
+	return pa;
+}
+
+/*
+ * A simple convex ring turns the same way at every vertex and
+ * runs back and forth in x and in y only once each.
+ */
+static int
+rectclip_ring_is_convex(const POINTARRAY *pa)
+{
+	const POINT2D *p1, *p2;
+	double dx, dy, pdx = 0.0, pdy = 0.0, lastdx = 0.0, lastdy = 0.0, cross;
+	int i, turn = 0, xturns = 0, yturns = 0;
+
+	if ( pa->npoints < 4 )
+		return LW_FALSE;
+
+	/* Start from the last edge, and the last ways it ran in x and y */
+	for ( i = pa->npoints - 1; i > 0; i-- )
+	{
+		p1 = getPoint2d_cp(pa, i - 1);
+		p2 = getPoint2d_cp(pa, i);
+		dx = p2->x - p1->x;
+		dy = p2->y - p1->y;
+		if ( pdx == 0.0 && pdy == 0.0 )
+		{
+			pdx = dx;
+			pdy = dy;
+		}
+		if ( lastdx == 0.0 ) lastdx = dx;
+		if ( lastdy == 0.0 ) lastdy = dy;
+	}
+	if ( lastdx == 0.0 || lastdy == 0.0 )
+		return LW_FALSE;
+
+	for ( i = 1; i < pa->npoints; i++ )
+	{
+		p1 = getPoint2d_cp(pa, i - 1);
+		p2 = getPoint2d_cp(pa, i);
+		dx = p2->x - p1->x;
+		dy = p2->y - p1->y;
+		if ( dx == 0.0 && dy == 0.0 )
+			continue;
+
+		cross = pdx * dy - pdy * dx;
+		if ( cross == 0.0 )
+		{
+			/* Spike back along itself */
+			if ( pdx * dx + pdy * dy < 0.0 )
+				return LW_FALSE;
+		}
+		else if ( ! turn )
+		{
+			turn = cross > 0.0 ? 1 : -1;
+		}
+		else if ( turn != (cross > 0.0 ? 1 : -1) )
+		{
+			return LW_FALSE;
+		}
+
+		if ( dx != 0.0 )
+		{
+			if ( (dx > 0.0) != (lastdx > 0.0) ) xturns++;
+			lastdx = dx;
+		}
+		if ( dy != 0.0 )
+		{
+			if ( (dy > 0.0) != (lastdy > 0.0) ) yturns++;
+			lastdy = dy;
+		}
+		pdx = dx;
+		pdy = dy;
+	}
+
+	return turn != 0 && xturns <= 2 && yturns <= 2;
+}
+
+static void
+rectclip_poly(RECTCLIP *clip, const LWPOLY *poly, LWCOLLECTION *out)
+{
+	const GBOX *box = &clip->box;
+	LWPOLY *opoly;
+	POINTARRAY *pa;
+	GBOX rbox;
+	int i;
+
+	if ( lwpoly_is_empty(poly) )
+		return;
+
+	ptarray_calculate_gbox_cartesian(poly->rings[0], &rbox);
+
+	/* Shell misses the box */
+	if ( ! gbox_overlaps_2d(&rbox, box) )
+		return;
+
+	/* Whole polygon is inside the box */
+	if ( rbox.xmin >= box->xmin && rbox.xmax <= box->xmax &&
+	     rbox.ymin >= box->ymin && rbox.ymax <= box->ymax )
+	{
+		lwcollection_add_lwgeom(out, lwgeom_clone_deep((LWGEOM*)poly));
+		return;
+	}
+
+	/* Concave shells can come out in pieces joined along the box edge */
+	if ( clip->exact && ! rectclip_ring_is_convex(poly->rings[0]) )
+	{
+		clip->failed = LW_TRUE;
+		return;
+	}
+
+	pa = rectclip_ring(box, poly->rings[0]);
+	if ( ! pa )
+	{
+		/* Only touches the box, GEOS would find a point or line */
+		if ( clip->exact )
+			clip->failed = LW_TRUE;
+		return;
+	}
+
+	opoly = lwpoly_construct_empty(poly->srid, FLAGS_GET_Z(poly->flags), FLAGS_GET_M(poly->flags));
+	lwpoly_add_ring(opoly, pa);
+
+	for ( i = 1; i < poly->nrings; i++ )
+	{
+		const POINTARRAY *ring = poly->rings[i];
+
+		if ( ring->npoints == 0 )
+			continue;
+
+		if ( clip->exact )
+		{
+			/* Holes must be clear of the box edges */
+			ptarray_calculate_gbox_cartesian(ring, &rbox);
+			if ( rbox.xmin > box->xmin && rbox.xmax < box->xmax &&
+			     rbox.ymin > box->ymin && rbox.ymax < box->ymax )
+			{
+				lwpoly_add_ring(opoly, ptarray_clone_deep(ring));
+			}
+			else if ( rbox.xmin > box->xmax || rbox.xmax < box->xmin ||
+			          rbox.ymin > box->ymax || rbox.ymax < box->ymin )
+			{
+				continue;
+			}
+			else
+			{
+				clip->failed = LW_TRUE;
+				lwpoly_free(opoly);
+				return;
+			}
+		}
+		else
+		{
+			pa = rectclip_ring(box, ring);
+			if ( pa )
+				lwpoly_add_ring(opoly, pa);
+		}
+	}
+
+	lwcollection_add_lwgeom(out, (LWGEOM*)opoly);
+}
+
+/*
+ * Add the parts of geom within the box to out.
+ */
+static void
+rectclip_geom(RECTCLIP *clip, const LWGEOM *geom, LWCOLLECTION *out)
+{
+	int i;
+
+	if ( clip->failed )
+		return;
+
+	switch ( geom->type )
+	{
+	case POINTTYPE:
+	{
+		const LWPOINT *pt = (const LWPOINT*)geom;
+		const POINT2D *p;
+		if ( lwpoint_is_empty(pt) )
+			return;
+		p = getPoint2d_cp(pt->point, 0);
+		if ( rectclip_contains(&clip->box, p->x, p->y) )
+			lwcollection_add_lwgeom(out, lwgeom_clone_deep(geom));
+		return;
+	}
+	case LINETYPE:
+		if ( ! lwline_is_empty((const LWLINE*)geom) )
+			rectclip_line(clip, (const LWLINE*)geom, out);
+		return;
+	case POLYGONTYPE:
+		rectclip_poly(clip, (const LWPOLY*)geom, out);
+		return;
+	case COLLECTIONTYPE:
+		/* Mixed results would need merging the way GEOS does */
+		if ( clip->exact )
+		{
+			clip->failed = LW_TRUE;
+			return;
+		}
+		/* Fall through */
+	case MULTIPOINTTYPE:
+	case MULTILINETYPE:
+	case MULTIPOLYGONTYPE:
+	{
+		const LWCOLLECTION *col = (const LWCOLLECTION*)geom;
+		for ( i = 0; i < col->ngeoms; i++ )
+			rectclip_geom(clip, col->geoms[i], out);
+		return;
+	}
+	default:
+		if ( clip->exact )
+		{
+			clip->failed = LW_TRUE;
+			return;
+		}
+		lwerror("%s: unsupported geometry type: %s", "lwgeom_clip_by_rect", lwtype_name(geom->type));
+		return;
+	}
+}
+
+/*
+ * Make a collection of parts of one type into the matching
+ * multi-type, or the part itself if there is just one and
+ * single is set. Takes ownership of col.
+ */
+static LWGEOM *
+rectclip_result(LWCOLLECTION *col, int single)
+{
+	LWGEOM *geom;
+
+	if ( col->ngeoms == 1 && single )
+	{
+		geom = col->geoms[0];
+		col->ngeoms = 0;
+		lwcollection_free(col);
+		return geom;
+	}
+	if ( col->ngeoms > 0 )
+		col->type = lwtype_get_collectiontype(col->geoms[0]->type);
+	return (LWGEOM*)col;
+}
+
+static LWGEOM *
+rectclip_clip(RECTCLIP *clip, const LWGEOM *geom)
+{
+	LWCOLLECTION *col;
+	int i;
+
+	/* Collections keep their parts apart */
+	if ( geom->type == COLLECTIONTYPE )
+	{
+		const LWCOLLECTION *in = (const LWCOLLECTION*)geom;
+		col = lwcollection_construct_empty(COLLECTIONTYPE, geom->srid, FLAGS_GET_Z(geom->flags), FLAGS_GET_M(geom->flags));
+		for ( i = 0; i < in->ngeoms; i++ )
+		{
+			LWGEOM *part = rectclip_clip(clip, in->geoms[i]);
+			if ( lwgeom_is_empty(part) )
+				lwgeom_free(part);
+			else
+				lwcollection_add_lwgeom(col, part);
+		}
+		return (LWGEOM*)col;
+	}
+
+	col = lwcollection_construct_empty(COLLECTIONTYPE, geom->srid, FLAGS_GET_Z(geom->flags), FLAGS_GET_M(geom->flags));
+	rectclip_geom(clip, geom, col);
+
+	if ( col->ngeoms == 0 )
+	{
+		lwcollection_free(col);
+		return lwgeom_construct_empty(geom->type, geom->srid, FLAGS_GET_Z(geom->flags), FLAGS_GET_M(geom->flags));
+	}
+
+	/* Multi inputs stay multi, singles only become multi when cut in pieces */
+	return rectclip_result(col, ! lwtype_is_collection(geom->type));
+}
+
+/**
+ * Clip a geometry to the rectangle with corners (x0, y0) and (x1, y1).
+ * Points, lines and polygons come out of the same type (or its multi
+ * when cut into pieces); collections keep the parts that are left.
+ * An empty geometry of the input type is returned when nothing is.
+ *
+ * Polygons are clipped ring by ring, so a concave polygon cut into
+ * several pieces comes out as one polygon whose pieces are joined along
+ * the box edge, which is not valid. Use lwgeom_intersection where that
+ * matters.
+ */
+LWGEOM *
+lwgeom_clip_by_rect(const LWGEOM *geom, double x0, double y0, double x1, double y1)
+{
+	RECTCLIP clip;
+
+	clip.box.xmin = FP_MIN(x0, x1);
+	clip.box.xmax = FP_MAX(x0, x1);
+	clip.box.ymin = FP_MIN(y0, y1);
+	clip.box.ymax = FP_MAX(y0, y1);
+	clip.exact = LW_FALSE;
+	clip.failed = LW_FALSE;
+
+	if ( lwgeom_is_empty(geom) )
+		return lwgeom_clone_deep(geom);
+
+	return rectclip_clip(&clip, geom);
+}
+
+/**
+ * The intersection of geom and the box when GEOS has nothing to work
+ * out: an empty collection when their extents are apart, a point
+ * itself when it is in the box. NULL in every other case, including
+ * geometries wholly inside the box, whose linework GEOS would node
+ * and clean up (or reject when invalid).
+ */
+LWGEOM *
+lwgeom_clip_to_gbox_trivial(const LWGEOM *geom, const GBOX *box)
+{
+	GBOX gbox;
+
+	if ( lwgeom_is_empty(geom) || lwgeom_calculate_gbox(geom, &gbox) == LW_FAILURE )
+		return NULL;
+
+	if ( gbox.xmax < box->xmin || gbox.ymax < box->ymin ||
+	     gbox.xmin > box->xmax || gbox.ymin > box->ymax )
+		return (LWGEOM*)lwcollection_construct_empty(COLLECTIONTYPE, geom->srid, FLAGS_GET_Z(geom->flags), 0);
+
+	/* GEOS would drop the M */
+	if ( geom->type == POINTTYPE && ! FLAGS_GET_M(geom->flags) )
+		return lwgeom_clone_deep(geom);
+
+	return NULL;
+}
+
+/**
+ * The intersection of geom and the box as a noded, valid geometry
+ * like lwgeom_intersection would make, though not necessarily with
+ * the same vertices, for ST_Subdivide. NULL if that cannot be done
+ * without GEOS.
+ * Handles (multi)points, (multi)lines that don't just touch the box
+ * and (multi)polygons that are inside it, outside it, or convex with
+ * holes clear of its edges. There must be no M.
+ */
+LWGEOM *
+lwgeom_clip_to_gbox_exact(const LWGEOM *geom, const GBOX *box)
+{
+	RECTCLIP clip;
+	LWCOLLECTION *col;
+
+	if ( FLAGS_GET_M(geom->flags) )
+		return NULL;
+
+	/* New polygon vertices would need their Z worked out the GEOS way */
+	if ( FLAGS_GET_Z(geom->flags) &&
+	     (geom->type == POLYGONTYPE || geom->type == MULTIPOLYGONTYPE) )
+		return NULL;
+
+	clip.box = *box;
+	clip.exact = LW_TRUE;
+	clip.failed = LW_FALSE;
+
+	col = lwcollection_construct_empty(COLLECTIONTYPE, geom->srid, FLAGS_GET_Z(geom->flags), FLAGS_GET_M(geom->flags));
+	rectclip_geom(&clip, geom, col);
+
+	if ( clip.failed )
+	{
+		lwcollection_free(col);
+		return NULL;
+	}
+
+	/* GEOS has nothing to go on for the type of an empty result */
+	if ( col->ngeoms == 0 )
+		return (LWGEOM*)col;
+
+	return rectclip_result(col, LW_TRUE);
+}
+
+/**
+ * Whether geom is a 2D polygon that is a rectangle with sides
+ * parallel to the axes, whose extent is then put in box.
+ */
+int
+lwgeom_is_rectangle_2d(const LWGEOM *geom, GBOX *box)
+{
+	const LWPOLY *poly = (const LWPOLY*)geom;
+	const POINT2D *p1, *p2;
+	int i, vertical = -1;
+
+	if ( geom->type != POLYGONTYPE || FLAGS_GET_Z(geom->flags) || FLAGS_GET_M(geom->flags) )
+		return LW_FALSE;
+
+	if ( poly->nrings != 1 || poly->rings[0]->npoints != 5 )
+		return LW_FALSE;
+
+	/* Four sides, each along one axis, turning each time, closed */
+	for ( i = 1; i < 5; i++ )
+	{
+		p1 = getPoint2d_cp(poly->rings[0], i - 1);
+		p2 = getPoint2d_cp(poly->rings[0], i);
+		if ( p1->x == p2->x && p1->y != p2->y )
+		{
+			if ( vertical == 1 ) return LW_FALSE;
+			vertical = 1;
+		}
+		else if ( p1->y == p2->y && p1->x != p2->x )
+		{
+			if ( vertical == 0 ) return LW_FALSE;
+			vertical = 0;
+		}
+		else
+		{
+			return LW_FALSE;
+		}
+	}
+	if ( ! ptarray_is_closed_2d(poly->rings[0]) )
+		return LW_FALSE;
+
+	ptarray_calculate_gbox_cartesian(poly->rings[0], box);
+	return LW_TRUE;
+}
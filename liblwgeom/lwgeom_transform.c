@@ -11,9 +11,11 @@
  **********************************************************************/
 
 #include "../postgis_config.h"
-#include "liblwgeom.h"
+#include "liblwgeom_internal.h"
 #include "lwgeom_log.h"
+#include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 
 /** convert decimal degress to radians */
@@ -32,37 +34,340 @@ to_dec(POINT4D *pt)
 	pt->y *= 180.0/M_PI;
 }
 
+/** Number of points handed to pj_transform() at once */
+#define PTARRAY_TRANSFORM_BATCH 256
+
+/** Sphere radius of the web mercator */
+#define WEBMERC_RADIUS 6378137.0
+
+/** Parameters of a PROJ definition we look at to spot the pairs above */
+typedef struct
+{
+	char proj[16];
+	char datum[16];
+	char ellps[16];
+	double a, b, R, k, lat_ts, lon_0, x_0, y_0; /* NAN when not given */
+	int towgs84_zero;  /* no +towgs84, or all zeros */
+	int nadgrids_null; /* +nadgrids=@null */
+	int unknown;       /* some parameter we don't handle */
+}
+LWPROJDEF;
+
+static void
+lwproj_def_parse(const char *def, LWPROJDEF *d)
+{
+	char *str, *loc;
+
+	memset(d, 0, sizeof(LWPROJDEF));
+	d->a = d->b = d->R = d->k = NAN;
+	d->lat_ts = d->lon_0 = d->x_0 = d->y_0 = NAN;
+	d->towgs84_zero = LW_TRUE;
+
+	str = lwalloc(strlen(def) + 1);
+	strcpy(str, def);
+
+	loc = str;
+	while ( loc && *loc )
+	{
+		double *num = NULL;
+		char *tok, *val, *end;
+
+		/* Split on the " " separator, as lwproj_from_string does */
+		tok = loc;
+		loc = strchr(loc, ' ');
+		if ( loc ) *loc++ = '\0';
+
+		if ( *tok++ != '+' )
+			continue;
+
+		val = strchr(tok, '=');
+		if ( val ) *val++ = '\0';
+
+		if ( ! strcmp(tok, "no_defs") || ! strcmp(tok, "wktext") )
+			continue;
+
+		if ( ! val )
+			d->unknown = LW_TRUE;
+		else if ( ! strcmp(tok, "proj") )
+			strncpy(d->proj, val, sizeof(d->proj) - 1);
+		else if ( ! strcmp(tok, "datum") )
+			strncpy(d->datum, val, sizeof(d->datum) - 1);
+		else if ( ! strcmp(tok, "ellps") )
+			strncpy(d->ellps, val, sizeof(d->ellps) - 1);
+		else if ( ! strcmp(tok, "towgs84") )
+			d->towgs84_zero = ( strspn(val, "0.,") == strlen(val) );
+		else if ( ! strcmp(tok, "nadgrids") && ! strcmp(val, "@null") )
+			d->nadgrids_null = LW_TRUE;
+		else if ( ! strcmp(tok, "units") && ! strcmp(val, "m") )
+			continue;
+		else if ( ! strcmp(tok, "a") ) num = &(d->a);
+		else if ( ! strcmp(tok, "b") ) num = &(d->b);
+		else if ( ! strcmp(tok, "R") ) num = &(d->R);
+		else if ( ! strcmp(tok, "k") || ! strcmp(tok, "k_0") ) num = &(d->k);
+		else if ( ! strcmp(tok, "lat_ts") ) num = &(d->lat_ts);
+		else if ( ! strcmp(tok, "lon_0") ) num = &(d->lon_0);
+		else if ( ! strcmp(tok, "x_0") ) num = &(d->x_0);
+		else if ( ! strcmp(tok, "y_0") ) num = &(d->y_0);
+		else
+			d->unknown = LW_TRUE;
+
+		if ( num )
+		{
+			*num = strtod(val, &end);
+			if ( *end ) d->unknown = LW_TRUE;
+		}
+	}
+
+	lwfree(str);
+}
+
+/** WGS84 lon/lat, with no datum shift or offsets of its own */
+static int
+lwproj_def_is_wgs84(const LWPROJDEF *d)
+{
+	if ( d->unknown || ! d->towgs84_zero || d->nadgrids_null )
+		return LW_FALSE;
+	if ( strcmp(d->proj, "longlat") && strcmp(d->proj, "latlong") )
+		return LW_FALSE;
+	if ( strcmp(d->datum, "WGS84") && ( *(d->datum) || strcmp(d->ellps, "WGS84") ) )
+		return LW_FALSE;
+	return isnan(d->a) && isnan(d->b) && isnan(d->R) && isnan(d->k) &&
+	       isnan(d->lat_ts) && isnan(d->lon_0) && isnan(d->x_0) && isnan(d->y_0);
+}
+
+/**
+ * Mercator on the 6378137m sphere, with no datum. PROJ treats
+ * +nadgrids=@null (or no datum at all) as no shift from WGS84,
+ * so lon/lat go straight onto the sphere.
+ */
+static int
+lwproj_def_is_webmerc(const LWPROJDEF *d)
+{
+	double a = isnan(d->R) ? d->a : d->R;
+	double b = isnan(d->R) ? d->b : d->R;
+
+	if ( d->unknown || ! d->towgs84_zero || strcmp(d->proj, "merc") )
+		return LW_FALSE;
+	if ( *(d->datum) || *(d->ellps) )
+		return LW_FALSE;
+	if ( a != WEBMERC_RADIUS || b != WEBMERC_RADIUS )
+		return LW_FALSE;
+	return ( isnan(d->k) || d->k == 1.0 ) &&
+	       ( isnan(d->lat_ts) || d->lat_ts == 0.0 ) &&
+	       ( isnan(d->lon_0) || d->lon_0 == 0.0 ) &&
+	       ( isnan(d->x_0) || d->x_0 == 0.0 ) &&
+	       ( isnan(d->y_0) || d->y_0 == 0.0 );
+}
+
+/**
+ * Tell whether a projection is one of those the special pairs are
+ * made of. This parses the PROJ definition, so callers transforming
+ * many geometries should work it out once per projection.
+ */
+int
+lwproj_kind(projPJ pj)
+{
+	LWPROJDEF d;
+	char *def;
+
+	def = pj_get_def(pj, 0);
+	if ( ! def ) return LW_PROJ_OTHER;
+	lwproj_def_parse(def, &d);
+	pj_dalloc(def);
+
+	if ( lwproj_def_is_wgs84(&d) )
+		return LW_PROJ_WGS84;
+	if ( lwproj_def_is_webmerc(&d) )
+		return LW_PROJ_WEBMERC;
+	return LW_PROJ_OTHER;
+}
+
+/**
+ * Tell which way a pair of projections can be handled,
+ * given the lwproj_kind() of each.
+ */
+int
+lwproj_pair_kind(int srckind, int dstkind)
+{
+	if ( srckind == LW_PROJ_WGS84 && dstkind == LW_PROJ_WEBMERC )
+		return LW_PJ_WGS84_TO_WEBMERC;
+	if ( srckind == LW_PROJ_WEBMERC && dstkind == LW_PROJ_WGS84 )
+		return LW_PJ_WEBMERC_TO_WGS84;
+	return LW_PJ_GENERIC;
+}
+
+/**
+ * Same as above, straight from the projections.
+ */
+static int
+lwproj_pair_kind_pj(projPJ srcpj, projPJ dstpj)
+{
+	/* We only know of one lon/lat <-> projected pair */
+	if ( pj_is_latlong(srcpj) == pj_is_latlong(dstpj) )
+		return LW_PJ_GENERIC;
+
+	return lwproj_pair_kind(lwproj_kind(srcpj), lwproj_kind(dstpj));
+}
+
+/**
+ * Bring a longitude in radians back into the -PI..PI range,
+ * the same way PROJ does.
+ */
+static double
+lwproj_adjlon(double lon)
+{
+	if ( fabs(lon) <= 3.14159265359 )
+		return lon;
+	lon += M_PI;
+	lon -= 2.0 * M_PI * floor(lon / (2.0 * M_PI));
+	lon -= M_PI;
+	return lon;
+}
+
+/**
+ * Transform WGS84 lon/lat to and from web mercator in place,
+ * following PROJ's spherical mercator formulas. Points outside
+ * the domain of the projection (the poles, silly longitudes)
+ * go through point4d_transform so they fail the way PROJ does.
+ */
+static int
+ptarray_transform_webmerc(POINTARRAY *pa, int kind, projPJ srcpj, projPJ dstpj)
+{
+	int i;
+	POINT4D p;
+
+	for ( i = 0; i < pa->npoints; i++ )
+	{
+		double *xy = (double*)getPoint_internal(pa, i);
+
+		if ( kind == LW_PJ_WGS84_TO_WEBMERC )
+		{
+			double lam = xy[0] * (M_PI/180.0);
+			double phi = xy[1] * (M_PI/180.0);
+
+			if ( fabs(lam) > 10.0 || fabs(phi) >= M_PI_2 - 1e-10 )
+			{
+				getPoint4d_p(pa, i, &p);
+				if ( ! point4d_transform(&p, srcpj, dstpj) ) return LW_FAILURE;
+				ptarray_set_point4d(pa, i, &p);
+				continue;
+			}
+			xy[0] = WEBMERC_RADIUS * lwproj_adjlon(lam);
+			xy[1] = WEBMERC_RADIUS * log(tan(M_PI_4 + 0.5 * phi));
+		}
+		else
+		{
+			double lam = xy[0] * (1.0 / WEBMERC_RADIUS);
+			double phi = xy[1] * (1.0 / WEBMERC_RADIUS);
+
+			if ( ! isfinite(lam) || ! isfinite(phi) )
+			{
+				getPoint4d_p(pa, i, &p);
+				if ( ! point4d_transform(&p, srcpj, dstpj) ) return LW_FAILURE;
+				ptarray_set_point4d(pa, i, &p);
+				continue;
+			}
+			xy[0] = lwproj_adjlon(lam) * (180.0/M_PI);
+			xy[1] = (M_PI_2 - 2.0 * atan(exp(-phi))) * (180.0/M_PI);
+		}
+	}
+
+	return LW_SUCCESS;
+}
+
 /**
  * Transform given POINTARRAY
  * from inpj projection to outpj projection
+ *
+ * Coordinates are handed to pj_transform() in place, a batch of
+ * points at a time, using the point stride of the array. Should
+ * PROJ report a problem with a batch, it is restored and redone
+ * point by point so the error names the offending point.
  */
-int
-ptarray_transform(POINTARRAY *pa, projPJ inpj, projPJ outpj)
+static int
+ptarray_transform_kind(POINTARRAY *pa, int kind, projPJ inpj, projPJ outpj)
 {
-  int i;
+	double backup[PTARRAY_TRANSFORM_BATCH * 4];
+	int ndims = FLAGS_NDIMS(pa->flags);
+	int hasz = FLAGS_GET_Z(pa->flags);
+	int in_latlong = pj_is_latlong(inpj);
+	int out_latlong = pj_is_latlong(outpj);
+	int i, j, n;
 	POINT4D p;
 
-  for ( i = 0; i < pa->npoints; i++ )
-  {
-    getPoint4d_p(pa, i, &p);
-    if ( ! point4d_transform(&p, inpj, outpj) ) return LW_FAILURE;
-    ptarray_set_point4d(pa, i, &p);
-  }
+	if ( kind != LW_PJ_GENERIC )
+		return ptarray_transform_webmerc(pa, kind, inpj, outpj);
+
+	for ( i = 0; i < pa->npoints; i += n )
+	{
+		double *pts = (double*)getPoint_internal(pa, i);
+		int rv, failed = LW_FALSE;
+
+		n = FP_MIN(PTARRAY_TRANSFORM_BATCH, pa->npoints - i);
+		memcpy(backup, pts, n * ndims * sizeof(double));
+
+		if ( in_latlong )
+		{
+			for ( j = 0; j < n * ndims; j += ndims )
+			{
+				pts[j] *= M_PI/180.0;
+				pts[j+1] *= M_PI/180.0;
+			}
+		}
+
+		/* Clear any error left by an earlier call before reading it */
+		*pj_get_errno_ref() = 0;
+		rv = pj_transform(inpj, outpj, n, ndims, pts, pts + 1, hasz ? pts + 2 : NULL);
+		if ( *pj_get_errno_ref() != 0 )
+			failed = LW_TRUE;
+
+		/* With several points, PROJ marks failed ones with HUGE_VAL */
+		for ( j = 0; j < n * ndims && ! failed; j += ndims )
+		{
+			if ( pts[j] == HUGE_VAL || pts[j+1] == HUGE_VAL )
+				failed = LW_TRUE;
+		}
+
+		if ( rv || failed )
+		{
+			memcpy(pts, backup, n * ndims * sizeof(double));
+			for ( j = i; j < i + n; j++ )
+			{
+				getPoint4d_p(pa, j, &p);
+				if ( ! point4d_transform(&p, inpj, outpj) ) return LW_FAILURE;
+				ptarray_set_point4d(pa, j, &p);
+			}
+			continue;
+		}
+
+		if ( out_latlong )
+		{
+			for ( j = 0; j < n * ndims; j += ndims )
+			{
+				pts[j] *= 180.0/M_PI;
+				pts[j+1] *= 180.0/M_PI;
+			}
+		}
+	}
 
 	return LW_SUCCESS;
 }
 
+int
+ptarray_transform(POINTARRAY *pa, projPJ inpj, projPJ outpj)
+{
+	return ptarray_transform_kind(pa, lwproj_pair_kind_pj(inpj, outpj), inpj, outpj);
+}
 
 /**
- * Transform given SERIALIZED geometry
- * from inpj projection to outpj projection
+ * Transform a geometry in-place, the pair kind being
+ * already known (see lwproj_pair_kind)
  */
 int
-lwgeom_transform(LWGEOM *geom, projPJ inpj, projPJ outpj)
+lwgeom_transform_kind(LWGEOM *geom, int kind, projPJ inpj, projPJ outpj)
 {
 	int i;
 
-	/* No points to transform in an empty! */
 	if ( lwgeom_is_empty(geom) )
 		return LW_SUCCESS;
 
@@ -74,7 +379,7 @@ lwgeom_transform(LWGEOM *geom, projPJ inpj, projPJ outpj)
 		case TRIANGLETYPE:
 		{
 			LWLINE *g = (LWLINE*)geom;
-      if ( ! ptarray_transform(g->points, inpj, outpj) ) return LW_FAILURE;
+      if ( ! ptarray_transform_kind(g->points, kind, inpj, outpj) ) return LW_FAILURE;
 			break;
 		}
 		case POLYGONTYPE:
@@ -82,7 +387,7 @@ lwgeom_transform(LWGEOM *geom, projPJ inpj, projPJ outpj)
 			LWPOLY *g = (LWPOLY*)geom;
 			for ( i = 0; i < g->nrings; i++ )
 			{
-        if ( ! ptarray_transform(g->rings[i], inpj, outpj) ) return LW_FAILURE;
+        if ( ! ptarray_transform_kind(g->rings[i], kind, inpj, outpj) ) return LW_FAILURE;
 			}
 			break;
 		}
@@ -100,7 +405,7 @@ lwgeom_transform(LWGEOM *geom, projPJ inpj, projPJ outpj)
 			LWCOLLECTION *g = (LWCOLLECTION*)geom;
 			for ( i = 0; i < g->ngeoms; i++ )
 			{
-				if ( ! lwgeom_transform(g->geoms[i], inpj, outpj) ) return LW_FAILURE;
+				if ( ! lwgeom_transform_kind(g->geoms[i], kind, inpj, outpj) ) return LW_FAILURE;
 			}
 			break;
 		}
@@ -114,6 +419,20 @@ lwgeom_transform(LWGEOM *geom, projPJ inpj, projPJ outpj)
 	return LW_SUCCESS;
 }
 
+/**
+ * Transform given SERIALIZED geometry
+ * from inpj projection to outpj projection
+ */
+int
+lwgeom_transform(LWGEOM *geom, projPJ inpj, projPJ outpj)
+{
+	/* No points to transform in an empty! */
+	if ( lwgeom_is_empty(geom) )
+		return LW_SUCCESS;
+
+	return lwgeom_transform_kind(geom, lwproj_pair_kind_pj(inpj, outpj), inpj, outpj);
+}
+
 int
 point4d_transform(POINT4D *pt, projPJ srcpj, projPJ dstpj)
 {
@@ -0,0 +1,378 @@
+/**********************************************************************
+ *
+ * PostGIS - Spatial Types for PostgreSQL
+ * http://postgis.refractions.net
+ *
+ * This is free software; you can redistribute and/or modify it under
+ * the terms of the GNU General Public Licence. See the COPYING file.
+ *
+ **********************************************************************
+ *
+ * Tiny WKB (TWKB) input, see lwout_twkb.c for the layout. Ids and
+ * bounding boxes are read past; the geometry comes out without SRID.
+ *
+ **********************************************************************/
+
+#include <math.h>
+
+#include "liblwgeom_internal.h"
+#include "lwgeom_log.h"
+#include "varint.h"
+
+/**
+* Used for passing the parse state between the parsing functions.
+*/
+typedef struct
+{
+	const uint8_t *twkb; /* Points to start of TWKB */
+	const uint8_t *twkb_end; /* Points just past the end of TWKB */
+	const uint8_t *pos; /* Current parse position */
+	int check; /* Simple validity checks on geometries */
+	uint32_t lwtype; /* Current type we are handling */
+	uint8_t meta; /* TWKB_META_* flags of the current geometry */
+	int has_z; /* Z? */
+	int has_m; /* M? */
+	int ndims;
+	double factor[4]; /* Scale of each ordinate from integer */
+	int64_t accum[4]; /* Previous point, coordinates are deltas from it */
+} twkb_parse_state;
+
+static LWGEOM* lwgeom_from_twkb_state(twkb_parse_state *s);
+
+
+/**
+* Check that we are not about to read off the end of the TWKB
+* array.
+*/
+static inline void twkb_parse_state_check(twkb_parse_state *s, size_t next)
+{
+	if( (s->pos + next) > s->twkb_end )
+		lwerror("TWKB structure does not match expected size!");
+}
+
+static uint8_t byte_from_twkb_state(twkb_parse_state *s)
+{
+	uint8_t val;
+	twkb_parse_state_check(s, 1);
+	val = *(s->pos);
+	s->pos++;
+	return val;
+}
+
+static uint64_t twkb_parse_state_uvarint(twkb_parse_state *s)
+{
+	size_t size;
+	uint64_t val = varint_u64_decode(s->pos, s->twkb_end, &size);
+	s->pos += size;
+	return val;
+}
+
+static int64_t twkb_parse_state_varint(twkb_parse_state *s)
+{
+	size_t size;
+	int64_t val = varint_s64_decode(s->pos, s->twkb_end, &size);
+	s->pos += size;
+	return val;
+}
+
+/**
+* Read a count of things that each take at least min_bytes, and make
+* sure that many can be there before anything is allocated for them.
+*/
+static uint32_t count_from_twkb_state(twkb_parse_state *s, int min_bytes)
+{
+	uint64_t count = twkb_parse_state_uvarint(s);
+	if ( count > (uint64_t)(s->twkb_end - s->pos) / min_bytes )
+	{
+		lwerror("TWKB structure does not match expected size!");
+		return 0;
+	}
+	return (uint32_t)count;
+}
+
+/**
+* POINTARRAY
+* Read npoints points, carrying on the deltas from the state.
+*/
+static POINTARRAY* ptarray_from_twkb_state(twkb_parse_state *s, uint32_t npoints)
+{
+	POINTARRAY *pa;
+	double *dlist;
+	int i, j;
+
+	if ( npoints == 0 )
+		return ptarray_construct_empty(s->has_z, s->has_m, 0);
+
+	pa = ptarray_construct(s->has_z, s->has_m, npoints);
+	dlist = (double*)(pa->serialized_pointlist);
+	for( i = 0; i < npoints; i++ )
+	{
+		for( j = 0; j < s->ndims; j++ )
+		{
+			s->accum[j] += twkb_parse_state_varint(s);
+			dlist[s->ndims * i + j] = s->accum[j] / s->factor[j];
+		}
+	}
+	return pa;
+}
+
+static LWPOINT* lwpoint_from_twkb_state(twkb_parse_state *s)
+{
+	POINTARRAY *pa = ptarray_from_twkb_state(s, 1);
+	return lwpoint_construct(SRID_UNKNOWN, NULL, pa);
+}
+
+static LWLINE* lwline_from_twkb_state(twkb_parse_state *s)
+{
+	uint32_t npoints = count_from_twkb_state(s, s->ndims);
+	POINTARRAY *pa;
+
+	if ( npoints == 0 )
+		return lwline_construct_empty(SRID_UNKNOWN, s->has_z, s->has_m);
+
+	pa = ptarray_from_twkb_state(s, npoints);
+	if( s->check & LW_PARSER_CHECK_MINPOINTS && pa->npoints < 2 )
+	{
+		lwerror("%s must have at least two points", lwtype_name(s->lwtype));
+		return NULL;
+	}
+
+	return lwline_construct(SRID_UNKNOWN, NULL, pa);
+}
+
+static LWPOLY* lwpoly_from_twkb_state(twkb_parse_state *s)
+{
+	uint32_t nrings = count_from_twkb_state(s, 1);
+	LWPOLY *poly = lwpoly_construct_empty(SRID_UNKNOWN, s->has_z, s->has_m);
+	int i;
+
+	for( i = 0; i < nrings; i++ )
+	{
+		uint32_t npoints = count_from_twkb_state(s, s->ndims);
+		POINTARRAY *pa = ptarray_from_twkb_state(s, npoints);
+
+		/* Check for at least four points. */
+		if( s->check & LW_PARSER_CHECK_MINPOINTS && pa->npoints < 4 )
+		{
+			lwerror("%s must have at least four points in each ring", lwtype_name(s->lwtype));
+			return NULL;
+		}
+
+		/* Check that first and last points are the same. */
+		if( s->check & LW_PARSER_CHECK_CLOSURE && ! ptarray_is_closed_2d(pa) )
+		{
+			lwerror("%s must have closed rings", lwtype_name(s->lwtype));
+			return NULL;
+		}
+
+		if ( lwpoly_add_ring(poly, pa) == LW_FAILURE )
+			lwerror("Unable to add ring to polygon");
+	}
+	return poly;
+}
+
+/**
+* MULTIPOINT, MULTILINESTRING, MULTIPOLYGON
+* Members have no header of their own and carry on the deltas.
+*/
+static LWCOLLECTION* lwmulti_from_twkb_state(twkb_parse_state *s)
+{
+	uint32_t ngeoms = count_from_twkb_state(s, 1);
+	LWCOLLECTION *col = lwcollection_construct_empty(s->lwtype, SRID_UNKNOWN, s->has_z, s->has_m);
+	uint32_t type = s->lwtype;
+	LWGEOM *geom = NULL;
+	int i;
+
+	/* Ids are not kept */
+	if ( s->meta & TWKB_META_IDLIST )
+	{
+		for ( i = 0; i < ngeoms; i++ )
+			twkb_parse_state_varint(s);
+	}
+
+	for ( i = 0; i < ngeoms; i++ )
+	{
+		switch ( type )
+		{
+		case MULTIPOINTTYPE:
+			s->lwtype = POINTTYPE;
+			geom = (LWGEOM*)lwpoint_from_twkb_state(s);
+			break;
+		case MULTILINETYPE:
+			s->lwtype = LINETYPE;
+			geom = (LWGEOM*)lwline_from_twkb_state(s);
+			break;
+		case MULTIPOLYGONTYPE:
+			s->lwtype = POLYGONTYPE;
+			geom = (LWGEOM*)lwpoly_from_twkb_state(s);
+			break;
+		}
+		if ( lwcollection_add_lwgeom(col, geom) == NULL )
+		{
+			lwerror("Unable to add geometry (%p) to collection (%p)", geom, col);
+			return NULL;
+		}
+	}
+	s->lwtype = type;
+
+	return col;
+}
+
+/**
+* GEOMETRYCOLLECTION
+* Members are whole TWKB geometries.
+*/
+static LWCOLLECTION* lwcollection_from_twkb_state(twkb_parse_state *s)
+{
+	uint32_t ngeoms = count_from_twkb_state(s, 2);
+	LWCOLLECTION *col = lwcollection_construct_empty(COLLECTIONTYPE, SRID_UNKNOWN, s->has_z, s->has_m);
+	LWGEOM *geom = NULL;
+	int i;
+
+	if ( s->meta & TWKB_META_IDLIST )
+	{
+		for ( i = 0; i < ngeoms; i++ )
+			twkb_parse_state_varint(s);
+	}
+
+	for ( i = 0; i < ngeoms; i++ )
+	{
+		geom = lwgeom_from_twkb_state(s);
+		if ( lwcollection_add_lwgeom(col, geom) == NULL )
+		{
+			lwerror("Unable to add geometry (%p) to collection (%p)", geom, col);
+			return NULL;
+		}
+	}
+
+	return col;
+}
+
+/**
+* GEOMETRY
+* Read the header of a geometry, set up the state for its dimensions
+* and precision, and pass to the handler for its type.
+*/
+static LWGEOM* lwgeom_from_twkb_state(twkb_parse_state *s)
+{
+	uint8_t type_prec, extdims;
+	int8_t prec_xy, prec_z = 0, prec_m = 0;
+	int j;
+
+	type_prec = byte_from_twkb_state(s);
+	s->meta = byte_from_twkb_state(s);
+	prec_xy = unzigzag64((type_prec & 0xF0) >> 4);
+
+	switch ( type_prec & 0x0F )
+	{
+	case WKB_POINT_TYPE:
+		s->lwtype = POINTTYPE;
+		break;
+	case WKB_LINESTRING_TYPE:
+		s->lwtype = LINETYPE;
+		break;
+	case WKB_POLYGON_TYPE:
+		s->lwtype = POLYGONTYPE;
+		break;
+	case WKB_MULTIPOINT_TYPE:
+		s->lwtype = MULTIPOINTTYPE;
+		break;
+	case WKB_MULTILINESTRING_TYPE:
+		s->lwtype = MULTILINETYPE;
+		break;
+	case WKB_MULTIPOLYGON_TYPE:
+		s->lwtype = MULTIPOLYGONTYPE;
+		break;
+	case WKB_GEOMETRYCOLLECTION_TYPE:
+		s->lwtype = COLLECTIONTYPE;
+		break;
+	default:
+		lwerror("Unsupported TWKB geometry type: %d", type_prec & 0x0F);
+		return NULL;
+	}
+
+	s->has_z = LW_FALSE;
+	s->has_m = LW_FALSE;
+	if ( s->meta & TWKB_META_EXTDIMS )
+	{
+		extdims = byte_from_twkb_state(s);
+		s->has_z = (extdims & 0x01) ? LW_TRUE : LW_FALSE;
+		s->has_m = (extdims & 0x02) ? LW_TRUE : LW_FALSE;
+		prec_z = (extdims & 0x1C) >> 2;
+		prec_m = (extdims & 0xE0) >> 5;
+	}
+	s->ndims = 2 + s->has_z + s->has_m;
+
+	s->factor[0] = s->factor[1] = pow(10, prec_xy);
+	s->factor[2] = pow(10, s->has_z ? prec_z : prec_m);
+	s->factor[3] = pow(10, prec_m);
+
+	/* The size is only there to allow skipping */
+	if ( s->meta & TWKB_META_SIZE )
+	{
+		uint64_t size = twkb_parse_state_uvarint(s);
+		twkb_parse_state_check(s, size);
+	}
+
+	if ( s->meta & TWKB_META_EMPTY )
+		return lwgeom_construct_empty(s->lwtype, SRID_UNKNOWN, s->has_z, s->has_m);
+
+	if ( s->meta & TWKB_META_BBOX )
+	{
+		for ( j = 0; j < 2 * s->ndims; j++ )
+			twkb_parse_state_varint(s);
+	}
+
+	for ( j = 0; j < 4; j++ )
+		s->accum[j] = 0;
+
+	switch ( s->lwtype )
+	{
+	case POINTTYPE:
+		return (LWGEOM*)lwpoint_from_twkb_state(s);
+	case LINETYPE:
+		return (LWGEOM*)lwline_from_twkb_state(s);
+	case POLYGONTYPE:
+		return (LWGEOM*)lwpoly_from_twkb_state(s);
+	case MULTIPOINTTYPE:
+	case MULTILINETYPE:
+	case MULTIPOLYGONTYPE:
+		return (LWGEOM*)lwmulti_from_twkb_state(s);
+	case COLLECTIONTYPE:
+		return (LWGEOM*)lwcollection_from_twkb_state(s);
+	}
+
+	/* Return value to keep compiler happy. */
+	return NULL;
+}
+
+/**
+* As with WKB, the input size must be given so that malformed TWKB
+* cannot read off the end of the memory segment.
+*
+* Check is a bitmask of: LW_PARSER_CHECK_MINPOINTS,
+* LW_PARSER_CHECK_CLOSURE, LW_PARSER_CHECK_NONE, LW_PARSER_CHECK_ALL
+*/
+LWGEOM* lwgeom_from_twkb(const uint8_t *twkb, size_t twkb_size, char check)
+{
+	twkb_parse_state s;
+
+	if ( ! twkb || ! twkb_size )
+	{
+		lwerror("lwgeom_from_twkb: empty input");
+		return NULL;
+	}
+
+	memset(&s, 0, sizeof(twkb_parse_state));
+	s.twkb = twkb;
+	s.twkb_end = twkb + twkb_size;
+	s.pos = twkb;
+
+	/* Hand the check catch-all values */
+	if ( check & LW_PARSER_CHECK_NONE )
+		s.check = 0;
+	else
+		s.check = check;
+
+	return lwgeom_from_twkb_state(&s);
+}
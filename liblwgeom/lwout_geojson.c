@@ -665,34 +665,22 @@ asgeojson_geom_buf(const LWGEOM *geom, char *output, GBOX *bbox, int precision)
 }
 
 /*
- * Print an ordinate value using at most the given number of decimal digits
+ * Print an ordinate value using at most the given number of decimal digits,
+ * without trailing zeros.
  *
  * The actual number of printed decimal digits may be less than the
  * requested ones if out of significant digits.
  *
- * The function will not write more than maxsize bytes, including the
- * terminating NULL. Returns the number of bytes that would have been
- * written if there was enough space (excluding terminating NULL).
- * So a return of ``bufsize'' or more means that the string was
- * truncated and misses a terminating NULL.
- *
- * TODO: export ?
- *
+ * Return value and truncation are as for lwprint_double().
  */
 static int
-lwprint_double(double d, int maxdd, char *buf, size_t bufsize)
+geojson_print_double(double d, int maxdd, char *buf, size_t bufsize)
 {
   double ad = fabs(d);
   int ndd = ad < 1 ? 0 : floor(log10(ad))+1; /* non-decimal digits */
-  if (fabs(d) < OUT_MAX_DOUBLE)
-  {
-    if ( maxdd > (OUT_MAX_DOUBLE_PRECISION - ndd) )  maxdd -= ndd;
-    return snprintf(buf, bufsize, "%.*f", maxdd, d);
-  }
-  else
-  {
-    return snprintf(buf, bufsize, "%g", d);
-  }
+  if ( ad < OUT_MAX_DOUBLE && maxdd > (OUT_MAX_DOUBLE_PRECISION - ndd) )
+    maxdd -= ndd;
+  return lwprint_double(d, maxdd, buf, bufsize);
 }
 
 
@@ -726,10 +714,8 @@ pointArray_to_geojson(POINTARRAY *pa, char *output, int precision)
 			POINT2D pt;
 			getPoint2d_p(pa, i, &pt);
 
-      lwprint_double(pt.x, precision, x, BUFSIZE);
-      trim_trailing_zeros(x);
-      lwprint_double(pt.y, precision, y, BUFSIZE);
-      trim_trailing_zeros(y);
+      geojson_print_double(pt.x, precision, x, BUFSIZE);
+      geojson_print_double(pt.y, precision, y, BUFSIZE);
 
 			if ( i ) ptr += sprintf(ptr, ",");
 			ptr += sprintf(ptr, "[%s,%s]", x, y);
@@ -742,12 +728,9 @@ pointArray_to_geojson(POINTARRAY *pa, char *output, int precision)
 			POINT4D pt;
 			getPoint4d_p(pa, i, &pt);
 
-      lwprint_double(pt.x, precision, x, BUFSIZE);
-      trim_trailing_zeros(x);
-      lwprint_double(pt.y, precision, y, BUFSIZE);
-      trim_trailing_zeros(y);
-      lwprint_double(pt.z, precision, z, BUFSIZE);
-      trim_trailing_zeros(z);
+      geojson_print_double(pt.x, precision, x, BUFSIZE);
+      geojson_print_double(pt.y, precision, y, BUFSIZE);
+      geojson_print_double(pt.z, precision, z, BUFSIZE);
 
 			if ( i ) ptr += sprintf(ptr, ",");
 			ptr += sprintf(ptr, "[%s,%s,%s]", x, y, z);
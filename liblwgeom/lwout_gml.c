@@ -638,9 +638,9 @@ pointArray_toGML2(POINTARRAY *pa, char *output, int precision)
 {
 	int i;
 	char *ptr;
-	char x[OUT_MAX_DIGS_DOUBLE+OUT_MAX_DOUBLE_PRECISION+1];
-	char y[OUT_MAX_DIGS_DOUBLE+OUT_MAX_DOUBLE_PRECISION+1];
-	char z[OUT_MAX_DIGS_DOUBLE+OUT_MAX_DOUBLE_PRECISION+1];
+	char x[OUT_DOUBLE_BUFFER_SIZE];
+	char y[OUT_DOUBLE_BUFFER_SIZE];
+	char z[OUT_DOUBLE_BUFFER_SIZE];
 
 	ptr = output;
 
@@ -651,17 +651,9 @@ pointArray_toGML2(POINTARRAY *pa, char *output, int precision)
 			POINT2D pt;
 			getPoint2d_p(pa, i, &pt);
 
-			if (fabs(pt.x) < OUT_MAX_DOUBLE)
-				sprintf(x, "%.*f", precision, pt.x);
-			else
-				sprintf(x, "%g", pt.x);
-			trim_trailing_zeros(x);
+			lwprint_double(pt.x, precision, x, sizeof(x));
 
-			if (fabs(pt.y) < OUT_MAX_DOUBLE)
-				sprintf(y, "%.*f", precision, pt.y);
-			else
-				sprintf(y, "%g", pt.y);
-			trim_trailing_zeros(y);
+			lwprint_double(pt.y, precision, y, sizeof(y));
 
 			if ( i ) ptr += sprintf(ptr, " ");
 			ptr += sprintf(ptr, "%s,%s", x, y);
@@ -674,23 +666,11 @@ pointArray_toGML2(POINTARRAY *pa, char *output, int precision)
 			POINT4D pt;
 			getPoint4d_p(pa, i, &pt);
 
-			if (fabs(pt.x) < OUT_MAX_DOUBLE)
-				sprintf(x, "%.*f", precision, pt.x);
-			else
-				sprintf(x, "%g", pt.x);
-			trim_trailing_zeros(x);
+			lwprint_double(pt.x, precision, x, sizeof(x));
 
-			if (fabs(pt.y) < OUT_MAX_DOUBLE)
-				sprintf(y, "%.*f", precision, pt.y);
-			else
-				sprintf(y, "%g", pt.y);
-			trim_trailing_zeros(y);
+			lwprint_double(pt.y, precision, y, sizeof(y));
 
-			if (fabs(pt.z) < OUT_MAX_DOUBLE)
-				sprintf(z, "%.*f", precision, pt.z);
-			else
-				sprintf(z, "%g", pt.z);
-			trim_trailing_zeros(z);
+			lwprint_double(pt.z, precision, z, sizeof(z));
 
 			if ( i ) ptr += sprintf(ptr, " ");
 			ptr += sprintf(ptr, "%s,%s,%s", x, y, z);
@@ -1394,9 +1374,9 @@ pointArray_toGML3(POINTARRAY *pa, char *output, int precision, int opts)
 {
 	int i;
 	char *ptr;
-	char x[OUT_MAX_DIGS_DOUBLE+OUT_MAX_DOUBLE_PRECISION+1];
-	char y[OUT_MAX_DIGS_DOUBLE+OUT_MAX_DOUBLE_PRECISION+1];
-	char z[OUT_MAX_DIGS_DOUBLE+OUT_MAX_DOUBLE_PRECISION+1];
+	char x[OUT_DOUBLE_BUFFER_SIZE];
+	char y[OUT_DOUBLE_BUFFER_SIZE];
+	char z[OUT_DOUBLE_BUFFER_SIZE];
 
 	ptr = output;
 
@@ -1407,17 +1387,9 @@ pointArray_toGML3(POINTARRAY *pa, char *output, int precision, int opts)
 			POINT2D pt;
 			getPoint2d_p(pa, i, &pt);
 
-			if (fabs(pt.x) < OUT_MAX_DOUBLE)
-				sprintf(x, "%.*f", precision, pt.x);
-			else
-				sprintf(x, "%g", pt.x);
-			trim_trailing_zeros(x);
+			lwprint_double(pt.x, precision, x, sizeof(x));
 
-			if (fabs(pt.y) < OUT_MAX_DOUBLE)
-				sprintf(y, "%.*f", precision, pt.y);
-			else
-				sprintf(y, "%g", pt.y);
-			trim_trailing_zeros(y);
+			lwprint_double(pt.y, precision, y, sizeof(y));
 
 			if ( i ) ptr += sprintf(ptr, " ");
 			if (IS_DEGREE(opts))
@@ -1433,23 +1405,11 @@ pointArray_toGML3(POINTARRAY *pa, char *output, int precision, int opts)
 			POINT4D pt;
 			getPoint4d_p(pa, i, &pt);
 
-			if (fabs(pt.x) < OUT_MAX_DOUBLE)
-				sprintf(x, "%.*f", precision, pt.x);
-			else
-				sprintf(x, "%g", pt.x);
-			trim_trailing_zeros(x);
+			lwprint_double(pt.x, precision, x, sizeof(x));
 
-			if (fabs(pt.y) < OUT_MAX_DOUBLE)
-				sprintf(y, "%.*f", precision, pt.y);
-			else
-				sprintf(y, "%g", pt.y);
-			trim_trailing_zeros(y);
+			lwprint_double(pt.y, precision, y, sizeof(y));
 
-			if (fabs(pt.z) < OUT_MAX_DOUBLE)
-				sprintf(z, "%.*f", precision, pt.z);
-			else
-				sprintf(z, "%g", pt.z);
-			trim_trailing_zeros(z);
+			lwprint_double(pt.z, precision, z, sizeof(z));
 
 			if ( i ) ptr += sprintf(ptr, " ");
 			if (IS_DEGREE(opts))
@@ -86,6 +86,7 @@ ptarray_to_kml2_sb(const POINTARRAY *pa, int precision, stringbuffer_t *sb)
 	int dims = FLAGS_GET_Z(pa->flags) ? 3 : 2;
 	POINT4D pt;
 	double *d;
+	char buf[OUT_DOUBLE_BUFFER_SIZE];
 	
 	for ( i = 0; i < pa->npoints; i++ )
 	{
@@ -95,15 +96,8 @@ ptarray_to_kml2_sb(const POINTARRAY *pa, int precision, stringbuffer_t *sb)
 		for (j = 0; j < dims; j++)
 		{
 			if ( j ) stringbuffer_append(sb,",");
-			if( fabs(d[j]) < OUT_MAX_DOUBLE )
-			{
-				if ( stringbuffer_aprintf(sb, "%.*f", precision, d[j]) < 0 ) return LW_FAILURE;
-			}
-			else 
-			{
-				if ( stringbuffer_aprintf(sb, "%g", d[j]) < 0 ) return LW_FAILURE;
-			}
-			stringbuffer_trim_trailing_zeroes(sb);
+			lwprint_double(d[j], precision, buf, sizeof(buf));
+			stringbuffer_append(sb, buf);
 		}
 	}
 	return LW_SUCCESS;
@@ -106,24 +106,16 @@ static size_t
 assvg_point_buf(const LWPOINT *point, char * output, int circle, int precision)
 {
 	char *ptr=output;
-	char x[OUT_MAX_DIGS_DOUBLE+OUT_MAX_DOUBLE_PRECISION+1];
-	char y[OUT_MAX_DIGS_DOUBLE+OUT_MAX_DOUBLE_PRECISION+1];
+	char x[OUT_DOUBLE_BUFFER_SIZE];
+	char y[OUT_DOUBLE_BUFFER_SIZE];
 	POINT2D pt;
 
 	getPoint2d_p(point->point, 0, &pt);
 
-	if (fabs(pt.x) < OUT_MAX_DOUBLE)
-		sprintf(x, "%.*f", precision, pt.x);
-	else
-		sprintf(x, "%g", pt.x);
-	trim_trailing_zeros(x);
+	lwprint_double(pt.x, precision, x, sizeof(x));
 
 	/* SVG Y axis is reversed, an no need to transform 0 into -0 */
-	if (fabs(pt.y) < OUT_MAX_DOUBLE)
-		sprintf(y, "%.*f", precision, fabs(pt.y) ? pt.y * -1 : pt.y);
-	else
-		sprintf(y, "%g", fabs(pt.y) ? pt.y * -1 : pt.y);
-	trim_trailing_zeros(y);
+	lwprint_double(fabs(pt.y) ? pt.y * -1 : pt.y, precision, y, sizeof(y));
 
 	if (circle) ptr += sprintf(ptr, "x=\"%s\" y=\"%s\"", x, y);
 	else ptr += sprintf(ptr, "cx=\"%s\" cy=\"%s\"", x, y);
@@ -548,8 +540,8 @@ pointArray_svg_rel(POINTARRAY *pa, char *output, int close_ring, int precision)
 {
 	int i, end;
 	char *ptr;
-	char x[OUT_MAX_DIGS_DOUBLE+OUT_MAX_DOUBLE_PRECISION+1];
-	char y[OUT_MAX_DIGS_DOUBLE+OUT_MAX_DOUBLE_PRECISION+1];
+	char x[OUT_DOUBLE_BUFFER_SIZE];
+	char y[OUT_DOUBLE_BUFFER_SIZE];
 	POINT2D pt, lpt;
 
 	ptr = output;
@@ -560,17 +552,9 @@ pointArray_svg_rel(POINTARRAY *pa, char *output, int close_ring, int precision)
 	/* Starting point */
 	getPoint2d_p(pa, 0, &pt);
 
-	if (fabs(pt.x) < OUT_MAX_DOUBLE)
-		sprintf(x, "%.*f", precision, pt.x);
-	else
-		sprintf(x, "%g", pt.x);
-	trim_trailing_zeros(x);
+	lwprint_double(pt.x, precision, x, sizeof(x));
 
-	if (fabs(pt.y) < OUT_MAX_DOUBLE)
-		sprintf(y, "%.*f", precision, fabs(pt.y) ? pt.y * -1 : pt.y);
-	else
-		sprintf(y, "%g", fabs(pt.y) ? pt.y * -1 : pt.y);
-	trim_trailing_zeros(y);
+	lwprint_double(fabs(pt.y) ? pt.y * -1 : pt.y, precision, y, sizeof(y));
 
 	ptr += sprintf(ptr,"%s %s l", x, y);
 
@@ -580,20 +564,11 @@ pointArray_svg_rel(POINTARRAY *pa, char *output, int close_ring, int precision)
 		lpt = pt;
 
 		getPoint2d_p(pa, i, &pt);
-		if (fabs(pt.x -lpt.x) < OUT_MAX_DOUBLE)
-			sprintf(x, "%.*f", precision, pt.x -lpt.x);
-		else
-			sprintf(x, "%g", pt.x -lpt.x);
-		trim_trailing_zeros(x);
+		lwprint_double(pt.x -lpt.x, precision, x, sizeof(x));
 
 		/* SVG Y axis is reversed, an no need to transform 0 into -0 */
-		if (fabs(pt.y -lpt.y) < OUT_MAX_DOUBLE)
-			sprintf(y, "%.*f", precision,
-			        fabs(pt.y -lpt.y) ? (pt.y - lpt.y) * -1: (pt.y - lpt.y));
-		else
-			sprintf(y, "%g",
-			        fabs(pt.y -lpt.y) ? (pt.y - lpt.y) * -1: (pt.y - lpt.y));
-		trim_trailing_zeros(y);
+		lwprint_double(fabs(pt.y -lpt.y) ? (pt.y - lpt.y) * -1: (pt.y - lpt.y),
+		               precision, y, sizeof(y));
 
 		ptr += sprintf(ptr," %s %s", x, y);
 	}
@@ -610,8 +585,8 @@ pointArray_svg_abs(POINTARRAY *pa, char *output, int close_ring, int precision)
 {
 	int i, end;
 	char *ptr;
-	char x[OUT_MAX_DIGS_DOUBLE+OUT_MAX_DOUBLE_PRECISION+1];
-	char y[OUT_MAX_DIGS_DOUBLE+OUT_MAX_DOUBLE_PRECISION+1];
+	char x[OUT_DOUBLE_BUFFER_SIZE];
+	char y[OUT_DOUBLE_BUFFER_SIZE];
 	POINT2D pt;
 
 	ptr = output;
@@ -623,18 +598,10 @@ pointArray_svg_abs(POINTARRAY *pa, char *output, int close_ring, int precision)
 	{
 		getPoint2d_p(pa, i, &pt);
 
-		if (fabs(pt.x) < OUT_MAX_DOUBLE)
-			sprintf(x, "%.*f", precision, pt.x);
-		else
-			sprintf(x, "%g", pt.x);
-		trim_trailing_zeros(x);
+		lwprint_double(pt.x, precision, x, sizeof(x));
 
 		/* SVG Y axis is reversed, an no need to transform 0 into -0 */
-		if (fabs(pt.y) < OUT_MAX_DOUBLE)
-			sprintf(y, "%.*f", precision, fabs(pt.y) ? pt.y * -1:pt.y);
-		else
-			sprintf(y, "%g", fabs(pt.y) ? pt.y * -1:pt.y);
-		trim_trailing_zeros(y);
+		lwprint_double(fabs(pt.y) ? pt.y * -1:pt.y, precision, y, sizeof(y));
 
 		if (i == 1) ptr += sprintf(ptr, " L ");
 		else if (i) ptr += sprintf(ptr, " ");
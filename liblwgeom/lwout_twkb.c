@@ -0,0 +1,453 @@
+/**********************************************************************
+ *
+ * PostGIS - Spatial Types for PostgreSQL
+ * http://postgis.refractions.net
+ *
+ * This is free software; you can redistribute and/or modify it under
+ * the terms of the GNU General Public Licence. See the COPYING file.
+ *
+ **********************************************************************
+ *
+ * Tiny WKB (TWKB) output. Coordinates are rounded to a fixed number
+ * of decimal digits, scaled to integers and written as zig-zag
+ * varints of the difference from the previous point, so that most
+ * ordinates of a dense line take one or two bytes instead of eight.
+ *
+ * Layout of a geometry:
+ *   type_and_precision  byte, type in the low four bits and
+ *                       zig-zagged xy precision in the high four
+ *   metadata            byte, TWKB_META_* flags
+ *   [extended_dims]     byte, has z, has m, z and m precisions
+ *   [size]              uvarint, bytes in the rest of the geometry
+ *   [bbox]              varint min and delta for each dimension
+ *   [body]              counts and coordinates, as for WKB
+ *
+ **********************************************************************/
+
+#include <math.h>
+
+#include "liblwgeom_internal.h"
+#include "lwgeom_log.h"
+#include "varint.h"
+
+/**
+* Growable output buffer.
+*/
+typedef struct
+{
+	uint8_t *data;
+	size_t len;
+	size_t capacity;
+} twkb_buffer;
+
+/**
+* Settings for a whole TWKB output.
+*/
+typedef struct
+{
+	uint8_t variant;
+	int8_t prec_xy;
+	int8_t prec_z;
+	int8_t prec_m;
+	double factor[4]; /* scale of each ordinate to integer */
+} TWKB_GLOBALS;
+
+/**
+* State of one geometry being written: where its body goes, the
+* previous point (coordinates are deltas from it) and the bounds
+* of what has been written.
+*/
+typedef struct
+{
+	twkb_buffer *buf;
+	const int64_t *idlist;
+	int64_t accum[4];
+	int64_t bbox_min[4];
+	int64_t bbox_max[4];
+} TWKB_STATE;
+
+static void lwgeom_to_twkb_buf(const LWGEOM *geom, const TWKB_GLOBALS *g, twkb_buffer *out, const int64_t *idlist, TWKB_STATE *parent);
+
+
+static void twkb_buffer_init(twkb_buffer *b)
+{
+	b->capacity = 64;
+	b->data = lwalloc(b->capacity);
+	b->len = 0;
+}
+
+static inline void twkb_buffer_reserve(twkb_buffer *b, size_t n)
+{
+	if ( b->len + n <= b->capacity )
+		return;
+	while ( b->len + n > b->capacity )
+		b->capacity *= 2;
+	b->data = lwrealloc(b->data, b->capacity);
+}
+
+static void twkb_buffer_append(twkb_buffer *b, const uint8_t *data, size_t n)
+{
+	twkb_buffer_reserve(b, n);
+	memcpy(b->data + b->len, data, n);
+	b->len += n;
+}
+
+static inline void twkb_buffer_byte(twkb_buffer *b, uint8_t c)
+{
+	twkb_buffer_reserve(b, 1);
+	b->data[b->len++] = c;
+}
+
+static inline void twkb_buffer_uvarint(twkb_buffer *b, uint64_t val)
+{
+	twkb_buffer_reserve(b, VARINT_MAX_SIZE);
+	b->len += varint_u64_encode_buf(val, b->data + b->len);
+}
+
+static inline void twkb_buffer_varint(twkb_buffer *b, int64_t val)
+{
+	twkb_buffer_reserve(b, VARINT_MAX_SIZE);
+	b->len += varint_s64_encode_buf(val, b->data + b->len);
+}
+
+/*
+* TWKB type numbers are the same as the WKB ones, and only
+* the seven basic types are supported.
+*/
+static uint8_t lwgeom_twkb_type(const LWGEOM *geom)
+{
+	switch ( geom->type )
+	{
+	case POINTTYPE:
+		return WKB_POINT_TYPE;
+	case LINETYPE:
+		return WKB_LINESTRING_TYPE;
+	case POLYGONTYPE:
+		return WKB_POLYGON_TYPE;
+	case MULTIPOINTTYPE:
+		return WKB_MULTIPOINT_TYPE;
+	case MULTILINETYPE:
+		return WKB_MULTILINESTRING_TYPE;
+	case MULTIPOLYGONTYPE:
+		return WKB_MULTIPOLYGON_TYPE;
+	case COLLECTIONTYPE:
+		return WKB_GEOMETRYCOLLECTION_TYPE;
+	default:
+		lwerror("lwgeom_to_twkb: Unsupported geometry type: %s", lwtype_name(geom->type));
+	}
+	return 0;
+}
+
+/*
+* Write the points of pa, with their number first if with_npoints is
+* set. Points that round onto the one before are dropped, as long as
+* minpoints are left and it is not the last one (that would open a ring).
+*/
+static void ptarray_to_twkb_buf(const POINTARRAY *pa, const TWKB_GLOBALS *g, TWKB_STATE *s, int with_npoints, uint32_t minpoints)
+{
+	int ndims = FLAGS_NDIMS(pa->flags);
+	int64_t nextval[4], delta[4];
+	twkb_buffer pts;
+	twkb_buffer *b = s->buf;
+	uint32_t npoints = 0;
+	int i, j;
+
+	/* The count is only known once the points are written */
+	if ( with_npoints )
+	{
+		twkb_buffer_init(&pts);
+		b = &pts;
+	}
+
+	for ( i = 0; i < pa->npoints; i++ )
+	{
+		const double *dbl = (const double*)getPoint_internal(pa, i);
+		int diff = LW_FALSE;
+
+		for ( j = 0; j < ndims; j++ )
+		{
+			nextval[j] = llround(dbl[j] * g->factor[j]);
+			delta[j] = nextval[j] - s->accum[j];
+			if ( delta[j] )
+				diff = LW_TRUE;
+		}
+
+		if ( with_npoints && ! diff && i > 0 && i < pa->npoints - 1 &&
+		     npoints + (pa->npoints - i - 1) >= minpoints )
+			continue;
+
+		for ( j = 0; j < ndims; j++ )
+		{
+			twkb_buffer_varint(b, delta[j]);
+			s->accum[j] = nextval[j];
+			if ( nextval[j] < s->bbox_min[j] ) s->bbox_min[j] = nextval[j];
+			if ( nextval[j] > s->bbox_max[j] ) s->bbox_max[j] = nextval[j];
+		}
+		npoints++;
+	}
+
+	if ( with_npoints )
+	{
+		twkb_buffer_uvarint(s->buf, npoints);
+		twkb_buffer_append(s->buf, pts.data, pts.len);
+		lwfree(pts.data);
+	}
+}
+
+static void lwpoly_to_twkb_buf(const LWPOLY *poly, const TWKB_GLOBALS *g, TWKB_STATE *s)
+{
+	int i;
+
+	twkb_buffer_uvarint(s->buf, poly->nrings);
+	for ( i = 0; i < poly->nrings; i++ )
+		ptarray_to_twkb_buf(poly->rings[i], g, s, LW_TRUE, 4);
+}
+
+/*
+* Members of a multi-geometry are written without headers and carry
+* on the deltas of the one before. Empty points have nothing to
+* write, so they are left out, with their ids.
+*/
+static void lwmulti_to_twkb_buf(const LWCOLLECTION *col, const TWKB_GLOBALS *g, TWKB_STATE *s)
+{
+	int i, ngeoms = 0;
+
+	for ( i = 0; i < col->ngeoms; i++ )
+	{
+		if ( col->type != MULTIPOINTTYPE || ! lwgeom_is_empty(col->geoms[i]) )
+			ngeoms++;
+	}
+
+	twkb_buffer_uvarint(s->buf, ngeoms);
+
+	if ( s->idlist )
+	{
+		for ( i = 0; i < col->ngeoms; i++ )
+		{
+			if ( col->type != MULTIPOINTTYPE || ! lwgeom_is_empty(col->geoms[i]) )
+				twkb_buffer_varint(s->buf, s->idlist[i]);
+		}
+	}
+
+	for ( i = 0; i < col->ngeoms; i++ )
+	{
+		const LWGEOM *sub = col->geoms[i];
+		switch ( sub->type )
+		{
+		case POINTTYPE:
+			if ( ! lwgeom_is_empty(sub) )
+				ptarray_to_twkb_buf(((const LWPOINT*)sub)->point, g, s, LW_FALSE, 1);
+			break;
+		case LINETYPE:
+			ptarray_to_twkb_buf(((const LWLINE*)sub)->points, g, s, LW_TRUE, 2);
+			break;
+		case POLYGONTYPE:
+			lwpoly_to_twkb_buf((const LWPOLY*)sub, g, s);
+			break;
+		default:
+			lwerror("lwgeom_to_twkb: Unsupported geometry type: %s", lwtype_name(sub->type));
+		}
+	}
+}
+
+/*
+* Members of a collection are whole TWKB geometries, with headers.
+*/
+static void lwcollection_to_twkb_buf(const LWCOLLECTION *col, const TWKB_GLOBALS *g, TWKB_STATE *s)
+{
+	int i;
+
+	twkb_buffer_uvarint(s->buf, col->ngeoms);
+
+	if ( s->idlist )
+	{
+		for ( i = 0; i < col->ngeoms; i++ )
+			twkb_buffer_varint(s->buf, s->idlist[i]);
+	}
+
+	for ( i = 0; i < col->ngeoms; i++ )
+		lwgeom_to_twkb_buf(col->geoms[i], g, s->buf, NULL, s);
+}
+
+/*
+* Write geom, header and all, to out. Its bounds are added to those
+* of parent, if there is one.
+*/
+static void lwgeom_to_twkb_buf(const LWGEOM *geom, const TWKB_GLOBALS *g, twkb_buffer *out, const int64_t *idlist, TWKB_STATE *parent)
+{
+	int ndims = FLAGS_NDIMS(geom->flags);
+	int has_z = FLAGS_GET_Z(geom->flags);
+	int has_m = FLAGS_GET_M(geom->flags);
+	uint8_t type_prec, meta = 0;
+	twkb_buffer body;
+	TWKB_STATE s;
+	int j;
+
+	type_prec = (lwgeom_twkb_type(geom) & 0x0F) | ((zigzag64(g->prec_xy) & 0x0F) << 4);
+
+	if ( has_z || has_m )
+		meta |= TWKB_META_EXTDIMS;
+	if ( g->variant & TWKB_SIZE )
+		meta |= TWKB_META_SIZE;
+
+	if ( lwgeom_is_empty(geom) )
+	{
+		meta |= TWKB_META_EMPTY;
+	}
+	else
+	{
+		/* A box around a single point would only repeat it */
+		if ( (g->variant & TWKB_BBOX) && geom->type != POINTTYPE )
+			meta |= TWKB_META_BBOX;
+		if ( idlist && lwgeom_is_collection(geom) )
+			meta |= TWKB_META_IDLIST;
+	}
+
+	twkb_buffer_byte(out, type_prec);
+	twkb_buffer_byte(out, meta);
+	if ( meta & TWKB_META_EXTDIMS )
+	{
+		twkb_buffer_byte(out, (has_z ? 0x01 : 0) | (has_m ? 0x02 : 0) |
+		                      ((g->prec_z & 0x07) << 2) | ((g->prec_m & 0x07) << 5));
+	}
+
+	if ( meta & TWKB_META_EMPTY )
+	{
+		if ( meta & TWKB_META_SIZE )
+			twkb_buffer_uvarint(out, 0);
+		return;
+	}
+
+	memset(&s, 0, sizeof(TWKB_STATE));
+	twkb_buffer_init(&body);
+	s.buf = &body;
+	s.idlist = (meta & TWKB_META_IDLIST) ? idlist : NULL;
+	for ( j = 0; j < 4; j++ )
+	{
+		s.bbox_min[j] = INT64_MAX;
+		s.bbox_max[j] = INT64_MIN;
+	}
+
+	switch ( geom->type )
+	{
+	case POINTTYPE:
+		ptarray_to_twkb_buf(((const LWPOINT*)geom)->point, g, &s, LW_FALSE, 1);
+		break;
+	case LINETYPE:
+		ptarray_to_twkb_buf(((const LWLINE*)geom)->points, g, &s, LW_TRUE, 2);
+		break;
+	case POLYGONTYPE:
+		lwpoly_to_twkb_buf((const LWPOLY*)geom, g, &s);
+		break;
+	case MULTIPOINTTYPE:
+	case MULTILINETYPE:
+	case MULTIPOLYGONTYPE:
+		lwmulti_to_twkb_buf((const LWCOLLECTION*)geom, g, &s);
+		break;
+	case COLLECTIONTYPE:
+		lwcollection_to_twkb_buf((const LWCOLLECTION*)geom, g, &s);
+		break;
+	}
+
+	if ( meta & TWKB_META_SIZE )
+	{
+		size_t size = body.len;
+		uint8_t tmp[VARINT_MAX_SIZE];
+
+		if ( meta & TWKB_META_BBOX )
+		{
+			for ( j = 0; j < ndims; j++ )
+			{
+				size += varint_s64_encode_buf(s.bbox_min[j], tmp);
+				size += varint_s64_encode_buf(s.bbox_max[j] - s.bbox_min[j], tmp);
+			}
+		}
+		twkb_buffer_uvarint(out, size);
+	}
+
+	if ( meta & TWKB_META_BBOX )
+	{
+		for ( j = 0; j < ndims; j++ )
+		{
+			twkb_buffer_varint(out, s.bbox_min[j]);
+			twkb_buffer_varint(out, s.bbox_max[j] - s.bbox_min[j]);
+		}
+	}
+
+	twkb_buffer_append(out, body.data, body.len);
+	lwfree(body.data);
+
+	if ( parent )
+	{
+		for ( j = 0; j < ndims; j++ )
+		{
+			if ( s.bbox_min[j] < parent->bbox_min[j] ) parent->bbox_min[j] = s.bbox_min[j];
+			if ( s.bbox_max[j] > parent->bbox_max[j] ) parent->bbox_max[j] = s.bbox_max[j];
+		}
+	}
+}
+
+
+uint8_t* lwgeom_to_twkb_with_idlist(const LWGEOM *geom, int64_t *idlist, uint8_t variant,
+                                    int8_t precision_xy, int8_t precision_z, int8_t precision_m,
+                                    size_t *twkb_size)
+{
+	TWKB_GLOBALS g;
+	twkb_buffer buf;
+
+	/* Initialize output size */
+	if ( twkb_size ) *twkb_size = 0;
+
+	if ( geom == NULL )
+	{
+		lwerror("Cannot convert NULL into TWKB.");
+		return NULL;
+	}
+
+	if ( precision_xy < -TWKB_MAX_PRECISION || precision_xy > TWKB_MAX_PRECISION )
+	{
+		lwerror("lwgeom_to_twkb: X/Y precision must be between %d and %d", -TWKB_MAX_PRECISION, TWKB_MAX_PRECISION);
+		return NULL;
+	}
+	if ( precision_z < 0 || precision_z > TWKB_MAX_PRECISION )
+	{
+		lwerror("lwgeom_to_twkb: Z precision must be between 0 and %d", TWKB_MAX_PRECISION);
+		return NULL;
+	}
+	if ( precision_m < 0 || precision_m > TWKB_MAX_PRECISION )
+	{
+		lwerror("lwgeom_to_twkb: M precision must be between 0 and %d", TWKB_MAX_PRECISION);
+		return NULL;
+	}
+
+	g.variant = variant;
+	g.prec_xy = precision_xy;
+	g.prec_z = precision_z;
+	g.prec_m = precision_m;
+	g.factor[0] = g.factor[1] = pow(10, precision_xy);
+	if ( FLAGS_GET_Z(geom->flags) )
+	{
+		g.factor[2] = pow(10, precision_z);
+		g.factor[3] = pow(10, precision_m);
+	}
+	else
+	{
+		g.factor[2] = pow(10, precision_m);
+		g.factor[3] = 0;
+	}
+
+	twkb_buffer_init(&buf);
+	lwgeom_to_twkb_buf(geom, &g, &buf, idlist, NULL);
+
+	LWDEBUGF(4, "TWKB output size: %d", buf.len);
+
+	if ( twkb_size ) *twkb_size = buf.len;
+	return buf.data;
+}
+
+uint8_t* lwgeom_to_twkb(const LWGEOM *geom, uint8_t variant,
+                        int8_t precision_xy, int8_t precision_z, int8_t precision_m,
+                        size_t *twkb_size)
+{
+	return lwgeom_to_twkb_with_idlist(geom, NULL, variant, precision_xy, precision_z, precision_m, twkb_size);
+}
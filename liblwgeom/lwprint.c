@@ -8,6 +8,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
 #include "liblwgeom_internal.h"
 
 /* Ensures the given lat and lon are in the "normal" range:
@@ -402,3 +403,248 @@ char* lwpoint_to_latlon(const LWPOINT * pt, const char *format)
 	getPoint2d_p(pt->point, 0, &p);
 	return lwdoubles_to_latlon(p.y, p.x, format);
 }
+
+/*
+* Fast double output.
+*
+* The text serializers used to sprintf() every ordinate with "%.*f" and
+* then walk the string again to drop trailing zeros. The routines below
+* produce the same characters directly from the binary value: the
+* fractional part of a double below OUT_MAX_DOUBLE is m * 2^-s exactly,
+* so multiplying m by 10^precision in 128 bits and shifting gives the
+* exact decimal digits, which are then rounded half-to-even on the exact
+* value just like the C library does. Anything outside that range goes
+* through snprintf() as before.
+*/
+
+/* Largest number of decimals the exact path handles (10^19 < 2^64) */
+#define LWPRINT_MAX_DECIMALS 19
+
+static const uint64_t lwprint_pow10[LWPRINT_MAX_DECIMALS + 1] =
+{
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+	10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+	100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+	100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+	100000000000000000ULL, 1000000000000000000ULL,
+	10000000000000000000ULL
+};
+
+/* 64 x 64 -> 128 bit product, as high and low words */
+static inline void
+lwprint_mul64(uint64_t a, uint64_t b, uint64_t *hi, uint64_t *lo)
+{
+	uint64_t a_lo = a & 0xFFFFFFFFULL, a_hi = a >> 32;
+	uint64_t b_lo = b & 0xFFFFFFFFULL, b_hi = b >> 32;
+	uint64_t p0 = a_lo * b_lo;
+	uint64_t p1 = a_lo * b_hi;
+	uint64_t p2 = a_hi * b_lo;
+	uint64_t p3 = a_hi * b_hi;
+	uint64_t mid = (p0 >> 32) + (p1 & 0xFFFFFFFFULL) + (p2 & 0xFFFFFFFFULL);
+
+	*lo = (mid << 32) | (p0 & 0xFFFFFFFFULL);
+	*hi = p3 + (p1 >> 32) + (p2 >> 32) + (mid >> 32);
+}
+
+static inline int
+lwprint_ndigits(uint64_t v)
+{
+	int n = 1;
+	while ( n <= LWPRINT_MAX_DECIMALS && v >= lwprint_pow10[n] )
+		n++;
+	return n;
+}
+
+/*
+* Round the non-negative a (< OUT_MAX_DOUBLE) to ndec decimals.
+* The integer part goes in *ip and the decimals, as an integer below
+* 10^ndec, in *dec.
+*/
+static void
+lwprint_fixed_digits(double a, int ndec, uint64_t *ip, uint64_t *dec)
+{
+	double fip = floor(a);
+	double frac = a - fip; /* exact */
+	uint64_t m, hi, lo, q;
+	int e, s, half, sticky;
+
+	*ip = (uint64_t)fip;
+	*dec = 0;
+	if ( frac == 0.0 )
+		return;
+
+	/* frac == m * 2^-s, with m < 2^53 */
+	m = (uint64_t)ldexp(frexp(frac, &e), 53);
+	s = 53 - e;
+
+	/* Digits are the top bits of m * 10^ndec, rounding bits the rest */
+	if ( s >= 128 )
+	{
+		/* m * 10^ndec < 2^117, far below one half */
+		return;
+	}
+	lwprint_mul64(m, lwprint_pow10[ndec], &hi, &lo);
+	if ( s >= 65 )
+	{
+		q = hi >> (s - 64);
+		half = (hi >> (s - 65)) & 1;
+		sticky = lo != 0 || (hi & ((1ULL << (s - 65)) - 1)) != 0;
+	}
+	else if ( s == 64 )
+	{
+		q = hi;
+		half = (lo >> 63) & 1;
+		sticky = (lo & ((1ULL << 63) - 1)) != 0;
+	}
+	else
+	{
+		q = (hi << (64 - s)) | (lo >> s);
+		half = (lo >> (s - 1)) & 1;
+		sticky = (lo & ((1ULL << (s - 1)) - 1)) != 0;
+	}
+
+	/* Round half to even, on the last printed digit */
+	if ( half && ( sticky || ((ndec ? q : *ip) & 1) ) )
+	{
+		q++;
+		if ( q == lwprint_pow10[ndec] )
+		{
+			q = 0;
+			(*ip)++;
+		}
+	}
+	*dec = q;
+}
+
+/*
+* Write sign, integer part and the ndec decimals in dec, without
+* trailing zeros (or the dot if no decimals remain). Returns the length.
+*/
+static int
+lwprint_fixed_format(char *str, int neg, uint64_t ip, uint64_t dec, int ndec)
+{
+	char tmp[LWPRINT_MAX_DECIMALS + 1];
+	char *ptr = str;
+	int i, n;
+
+	if ( neg )
+		*ptr++ = '-';
+
+	n = 0;
+	do
+	{
+		tmp[n++] = '0' + (ip % 10);
+		ip /= 10;
+	}
+	while ( ip );
+	while ( n )
+		*ptr++ = tmp[--n];
+
+	if ( dec )
+	{
+		while ( dec % 10 == 0 )
+		{
+			dec /= 10;
+			ndec--;
+		}
+		*ptr++ = '.';
+		for ( i = ndec - 1; i >= 0; i-- )
+		{
+			ptr[i] = '0' + (dec % 10);
+			dec /= 10;
+		}
+		ptr += ndec;
+	}
+	*ptr = '\0';
+	return ptr - str;
+}
+
+static int
+lwprint_copy(const char *str, int len, char *buf, size_t bufsize)
+{
+	if ( bufsize )
+	{
+		size_t n = (size_t)len < bufsize ? (size_t)len : bufsize - 1;
+		memcpy(buf, str, n);
+		buf[n] = '\0';
+	}
+	return len;
+}
+
+/**
+* Print d with at most maxdd decimals and no trailing zeros, as
+* sprintf("%.*f") followed by trim_trailing_zeros() would. Values beyond
+* OUT_MAX_DOUBLE are printed with "%g". Like snprintf(), at most bufsize
+* bytes are written and the full length is returned.
+*/
+int
+lwprint_double(double d, int maxdd, char *buf, size_t bufsize)
+{
+	char str[OUT_DOUBLE_BUFFER_SIZE];
+	double a = fabs(d);
+	uint64_t ip, dec;
+	int len;
+
+	/* Also catches NaN */
+	if ( ! (a < OUT_MAX_DOUBLE) )
+		return snprintf(buf, bufsize, "%g", d);
+
+	if ( maxdd < 0 || maxdd > LWPRINT_MAX_DECIMALS )
+	{
+		char *big = lwalloc(OUT_MAX_DIGS_DOUBLE + (maxdd > 0 ? maxdd : 6) + 1);
+		sprintf(big, "%.*f", maxdd, d);
+		trim_trailing_zeros(big);
+		len = lwprint_copy(big, strlen(big), buf, bufsize);
+		lwfree(big);
+		return len;
+	}
+
+	lwprint_fixed_digits(a, maxdd, &ip, &dec);
+	len = lwprint_fixed_format(str, signbit(d) != 0, ip, dec, maxdd);
+	return lwprint_copy(str, len, buf, bufsize);
+}
+
+/**
+* Print d with sigdigits significant digits, as sprintf("%.*g") would.
+* Returns the full length, like snprintf().
+*/
+int
+lwprint_double_significant(double d, int sigdigits, char *buf, size_t bufsize)
+{
+	char str[OUT_DOUBLE_BUFFER_SIZE];
+	double a = fabs(d);
+	uint64_t ip, dec;
+	int x, ndec, nd, i, len;
+
+	if ( a == 0.0 )
+		return lwprint_copy(signbit(d) ? "-0" : "0", signbit(d) ? 2 : 1, buf, bufsize);
+
+	/* The exact path only covers the non-exponent form */
+	if ( sigdigits < 1 || sigdigits > OUT_MAX_DOUBLE_PRECISION ||
+	     ! (a >= 1e-4 && a < lwprint_pow10[sigdigits]) )
+		return snprintf(buf, bufsize, "%.*g", sigdigits, d);
+
+	/*
+	* The decimal exponent of the rounded value decides the number of
+	* decimals; log10() gives a first guess, then the count of digits
+	* actually produced settles it.
+	*/
+	x = (int)floor(log10(a));
+	for ( i = 0; i < 3; i++ )
+	{
+		ndec = sigdigits - 1 - x;
+		if ( ndec < 0 || ndec > LWPRINT_MAX_DECIMALS )
+			break;
+		lwprint_fixed_digits(a, ndec, &ip, &dec);
+		nd = ip ? lwprint_ndigits(ip) + ndec : lwprint_ndigits(dec);
+		if ( nd == sigdigits )
+		{
+			len = lwprint_fixed_format(str, signbit(d) != 0, ip, dec, ndec);
+			return lwprint_copy(str, len, buf, bufsize);
+		}
+		x += nd > sigdigits ? 1 : -1;
+	}
+
+	/* Rounded up into the exponent form, or log10() was way off */
+	return snprintf(buf, bufsize, "%.*g", sigdigits, d);
+}
@@ -1,6 +1,7 @@
 #include "liblwgeom_internal.h"
 #include "lwgeom_log.h"
 #include "lwtree.h"
+#include "measures.h"
 
 
 /**
@@ -144,42 +145,38 @@ RECT_NODE* rect_node_internal_new(RECT_NODE *left_node, RECT_NODE *right_node)
 }
 
 /**
-* Build a tree of nodes from a point array, one node per edge, and each
-* with an associated measure range along a one-dimensional space. We
-* can then search that space as a range tree.
+* Create a new leaf node standing for a single point, so that puntal
+* geometries (and lines collapsed to one location) still take part
+* in distance calculations.
 */
-RECT_NODE* rect_tree_new(const POINTARRAY *pa)
+static RECT_NODE* rect_node_point_new(const POINTARRAY *pa, int i)
 {
-	int num_edges, num_children, num_parents;
-	int i, j;
-	RECT_NODE **nodes;
-	RECT_NODE *node;
+	RECT_NODE *node = lwalloc(sizeof(RECT_NODE));
+	node->p1 = (POINT2D*)getPoint_internal(pa, i);
+	node->p2 = node->p1;
+	node->xmin = node->xmax = node->p1->x;
+	node->ymin = node->ymax = node->p1->y;
+	node->left_node = NULL;
+	node->right_node = NULL;
+	return node;
+}
+
+/**
+* Pair up a flat list of nodes level by level until a single root is
+* left. Frees the list, but not the nodes. Returns NULL on an empty list.
+*/
+static RECT_NODE* rect_tree_from_nodes(RECT_NODE **nodes, int num_nodes)
+{
+	int num_children, num_parents;
+	int j;
 	RECT_NODE *tree;
 
-	if ( pa->npoints < 2 )
+	if ( num_nodes < 1 )
 	{
+		lwfree(nodes);
 		return NULL;
 	}
 
-	/*
-	** First create a flat list of nodes, one per edge.
-	** For each vertex, transform into our one-dimensional measure.
-	** Hopefully, when projected, the points turn into a fairly
-	** uniformly distributed collection of measures.
-	*/
-	num_edges = pa->npoints - 1;
-	nodes = lwalloc(sizeof(RECT_NODE*) * pa->npoints);
-	j = 0;
-	for ( i = 0; i < num_edges; i++ )
-	{
-		node = rect_node_leaf_new(pa, i);
-		if ( node ) /* Not zero length? */
-		{
-			nodes[j] = node;
-			j++;
-		}
-	}
-
 	/*
 	** If we sort the nodelist first, we'll get a more balanced tree
 	** in the end, but at the cost of sorting. For now, we just
@@ -187,7 +184,7 @@ RECT_NODE* rect_tree_new(const POINTARRAY *pa)
 	** reasonable amount of sorting already.
 	*/
 
-	num_children = j;
+	num_children = num_nodes;
 	num_parents = num_children / 2;
 	while ( num_parents > 0 )
 	{
@@ -219,6 +216,408 @@ RECT_NODE* rect_tree_new(const POINTARRAY *pa)
 	lwfree(nodes);
 
 	return tree;
+}
+
+/**
+* Build a tree of nodes from a point array, one node per edge, and each
+* with an associated measure range along a one-dimensional space. We
+* can then search that space as a range tree.
+*/
+RECT_NODE* rect_tree_new(const POINTARRAY *pa)
+{
+	int num_edges;
+	int i, j;
+	RECT_NODE **nodes;
+	RECT_NODE *node;
+
+	if ( pa->npoints < 2 )
+	{
+		return NULL;
+	}
+
+	/*
+	** First create a flat list of nodes, one per edge.
+	** For each vertex, transform into our one-dimensional measure.
+	** Hopefully, when projected, the points turn into a fairly
+	** uniformly distributed collection of measures.
+	*/
+	num_edges = pa->npoints - 1;
+	nodes = lwalloc(sizeof(RECT_NODE*) * pa->npoints);
+	j = 0;
+	for ( i = 0; i < num_edges; i++ )
+	{
+		node = rect_node_leaf_new(pa, i);
+		if ( node ) /* Not zero length? */
+		{
+			nodes[j] = node;
+			j++;
+		}
+	}
+
+	return rect_tree_from_nodes(nodes, j);
+}
+
+/**
+* Append the edge nodes of a point array to the node list. A point
+* array with no non-zero-length edge is added as a single point node.
+*/
+static int rect_tree_add_ptarray(const POINTARRAY *pa, RECT_NODE **nodes, int num_nodes)
+{
+	int i;
+	int first = num_nodes;
+	RECT_NODE *node;
+
+	for ( i = 0; i < pa->npoints - 1; i++ )
+	{
+		node = rect_node_leaf_new(pa, i);
+		if ( node )
+			nodes[num_nodes++] = node;
+	}
+	if ( pa->npoints > 0 && num_nodes == first )
+		nodes[num_nodes++] = rect_node_point_new(pa, 0);
+
+	return num_nodes;
+}
+
+static int rect_tree_add_lwgeom(const LWGEOM *lwgeom, RECT_NODE **nodes, int num_nodes)
+{
+	int i;
+
+	switch ( lwgeom->type )
+	{
+		case POINTTYPE:
+			return rect_tree_add_ptarray(((LWPOINT*)lwgeom)->point, nodes, num_nodes);
+		case LINETYPE:
+			return rect_tree_add_ptarray(((LWLINE*)lwgeom)->points, nodes, num_nodes);
+		case POLYGONTYPE:
+		{
+			LWPOLY *poly = (LWPOLY*)lwgeom;
+			for ( i = 0; i < poly->nrings; i++ )
+				num_nodes = rect_tree_add_ptarray(poly->rings[i], nodes, num_nodes);
+			return num_nodes;
+		}
+		case MULTIPOINTTYPE:
+		case MULTILINETYPE:
+		case MULTIPOLYGONTYPE:
+		{
+			LWCOLLECTION *col = (LWCOLLECTION*)lwgeom;
+			for ( i = 0; i < col->ngeoms; i++ )
+				num_nodes = rect_tree_add_lwgeom(col->geoms[i], nodes, num_nodes);
+			return num_nodes;
+		}
+		default:
+			lwerror("rect_tree_add_lwgeom: unsupported geometry type %s", lwtype_name(lwgeom->type));
+			return num_nodes;
+	}
+}
+
+/**
+* Build a tree over every edge of a point, line or polygon geometry
+* (or a homogeneous multi-geometry of those), with isolated points
+* stored as zero-length leaves. Returns NULL for empty geometries and
+* for types we do not index (curves, collections, surfaces).
+* The tree references the geometry coordinates, so the geometry must
+* outlive it.
+*/
+RECT_NODE* rect_tree_from_lwgeom(const LWGEOM *lwgeom)
+{
+	RECT_NODE **nodes;
+	int num_nodes;
+
+	if ( ! lwgeom || lwgeom_is_empty(lwgeom) )
+		return NULL;
+
+	switch ( lwgeom->type )
+	{
+		case POINTTYPE:
+		case LINETYPE:
+		case POLYGONTYPE:
+		case MULTIPOINTTYPE:
+		case MULTILINETYPE:
+		case MULTIPOLYGONTYPE:
+			break;
+		default:
+			return NULL;
+	}
+
+	/* There are never more leaves than vertices */
+	nodes = lwalloc(sizeof(RECT_NODE*) * lwgeom_count_vertices(lwgeom));
+	num_nodes = rect_tree_add_lwgeom(lwgeom, nodes, 0);
+	return rect_tree_from_nodes(nodes, num_nodes);
+}
+
+/**
+* Minimum Cartesian distance between the rectangles of two nodes,
+* zero when they overlap.
+*/
+static double rect_node_box_distance(const RECT_NODE *n1, const RECT_NODE *n2)
+{
+	double dx = 0.0;
+	double dy = 0.0;
+
+	if ( n1->xmax < n2->xmin )
+		dx = n2->xmin - n1->xmax;
+	else if ( n2->xmax < n1->xmin )
+		dx = n1->xmin - n2->xmax;
+
+	if ( n1->ymax < n2->ymin )
+		dy = n2->ymin - n1->ymax;
+	else if ( n2->ymax < n1->ymin )
+		dy = n1->ymin - n2->ymax;
+
+	if ( dx == 0.0 )
+		return dy;
+	if ( dy == 0.0 )
+		return dx;
+	return sqrt(dx*dx + dy*dy);
+}
+
+static double rect_node_size(const RECT_NODE *node)
+{
+	return (node->xmax - node->xmin) + (node->ymax - node->ymin);
+}
+
+static void rect_tree_distance_tree_r(const RECT_NODE *n1, const RECT_NODE *n2, double threshold, DISTPTS *dl)
+{
+	const RECT_NODE *c1, *c2;
+
+	/* Close enough already, or nothing under this pair can beat what we have */
+	if ( dl->distance <= threshold || rect_node_box_distance(n1, n2) >= dl->distance )
+		return;
+
+	if ( rect_node_is_leaf(n1) && rect_node_is_leaf(n2) )
+	{
+		/* Only replaces the best pair when strictly closer, p1 on the n1 side */
+		dl->twisted = 1;
+		lw_dist2d_seg_seg(n1->p1, n1->p2, n2->p1, n2->p2, dl);
+		return;
+	}
+
+	/* Descend into the bigger internal node, nearest child first */
+	if ( rect_node_is_leaf(n1) || ( ! rect_node_is_leaf(n2) && rect_node_size(n2) > rect_node_size(n1) ) )
+	{
+		c1 = n2->left_node;
+		c2 = n2->right_node;
+		if ( rect_node_box_distance(n1, c2) < rect_node_box_distance(n1, c1) )
+		{
+			c1 = n2->right_node;
+			c2 = n2->left_node;
+		}
+		rect_tree_distance_tree_r(n1, c1, threshold, dl);
+		rect_tree_distance_tree_r(n1, c2, threshold, dl);
+	}
+	else
+	{
+		c1 = n1->left_node;
+		c2 = n1->right_node;
+		if ( rect_node_box_distance(c2, n2) < rect_node_box_distance(c1, n2) )
+		{
+			c1 = n1->right_node;
+			c2 = n1->left_node;
+		}
+		rect_tree_distance_tree_r(c1, n2, threshold, dl);
+		rect_tree_distance_tree_r(c2, n2, threshold, dl);
+	}
+}
+
+/**
+* Minimum distance between the edges (and points) of two trees, using
+* the node rectangles to prune pairs that cannot improve on the best
+* distance found so far. The search stops as soon as a distance of
+* threshold or less is found, so pass 0.0 for an exact minimum or a
+* tolerance for a within-distance test. Interiors of polygons are not
+* considered, see rect_tree_area_contains_lwgeom().
+*/
+double rect_tree_distance_tree(const RECT_NODE *n1, const RECT_NODE *n2, double threshold)
+{
+	return rect_tree_closest_points(n1, n2, threshold, NULL, NULL);
+}
+
+/**
+* As rect_tree_distance_tree(), also returning the points of the
+* closest pair found, p1 on the edges of n1 and p2 on those of n2
+* (either may be NULL). Where several pairs are equally close, any
+* of them may be returned.
+*/
+double rect_tree_closest_points(const RECT_NODE *n1, const RECT_NODE *n2, double threshold, POINT2D *p1, POINT2D *p2)
+{
+	DISTPTS dl;
+	lw_dist2d_distpts_init(&dl, DIST_MIN);
+	rect_tree_distance_tree_r(n1, n2, threshold, &dl);
+	if ( p1 ) *p1 = dl.p1;
+	if ( p2 ) *p2 = dl.p2;
+	return dl.distance;
+}
+
+/**
+* Maximum Cartesian distance between the rectangles of two nodes,
+* corner to opposite corner.
+*/
+static double rect_node_box_max_distance(const RECT_NODE *n1, const RECT_NODE *n2)
+{
+	double dx = FP_MAX(n1->xmax - n2->xmin, n2->xmax - n1->xmin);
+	double dy = FP_MAX(n1->ymax - n2->ymin, n2->ymax - n1->ymin);
+	return sqrt(dx*dx + dy*dy);
+}
+
+static void rect_tree_max_distance_tree_r(const RECT_NODE *n1, const RECT_NODE *n2, DISTPTS *dl)
+{
+	const RECT_NODE *c1, *c2;
+
+	/* Nothing under this pair can be further apart than what we have */
+	if ( rect_node_box_max_distance(n1, n2) <= dl->distance )
+		return;
+
+	/* The furthest pair is always a pair of vertices */
+	if ( rect_node_is_leaf(n1) && rect_node_is_leaf(n2) )
+	{
+		dl->twisted = 1;
+		lw_dist2d_pt_pt(n1->p1, n2->p1, dl);
+		lw_dist2d_pt_pt(n1->p1, n2->p2, dl);
+		lw_dist2d_pt_pt(n1->p2, n2->p1, dl);
+		lw_dist2d_pt_pt(n1->p2, n2->p2, dl);
+		return;
+	}
 
+	/* Descend into the bigger internal node, furthest child first */
+	if ( rect_node_is_leaf(n1) || ( ! rect_node_is_leaf(n2) && rect_node_size(n2) > rect_node_size(n1) ) )
+	{
+		c1 = n2->left_node;
+		c2 = n2->right_node;
+		if ( rect_node_box_max_distance(n1, c2) > rect_node_box_max_distance(n1, c1) )
+		{
+			c1 = n2->right_node;
+			c2 = n2->left_node;
+		}
+		rect_tree_max_distance_tree_r(n1, c1, dl);
+		rect_tree_max_distance_tree_r(n1, c2, dl);
+	}
+	else
+	{
+		c1 = n1->left_node;
+		c2 = n1->right_node;
+		if ( rect_node_box_max_distance(c2, n2) > rect_node_box_max_distance(c1, n2) )
+		{
+			c1 = n1->right_node;
+			c2 = n1->left_node;
+		}
+		rect_tree_max_distance_tree_r(c1, n2, dl);
+		rect_tree_max_distance_tree_r(c2, n2, dl);
+	}
+}
+
+/**
+* Maximum distance between the vertices of two trees, returning the
+* points of the furthest pair found, p1 from n1 and p2 from n2 (either
+* may be NULL). Pairs of nodes whose rectangles cannot be further apart
+* than the best pair so far are skipped.
+*/
+double rect_tree_farthest_points(const RECT_NODE *n1, const RECT_NODE *n2, POINT2D *p1, POINT2D *p2)
+{
+	DISTPTS dl;
+	lw_dist2d_distpts_init(&dl, DIST_MAX);
+	rect_tree_max_distance_tree_r(n1, n2, &dl);
+	if ( p1 ) *p1 = dl.p1;
+	if ( p2 ) *p2 = dl.p2;
+	return dl.distance;
+}
+
+/**
+* Count the edges crossed by a ray running from pt towards positive x.
+* Each edge is treated as half-open in y, so a ray through a vertex is
+* only counted once, and horizontal edges and point nodes never count.
+*/
+static int rect_tree_ray_crossings(const RECT_NODE *node, const POINT2D *pt)
+{
+	if ( pt->y < node->ymin || pt->y > node->ymax || pt->x > node->xmax )
+		return 0;
+
+	if ( rect_node_is_leaf(node) )
+	{
+		const POINT2D *p1 = node->p1;
+		const POINT2D *p2 = node->p2;
+		if ( (p1->y > pt->y) != (p2->y > pt->y) )
+		{
+			double x = p1->x + (pt->y - p1->y) * (p2->x - p1->x) / (p2->y - p1->y);
+			if ( x > pt->x )
+				return 1;
+		}
+		return 0;
+	}
+
+	return rect_tree_ray_crossings(node->left_node, pt) +
+	       rect_tree_ray_crossings(node->right_node, pt);
+}
+
+/**
+* Even-odd point in polygon test against a tree built from a polygonal
+* geometry, holes and multiple parts included. Points on the boundary
+* may go either way, so callers should settle those with an edge test.
+*/
+int rect_tree_area_contains_point(const RECT_NODE *tree, const POINT2D *pt)
+{
+	return rect_tree_ray_crossings(tree, pt) % 2;
 }
 
+/**
+* Returns LW_TRUE if any part of lwgeom has its first vertex inside the
+* polygonal tree. When the edges of the two do not interact, every part
+* is either wholly inside or wholly outside the area, so one vertex per
+* part is enough to tell whether they intersect.
+*/
+int rect_tree_area_contains_lwgeom(const RECT_NODE *tree, const LWGEOM *lwgeom)
+{
+	POINT2D pt;
+	return rect_tree_area_contains_lwgeom_vertex(tree, lwgeom, &pt);
+}
+
+/**
+* As rect_tree_area_contains_lwgeom(), also returning in pt the first
+* vertex of the first part found inside the area. pt is left untouched
+* when no part is inside.
+*/
+int rect_tree_area_contains_lwgeom_vertex(const RECT_NODE *tree, const LWGEOM *lwgeom, POINT2D *pt)
+{
+	const POINTARRAY *pa = NULL;
+	POINT2D p;
+	int i;
+
+	switch ( lwgeom->type )
+	{
+		case POINTTYPE:
+			pa = ((LWPOINT*)lwgeom)->point;
+			break;
+		case LINETYPE:
+			pa = ((LWLINE*)lwgeom)->points;
+			break;
+		case POLYGONTYPE:
+			if ( ((LWPOLY*)lwgeom)->nrings > 0 )
+				pa = ((LWPOLY*)lwgeom)->rings[0];
+			break;
+		case MULTIPOINTTYPE:
+		case MULTILINETYPE:
+		case MULTIPOLYGONTYPE:
+		{
+			LWCOLLECTION *col = (LWCOLLECTION*)lwgeom;
+			for ( i = 0; i < col->ngeoms; i++ )
+			{
+				if ( rect_tree_area_contains_lwgeom_vertex(tree, col->geoms[i], pt) )
+					return LW_TRUE;
+			}
+			return LW_FALSE;
+		}
+		default:
+			lwerror("rect_tree_area_contains_lwgeom: unsupported geometry type %s", lwtype_name(lwgeom->type));
+			return LW_FALSE;
+	}
+
+	if ( ! pa || pa->npoints < 1 )
+		return LW_FALSE;
+
+	getPoint2d_p(pa, 0, &p);
+	if ( ! rect_tree_area_contains_point(tree, &p) )
+		return LW_FALSE;
+
+	*pt = p;
+	return LW_TRUE;
+}
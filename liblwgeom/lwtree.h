@@ -1,3 +1,6 @@
+#ifndef _LWTREE_H
+#define _LWTREE_H 1
+
 /**
 * Note that p1 and p2 are pointers into an independent POINTARRAY, do not free them.
 */
@@ -19,3 +22,12 @@ void rect_tree_free(RECT_NODE *node);
 RECT_NODE* rect_node_leaf_new(const POINTARRAY *pa, int i);
 RECT_NODE* rect_node_internal_new(RECT_NODE *left_node, RECT_NODE *right_node);
 RECT_NODE* rect_tree_new(const POINTARRAY *pa);
+RECT_NODE* rect_tree_from_lwgeom(const LWGEOM *lwgeom);
+double rect_tree_distance_tree(const RECT_NODE *n1, const RECT_NODE *n2, double threshold);
+double rect_tree_closest_points(const RECT_NODE *n1, const RECT_NODE *n2, double threshold, POINT2D *p1, POINT2D *p2);
+double rect_tree_farthest_points(const RECT_NODE *n1, const RECT_NODE *n2, POINT2D *p1, POINT2D *p2);
+int rect_tree_area_contains_point(const RECT_NODE *tree, const POINT2D *pt);
+int rect_tree_area_contains_lwgeom(const RECT_NODE *tree, const LWGEOM *lwgeom);
+int rect_tree_area_contains_lwgeom_vertex(const RECT_NODE *tree, const LWGEOM *lwgeom, POINT2D *pt);
+
+#endif /* !defined _LWTREE_H */
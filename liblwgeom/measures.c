@@ -15,8 +15,16 @@
 #include <stdlib.h>
 
 #include "measures.h"
+#include "lwtree.h"
 #include "lwgeom_log.h"
 
+/**
+* Both geometries need at least this many vertices before a pair is
+* compared through edge trees (lw_dist2d_tree) instead of segment by
+* segment. Below it building the trees costs more than it saves.
+*/
+#define DIST2D_TREE_MIN_VERTICES 128
+
 
 /*------------------------------------------------------------------------------------------------------------
 Initializing functions
@@ -245,6 +253,10 @@ int lw_dist2d_recursive(const LWGEOM *lwg1, const LWGEOM *lwg2, DISTPTS *dl)
 
 	LWDEBUGF(2, "lw_dist2d_comp is called with type1=%d, type2=%d", lwg1->type, lwg2->type);
 
+	/* Large enough to index, compare the whole geometries at once */
+	if ( lw_dist2d_tree_applies(lwg1, lwg2) )
+		return lw_dist2d_tree(lwg1, lwg2, dl);
+
 	if (lw_dist2d_is_collection(lwg1))
 	{
 		LWDEBUG(3, "First geometry is collection");
@@ -307,7 +319,12 @@ int lw_dist2d_recursive(const LWGEOM *lwg1, const LWGEOM *lwg2, DISTPTS *dl)
 			/*If one of geometries is empty, return. True here only means continue searching. False would have stoped the process*/
 			if (lwgeom_is_empty(g1)||lwgeom_is_empty(g2)) return LW_TRUE;
 
-			if ( (dl->mode != DIST_MAX) && 
+			if ( lw_dist2d_tree_applies(g1, g2) )
+			{
+				if (!lw_dist2d_tree(g1, g2, dl)) return LW_FALSE;
+				if (dl->distance<=dl->tolerance && dl->mode == DIST_MIN) return LW_TRUE; /*just a check if  the answer is already given*/
+			}
+			else if ( (dl->mode != DIST_MAX) && 
 				 (! lw_dist2d_check_overlap(g1, g2)) && 
 			     (g1->type == LINETYPE || g1->type == POLYGONTYPE) && 
 			     (g2->type == LINETYPE || g2->type == POLYGONTYPE) )	
@@ -449,6 +466,100 @@ lw_dist2d_distribute_bruteforce(LWGEOM *lwg1, LWGEOM *lwg2, DISTPTS *dl)
 
 
 
+/**
+* Geometry types rect_tree_from_lwgeom() builds trees for
+*/
+static int
+lw_dist2d_is_tree_type(const LWGEOM *g)
+{
+	switch (g->type)
+	{
+	case POINTTYPE:
+	case LINETYPE:
+	case POLYGONTYPE:
+	case MULTIPOINTTYPE:
+	case MULTILINETYPE:
+	case MULTIPOLYGONTYPE:
+		return LW_TRUE;
+	default:
+		return LW_FALSE;
+	}
+}
+
+/**
+* Whether two geometries should be compared with lw_dist2d_tree(): both
+* non-empty, without curves, and of DIST2D_TREE_MIN_VERTICES or more.
+*/
+int
+lw_dist2d_tree_applies(const LWGEOM *lwg1, const LWGEOM *lwg2)
+{
+	if ( ! ( lw_dist2d_is_tree_type(lwg1) && lw_dist2d_is_tree_type(lwg2) ) )
+		return LW_FALSE;
+	if ( lwgeom_is_empty(lwg1) || lwgeom_is_empty(lwg2) )
+		return LW_FALSE;
+	return lwgeom_count_vertices(lwg1) >= DIST2D_TREE_MIN_VERTICES &&
+	       lwgeom_count_vertices(lwg2) >= DIST2D_TREE_MIN_VERTICES;
+}
+
+/**
+* Distance through edge trees built on the fly, so that only pairs of
+* edges whose boxes could beat the best distance so far get compared.
+* The minimum stops at dl->tolerance like the brute force does, and is
+* zero when a polygon contains the other geometry. The maximum is
+* searched among vertex pairs.
+*/
+int
+lw_dist2d_tree(const LWGEOM *lwg1, const LWGEOM *lwg2, DISTPTS *dl)
+{
+	RECT_NODE *tree1, *tree2;
+	POINT2D p1, p2, inside;
+	double distance;
+	int area1 = (lwg1->type == POLYGONTYPE || lwg1->type == MULTIPOLYGONTYPE);
+	int area2 = (lwg2->type == POLYGONTYPE || lwg2->type == MULTIPOLYGONTYPE);
+
+	LWDEBUGF(2, "lw_dist2d_tree is called with type1=%d, type2=%d", lwg1->type, lwg2->type);
+
+	tree1 = rect_tree_from_lwgeom(lwg1);
+	tree2 = rect_tree_from_lwgeom(lwg2);
+	if ( ! ( tree1 && tree2 ) )
+	{
+		if ( tree1 ) rect_tree_free(tree1);
+		if ( tree2 ) rect_tree_free(tree2);
+		lwerror("lw_dist2d_tree: unable to build trees for %s and %s", lwtype_name(lwg1->type), lwtype_name(lwg2->type));
+		return LW_FALSE;
+	}
+
+	if ( dl->mode == DIST_MAX )
+	{
+		distance = rect_tree_farthest_points(tree1, tree2, &p1, &p2);
+	}
+	else
+	{
+		distance = rect_tree_closest_points(tree1, tree2, dl->tolerance, &p1, &p2);
+
+		/* The edges are apart, but one may still lie inside the other */
+		if ( distance > 0.0 &&
+		     ( ( area1 && rect_tree_area_contains_lwgeom_vertex(tree1, lwg2, &inside) ) ||
+		       ( area2 && rect_tree_area_contains_lwgeom_vertex(tree2, lwg1, &inside) ) ) )
+		{
+			distance = 0.0;
+			p1 = p2 = inside;
+		}
+	}
+
+	rect_tree_free(tree1);
+	rect_tree_free(tree2);
+
+	/* Keep the best of this and earlier pairs, p1 always on lwg1 */
+	if ( (dl->distance - distance) * dl->mode > 0 )
+	{
+		dl->distance = distance;
+		dl->p1 = p1;
+		dl->p2 = p2;
+	}
+	return LW_TRUE;
+}
+
 /**
 
 We have to check for overlapping bboxes
@@ -1011,6 +1122,9 @@ lw_dist2d_pt_ptarray(const POINT2D *p, POINTARRAY *pa,DISTPTS *dl)
 	int t;
 	const POINT2D *start, *end;
 	int twist = dl->twisted;
+	/* Batch distances, used to skip segments that cannot get any closer */
+	double dist[LW_SEG_BATCH];
+	int screen = ( dl->mode == DIST_MIN && lw_simd_level() != LW_SIMD_NONE );
 
 	LWDEBUG(2, "lw_dist2d_pt_ptarray is called");
 
@@ -1020,9 +1134,15 @@ lw_dist2d_pt_ptarray(const POINT2D *p, POINTARRAY *pa,DISTPTS *dl)
 
 	for (t=1; t<pa->npoints; t++)
 	{
+		if ( screen && (t-1) % LW_SEG_BATCH == 0 )
+			ptarray_dist2d_pt_segs(pa, t-1, FP_MIN(LW_SEG_BATCH, pa->npoints - t), p, dist);
+
 		dl->twisted=twist;
 		end = getPoint2d_cp(pa, t);
-		if (!lw_dist2d_pt_seg(p, start, end, dl)) return LW_FALSE;
+		if ( ! ( screen && dist[(t-1) % LW_SEG_BATCH] > dl->distance ) )
+		{
+			if (!lw_dist2d_pt_seg(p, start, end, dl)) return LW_FALSE;
+		}
 
 		if (dl->distance<=dl->tolerance && dl->mode == DIST_MIN) return LW_TRUE; /*just a check if  the answer is already given*/
 		start = end;
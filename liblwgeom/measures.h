@@ -43,6 +43,8 @@ int lw_dist2d_distribute_bruteforce(LWGEOM *lwg1, LWGEOM *lwg2, DISTPTS *dl);
 int lw_dist2d_recursive(const LWGEOM *lwg1, const LWGEOM *lwg2, DISTPTS *dl);
 int lw_dist2d_check_overlap(LWGEOM *lwg1,LWGEOM *lwg2);
 int lw_dist2d_distribute_fast(LWGEOM *lwg1, LWGEOM *lwg2, DISTPTS *dl);
+int lw_dist2d_tree_applies(const LWGEOM *lwg1, const LWGEOM *lwg2);
+int lw_dist2d_tree(const LWGEOM *lwg1, const LWGEOM *lwg2, DISTPTS *dl);
 
 /*
 * Brute force functions
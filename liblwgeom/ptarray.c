@@ -708,6 +708,9 @@ ptarray_contains_point_partial(const POINTARRAY *pa, const POINT2D *pt, int chec
 	const POINT2D *seg1;
 	const POINT2D *seg2;
 	double ymin, ymax;
+	/* Segments of the current batch worth a look, all of them when not screening */
+	int span = -1;
+	int screen = ( lw_simd_level() != LW_SIMD_NONE );
 
 	seg1 = getPoint2d_cp(pa, 0);
 	seg2 = getPoint2d_cp(pa, pa->npoints-1);
@@ -716,7 +719,28 @@ ptarray_contains_point_partial(const POINTARRAY *pa, const POINT2D *pt, int chec
 	
 	for ( i=1; i < pa->npoints; i++ )
 	{
+		if ( screen && (i-1) % LW_SEG_BATCH == 0 )
+		{
+			int n = FP_MIN(LW_SEG_BATCH, pa->npoints - i);
+			span = ptarray_segs_span_y(pa, i-1, n, pt->y);
+
+			/* Nothing to look at in this batch, on to the next one */
+			if ( ! span )
+			{
+				i += n - 1;
+				seg1 = getPoint2d_cp(pa, i);
+				continue;
+			}
+		}
+
 		seg2 = getPoint2d_cp(pa, i);
+
+		/* Zero length or out of our vertical range, as tested below */
+		if ( ! ( span & (1 << ((i-1) % LW_SEG_BATCH)) ) )
+		{
+			seg1 = seg2;
+			continue;
+		}
 		
 		/* Zero length segments are ignored. */
 		if ( seg1->x == seg2->x && seg1->y == seg2->y )
@@ -0,0 +1,363 @@
+/**********************************************************************
+ *
+ * PostGIS - Spatial Types for PostgreSQL
+ * http://postgis.refractions.net
+ *
+ * This is free software; you can redistribute and/or modify it under
+ * the terms of the GNU General Public Licence. See the COPYING file.
+ *
+ **********************************************************************
+ *
+ * Batched point-to-segment kernels working straight off the point
+ * array buffer, several segments per instruction on x86-64 (SSE2 and,
+ * when the CPU has it, AVX2).
+ *
+ * They are only used to screen segments: every value is computed with
+ * the same operations in the same order as the scalar code, so the
+ * callers can skip the segments that cannot change their answer and
+ * run the scalar code on the rest, getting bitwise identical results.
+ * Where a fused multiply-add could be contracted into either side the
+ * values would no longer match, so the vector code is left out.
+ *
+ **********************************************************************/
+
+#include <math.h>
+
+#include "liblwgeom_internal.h"
+#include "lwgeom_log.h"
+
+#if defined(__GNUC__) && defined(__x86_64__) && ! defined(__FMA__)
+#define HAVE_LW_SSE2 1
+#include <emmintrin.h>
+#if __GNUC__ > 4 || ( __GNUC__ == 4 && __GNUC_MINOR__ >= 9 )
+#define HAVE_LW_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
+/* Level in use, -1 until probed */
+static int lw_simd = -1;
+
+static int
+lw_simd_supported(void)
+{
+#if HAVE_LW_AVX2
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports("avx2") )
+		return LW_SIMD_AVX2;
+#endif
+#if HAVE_LW_SSE2
+	return LW_SIMD_SSE2;
+#else
+	return LW_SIMD_NONE;
+#endif
+}
+
+/**
+* Returns the instruction set the kernels use, the best one the CPU
+* supports unless lowered with lw_simd_set_level().
+*/
+int
+lw_simd_level(void)
+{
+	if ( lw_simd < 0 )
+		lw_simd = lw_simd_supported();
+	return lw_simd;
+}
+
+/**
+* Use at most the given instruction set (LW_SIMD_NONE runs the plain
+* scalar loops). Returns the level actually in use.
+*/
+int
+lw_simd_set_level(int level)
+{
+	int best = lw_simd_supported();
+	lw_simd = ( level < best ? level : best );
+	return lw_simd;
+}
+
+/*
+* Scalar versions, also used for the odd segments at the end of a batch.
+* Mirror lw_dist2d_pt_seg() and lw_dist2d_pt_pt() for DIST_MIN.
+*/
+static inline double
+pt_pt_distance(const POINT2D *p, const POINT2D *q)
+{
+	double hside = q->x - p->x;
+	double vside = q->y - p->y;
+	return sqrt(hside*hside + vside*vside);
+}
+
+static inline double
+pt_seg_distance(const POINT2D *p, const POINT2D *A, const POINT2D *B)
+{
+	POINT2D c;
+	double r;
+
+	if ( A->x == B->x && A->y == B->y )
+		return pt_pt_distance(p, A);
+
+	r = ( (p->x-A->x) * (B->x-A->x) + (p->y-A->y) * (B->y-A->y) )/( (B->x-A->x)*(B->x-A->x) +(B->y-A->y)*(B->y-A->y) );
+
+	if ( r < 0 )
+		return pt_pt_distance(p, A);
+	if ( r >= 1 )
+		return pt_pt_distance(p, B);
+	if ( (A->y-p->y)*(B->x-A->x) == (A->x-p->x)*(B->y-A->y) )
+		return 0.0;
+
+	c.x = A->x + r * (B->x-A->x);
+	c.y = A->y + r * (B->y-A->y);
+	return pt_pt_distance(p, &c);
+}
+
+static inline int
+seg_spans_y(const POINT2D *seg1, const POINT2D *seg2, double y)
+{
+	if ( seg1->x == seg2->x && seg1->y == seg2->y )
+		return LW_FALSE;
+	return ! ( y > FP_MAX(seg1->y, seg2->y) || y < FP_MIN(seg1->y, seg2->y) );
+}
+
+#if HAVE_LW_SSE2
+
+/* Select a where mask is set, b elsewhere */
+static inline __m128d
+sse2_select(__m128d mask, __m128d a, __m128d b)
+{
+	return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+}
+
+static inline __m128d
+sse2_pt_pt_distance(__m128d px, __m128d py, __m128d qx, __m128d qy)
+{
+	__m128d hside = _mm_sub_pd(qx, px);
+	__m128d vside = _mm_sub_pd(qy, py);
+	return _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(hside, hside), _mm_mul_pd(vside, vside)));
+}
+
+static void
+sse2_pt_segs_distance(const double *pts, int stride, int n, const POINT2D *p, double *dist)
+{
+	__m128d px = _mm_set1_pd(p->x);
+	__m128d py = _mm_set1_pd(p->y);
+	__m128d zero = _mm_setzero_pd();
+	__m128d one = _mm_set1_pd(1.0);
+	int k;
+
+	for ( k = 0; k + 2 <= n; k += 2 )
+	{
+		const double *a = pts + k * stride;
+		__m128d p0 = _mm_loadu_pd(a);
+		__m128d p1 = _mm_loadu_pd(a + stride);
+		__m128d p2 = _mm_loadu_pd(a + 2 * stride);
+		__m128d ax = _mm_unpacklo_pd(p0, p1), ay = _mm_unpackhi_pd(p0, p1);
+		__m128d bx = _mm_unpacklo_pd(p1, p2), by = _mm_unpackhi_pd(p1, p2);
+		__m128d abx = _mm_sub_pd(bx, ax), aby = _mm_sub_pd(by, ay);
+		__m128d r, d, onseg;
+
+		r = _mm_div_pd(_mm_add_pd(_mm_mul_pd(_mm_sub_pd(px, ax), abx), _mm_mul_pd(_mm_sub_pd(py, ay), aby)),
+		               _mm_add_pd(_mm_mul_pd(abx, abx), _mm_mul_pd(aby, aby)));
+		onseg = _mm_cmpeq_pd(_mm_mul_pd(_mm_sub_pd(ay, py), abx), _mm_mul_pd(_mm_sub_pd(ax, px), aby));
+
+		/* Projection, then the exits of lw_dist2d_pt_seg from last to first */
+		d = sse2_pt_pt_distance(px, py, _mm_add_pd(ax, _mm_mul_pd(r, abx)), _mm_add_pd(ay, _mm_mul_pd(r, aby)));
+		d = sse2_select(onseg, zero, d);
+		d = sse2_select(_mm_cmpge_pd(r, one), sse2_pt_pt_distance(px, py, bx, by), d);
+		d = sse2_select(_mm_or_pd(_mm_cmplt_pd(r, zero), _mm_and_pd(_mm_cmpeq_pd(ax, bx), _mm_cmpeq_pd(ay, by))),
+		                sse2_pt_pt_distance(px, py, ax, ay), d);
+		_mm_storeu_pd(dist + k, d);
+	}
+	for ( ; k < n; k++ )
+		dist[k] = pt_seg_distance(p, (const POINT2D*)(pts + k * stride), (const POINT2D*)(pts + (k+1) * stride));
+}
+
+static int
+sse2_segs_span_y(const double *pts, int stride, int n, double y)
+{
+	__m128d vy = _mm_set1_pd(y);
+	int mask = 0;
+	int k;
+
+	for ( k = 0; k + 2 <= n; k += 2 )
+	{
+		const double *a = pts + k * stride;
+		__m128d p0 = _mm_loadu_pd(a);
+		__m128d p1 = _mm_loadu_pd(a + stride);
+		__m128d p2 = _mm_loadu_pd(a + 2 * stride);
+		__m128d ax = _mm_unpacklo_pd(p0, p1), ay = _mm_unpackhi_pd(p0, p1);
+		__m128d bx = _mm_unpacklo_pd(p1, p2), by = _mm_unpackhi_pd(p1, p2);
+		__m128d skip;
+
+		skip = _mm_or_pd(_mm_cmpgt_pd(vy, _mm_max_pd(ay, by)), _mm_cmplt_pd(vy, _mm_min_pd(ay, by)));
+		skip = _mm_or_pd(skip, _mm_and_pd(_mm_cmpeq_pd(ax, bx), _mm_cmpeq_pd(ay, by)));
+		mask |= ( ~_mm_movemask_pd(skip) & 0x3 ) << k;
+	}
+	for ( ; k < n; k++ )
+	{
+		if ( seg_spans_y((const POINT2D*)(pts + k * stride), (const POINT2D*)(pts + (k+1) * stride), y) )
+			mask |= 1 << k;
+	}
+	return mask;
+}
+
+#endif /* HAVE_LW_SSE2 */
+
+#if HAVE_LW_AVX2
+
+/* Points k to k+3 as x and y vectors */
+__attribute__((target("avx2"))) static inline void
+avx2_load_points(const double *pts, int stride, __m256d *x, __m256d *y)
+{
+	__m256d a = _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_loadu_pd(pts)), _mm_loadu_pd(pts + 2 * stride), 1);
+	__m256d b = _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_loadu_pd(pts + stride)), _mm_loadu_pd(pts + 3 * stride), 1);
+	*x = _mm256_unpacklo_pd(a, b);
+	*y = _mm256_unpackhi_pd(a, b);
+}
+
+__attribute__((target("avx2"))) static inline __m256d
+avx2_pt_pt_distance(__m256d px, __m256d py, __m256d qx, __m256d qy)
+{
+	__m256d hside = _mm256_sub_pd(qx, px);
+	__m256d vside = _mm256_sub_pd(qy, py);
+	return _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(hside, hside), _mm256_mul_pd(vside, vside)));
+}
+
+__attribute__((target("avx2"))) static void
+avx2_pt_segs_distance(const double *pts, int stride, int n, const POINT2D *p, double *dist)
+{
+	__m256d px = _mm256_set1_pd(p->x);
+	__m256d py = _mm256_set1_pd(p->y);
+	__m256d zero = _mm256_setzero_pd();
+	__m256d one = _mm256_set1_pd(1.0);
+	int k;
+
+	for ( k = 0; k + 4 <= n; k += 4 )
+	{
+		__m256d ax, ay, bx, by, abx, aby, r, d, onseg, before;
+
+		avx2_load_points(pts + k * stride, stride, &ax, &ay);
+		avx2_load_points(pts + (k+1) * stride, stride, &bx, &by);
+		abx = _mm256_sub_pd(bx, ax);
+		aby = _mm256_sub_pd(by, ay);
+
+		r = _mm256_div_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_sub_pd(px, ax), abx), _mm256_mul_pd(_mm256_sub_pd(py, ay), aby)),
+		                  _mm256_add_pd(_mm256_mul_pd(abx, abx), _mm256_mul_pd(aby, aby)));
+		onseg = _mm256_cmp_pd(_mm256_mul_pd(_mm256_sub_pd(ay, py), abx), _mm256_mul_pd(_mm256_sub_pd(ax, px), aby), _CMP_EQ_OQ);
+		before = _mm256_or_pd(_mm256_cmp_pd(r, zero, _CMP_LT_OQ),
+		                      _mm256_and_pd(_mm256_cmp_pd(ax, bx, _CMP_EQ_OQ), _mm256_cmp_pd(ay, by, _CMP_EQ_OQ)));
+
+		/* Projection, then the exits of lw_dist2d_pt_seg from last to first */
+		d = avx2_pt_pt_distance(px, py, _mm256_add_pd(ax, _mm256_mul_pd(r, abx)), _mm256_add_pd(ay, _mm256_mul_pd(r, aby)));
+		d = _mm256_blendv_pd(d, zero, onseg);
+		d = _mm256_blendv_pd(d, avx2_pt_pt_distance(px, py, bx, by), _mm256_cmp_pd(r, one, _CMP_GE_OQ));
+		d = _mm256_blendv_pd(d, avx2_pt_pt_distance(px, py, ax, ay), before);
+		_mm256_storeu_pd(dist + k, d);
+	}
+	if ( k < n )
+		sse2_pt_segs_distance(pts + k * stride, stride, n - k, p, dist + k);
+}
+
+__attribute__((target("avx2"))) static int
+avx2_segs_span_y(const double *pts, int stride, int n, double y)
+{
+	__m256d vy = _mm256_set1_pd(y);
+	int mask = 0;
+	int k;
+
+	for ( k = 0; k + 4 <= n; k += 4 )
+	{
+		__m256d ax, ay, bx, by, skip;
+
+		avx2_load_points(pts + k * stride, stride, &ax, &ay);
+		avx2_load_points(pts + (k+1) * stride, stride, &bx, &by);
+
+		skip = _mm256_or_pd(_mm256_cmp_pd(vy, _mm256_max_pd(ay, by), _CMP_GT_OQ),
+		                    _mm256_cmp_pd(vy, _mm256_min_pd(ay, by), _CMP_LT_OQ));
+		skip = _mm256_or_pd(skip, _mm256_and_pd(_mm256_cmp_pd(ax, bx, _CMP_EQ_OQ), _mm256_cmp_pd(ay, by, _CMP_EQ_OQ)));
+		mask |= ( ~_mm256_movemask_pd(skip) & 0xf ) << k;
+	}
+	if ( k < n )
+		mask |= sse2_segs_span_y(pts + k * stride, stride, n - k, y) << k;
+	return mask;
+}
+
+#endif /* HAVE_LW_AVX2 */
+
+/**
+* Fill dist with the distances from p to the n (up to LW_SEG_BATCH)
+* segments of pa starting at vertex first, as lw_dist2d_pt_seg() would
+* find them looking for the minimum. Zero stands for p on the segment.
+*/
+void
+ptarray_dist2d_pt_segs(const POINTARRAY *pa, int first, int n, const POINT2D *p, double *dist)
+{
+	const double *pts;
+	int stride = FLAGS_NDIMS(pa->flags);
+	int k;
+
+	if ( first < 0 || n < 1 || n > LW_SEG_BATCH || first + n >= pa->npoints )
+	{
+		lwerror("ptarray_dist2d_pt_segs: segments %d to %d out of range", first, first + n);
+		return;
+	}
+	pts = (const double*)getPoint_internal(pa, first);
+
+	switch ( lw_simd_level() )
+	{
+#if HAVE_LW_AVX2
+	case LW_SIMD_AVX2:
+		avx2_pt_segs_distance(pts, stride, n, p, dist);
+		return;
+#endif
+#if HAVE_LW_SSE2
+	case LW_SIMD_SSE2:
+		sse2_pt_segs_distance(pts, stride, n, p, dist);
+		return;
+#endif
+	default:
+		for ( k = 0; k < n; k++ )
+			dist[k] = pt_seg_distance(p, (const POINT2D*)(pts + k * stride), (const POINT2D*)(pts + (k+1) * stride));
+	}
+}
+
+/**
+* Returns a mask with bit k set when segment first+k of pa is not zero
+* length and spans y, that is when ptarray_contains_point() needs to
+* look at it. Works on up to LW_SEG_BATCH segments.
+*/
+int
+ptarray_segs_span_y(const POINTARRAY *pa, int first, int n, double y)
+{
+	const double *pts;
+	int stride = FLAGS_NDIMS(pa->flags);
+	int mask = 0;
+	int k;
+
+	if ( first < 0 || n < 1 || n > LW_SEG_BATCH || first + n >= pa->npoints )
+	{
+		lwerror("ptarray_segs_span_y: segments %d to %d out of range", first, first + n);
+		return 0;
+	}
+	pts = (const double*)getPoint_internal(pa, first);
+
+	switch ( lw_simd_level() )
+	{
+#if HAVE_LW_AVX2
+	case LW_SIMD_AVX2:
+		return avx2_segs_span_y(pts, stride, n, y);
+#endif
+#if HAVE_LW_SSE2
+	case LW_SIMD_SSE2:
+		return sse2_segs_span_y(pts, stride, n, y);
+#endif
+	default:
+		for ( k = 0; k < n; k++ )
+		{
+			if ( seg_spans_y((const POINT2D*)(pts + k * stride), (const POINT2D*)(pts + (k+1) * stride), y) )
+				mask |= 1 << k;
+		}
+		return mask;
+	}
+}
@@ -0,0 +1,84 @@
+/**********************************************************************
+ *
+ * PostGIS - Spatial Types for PostgreSQL
+ * http://postgis.refractions.net
+ *
+ * This is free software; you can redistribute and/or modify it under
+ * the terms of the GNU General Public Licence. See the COPYING file.
+ *
+ **********************************************************************/
+
+#include "liblwgeom_internal.h"
+#include "varint.h"
+
+/**
+* Write val into buf, which must have room for VARINT_MAX_SIZE
+* bytes. Returns the number of bytes written.
+*/
+size_t
+varint_u64_encode_buf(uint64_t val, uint8_t *buf)
+{
+	uint8_t *ptr = buf;
+
+	while ( val > 0x7F )
+	{
+		*ptr++ = (uint8_t)(val & 0x7F) | 0x80;
+		val >>= 7;
+	}
+	*ptr++ = (uint8_t)val;
+	return ptr - buf;
+}
+
+size_t
+varint_s64_encode_buf(int64_t val, uint8_t *buf)
+{
+	return varint_u64_encode_buf(zigzag64(val), buf);
+}
+
+/**
+* Read a value starting at the_start, never looking at the_end or
+* beyond. The number of bytes used is put in size.
+*/
+uint64_t
+varint_u64_decode(const uint8_t *the_start, const uint8_t *the_end, size_t *size)
+{
+	const uint8_t *ptr = the_start;
+	uint64_t val = 0;
+	int shift = 0;
+
+	while ( ptr < the_end )
+	{
+		uint8_t b = *ptr++;
+		val |= (uint64_t)(b & 0x7F) << shift;
+		if ( ! (b & 0x80) )
+		{
+			*size = ptr - the_start;
+			return val;
+		}
+		shift += 7;
+		if ( shift > 63 )
+			break;
+	}
+
+	lwerror("varint_u64_decode: varint is truncated or too long");
+	*size = ptr - the_start;
+	return 0;
+}
+
+int64_t
+varint_s64_decode(const uint8_t *the_start, const uint8_t *the_end, size_t *size)
+{
+	return unzigzag64(varint_u64_decode(the_start, the_end, size));
+}
+
+uint64_t
+zigzag64(int64_t val)
+{
+	return (((uint64_t)val) << 1) ^ (uint64_t)(val >> 63);
+}
+
+int64_t
+unzigzag64(uint64_t val)
+{
+	return (int64_t)(val >> 1) ^ -(int64_t)(val & 1);
+}
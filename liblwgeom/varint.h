@@ -0,0 +1,35 @@
+/**********************************************************************
+ *
+ * PostGIS - Spatial Types for PostgreSQL
+ * http://postgis.refractions.net
+ *
+ * This is free software; you can redistribute and/or modify it under
+ * the terms of the GNU General Public Licence. See the COPYING file.
+ *
+ **********************************************************************
+ *
+ * Variable length integers, seven bits to a byte with the high bit
+ * set on all but the last byte, and zig-zag mapping of signed values
+ * so that small negative numbers stay short too.
+ *
+ **********************************************************************/
+
+#ifndef _LIBLWGEOM_VARINT_H
+#define _LIBLWGEOM_VARINT_H 1
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Longest encoding of a 64-bit value */
+#define VARINT_MAX_SIZE 10
+
+size_t varint_u64_encode_buf(uint64_t val, uint8_t *buf);
+size_t varint_s64_encode_buf(int64_t val, uint8_t *buf);
+
+uint64_t varint_u64_decode(const uint8_t *the_start, const uint8_t *the_end, size_t *size);
+int64_t varint_s64_decode(const uint8_t *the_start, const uint8_t *the_end, size_t *size);
+
+uint64_t zigzag64(int64_t val);
+int64_t unzigzag64(uint64_t val);
+
+#endif /* !defined _LIBLWGEOM_VARINT_H */
@@ -18,6 +18,7 @@
 #include "../postgis_config.h"
 
 #include "liblwgeom.h"         /* For standard geometry types. */
+#include "liblwgeom_internal.h"  /* For gserialized_read_gbox_p */
 #include "lwgeom_pg.h"       /* For debugging macros. */
 #include "gserialized_gist.h"
 
@@ -81,6 +82,45 @@ gserialized_datum_get_gbox_p(Datum gsdatum, GBOX *gbox)
 	return LW_SUCCESS;
 }
 
+/**
+* Given a #GSERIALIZED datum, return the same box gserialized_get_gbox_p()
+* would return for the detoasted object, and optionally its SRID. The box
+* (cached, or that of a point or two-point line) and the SRID sit at the
+* top of the serialization, so only a slice of the datum is detoasted;
+* boxless objects are detoasted in full so the box can be calculated.
+* Returns #LW_FAILURE for empty geometries.
+*/
+int
+gserialized_datum_peek_gbox_p(Datum gsdatum, GBOX *gbox, int32_t *srid)
+{
+	GSERIALIZED *gpart, *g;
+	int result;
+
+	/*
+	** 8 bytes of header, then either the 32 bytes of an XYZM float box or
+	** the type, point count and 2 XYZM vertices of a boxless two-point line.
+	*/
+	gpart = (GSERIALIZED*)PG_DETOAST_DATUM_SLICE(gsdatum, 0, 16 + 8 * sizeof(double));
+
+	if ( srid )
+		*srid = gserialized_get_srid(gpart);
+
+	result = gserialized_read_gbox_p(gpart, gbox);
+	if ( result == LW_FAILURE )
+	{
+		POSTGIS_DEBUG(4, "no box in the slice, detoasting the whole object");
+		g = (GSERIALIZED*)PG_DETOAST_DATUM(gsdatum);
+		result = gserialized_get_gbox_p(g, gbox);
+		if ( (Pointer)g != DatumGetPointer(gsdatum) )
+			pfree(g);
+	}
+
+	if ( (Pointer)gpart != DatumGetPointer(gsdatum) )
+		pfree(gpart);
+
+	return result;
+}
+
 
 /**
 * Update the bounding box of a #GSERIALIZED, allocating a fresh one
@@ -99,3 +99,4 @@ GSERIALIZED* gserialized_drop_gidx(GSERIALIZED *g);
 
 
 
+
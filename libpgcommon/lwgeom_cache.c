@@ -12,6 +12,8 @@
 
 #include "postgres.h"
 #include "fmgr.h"
+#include "access/hash.h"
+#include "portability/instr_time.h"
 
 #include "../postgis_config.h"
 #include "lwgeom_cache.h"
@@ -22,8 +24,9 @@
 * 
 *   geometries-with-trees
 *      PreparedGeometry, RTree, CIRC_TREE, RECT_TREE
-*   srids-with-projections
-*      projPJ
+* 
+* (srid-to-projPJ lookups live in a backend-lifetime
+* hash of their own, see lwgeom_transform.c)
 * 
 * Each GenericCache* has a type, and after that
 * some data. Similar to generic LWGEOM*. Test that
@@ -36,17 +39,51 @@ typedef struct {
 } GenericCache;
 
 /* 
-* Although there are only two basic kinds of 
-* cache entries, the actual trees stored in the
-* geometries-with-trees pattern are quite diverse,
-* and they might be used in combination, so we have 
-* one slot for each tree type as well as a slot for
-* projections.
+* The actual trees stored in the geometries-with-trees
+* pattern are quite diverse, and they might be used in 
+* combination, so we have one slot for each tree type.
 */
 typedef struct {
 	GenericCache* entry[NUM_CACHE_ENTRIES];
 } GenericCacheCollection;
 
+/*
+* The geometries-with-trees entries hold a set of slots
+* rather than a single GeomCache, so that joins cycling
+* through a few geometries on one side find each of them
+* still indexed. Every slot has one key geometry and the 
+* type-specific GeomCache holding its index, plus a cheap 
+* hash of the key, so most non-matching slots are passed 
+* over without comparing whole serializations.
+*/
+typedef struct {
+	GeomCache*   cache;     /* NULL until the slot is first used */
+	uint32       hash;      /* GeomCacheKeyHash() of cache->geom */
+	uint32       last_used; /* GeomCacheSet clock at the last hit */
+	int          built;     /* 1 = index built, -1 = build failed, 0 = not tried */
+} GeomCacheSlot;
+
+typedef struct {
+	int              type;
+	int              nslots;
+	uint32           clock;
+#if POSTGIS_PGSQL_VERSION >= 95
+	MemoryContextCallback callback; /* Gives back the bytes held at statement end */
+#endif
+	GeomCacheSlot    slot[1]; /* nslots long */
+} GeomCacheSet;
+
+/* Number of slots in newly created GeomCacheSets, see postgis.geom_cache_size */
+int geom_cache_size = GEOM_CACHE_SIZE_DEFAULT;
+
+/* Backend counters for each cache type */
+CacheStats geom_cache_stats[NUM_CACHE_ENTRIES];
+
+/* Bytes hashed from the start of a key: header, bbox and first coordinates */
+#define GEOM_CACHE_HASH_HEAD 64
+/* Number of 8-byte words sampled evenly from the rest of a key */
+#define GEOM_CACHE_HASH_SAMPLES 16
+
 /**
 * Utility function to read the upper memory context off a function call 
 * info data.
@@ -77,151 +114,277 @@ GetGenericCacheCollection(FunctionCallInfoData* fcinfo)
 	
 
 /**
-* Get the Proj4 entry from the generic cache if one exists.
-* If it doesn't exist, make a new empty one and return it.
+* Cheap hash of a cache key. Small keys are hashed whole; for large
+* ones we hash the size (part of the varlena header), the bounding 
+* box and some leading coordinates, plus a fixed number of words
+* sampled along the rest of the serialization. Equal hashes still
+* need a memcmp to confirm a match.
+*/
+static uint32
+GeomCacheKeyHash(const GSERIALIZED* g)
+{
+	const uint8* bytes = (const uint8*)g;
+	size_t size = VARSIZE(g);
+	uint8 buf[GEOM_CACHE_HASH_HEAD + 8 * GEOM_CACHE_HASH_SAMPLES];
+	size_t step;
+	int i;
+
+	if ( size <= sizeof(buf) )
+		return DatumGetUInt32(hash_any(bytes, size));
+
+	memcpy(buf, bytes, GEOM_CACHE_HASH_HEAD);
+	/* Samples run from just after the head up to the last word */
+	step = (size - GEOM_CACHE_HASH_HEAD - 8) / (GEOM_CACHE_HASH_SAMPLES - 1);
+	for ( i = 0; i < GEOM_CACHE_HASH_SAMPLES; i++ )
+		memcpy(buf + GEOM_CACHE_HASH_HEAD + 8 * i, bytes + GEOM_CACHE_HASH_HEAD + step * i, 8);
+
+	return DatumGetUInt32(hash_any(buf, sizeof(buf)));
+}
+
+/**
+* Zero the counters, but keep the bytes held: those keys are
+* still in the cache and will be taken off when dropped.
+*/
+void
+CacheStatsReset(CacheStats* stats)
+{
+	int64 bytes = stats->bytes;
+	memset(stats, 0, sizeof(CacheStats));
+	stats->bytes = bytes;
+}
+
+#if POSTGIS_PGSQL_VERSION >= 95
+/**
+* Called when the statement memory holding a GeomCacheSet goes
+* away, to take its keys off the bytes held.
 */
-PROJ4PortalCache*
-GetPROJ4SRSCache(FunctionCallInfoData* fcinfo)
+static void
+GeomCacheSetRelease(void* arg)
+{
+	GeomCacheSet* set = (GeomCacheSet*)arg;
+	int i;
+
+	for ( i = 0; i < set->nslots; i++ )
+	{
+		if ( set->slot[i].cache && set->slot[i].cache->geom )
+			geom_cache_stats[set->type].bytes -= set->slot[i].cache->geom_size;
+	}
+}
+#endif
+
+/**
+* Get the GeomCacheSet for a cache type off the generic cache, 
+* allocating an empty one if we don't have one already.
+*/
+static GeomCacheSet*
+GetGeomCacheSet(FunctionCallInfoData* fcinfo, int entry_number)
 {
 	GenericCacheCollection* generic_cache = GetGenericCacheCollection(fcinfo);
-	PROJ4PortalCache* cache = (PROJ4PortalCache*)(generic_cache->entry[PROJ_CACHE_ENTRY]);
+	GeomCacheSet* set = (GeomCacheSet*)(generic_cache->entry[entry_number]);
 	
-	if ( ! cache )
+	if ( ! set )
 	{
+		int nslots = geom_cache_size;
+		size_t set_size;
+
+		if ( nslots < GEOM_CACHE_SIZE_MIN ) nslots = GEOM_CACHE_SIZE_MIN;
+		if ( nslots > GEOM_CACHE_SIZE_MAX ) nslots = GEOM_CACHE_SIZE_MAX;
+
 		/* Allocate in the upper context */
-		cache = MemoryContextAlloc(FIContext(fcinfo), sizeof(PROJ4PortalCache));
+		set_size = sizeof(GeomCacheSet) + (nslots - 1) * sizeof(GeomCacheSlot);
+		set = MemoryContextAlloc(FIContext(fcinfo), set_size);
+		memset(set, 0, set_size);
+		set->type = entry_number;
+		set->nslots = nslots;
+#if POSTGIS_PGSQL_VERSION >= 95
+		set->callback.func = GeomCacheSetRelease;
+		set->callback.arg = set;
+		MemoryContextRegisterResetCallback(FIContext(fcinfo), &(set->callback));
+#endif
 
-		if (cache)
+		POSTGIS_DEBUGF(3, "Allocated GeomCacheSet type %d with %d slots", entry_number, nslots);
+
+		/* Store the pointer in GenericCache */
+		generic_cache->entry[entry_number] = (GenericCache*)set;
+	}
+	return set;
+}
+
+/**
+* Find the slot holding a copy of g, or NULL if there is none.
+*/
+static GeomCacheSlot*
+GeomCacheSetFind(GeomCacheSet* set, const GSERIALIZED* g, uint32 hash)
+{
+	size_t size = VARSIZE(g);
+	int i;
+
+	for ( i = 0; i < set->nslots; i++ )
+	{
+		GeomCacheSlot* slot = &(set->slot[i]);
+		if ( slot->cache && slot->cache->geom &&
+		     slot->hash == hash &&
+		     slot->cache->geom_size == size &&
+		     memcmp(slot->cache->geom, g, size) == 0 )
 		{
-			int i;
-
-			POSTGIS_DEBUGF(3, "Allocating PROJ4Cache for portal with transform() MemoryContext %p", FIContext(fcinfo));
-			/* Put in any required defaults */
-			for (i = 0; i < PROJ4_CACHE_ITEMS; i++)
-			{
-				cache->PROJ4SRSCache[i].srid = SRID_UNKNOWN;
-				cache->PROJ4SRSCache[i].projection = NULL;
-				cache->PROJ4SRSCache[i].projection_mcxt = NULL;
-			}
-			cache->type = PROJ_CACHE_ENTRY;
-			cache->PROJ4SRSCacheCount = 0;
-			cache->PROJ4SRSCacheContext = FIContext(fcinfo);
-
-			/* Store the pointer in GenericCache */
-			generic_cache->entry[PROJ_CACHE_ENTRY] = (GenericCache*)cache;
+			return slot;
 		}
 	}
-	return cache;
+	return NULL;
+}
+
+/**
+* Copy g into the least recently used slot, freeing whatever
+* index the previous occupant had.
+*/
+static void
+GeomCacheSetInsert(FunctionCallInfoData* fcinfo, GeomCacheSet* set, const GeomCacheMethods* cache_methods, const GSERIALIZED* g, uint32 hash)
+{
+	GeomCacheSlot* slot = &(set->slot[0]);
+	CacheStats* stats = &(geom_cache_stats[set->type]);
+	int i;
+
+	for ( i = 1; i < set->nslots && slot->cache; i++ )
+	{
+		if ( ! set->slot[i].cache || set->slot[i].last_used < slot->last_used )
+			slot = &(set->slot[i]);
+	}
+
+	if ( ! slot->cache )
+	{
+		MemoryContext old_context = MemoryContextSwitchTo(FIContext(fcinfo));
+		/* Allocate in the upper context */
+		slot->cache = cache_methods->GeomCacheAllocator();
+		MemoryContextSwitchTo(old_context);
+		slot->cache->type = cache_methods->entry_number;
+	}
+	else
+	{
+		/* Evicting a built index? Free it. */
+		if ( slot->built == 1 )
+			cache_methods->GeomIndexFreer(slot->cache);
+		if ( slot->cache->geom ) 
+		{
+			stats->bytes -= slot->cache->geom_size;
+			stats->evictions++;
+			pfree(slot->cache->geom);
+		}
+	}
+
+	slot->cache->argnum = 0;
+	slot->cache->geom_size = VARSIZE(g);
+	slot->cache->geom = MemoryContextAlloc(FIContext(fcinfo), slot->cache->geom_size);
+	memcpy(slot->cache->geom, g, slot->cache->geom_size);
+	stats->bytes += slot->cache->geom_size;
+	slot->hash = hash;
+	slot->built = 0;
+	slot->last_used = set->clock;
 }
 
 /**
 * Get an appropriate (based on the entry type number) 
 * GeomCache entry from the generic cache if one exists.
 * Returns a cache pointer if there is a cache hit and we have an
-* index built and ready to use. Returns NULL otherwise.
+* index built and ready to use, with argnum set to the argument
+* (1 or 2) the index belongs to. Returns NULL otherwise.
+*
+* Indexes are only built the second time a geometry is seen,
+* so one-off arguments just cost a copy into the cache.
 */
 GeomCache*            
 GetGeomCache(FunctionCallInfoData* fcinfo, const GeomCacheMethods* cache_methods, const GSERIALIZED* g1, const GSERIALIZED* g2)
 {
-	GeomCache* cache;
+	GeomCacheSet* set;
+	GeomCacheSlot* slot = NULL;
+	CacheStats* stats;
 	int cache_hit = 0;
-	MemoryContext old_context;
-	const GSERIALIZED *geom;
-	GenericCacheCollection* generic_cache = GetGenericCacheCollection(fcinfo);
+	uint32 hash1 = 0;
+	uint32 hash2 = 0;
 	int entry_number = cache_methods->entry_number;
 	
 	Assert(entry_number >= 0);
 	Assert(entry_number < NUM_CACHE_ENTRIES);
 	
-	cache = (GeomCache*)(generic_cache->entry[entry_number]);
-	
-	if ( ! cache )
-	{
-		old_context = MemoryContextSwitchTo(FIContext(fcinfo));
-		/* Allocate in the upper context */
-		cache = cache_methods->GeomCacheAllocator();
-		MemoryContextSwitchTo(old_context);
-		/* Store the pointer in GenericCache */
-		cache->type = entry_number;
-		generic_cache->entry[entry_number] = (GenericCache*)cache;
-	}	
+	set = GetGeomCacheSet(fcinfo, entry_number);
+	set->clock++;
+	stats = &(geom_cache_stats[entry_number]);
+	stats->lookups++;
 
 	/* Cache hit on the first argument */
-	if ( g1 &&
-	     cache->argnum != 2 &&
-	     cache->geom1_size == VARSIZE(g1) &&
-	     memcmp(cache->geom1, g1, cache->geom1_size) == 0 )
+	if ( g1 )
 	{
-		cache_hit = 1;
-		geom = cache->geom1;
-
+		hash1 = GeomCacheKeyHash(g1);
+		slot = GeomCacheSetFind(set, g1, hash1);
+		if ( slot ) 
+			cache_hit = 1;
 	}
 	/* Cache hit on second argument */
-	else if ( g2 &&
-	          cache->argnum != 1 &&
-	          cache->geom2_size == VARSIZE(g2) &&
-	          memcmp(cache->geom2, g2, cache->geom2_size) == 0 )
+	if ( ! slot && g2 )
 	{
-		cache_hit = 2;
-		geom = cache->geom2;
+		hash2 = GeomCacheKeyHash(g2);
+		slot = GeomCacheSetFind(set, g2, hash2);
+		if ( slot ) 
+			cache_hit = 2;
 	}
-	/* No cache hit. If we have a tree, free it. */
-	else
+
+	/* No cache hit. Remember the arguments for next time. */
+	if ( ! slot )
 	{
-		cache_hit = 0;
-		if ( cache->argnum )
-		{
-			cache_methods->GeomIndexFreer(cache);
-			cache->argnum = 0;
-		}
+		if ( g1 )
+			GeomCacheSetInsert(fcinfo, set, cache_methods, g1, hash1);
+		/* Don't waste a slot on a second copy of the same geometry */
+		if ( g2 && ! ( g1 && hash1 == hash2 && GeomCacheSetFind(set, g2, hash2) ) )
+			GeomCacheSetInsert(fcinfo, set, cache_methods, g2, hash2);
+		return NULL;
 	}
 
+	slot->last_used = set->clock;
+	stats->hits[cache_hit - 1]++;
+
 	/* Cache hit, but no tree built yet, build it! */
-	if ( cache_hit && ! cache->argnum )
+	if ( slot->built == 0 )
 	{
 		int rv;
-		LWGEOM *lwgeom = lwgeom_from_gserialized(geom);
+		MemoryContext old_context;
+		instr_time start_time, end_time;
+		LWGEOM *lwgeom = lwgeom_from_gserialized(slot->cache->geom);
 
 		/* Can't build a tree on a NULL or empty */
 		if ( (!lwgeom) || lwgeom_is_empty(lwgeom) )
+		{
+			slot->built = -1;
 			return NULL;
+		}
 
+		INSTR_TIME_SET_CURRENT(start_time);
 		old_context = MemoryContextSwitchTo(FIContext(fcinfo));
-		rv = cache_methods->GeomIndexBuilder(lwgeom, cache);
+		slot->cache->argnum = 0;
+		rv = cache_methods->GeomIndexBuilder(lwgeom, slot->cache);
 		MemoryContextSwitchTo(old_context);
-		cache->argnum = cache_hit;
+		INSTR_TIME_SET_CURRENT(end_time);
+		INSTR_TIME_SUBTRACT(end_time, start_time);
+		stats->build_ms += INSTR_TIME_GET_MILLISEC(end_time);
 
-		/* Something went awry in the tree build phase */
+		/* Something went awry in the tree build phase, don't try again */
 		if ( ! rv )
 		{
-			cache->argnum = 0;
+			POSTGIS_DEBUGF(3, "GeomCache type %d failed to build index", entry_number);
+			cache_methods->GeomIndexFreer(slot->cache);
+			slot->cache->argnum = 0;
+			slot->built = -1;
+			stats->build_failures++;
 			return NULL;
 		}
-
+		slot->built = 1;
+		stats->builds++;
 	}
 
 	/* We have a hit and a calculated tree, we're done */
-	if ( cache_hit && cache->argnum )
-		return cache;
-
-	/* Argument one didn't match, so copy the new value in. */
-	if ( g1 && cache_hit != 1 )
-	{
-		if ( cache->geom1 ) pfree(cache->geom1);
-		cache->geom1_size = VARSIZE(g1);
-		cache->geom1 = MemoryContextAlloc(FIContext(fcinfo), cache->geom1_size);
-		memcpy(cache->geom1, g1, cache->geom1_size);
-	}
-	/* Argument two didn't match, so copy the new value in. */
-	if ( g2 && cache_hit != 2 )
+	if ( slot->built == 1 )
 	{
-		if ( cache->geom2 ) pfree(cache->geom2);
-		cache->geom2_size = VARSIZE(g2);
-		cache->geom2 = MemoryContextAlloc(FIContext(fcinfo), cache->geom2_size);
-		memcpy(cache->geom2, g2, cache->geom2_size);
+		slot->cache->argnum = cache_hit;
+		return slot->cache;
 	}
 
 	return NULL;
 }
-
-
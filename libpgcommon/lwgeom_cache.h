@@ -21,7 +21,6 @@
 #include "lwgeom_pg.h"
 
 
-#define PROJ_CACHE_ENTRY 0
 #define PREP_CACHE_ENTRY 1
 #define RTREE_CACHE_ENTRY 2
 #define CIRC_CACHE_ENTRY 3
@@ -32,59 +31,35 @@
 
 /* 
 * A generic GeomCache just needs space for the cache type,
-* the cache keys (GSERIALIZED geometries), the key sizes, 
-* and the argument number the cached index/tree is going
-* to refer to.
+* the cache key (a GSERIALIZED geometry), the key size, 
+* and the argument number the cached index/tree was found
+* for on the current call.
 */
 typedef struct {
 	int                         type;
-	GSERIALIZED*                geom1;
-	GSERIALIZED*                geom2;
-	size_t                      geom1_size;
-	size_t                      geom2_size;
+	GSERIALIZED*                geom;
+	size_t                      geom_size;
 	int32                       argnum; 
 } GeomCache;
 
 /*
-* Other specific geometry cache types are the 
-* RTreeGeomCache - lwgeom_rtree.h
-* PrepGeomCache - lwgeom_geos_prepared.h
+* Each cache type keeps this many geometries (and their
+* indexes) per statement, recycling the least recently
+* used one. Set with the postgis.geom_cache_size GUC.
 */
+#define GEOM_CACHE_SIZE_DEFAULT 8
+#define GEOM_CACHE_SIZE_MIN 2
+#define GEOM_CACHE_SIZE_MAX 256
 
-/* 
-* Proj4 caching has it's own mechanism, but is 
-* integrated into the generic caching system because
-* some geography functions make cached SRID lookup
-* calls and also CircTree accelerated calls, so 
-* there needs to be a management object on 
-* fcinfo->flinfo->fn_extra to avoid collisions.
-*/
-
-/* An entry in the PROJ4 SRS cache */
-typedef struct struct_PROJ4SRSCacheItem
-{
-	int srid;
-	projPJ projection;
-	MemoryContext projection_mcxt;
-}
-PROJ4SRSCacheItem;
-
-/* PROJ 4 lookup transaction cache methods */
-#define PROJ4_CACHE_ITEMS	8
+extern int geom_cache_size;
 
 /*
-* The proj4 cache holds a fixed number of reprojection
-* entries. In normal usage we don't expect it to have
-* many entries, so we always linearly scan the list.
+* Other specific geometry cache types are the 
+* RTreeGeomCache - lwgeom_rtree.h
+* PrepGeomCache - lwgeom_geos_prepared.h
+* CircTreeGeomCache - geography_measurement_trees.c
+* RectTreeGeomCache - lwgeom_rectree.c
 */
-typedef struct struct_PROJ4PortalCache
-{
-	int type;
-	PROJ4SRSCacheItem PROJ4SRSCache[PROJ4_CACHE_ITEMS];
-	int PROJ4SRSCacheCount;
-	MemoryContext PROJ4SRSCacheContext;
-}
-PROJ4PortalCache;
 
 /**
 * Generic signature for functions to manage a geometry
@@ -98,10 +73,30 @@ typedef struct
 	GeomCache* (*GeomCacheAllocator)(void); /* Allocate the kind of cache object you use (GeomCache+some extra space) */
 } GeomCacheMethods;
 
+/*
+* Per-backend counters of a cache, summed over all the statements
+* since the backend started or the counters were last reset.
+* Shown by postgis_cache_stats().
+*/
+typedef struct {
+	uint64 lookups;        /* Cache lookups */
+	uint64 hits[2];        /* Lookups finding the first, second argument */
+	uint64 builds;         /* Indexes (or projections) built */
+	uint64 build_failures; /* Builds that failed and won't be retried */
+	double build_ms;       /* Time spent building, in milliseconds */
+	int64  bytes;          /* Size of the keys currently held */
+	uint64 evictions;      /* Keys dropped from the cache */
+} CacheStats;
+
+/* Counters of the geometry caches, by entry number */
+extern CacheStats geom_cache_stats[NUM_CACHE_ENTRIES];
+
+/* Zero the counters of a cache, except for the bytes still held */
+void CacheStatsReset(CacheStats* stats);
+
 /* 
 * Cache retrieval functions
 */
-PROJ4PortalCache*  GetPROJ4SRSCache(FunctionCallInfoData *fcinfo);
-GeomCache*         GetGeomCache(FunctionCallInfoData *fcinfo, const GeomCacheMethods* cache_methods, const GSERIALIZED* g1, const GSERIALIZED* g2);
+GeomCache* GetGeomCache(FunctionCallInfoData *fcinfo, const GeomCacheMethods* cache_methods, const GSERIALIZED* g1, const GSERIALIZED* g2);
 
 #endif /* LWGEOM_CACHE_H_ */
@@ -105,6 +105,13 @@ GSERIALIZED* geography_serialize(LWGEOM *lwgeom);
 */
 int gserialized_datum_get_gbox_p(Datum gsdatum, GBOX *gbox);
 
+/**
+* Read the same (float-rounded) box gserialized_get_gbox_p() would, and
+* the SRID if srid is not NULL, detoasting only a slice of the datum
+* unless the box has to be calculated. Fails on empty.
+*/
+int gserialized_datum_peek_gbox_p(Datum gsdatum, GBOX *gbox, int32_t *srid);
+
 /**
 * Convert cstrings (null-terminated byte array) to textp pointers 
 * (PgSQL varlena structure with VARSIZE header).
@@ -16,9 +16,12 @@
 #include "fmgr.h"
 #include "miscadmin.h"
 #include "utils/memutils.h"
+#include "utils/inval.h"
 #include "executor/spi.h"
 #include "access/hash.h"
+#include "catalog/namespace.h"
 #include "utils/hsearch.h"
+#include "portability/instr_time.h"
 
 /* PostGIS headers */
 #include "../postgis_config.h"
@@ -40,289 +43,296 @@ int pj_transform_nodatum(projPJ srcdefn, projPJ dstdefn, long point_count, int p
 
 /*
  * PROJ 4 backend hash table initial hash size
- * (since 16 is the default portal hash table size, and we would
- * typically have 2 entries per portal
- * then we shall use a default size of 32)
+ * (most databases only ever transform between a handful
+ * of SRIDs, so this rarely needs to grow)
  */
 #define PROJ4_BACKEND_HASH_SIZE	32
 
+/*
+ * Upper bound on the number of projections kept by a backend.
+ * Once reached the whole cache is flushed and refilled on demand,
+ * which keeps memory bounded for callers cycling through many
+ * SRIDs without any per-lookup bookkeeping.
+ */
+#define PROJ4_BACKEND_CACHE_MAX	1024
+
 
 /**
  * Backend projPJ hash table
  *
- * This hash table stores a key/value pair of MemoryContext/projPJ objects.
- * Whenever we create a projPJ object using pj_init(), we create a separate
- * MemoryContext as a child context of the current executor context.
- * The MemoryContext/projPJ object is stored in this hash table so
- * that when PROJ4SRSCacheDelete() is called during query cleanup, we can
- * lookup the projPJ object based upon the MemoryContext parameter and hence
- * pj_free() it.
+ * This hash table maps an SRID to its projPJ object and the
+ * proj4text it was built from. It lives in its own child of
+ * TopMemoryContext and so survives across statements and
+ * transactions: each SRID is looked up in spatial_ref_sys and
+ * parsed by pj_init() once per backend rather than once per
+ * portal.
+ *
+ * Since the cached definitions are only valid as long as
+ * spatial_ref_sys does not change, we register a relcache
+ * invalidation callback and flush the table whenever the
+ * relation is invalidated. The statement level trigger on
+ * spatial_ref_sys (postgis_proj_cache_invalidate) makes sure
+ * any modification of the table raises such an invalidation,
+ * in this backend and in all the others once it commits.
  */
-static HTAB *PJHash = NULL;
+static HTAB *PROJ4Hash = NULL;
+static MemoryContext PROJ4CacheContext = NULL;
 
-typedef struct struct_PJHashEntry
+typedef struct struct_PROJ4HashEntry
 {
-	MemoryContext ProjectionContext;
+	int srid;		/* hash key, must be first */
 	projPJ projection;
+	int kind;		/* lwproj_kind() of the projection */
+	char *proj4text;
+	uint32 hits;
 }
-PJHashEntry;
+PROJ4HashEntry;
 
+/* Set by the invalidation callback, acted upon at the next lookup */
+static bool PROJ4HashStale = false;
+static bool PROJ4CallbackRegistered = false;
 
-/* PJ Hash API */
-uint32 mcxt_ptr_hash(const void *key, Size keysize);
+/* Relation oid of spatial_ref_sys as last seen by a SPI lookup */
+static Oid SpatialRefSysOid = InvalidOid;
 
-static HTAB *CreatePJHash(void);
-static void AddPJHashEntry(MemoryContext mcxt, projPJ projection);
-static projPJ GetPJHashEntry(MemoryContext mcxt);
-static void DeletePJHashEntry(MemoryContext mcxt);
+/* Backend counters, bytes being those of the proj4text copies */
+CacheStats proj4_cache_stats;
 
-/* Internal Cache API */
-/* static PROJ4PortalCache *GetPROJ4SRSCache(FunctionCallInfo fcinfo) ; */
-static bool IsInPROJ4SRSCache(PROJ4PortalCache *PROJ4Cache, int srid);
-static projPJ GetProjectionFromPROJ4SRSCache(PROJ4PortalCache *PROJ4Cache, int srid);
-static void AddToPROJ4SRSCache(PROJ4PortalCache *PROJ4Cache, int srid, int other_srid);
-static void DeleteFromPROJ4SRSCache(PROJ4PortalCache *PROJ4Cache, int srid);
+/* PROJ4 Hash API */
+static uint32 srid_hash(const void *key, Size keysize);
+static void PROJ4CacheInvalidateCallback(Datum arg, Oid relid);
+static void PROJ4CacheCreate(void);
+static void PROJ4CacheFlush(void);
+static void PROJ4CacheCheck(void);
+static PROJ4HashEntry *GetPROJ4HashEntry(int srid, int argnum, bool *loaded);
 
 /* Search path for PROJ.4 library */
 static bool IsPROJ4LibPathSet = false;
 void SetPROJ4LibPath(void);
 
-/* Memory context cache functions */
-static void PROJ4SRSCacheInit(MemoryContext context);
-static void PROJ4SRSCacheDelete(MemoryContext context);
-static void PROJ4SRSCacheReset(MemoryContext context);
-static bool PROJ4SRSCacheIsEmpty(MemoryContext context);
-static void PROJ4SRSCacheStats(MemoryContext context, int level);
-#ifdef MEMORY_CONTEXT_CHECKING
-static void PROJ4SRSCacheCheck(MemoryContext context);
-#endif
+static char* GetProj4String(int srid);
 
 
-/* Memory context definition must match the current version of PostgreSQL */
-static MemoryContextMethods PROJ4SRSCacheContextMethods =
-{
-	NULL,
-	NULL,
-	NULL,
-	PROJ4SRSCacheInit,
-	PROJ4SRSCacheReset,
-	PROJ4SRSCacheDelete,
-	NULL,
-	PROJ4SRSCacheIsEmpty,
-	PROJ4SRSCacheStats
-#ifdef MEMORY_CONTEXT_CHECKING
-	,PROJ4SRSCacheCheck
-#endif
-};
+/*
+ * PROJ4 projPJ Hash Table functions
+ */
 
 
-static void
-PROJ4SRSCacheInit(MemoryContext context)
+/**
+ * We specify the hash function here as the int4 hash
+ * has changed name over the years....
+ */
+static uint32
+srid_hash(const void *key, Size keysize)
 {
-	/*
-	 * Do nothing as the cache is initialised when the transform()
-	 * function is first called
-	 */
+	return DatumGetUInt32(hash_uint32((uint32) *((const int *) key)));
 }
 
+/**
+ * Relcache invalidation callback. We may be called in the middle
+ * of a lookup (SPI processes pending invalidations), so just mark
+ * the cache stale and let PROJ4CacheCheck() do the flush.
+ */
 static void
-PROJ4SRSCacheDelete(MemoryContext context)
+PROJ4CacheInvalidateCallback(Datum arg, Oid relid)
 {
-	projPJ projection;
-
-	/* Lookup the projPJ pointer in the global hash table so we can free it */
-	projection = GetPJHashEntry(context);
-
-	if (!projection)
-		elog(ERROR, "PROJ4SRSCacheDelete: Trying to delete non-existant projection object with MemoryContext key (%p)", (void *)context);
-
-	POSTGIS_DEBUGF(3, "deleting projection object (%p) with MemoryContext key (%p)", projection, context);
-
-	/* Free it */
-	pj_free(projection);
-
-	/* Remove the hash entry as it is no longer needed */
-	DeletePJHashEntry(context);
+	if ( relid == InvalidOid || relid == SpatialRefSysOid )
+		PROJ4HashStale = true;
 }
 
 static void
-PROJ4SRSCacheReset(MemoryContext context)
+PROJ4CacheCreate(void)
 {
-	/*
-	 * Do nothing, but we must supply a function since this call is mandatory according to tgl
-	 * (see postgis-devel archives July 2007)
-	 */
-}
+	HASHCTL ctl;
 
-static bool
-PROJ4SRSCacheIsEmpty(MemoryContext context)
-{
-	/*
-	 * Always return false since this call is mandatory according to tgl
-	 * (see postgis-devel archives July 2007)
-	 */
-	return FALSE;
-}
+	if ( ! PROJ4CacheContext )
+	{
+		PROJ4CacheContext = AllocSetContextCreate(TopMemoryContext,
+		                    "PostGIS PROJ4 Backend Cache",
+		                    ALLOCSET_SMALL_MINSIZE,
+		                    ALLOCSET_SMALL_INITSIZE,
+		                    ALLOCSET_DEFAULT_MAXSIZE);
+	}
 
-static void
-PROJ4SRSCacheStats(MemoryContext context, int level)
-{
-	/*
-	 * Simple stats display function - we must supply a function since this call is mandatory according to tgl
-	 * (see postgis-devel archives July 2007)
-	 */
+	if ( ! PROJ4CallbackRegistered )
+	{
+		CacheRegisterRelcacheCallback(PROJ4CacheInvalidateCallback, (Datum) 0);
+		PROJ4CallbackRegistered = true;
+	}
 
-	fprintf(stderr, "%s: PROJ4 context\n", context->name);
-}
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(int);
+	ctl.entrysize = sizeof(PROJ4HashEntry);
+	ctl.hash = srid_hash;
+	ctl.hcxt = PROJ4CacheContext;
 
-#ifdef MEMORY_CONTEXT_CHECKING
-static void
-PROJ4SRSCacheCheck(MemoryContext context)
-{
-	/*
-	 * Do nothing - stub required for when PostgreSQL is compiled
-	 * with MEMORY_CONTEXT_CHECKING defined
-	 */
+	PROJ4Hash = hash_create("PostGIS PROJ4 Backend projPJ Hash", PROJ4_BACKEND_HASH_SIZE, &ctl, (HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT));
+	PROJ4HashStale = false;
 }
-#endif
-
 
-/*
- * PROJ4 projPJ Hash Table functions
+/**
+ * Free every cached projection and drop the hash table.
  */
+static void
+PROJ4CacheFlush(void)
+{
+	HASH_SEQ_STATUS status;
+	PROJ4HashEntry *he;
 
+	if ( ! PROJ4Hash )
+		return;
 
-/**
- * A version of tag_hash - we specify this here as the implementation
- * has changed over the years....
- */
+	POSTGIS_DEBUGF(3, "flushing %ld entries from the backend PROJ4 cache", hash_get_num_entries(PROJ4Hash));
 
-uint32 mcxt_ptr_hash(const void *key, Size keysize)
-{
-	uint32 hashval;
+	hash_seq_init(&status, PROJ4Hash);
+	while ( (he = (PROJ4HashEntry *) hash_seq_search(&status)) != NULL )
+	{
+		if ( he->projection )
+			pj_free(he->projection);
+		he->projection = NULL;
+		proj4_cache_stats.bytes -= strlen(he->proj4text) + 1;
+		proj4_cache_stats.evictions++;
+	}
 
-	hashval = DatumGetUInt32(hash_any(key, keysize));
+	hash_destroy(PROJ4Hash);
+	PROJ4Hash = NULL;
 
-	return hashval;
+	/* The proj4text copies */
+	MemoryContextReset(PROJ4CacheContext);
 }
 
-
-static HTAB *CreatePJHash(void)
+/**
+ * Make sure the backend cache exists and is current. Must only be
+ * called where no projPJ handed out earlier is still in use.
+ */
+static void
+PROJ4CacheCheck(void)
 {
-	HASHCTL ctl;
-
-	ctl.keysize = sizeof(MemoryContext);
-	ctl.entrysize = sizeof(PJHashEntry);
-	ctl.hash = mcxt_ptr_hash;
+	if ( PROJ4Hash && ( PROJ4HashStale || hash_get_num_entries(PROJ4Hash) >= PROJ4_BACKEND_CACHE_MAX ) )
+		PROJ4CacheFlush();
 
-	return hash_create("PostGIS PROJ4 Backend projPJ MemoryContext Hash", PROJ4_BACKEND_HASH_SIZE, &ctl, (HASH_ELEM | HASH_FUNCTION));
+	if ( ! PROJ4Hash )
+		PROJ4CacheCreate();
 }
 
-static void AddPJHashEntry(MemoryContext mcxt, projPJ projection)
+/**
+ * Return the cache entry for the given SRID, building the
+ * projection if it is not there yet. argnum (1 or 2) is the
+ * argument the SRID came from, for the counters. *loaded
+ * tells whether this call had to build it.
+ */
+static PROJ4HashEntry *
+GetPROJ4HashEntry(int srid, int argnum, bool *loaded)
 {
+	PROJ4HashEntry *he;
+	projPJ projection = NULL;
+	char *proj_str = NULL;
 	bool found;
-	void **key;
-	PJHashEntry *he;
+	instr_time start_time, end_time;
 
-	/* The hash key is the MemoryContext pointer */
-	key = (void *)&mcxt;
+	proj4_cache_stats.lookups++;
 
-	he = (PJHashEntry *) hash_search(PJHash, key, HASH_ENTER, &found);
-	if (!found)
+	he = (PROJ4HashEntry *) hash_search(PROJ4Hash, &srid, HASH_FIND, NULL);
+	if ( he )
 	{
-		/* Insert the entry into the new hash element */
-		he->ProjectionContext = mcxt;
-		he->projection = projection;
+		he->hits++;
+		proj4_cache_stats.hits[argnum - 1]++;
+		if ( loaded ) *loaded = false;
+		return he;
 	}
-	else
-	{
-		elog(ERROR, "AddPJHashEntry: PROJ4 projection object already exists for this MemoryContext (%p)",
-		     (void *)mcxt);
-	}
-}
-
-static projPJ GetPJHashEntry(MemoryContext mcxt)
-{
-	void **key;
-	PJHashEntry *he;
-
-	/* The hash key is the MemoryContext pointer */
-	key = (void *)&mcxt;
-
-	/* Return the projection object from the hash */
-	he = (PJHashEntry *) hash_search(PJHash, key, HASH_FIND, NULL);
 
-	return he->projection;
-}
+	INSTR_TIME_SET_CURRENT(start_time);
 
+	/*
+	** Turn the SRID number into a proj4 string, by reading from spatial_ref_sys
+	** or instantiating a magical value from a negative srid.
+	*/
+	proj_str = GetProj4String(srid);
+	if ( ! proj_str )
+	{
+		proj4_cache_stats.build_failures++;
+		elog(ERROR, "GetProj4String returned NULL for SRID (%d)", srid);
+	}
 
-static void DeletePJHashEntry(MemoryContext mcxt)
-{
-	void **key;
-	PJHashEntry *he;
+	projection = lwproj_from_string(proj_str);
+	if ( projection == NULL )
+	{
+		char *pj_errstr = pj_strerrno(*pj_get_errno_ref());
+		if ( ! pj_errstr )
+			pj_errstr = "";
+		
+		proj4_cache_stats.build_failures++;
+		elog(ERROR,
+		    "GetPROJ4HashEntry: could not parse proj4 string '%s' %s",
+		    proj_str, pj_errstr);
+	}
 
-	/* The hash key is the MemoryContext pointer */
-	key = (void *)&mcxt;
+	POSTGIS_DEBUGF(3, "adding SRID %d with proj4text \"%s\" to backend cache", srid, proj_str);
 
-	/* Delete the projection object from the hash */
-	he = (PJHashEntry *) hash_search(PJHash, key, HASH_REMOVE, NULL);
+	he = (PROJ4HashEntry *) hash_search(PROJ4Hash, &srid, HASH_ENTER, &found);
+	he->projection = projection;
+	he->kind = lwproj_kind(projection);
+	he->proj4text = MemoryContextStrdup(PROJ4CacheContext, proj_str);
+	he->hits = 1;
 
-	he->projection = NULL;
+	/* Free the projection string */
+	pfree(proj_str);
 
-	if (!he)
-		elog(ERROR, "DeletePJHashEntry: There was an error removing the PROJ4 projection object from this MemoryContext (%p)", (void *)mcxt);
-}
+	INSTR_TIME_SET_CURRENT(end_time);
+	INSTR_TIME_SUBTRACT(end_time, start_time);
+	proj4_cache_stats.build_ms += INSTR_TIME_GET_MILLISEC(end_time);
+	proj4_cache_stats.builds++;
+	proj4_cache_stats.bytes += strlen(he->proj4text) + 1;
 
-bool
-IsInPROJ4Cache(Proj4Cache PROJ4Cache, int srid) {
-	return IsInPROJ4SRSCache((PROJ4PortalCache *)PROJ4Cache, srid) ;
+	if ( loaded ) *loaded = true;
+	return he;
 }
 
-/*
- * Per-cache management functions
+/**
+ * Make sure the projection for this SRID is in the backend cache.
+ * Returns true if it had to be loaded, false if it was already there.
  */
-
-static bool
-IsInPROJ4SRSCache(PROJ4PortalCache *PROJ4Cache, int srid)
+bool
+LoadPROJ4Projection(int srid)
 {
-	/*
-	 * Return true/false depending upon whether the item
-	 * is in the SRS cache.
-	 */
-
-	int i;
+	bool loaded;
 
-	for (i = 0; i < PROJ4_CACHE_ITEMS; i++)
-	{
-		if (PROJ4Cache->PROJ4SRSCache[i].srid == srid)
-			return 1;
-	}
-
-	/* Otherwise not found */
-	return 0;
-}
+	SetPROJ4LibPath();
+	PROJ4CacheCheck();
+	GetPROJ4HashEntry(srid, 1, &loaded);
 
-projPJ GetProjectionFromPROJ4Cache(Proj4Cache cache, int srid)
-{
-	return GetProjectionFromPROJ4SRSCache((PROJ4PortalCache *)cache, srid) ;
+	return loaded;
 }
 
 /**
- * Return the projection object from the cache (we should
- * already have checked it exists using IsInPROJ4SRSCache first)
+ * Return a snapshot of the backend cache contents, allocated
+ * in the current memory context, and the number of items in it.
  */
-static projPJ
-GetProjectionFromPROJ4SRSCache(PROJ4PortalCache *PROJ4Cache, int srid)
+int
+GetPROJ4CacheItems(PROJ4CacheItem **items)
 {
-	int i;
+	HASH_SEQ_STATUS status;
+	PROJ4HashEntry *he;
+	int n = 0;
 
-	for (i = 0; i < PROJ4_CACHE_ITEMS; i++)
+	*items = NULL;
+
+	/* Don't report entries we are going to throw away */
+	if ( ! PROJ4Hash || PROJ4HashStale )
+		return 0;
+
+	*items = palloc(sizeof(PROJ4CacheItem) * (hash_get_num_entries(PROJ4Hash) + 1));
+
+	hash_seq_init(&status, PROJ4Hash);
+	while ( (he = (PROJ4HashEntry *) hash_seq_search(&status)) != NULL )
 	{
-		if (PROJ4Cache->PROJ4SRSCache[i].srid == srid)
-			return PROJ4Cache->PROJ4SRSCache[i].projection;
+		(*items)[n].srid = he->srid;
+		(*items)[n].proj4text = pstrdup(he->proj4text);
+		(*items)[n].hits = he->hits;
+		n++;
 	}
 
-	return NULL;
+	return n;
 }
 
 char* GetProj4StringSPI(int srid)
@@ -390,6 +400,8 @@ static char* GetProj4String(int srid)
 	/* SRIDs in SPATIAL_REF_SYS */
 	if ( srid < SRID_RESERVE_OFFSET )
 	{
+		/* Remember which relation to watch for invalidations */
+		SpatialRefSysOid = RelnameGetRelid("spatial_ref_sys");
 		return GetProj4StringSPI(srid);
 	}
 	/* Automagic SRIDs */
@@ -468,134 +480,6 @@ static char* GetProj4String(int srid)
 	}
 }
 
-void AddToPROJ4Cache(Proj4Cache cache, int srid, int other_srid) {
-	AddToPROJ4SRSCache((PROJ4PortalCache *)cache, srid, other_srid) ;
-}
-
-
-/**
- * Add an entry to the local PROJ4 SRS cache. If we need to wrap around then
- * we must make sure the entry we choose to delete does not contain other_srid
- * which is the definition for the other half of the transformation.
- */
-static void
-AddToPROJ4SRSCache(PROJ4PortalCache *PROJ4Cache, int srid, int other_srid)
-{
-	MemoryContext PJMemoryContext;
-	projPJ projection = NULL;
-	char *proj_str = NULL;
-
-	/*
-	** Turn the SRID number into a proj4 string, by reading from spatial_ref_sys
-	** or instantiating a magical value from a negative srid.
-	*/
-	proj_str = GetProj4String(srid);
-	if ( ! proj_str )
-	{
-		elog(ERROR, "GetProj4String returned NULL for SRID (%d)", srid);
-	}
-
-	projection = lwproj_from_string(proj_str);
-	if ( projection == NULL )
-	{
-		char *pj_errstr = pj_strerrno(*pj_get_errno_ref());
-		if ( ! pj_errstr )
-			pj_errstr = "";
-		
-		elog(ERROR,
-		    "AddToPROJ4SRSCache: could not parse proj4 string '%s' %s",
-		    proj_str, pj_errstr);
-	}
-
-	/*
-	 * If the cache is already full then find the first entry
-	 * that doesn't contain other_srid and use this as the
-	 * subsequent value of PROJ4SRSCacheCount
-	 */
-	if (PROJ4Cache->PROJ4SRSCacheCount == PROJ4_CACHE_ITEMS)
-	{
-		bool found = false;
-		int i;
-
-		for (i = 0; i < PROJ4_CACHE_ITEMS; i++)
-		{
-			if (PROJ4Cache->PROJ4SRSCache[i].srid != other_srid && found == false)
-			{
-				POSTGIS_DEBUGF(3, "choosing to remove item from query cache with SRID %d and index %d", PROJ4Cache->PROJ4SRSCache[i].srid, i);
-
-				DeleteFromPROJ4SRSCache(PROJ4Cache, PROJ4Cache->PROJ4SRSCache[i].srid);
-				PROJ4Cache->PROJ4SRSCacheCount = i;
-
-				found = true;
-			}
-		}
-	}
-
-	/*
-	 * Now create a memory context for this projection and
-	 * store it in the backend hash
-	 */
-	POSTGIS_DEBUGF(3, "adding SRID %d with proj4text \"%s\" to query cache at index %d", srid, proj_str, PROJ4Cache->PROJ4SRSCacheCount);
-
-	PJMemoryContext = MemoryContextCreate(T_AllocSetContext, 8192,
-	                                      &PROJ4SRSCacheContextMethods,
-	                                      PROJ4Cache->PROJ4SRSCacheContext,
-	                                      "PostGIS PROJ4 PJ Memory Context");
-
-	/* Create the backend hash if it doesn't already exist */
-	if (!PJHash)
-		PJHash = CreatePJHash();
-
-	/*
-	 * Add the MemoryContext to the backend hash so we can
-	 * clean up upon portal shutdown
-	 */
-	POSTGIS_DEBUGF(3, "adding projection object (%p) to hash table with MemoryContext key (%p)", projection, PJMemoryContext);
-
-	AddPJHashEntry(PJMemoryContext, projection);
-
-	PROJ4Cache->PROJ4SRSCache[PROJ4Cache->PROJ4SRSCacheCount].srid = srid;
-	PROJ4Cache->PROJ4SRSCache[PROJ4Cache->PROJ4SRSCacheCount].projection = projection;
-	PROJ4Cache->PROJ4SRSCache[PROJ4Cache->PROJ4SRSCacheCount].projection_mcxt = PJMemoryContext;
-	PROJ4Cache->PROJ4SRSCacheCount++;
-
-	/* Free the projection string */
-	pfree(proj_str);
-
-}
-
-void DeleteFromPROJ4Cache(Proj4Cache cache, int srid) {
-	DeleteFromPROJ4SRSCache((PROJ4PortalCache *)cache, srid) ;
-}
-
-
-static void DeleteFromPROJ4SRSCache(PROJ4PortalCache *PROJ4Cache, int srid)
-{
-	/*
-	 * Delete the SRID entry from the cache
-	 */
-
-	int i;
-
-	for (i = 0; i < PROJ4_CACHE_ITEMS; i++)
-	{
-		if (PROJ4Cache->PROJ4SRSCache[i].srid == srid)
-		{
-			POSTGIS_DEBUGF(3, "removing query cache entry with SRID %d at index %d", srid, i);
-
-			/*
-			 * Zero out the entries and free the PROJ4 handle
-			 * by deleting the memory context
-			 */
-			MemoryContextDelete(PROJ4Cache->PROJ4SRSCache[i].projection_mcxt);
-			PROJ4Cache->PROJ4SRSCache[i].projection = NULL;
-			PROJ4Cache->PROJ4SRSCache[i].projection_mcxt = NULL;
-			PROJ4Cache->PROJ4SRSCache[i].srid = SRID_UNKNOWN;
-		}
-	}
-}
-
-
 /**
  * Specify an alternate directory for the PROJ.4 grid files
  * (this should augment the PROJ.4 compile-time path)
@@ -638,80 +522,44 @@ void SetPROJ4LibPath(void)
 	}
 }
 
-Proj4Cache GetPROJ4Cache(FunctionCallInfo fcinfo) {
-	return (Proj4Cache)GetPROJ4SRSCache(fcinfo);
-}
-
-#if 0
-static PROJ4PortalCache *GetPROJ4SRSCache(FunctionCallInfo fcinfo)
+/**
+ * Look up the projections for both SRIDs in the backend cache,
+ * loading them from spatial_ref_sys as needed. The returned
+ * objects are owned by the cache and must not be freed. The
+ * fcinfo argument is unused now that the cache is not tied
+ * to the calling portal, but kept for API stability.
+ */
+int
+GetProjectionsUsingFCInfo(FunctionCallInfo fcinfo, int srid1, int srid2, projPJ *pj1, projPJ *pj2)
 {
-	PROJ4PortalCache *PROJ4Cache = (GetGeomCache(fcinfo))->proj;
-
-	/*
-	 * If we have not already created PROJ4 cache for this portal
-	 * then create it
-	 */
-	if (fcinfo->flinfo->fn_extra == NULL)
-	{
-		MemoryContext old_context;
-
-		old_context = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
-		PROJ4Cache = palloc(sizeof(PROJ4PortalCache));
-		MemoryContextSwitchTo(old_context);
-
-		if (PROJ4Cache)
-		{
-			int i;
-
-			POSTGIS_DEBUGF(3, "Allocating PROJ4Cache for portal with transform() MemoryContext %p", fcinfo->flinfo->fn_mcxt);
-			/* Put in any required defaults */
-			for (i = 0; i < PROJ4_CACHE_ITEMS; i++)
-			{
-				PROJ4Cache->PROJ4SRSCache[i].srid = SRID_UNKNOWN;
-				PROJ4Cache->PROJ4SRSCache[i].projection = NULL;
-				PROJ4Cache->PROJ4SRSCache[i].projection_mcxt = NULL;
-			}
-			PROJ4Cache->PROJ4SRSCacheCount = 0;
-			PROJ4Cache->PROJ4SRSCacheContext = fcinfo->flinfo->fn_mcxt;
-
-			/* Store the pointer in fcinfo->flinfo->fn_extra */
-			fcinfo->flinfo->fn_extra = PROJ4Cache;
-		}
-	}
-	else
-	{
-		/* Use the existing cache */
-		PROJ4Cache = fcinfo->flinfo->fn_extra;
-	}
-
-	return PROJ4Cache ;
+	return GetProjectionPairUsingFCInfo(fcinfo, srid1, srid2, pj1, pj2, NULL);
 }
-#endif
 
+/**
+ * As GetProjectionsUsingFCInfo, also returning in *pair_kind
+ * (unless NULL) the lwproj_pair_kind() of the two projections,
+ * as worked out when they were added to the cache, for use
+ * with lwgeom_transform_kind().
+ */
 int
-GetProjectionsUsingFCInfo(FunctionCallInfo fcinfo, int srid1, int srid2, projPJ *pj1, projPJ *pj2)
+GetProjectionPairUsingFCInfo(FunctionCallInfo fcinfo, int srid1, int srid2, projPJ *pj1, projPJ *pj2, int *pair_kind)
 {
-	Proj4Cache *proj_cache = NULL;
+	PROJ4HashEntry *he1, *he2;
 
 	/* Set the search path if we haven't already */
 	SetPROJ4LibPath();
 
-	/* get or initialize the cache for this round */
-	proj_cache = GetPROJ4Cache(fcinfo);
-	if ( !proj_cache )
-		return LW_FAILURE;
-
-	/* Add the output srid to the cache if it's not already there */
-	if (!IsInPROJ4Cache(proj_cache, srid1))
-		AddToPROJ4Cache(proj_cache, srid1, srid2);
+	/* Flush the cache if spatial_ref_sys changed since last time */
+	PROJ4CacheCheck();
 
-	/* Add the input srid to the cache if it's not already there */
-	if (!IsInPROJ4Cache(proj_cache, srid2))
-		AddToPROJ4Cache(proj_cache, srid2, srid1);
+	/* Get the projections, adding them to the cache if not already there */
+	he1 = GetPROJ4HashEntry(srid1, 1, NULL);
+	he2 = GetPROJ4HashEntry(srid2, 2, NULL);
 
-	/* Get the projections */
-	*pj1 = GetProjectionFromPROJ4Cache(proj_cache, srid1);
-	*pj2 = GetProjectionFromPROJ4Cache(proj_cache, srid2);
+	*pj1 = he1->projection;
+	*pj2 = he2->projection;
+	if ( pair_kind )
+		*pair_kind = lwproj_pair_kind(he1->kind, he2->kind);
 
 	return LW_SUCCESS;
 }
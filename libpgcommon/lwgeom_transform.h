@@ -13,6 +13,7 @@
 #include "postgres.h"
 #include "liblwgeom.h"
 #include "lwgeom_pg.h"
+#include "lwgeom_cache.h"
 
 
 
@@ -21,17 +22,24 @@ void SetPROJ4LibPath(void) ;
 
 
 /**
- * Opaque type to use in the projection cache API.
+ * A snapshot of one entry of the backend projection cache,
+ * as returned by GetPROJ4CacheItems().
  */
-typedef void *Proj4Cache ;
-
-void SetPROJ4LibPath(void);
-Proj4Cache GetPROJ4Cache(FunctionCallInfo fcinfo) ;
-bool IsInPROJ4Cache(Proj4Cache cache, int srid) ;
-void AddToPROJ4Cache(Proj4Cache cache, int srid, int other_srid);
-void DeleteFromPROJ4Cache(Proj4Cache cache, int srid) ;
-projPJ GetProjectionFromPROJ4Cache(Proj4Cache cache, int srid);
+typedef struct struct_PROJ4CacheItem
+{
+	int srid;
+	char *proj4text;
+	uint32 hits;
+}
+PROJ4CacheItem;
+
+/* Counters of the backend projection cache */
+extern CacheStats proj4_cache_stats;
+
+bool LoadPROJ4Projection(int srid);
+int GetPROJ4CacheItems(PROJ4CacheItem **items);
 int GetProjectionsUsingFCInfo(FunctionCallInfo fcinfo, int srid1, int srid2, projPJ *pj1, projPJ *pj2);
+int GetProjectionPairUsingFCInfo(FunctionCallInfo fcinfo, int srid1, int srid2, projPJ *pj1, projPJ *pj2, int *pair_kind);
 int spheroid_init_from_srid(FunctionCallInfo fcinfo, int srid, SPHEROID *s);
 void srid_is_latlong(FunctionCallInfo fcinfo, int srid);
 
@@ -28,6 +28,7 @@
 #include "lwgeom_transform.h" /* For SRID functions */
 
 Datum geography_distance(PG_FUNCTION_ARGS);
+Datum geography_distance_knn(PG_FUNCTION_ARGS);
 Datum geography_distance_uncached(PG_FUNCTION_ARGS);
 Datum geography_distance_tree(PG_FUNCTION_ARGS);
 Datum geography_dwithin(PG_FUNCTION_ARGS);
@@ -172,6 +173,58 @@ Datum geography_distance(PG_FUNCTION_ARGS)
 	PG_RETURN_FLOAT8(distance);
 }
 
+/*
+** geography_distance_knn(GSERIALIZED *g1, GSERIALIZED *g2)
+** returns double distance in meters over the spheroid, as used by
+** the <-> operator and rechecked by the index KNN scan
+*/
+PG_FUNCTION_INFO_V1(geography_distance_knn);
+Datum geography_distance_knn(PG_FUNCTION_ARGS)
+{
+	GSERIALIZED* g1 = NULL;
+	GSERIALIZED* g2 = NULL;
+	double distance;
+	SPHEROID s;
+
+	/* Get our geometry objects loaded into memory. */
+	g1 = (GSERIALIZED*)PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
+	g2 = (GSERIALIZED*)PG_DETOAST_DATUM(PG_GETARG_DATUM(1));
+
+	/* Initialize spheroid */
+	spheroid_init_from_srid(fcinfo, gserialized_get_srid(g1), &s);
+
+	/* Return NULL on empty arguments. */
+	if ( gserialized_is_empty(g1) || gserialized_is_empty(g2) )
+	{
+		PG_FREE_IF_COPY(g1, 0);
+		PG_FREE_IF_COPY(g2, 1);
+		PG_RETURN_NULL();
+	}
+
+	/* Do the brute force calculation if the cached calculation doesn't tick over */
+	if ( LW_FAILURE == geography_distance_cache(fcinfo, g1, g2, &s, &distance) )
+	{
+		LWGEOM* lwgeom1 = lwgeom_from_gserialized(g1);
+		LWGEOM* lwgeom2 = lwgeom_from_gserialized(g2);
+		distance = lwgeom_distance_spheroid(lwgeom1, lwgeom2, &s, 0.0);
+		lwgeom_free(lwgeom1);
+		lwgeom_free(lwgeom2);
+	}
+
+	/* Clean up */
+	PG_FREE_IF_COPY(g1, 0);
+	PG_FREE_IF_COPY(g2, 1);
+
+	/* Something went wrong, negative return... should already be eloged, return NULL */
+	if ( distance < 0.0 )
+	{
+		elog(ERROR, "distance returned negative!");
+		PG_RETURN_NULL();
+	}
+
+	PG_RETURN_FLOAT8(distance);
+}
+
 
 /*
 ** geography_dwithin(GSERIALIZED *g1, GSERIALIZED *g2, double tolerance, boolean use_spheroid)
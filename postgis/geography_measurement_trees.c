@@ -10,10 +10,8 @@
 */
 typedef struct {
 	int                         type;       // <GeomCache>
-	GSERIALIZED*                geom1;      // 
-	GSERIALIZED*                geom2;      // 
-	size_t                      geom1_size; // 
-	size_t                      geom2_size; // 
+	GSERIALIZED*                geom;       // 
+	size_t                      geom_size;  // 
 	int32                       argnum;     // </GeomCache>
 	CIRC_NODE*                  index;
 } CircTreeGeomCache;
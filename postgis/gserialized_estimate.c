@@ -26,6 +26,11 @@ queries with relations on both sides call gserialized_gist_joinsel.
 gserialized_gist_sel sums up the values in the histogram that overlap
 the contant search box.
 
+The histogram cells are not evenly sized: along each axis the cell
+edges follow the density of the sample (equi-depth), blended with an
+even spread, so features packed into a few small areas get many small
+cells and empty stretches get a few large ones.
+
 gserialized_gist_joinsel sums up the product of the overlapping 
 cells in each relation's histogram.
 
@@ -36,6 +41,14 @@ will be 2D or ND.
 - geometry &&& geometry ==> ND
 - geography && geography ==> ND
 
+ST_DWithin inlines to a pair of mirrored box tests,
+a && ST_Expand(b, d) AND b && ST_Expand(a, d). Both estimators look
+through the ST_Expand (or geography _ST_Expand) call on a column and
+grow the search box, or the histogram cells, by the distance instead.
+The two tests pass exactly the same rows, so when the mirror of a
+clause is present only one of them reports its selectivity and the
+other reports 1.0, rather than counting the filter twice.
+
 The 2D mode is put in effect by retrieving the 2D histogram from the 
 statistics cache and then allowing the generic ND calculations to
 go to work.
@@ -50,12 +63,23 @@ dimensionality cases. (2D geometry) &&& (3D column), etc.
 #include "fmgr.h"
 #include "commands/vacuum.h"
 #include "nodes/relation.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/clauses.h"
 #include "parser/parsetree.h"
+#include "catalog/pg_type.h"
 #include "utils/array.h"
 #include "utils/lsyscache.h"
 #include "utils/builtins.h"
 #include "utils/syscache.h"
 #include "utils/rel.h"
+#include "utils/relcache.h"
+#include "access/genam.h"
+#include "access/gist_private.h"
+#include "access/heapam.h"
+#include "access/itup.h"
+#include "catalog/pg_am.h"
+#include "catalog/pg_index.h"
+#include "storage/bufmgr.h"
 
 #include "../postgis_config.h"
 
@@ -144,6 +168,14 @@ Datum geometry_estimated_extent(PG_FUNCTION_ARGS);
 #define FALLBACK_ND_SEL 0.2	
 #define FALLBACK_ND_JOINSEL 0.3	
 
+/**
+* Share of the histogram cell edges on each axis that are spread
+* evenly over the extent rather than by the density of the sample.
+* It is also the share of the extent that is kept as a minimum
+* width for the cells, so no cell collapses onto repeated coordinates.
+*/
+#define HISTOGRAM_UNIFORM_SHARE 0.1
+
 /**
 * N-dimensional box type for calculations, to avoid doing
 * explicit axis conversions from GBOX in all calculations
@@ -202,7 +234,8 @@ typedef struct ND_STATS_T
 	/* now always equal histogram_features */
 	float4 cells_covered;
 	
-	/* Variable length # of floats for histogram */
+	/* Variable length # of floats for histogram, followed by */
+	/* the size[d]+1 cell edges of each dimension in turn */
 	float4 value[1];
 } ND_STATS;
 
@@ -262,6 +295,23 @@ cmp_int (const void *a, const void *b)
 		return -1;
 }
 
+/**
+* Float comparison function for qsort 
+*/
+static int 
+cmp_float (const void *a, const void *b)
+{
+	float4 fa = *((const float4*)a);
+	float4 fb = *((const float4*)b);
+
+	if ( fa == fb )
+		return 0;
+	else if ( fa > fb )
+		return 1;
+	else 
+		return -1;
+}
+
 /**
 * The difference between the fourth and first quintile values,
 * the "inter-quintile range"
@@ -359,6 +409,76 @@ nd_stats_value_index(const ND_STATS *stats, int *indexes)
 	return vdx;
 }
 
+/**
+* The cell edges of dimension d of the histogram, size[d]+1
+* values from extent.min[d] to extent.max[d], stored after
+* the cell values.
+*/
+static float4*
+nd_stats_edges(const ND_STATS *nd_stats, int d)
+{
+	int i;
+	int offset = (int)roundf(nd_stats->histogram_cells);
+	for ( i = 0; i < d; i++ )
+		offset += (int)roundf(nd_stats->size[i]) + 1;
+	return (float4*)(nd_stats->value + offset);
+}
+
+/**
+* Size in bytes of an #ND_STATS with the given dimensions,
+* including the cell values and the cell edges.
+*/
+static size_t
+nd_stats_size(int ndims, const int *size)
+{
+	int d;
+	int cells = 1, edges = 0;
+	for ( d = 0; d < ndims; d++ )
+	{
+		cells *= size[d];
+		edges += size[d] + 1;
+	}
+	return sizeof(ND_STATS) + (cells + edges - 1) * sizeof(float4);
+}
+
+/**
+* Set the bounds of the histogram cell at the given position
+*/
+static void
+nd_stats_cell(const ND_STATS *nd_stats, const int *at, ND_BOX *nd_cell)
+{
+	int d;
+	for ( d = 0; d < (int)roundf(nd_stats->ndims); d++ )
+	{
+		const float4 *edges = nd_stats_edges(nd_stats, d);
+		nd_cell->min[d] = edges[at[d]];
+		nd_cell->max[d] = edges[at[d]+1];
+	}
+}
+
+/**
+* The position along dimension d of the histogram cell holding
+* the coordinate, clamped into the histogram.
+*/
+static int
+nd_stats_cell_index(const ND_STATS *nd_stats, int d, double coord)
+{
+	const float4 *edges = nd_stats_edges(nd_stats, d);
+	int lo = 0;
+	int hi = (int)roundf(nd_stats->size[d]) - 1;
+
+	/* Last cell whose lower edge is at or below the coordinate */
+	while ( lo < hi )
+	{
+		int mid = (lo + hi + 1) / 2;
+		if ( edges[mid] <= coord )
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}
+
 /** 
 * Convert an #ND_BOX to a JSON string for printing 
 */
@@ -417,6 +537,23 @@ nd_stats_to_json(const ND_STATS *nd_stats)
 	json_extent = nd_box_to_json(&(nd_stats->extent), ndims);
 	stringbuffer_aprintf(sb, "\"extent\":%s,", json_extent);
 	pfree(json_extent);
+
+	/* Cell edges */
+	stringbuffer_append(sb, "\"edges\":[");
+	for ( d = 0; d < ndims; d++ )
+	{
+		const float4 *edges = nd_stats_edges(nd_stats, d);
+		int i, size = (int)roundf(nd_stats->size[d]);
+		if ( d ) stringbuffer_append(sb, ",");
+		stringbuffer_append(sb, "[");
+		for ( i = 0; i <= size; i++ )
+		{
+			if ( i ) stringbuffer_append(sb, ",");
+			stringbuffer_aprintf(sb, "%.6g", edges[i]);
+		}
+		stringbuffer_append(sb, "]");
+	}
+	stringbuffer_append(sb, "],");
 	
 	stringbuffer_aprintf(sb, "\"table_features\":%d,", (int)roundf(nd_stats->table_features));
 	stringbuffer_aprintf(sb, "\"sample_features\":%d,", (int)roundf(nd_stats->sample_features));
@@ -600,21 +737,11 @@ nd_box_overlap(const ND_STATS *nd_stats, const ND_BOX *nd_box, ND_IBOX *nd_ibox)
 	/* In each dimension... */
 	for ( d = 0; d < nd_stats->ndims; d++ )
 	{
-		double smin = nd_stats->extent.min[d];
-		double smax = nd_stats->extent.max[d];
-		double width = smax - smin;
-		int size = roundf(nd_stats->size[d]);
-		
 		/* ... find cells the box overlaps with in this dimension */
-		nd_ibox->min[d] = floor(size * (nd_box->min[d] - smin) / width);
-		nd_ibox->max[d] = floor(size * (nd_box->max[d] - smin) / width);
+		nd_ibox->min[d] = nd_stats_cell_index(nd_stats, d, nd_box->min[d]);
+		nd_ibox->max[d] = nd_stats_cell_index(nd_stats, d, nd_box->max[d]);
 
-		POSTGIS_DEBUGF(5, " stats: dim %d: min %g: max %g: width %g", d, smin, smax, width);
 		POSTGIS_DEBUGF(5, " overlap: dim %d: (%d, %d)", d, nd_ibox->min[d], nd_ibox->max[d]);
-		
-		/* Push any out-of range values into range */
-		nd_ibox->min[d] = Max(nd_ibox->min[d], 0);
-		nd_ibox->max[d] = Min(nd_ibox->max[d], size-1);
 	}
 	return TRUE;
 }
@@ -666,6 +793,37 @@ nd_box_ratio(const ND_BOX *b1, const ND_BOX *b2, int ndims)
 	return ivol / vol2;
 }
 
+/**
+* Returns the proportion of the feature box that lies in the
+* histogram cell. Dimensions in which the feature box has no width
+* count as wholly inside, since nd_box_overlap has already picked the
+* one cell holding that coordinate, so points and axis-aligned lines
+* on a cell edge are counted once rather than dropped.
+*/
+static inline double
+nd_box_feature_ratio(const ND_BOX *nd_cell, const ND_BOX *nd_box, int ndims)
+{
+	int d;
+	double ratio = 1.0;
+
+	for ( d = 0; d < ndims; d++ )
+	{
+		double width = nd_box->max[d] - nd_box->min[d];
+		double imin, imax;
+
+		if ( width <= 0 )
+			continue;
+
+		imin = Max(nd_cell->min[d], nd_box->min[d]);
+		imax = Min(nd_cell->max[d], nd_box->max[d]);
+		if ( imax <= imin )
+			return 0.0;
+
+		ratio *= (imax - imin) / width;
+	}
+	return ratio;
+}
+
 
 /**
 * Calculate how much a set of boxes is homogenously distributed
@@ -803,6 +961,8 @@ pg_get_nd_stats(const Oid table_oid, AttrNumber att_num, int mode)
 	ND_STATS *nd_stats;
 	int rv, nvalues;
 	int stats_kind = STATISTIC_KIND_ND;
+	int d, ndims;
+	int size[ND_DIMS];
 
 	/* First pull the stats tuple */
 	stats_tuple = SearchSysCache2(STATRELATT, table_oid, att_num);
@@ -828,6 +988,23 @@ pg_get_nd_stats(const Oid table_oid, AttrNumber att_num, int mode)
 	/* Clone the stats here so we can release the attstatsslot immediately */
 	nd_stats = palloc(sizeof(float) * nvalues);
 	memcpy(nd_stats, floatptr, sizeof(float) * nvalues);
+
+	/* Stats from before the cell edges were stored have even cells */
+	ndims = (int)roundf(nd_stats->ndims);
+	for ( d = 0; d < ndims; d++ )
+		size[d] = (int)roundf(nd_stats->size[d]);
+	if ( sizeof(float4) * nvalues < nd_stats_size(ndims, size) )
+	{
+		int i;
+		nd_stats = repalloc(nd_stats, nd_stats_size(ndims, size));
+		for ( d = 0; d < ndims; d++ )
+		{
+			float4 *edges = nd_stats_edges(nd_stats, d);
+			double width = nd_stats->extent.max[d] - nd_stats->extent.min[d];
+			for ( i = 0; i <= size[d]; i++ )
+				edges[i] = nd_stats->extent.min[d] + i * width / size[d];
+		}
+	}
 	
 	/* Clean up */
 	free_attstatsslot(0, NULL, 0, floatptr, nvalues);
@@ -864,6 +1041,202 @@ pg_get_nd_stats_by_name(const Oid table_oid, const text *att_text, int mode)
 	return pg_get_nd_stats(table_oid, att_num, mode);
 }
 
+/**
+* Grow an #ND_BOX by a distance in each of its first ndims dimensions.
+*/
+static void
+nd_box_grow(ND_BOX *nd_box, int ndims, double distance)
+{
+	int d;
+	for ( d = 0; d < ndims; d++ )
+	{
+		nd_box->min[d] -= distance;
+		nd_box->max[d] += distance;
+	}
+}
+
+/**
+* Return TRUE if #ND_BOX a and b are the same box, allowing for
+* the float rounding of serialized boxes.
+*/
+static int
+nd_box_same_approx(const ND_BOX *a, const ND_BOX *b, int ndims)
+{
+	int d;
+	for ( d = 0; d < ndims; d++ )
+	{
+		double tol = 4 * FLT_EPSILON * Max(1.0, Max(fabs(a->max[d]), fabs(a->min[d])));
+		if ( fabs(a->min[d] - b->min[d]) > tol || fabs(a->max[d] - b->max[d]) > tol )
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+* Grow a #GBOX by a distance in every dimension, the way ST_Expand
+* and _ST_Expand grow the box of their input. Geodetic boxes are
+* geocentric X/Y/Z boxes, whether or not they carry the Z flag.
+*/
+static void
+gbox_grow(GBOX *gbox, double distance)
+{
+	gbox_expand(gbox, distance);
+	if ( FLAGS_GET_GEODETIC(gbox->flags) && ! FLAGS_GET_Z(gbox->flags) )
+	{
+		gbox->zmin -= distance;
+		gbox->zmax += distance;
+	}
+}
+
+/**
+* Look through ST_Expand(geometry, float8) and _ST_Expand(geography, float8)
+* calls with a known, non-negative distance, down to the column they
+* expand. Returns that column, or NULL if the node is anything else,
+* and adds the distance its boxes grow by to *expand (on the unit
+* sphere for geography, as geography_expand does).
+*/
+static Var*
+expanded_var(PlannerInfo *root, Node *node, double *expand)
+{
+	while ( IsA(node, FuncExpr) )
+	{
+		FuncExpr *func = (FuncExpr *) node;
+		Node *dist;
+		char *fname;
+		double distance;
+
+		if ( list_length(func->args) != 2 ||
+		     exprType((Node *) linitial(func->args)) != func->funcresulttype )
+			return NULL;
+
+		/* Fold the distance, for parameters and stable expressions */
+		dist = estimate_expression_value(root, (Node *) lsecond(func->args));
+		if ( ! IsA(dist, Const) || ((Const *) dist)->constisnull ||
+		     ((Const *) dist)->consttype != FLOAT8OID )
+			return NULL;
+
+		distance = DatumGetFloat8(((Const *) dist)->constvalue);
+		if ( ! (distance >= 0.0) )
+			return NULL;
+
+		fname = get_func_name(func->funcid);
+		if ( fname && strcmp(fname, "st_expand") == 0 )
+			*expand += distance;
+		else if ( fname && strcmp(fname, "_st_expand") == 0 )
+			*expand += distance / WGS84_RADIUS;
+		else
+			return NULL;
+
+		node = (Node *) linitial(func->args);
+	}
+
+	if ( ! IsA(node, Var) )
+		return NULL;
+
+	return (Var *) node;
+}
+
+/**
+* Does the restriction list of the column hold var && <const> with
+* the constant box equal to the (already grown) search box? That is the
+* mirror of a <const> && ST_Expand(var, d) clause from ST_DWithin.
+*/
+static int
+restriction_has_mirror(PlannerInfo *root, Oid opno, const Var *var, const GBOX *search_box)
+{
+	RelOptInfo *rel;
+	ListCell *lc;
+	ND_BOX nd_box;
+	int ndims = gbox_ndims(search_box);
+
+	if ( var->varno >= root->simple_rel_array_size )
+		return FALSE;
+	rel = root->simple_rel_array[var->varno];
+	if ( ! rel )
+		return FALSE;
+
+	nd_box_from_gbox(search_box, &nd_box);
+
+	foreach(lc, rel->baserestrictinfo)
+	{
+		RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+		OpExpr *op = (OpExpr *) rinfo->clause;
+		Node *col, *cnst;
+		GBOX gbox;
+		ND_BOX nd_other;
+
+		if ( ! IsA(op, OpExpr) || op->opno != opno || list_length(op->args) != 2 )
+			continue;
+
+		col = (Node *) linitial(op->args);
+		cnst = (Node *) lsecond(op->args);
+		if ( IsA(col, Const) )
+		{
+			Node *tmp = col;
+			col = cnst;
+			cnst = tmp;
+		}
+
+		if ( ! equal(col, var) || ! IsA(cnst, Const) || ((Const *) cnst)->constisnull )
+			continue;
+
+		if ( ! gserialized_datum_get_gbox_p(((Const *) cnst)->constvalue, &gbox) )
+			continue;
+
+		nd_box_from_gbox(&gbox, &nd_other);
+		if ( nd_box_same_approx(&nd_box, &nd_other, ndims) )
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/**
+* Does the join list of the bare column hold expanded && ST_Expand(bare, d)
+* for the same distance? That is the mirror of a bare && ST_Expand(expanded, d)
+* clause from ST_DWithin.
+*/
+static int
+join_has_mirror(PlannerInfo *root, Oid opno, const Var *bare, const Var *expanded, double expand)
+{
+	RelOptInfo *rel;
+	ListCell *lc;
+
+	if ( bare->varno >= root->simple_rel_array_size )
+		return FALSE;
+	rel = root->simple_rel_array[bare->varno];
+	if ( ! rel )
+		return FALSE;
+
+	foreach(lc, rel->joininfo)
+	{
+		RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
+		OpExpr *op = (OpExpr *) rinfo->clause;
+		Node *col, *func;
+		Var *var;
+		double e = 0.0;
+
+		if ( ! IsA(op, OpExpr) || op->opno != opno || list_length(op->args) != 2 )
+			continue;
+
+		col = (Node *) linitial(op->args);
+		func = (Node *) lsecond(op->args);
+		if ( ! IsA(col, Var) )
+		{
+			Node *tmp = col;
+			col = func;
+			func = tmp;
+		}
+
+		if ( ! IsA(col, Var) || ! IsA(func, FuncExpr) || ! equal(col, expanded) )
+			continue;
+
+		var = expanded_var(root, func, &e);
+		if ( var && equal(var, bare) && e == expand )
+			return TRUE;
+	}
+	return FALSE;
+}
+
 /**
 * Given two statistics histograms, what is the selectivity
 * of a join driven by the && or &&& operator?
@@ -876,9 +1249,12 @@ pg_get_nd_stats_by_name(const Oid table_oid, const text *att_text, int mode)
 * of one histogram, and multiply the cell value by the
 * proportion of the cells in the other histogram the cell
 * overlaps: val += val1 * ( val2 * overlap_ratio )
+*
+* For a && ST_Expand(b, expand) the cells of one histogram are
+* grown by the expansion distance before they are overlaid.
 */
 static float8
-estimate_join_selectivity(const ND_STATS *s1, const ND_STATS *s2)
+estimate_join_selectivity(const ND_STATS *s1, const ND_STATS *s2, double expand)
 {
 	int ncells1, ncells2;
 	int ndims1, ndims2, ndims;
@@ -889,14 +1265,6 @@ estimate_join_selectivity(const ND_STATS *s1, const ND_STATS *s2)
 	ND_IBOX ibox1, ibox2;
 	int at1[ND_DIMS];
 	int at2[ND_DIMS];
-	double min1[ND_DIMS];
-	double width1[ND_DIMS];
-	double cellsize1[ND_DIMS];
-	int size2[ND_DIMS];
-	double min2[ND_DIMS];
-	double width2[ND_DIMS];
-	double cellsize2[ND_DIMS];
-	int size1[ND_DIMS];
 	int d;
 	double val = 0;
 	float8 selectivity;
@@ -941,6 +1309,7 @@ estimate_join_selectivity(const ND_STATS *s1, const ND_STATS *s2)
 	/* Get the extents */
 	extent1 = s1->extent;
 	extent2 = s2->extent;
+	nd_box_grow(&extent2, ndims, expand);
 
 	/* If relation stats do not intersect, join is very very selective. */
 	if ( ! nd_box_intersects(&extent1, &extent2, ndims) )
@@ -959,24 +1328,9 @@ estimate_join_selectivity(const ND_STATS *s1, const ND_STATS *s2)
 		PG_RETURN_FLOAT8(FALLBACK_ND_JOINSEL);		
 	}
 	
-	/* Initialize counters / constants on s1 */
+	/* Initialize counters on s1 */
 	for ( d = 0; d < ndims1; d++ )
-	{
 		at1[d] = ibox1.min[d];
-		min1[d] = s1->extent.min[d];
-		width1[d] = s1->extent.max[d] - s1->extent.min[d];
-		size1[d] = (int)roundf(s1->size[d]);
-		cellsize1[d] = width1[d] / size1[d];
-	}
-
-	/* Initialize counters / constants on s2 */
-	for ( d = 0; d < ndims2; d++ )
-	{
-		min2[d] = s2->extent.min[d];
-		width2[d] = s2->extent.max[d] - s2->extent.min[d];
-		size2[d] = (int)roundf(s2->size[d]);
-		cellsize2[d] = width2[d] / size2[d];
-	}
 
 	/* For each affected cell of s1... */
 	do
@@ -985,11 +1339,10 @@ estimate_join_selectivity(const ND_STATS *s1, const ND_STATS *s2)
 		/* Construct the bounds of this cell */
 		ND_BOX nd_cell1;
 		nd_box_init(&nd_cell1);
-		for ( d = 0; d < ndims1; d++ )
-		{
-			nd_cell1.min[d] = min1[d] + (at1[d]+0) * cellsize1[d];
-			nd_cell1.max[d] = min1[d] + (at1[d]+1) * cellsize1[d];
-		}
+		nd_stats_cell(s1, at1, &nd_cell1);
+		
+		/* Reach out as far as the expanded features in this cell do */
+		nd_box_grow(&nd_cell1, ndims1, expand);
 		
 		/* Find the cells of s2 that cell1 overlaps.. */
 		nd_box_overlap(s2, &nd_cell1, &ibox2);
@@ -1014,11 +1367,7 @@ estimate_join_selectivity(const ND_STATS *s1, const ND_STATS *s2)
 			/* Construct the bounds of this cell */
 			ND_BOX nd_cell2;
 			nd_box_init(&nd_cell2);
-			for ( d = 0; d < ndims2; d++ )
-			{
-				nd_cell2.min[d] = min2[d] + (at2[d]+0) * cellsize2[d];
-				nd_cell2.max[d] = min2[d] + (at2[d]+1) * cellsize2[d];
-			}
+			nd_stats_cell(s2, at2, &nd_cell2);
 
 			POSTGIS_DEBUGF(3, "  at2 %d,%d  %s", at2[0], at2[1], nd_box_to_json(&nd_cell2, ndims2));
 			
@@ -1110,7 +1459,7 @@ PG_FUNCTION_INFO_V1(gserialized_gist_joinsel);
 Datum gserialized_gist_joinsel(PG_FUNCTION_ARGS)
 {
 	PlannerInfo *root = (PlannerInfo *) PG_GETARG_POINTER(0);
-	/* Oid operator = PG_GETARG_OID(1); */
+	Oid operator = PG_GETARG_OID(1);
 	List *args = (List *) PG_GETARG_POINTER(2);
 	JoinType jointype = (JoinType) PG_GETARG_INT16(3);
 	int mode = PG_GETARG_INT32(4);
@@ -1118,6 +1467,7 @@ Datum gserialized_gist_joinsel(PG_FUNCTION_ARGS)
 	Node *arg1, *arg2;
 	Var *var1, *var2;
 	Oid relid1, relid2;
+	double expand = 0.0;
 	
 	ND_STATS *stats1, *stats2;
 	float8 selectivity;
@@ -1132,17 +1482,34 @@ Datum gserialized_gist_joinsel(PG_FUNCTION_ARGS)
 	/* Find Oids of the geometry columns we are working with */
 	arg1 = (Node*) linitial(args);
 	arg2 = (Node*) lsecond(args);
-	var1 = (Var*) arg1;
-	var2 = (Var*) arg2;
 
-	/* We only do column joins right now, no functional joins */
-	/* TODO: handle g1 && ST_Expand(g2) */
-	if (!IsA(arg1, Var) || !IsA(arg2, Var))
+	/* We only do column joins, g1 && g2 and g1 && ST_Expand(g2, d) */
+	var1 = expanded_var(root, arg1, &expand);
+	var2 = expanded_var(root, arg2, &expand);
+	if ( ! ( var1 && var2 ) )
 	{
 		elog(DEBUG1, "gserialized_gist_joinsel called with arguments that are not column references");
 		PG_RETURN_FLOAT8(DEFAULT_ND_JOINSEL);
 	}
 
+	/*
+	 * Of the mirrored pair of clauses an ST_DWithin join inlines to,
+	 * the one with the lower column on its bare side carries the estimate.
+	 */
+	if ( IsA(arg1, Var) != IsA(arg2, Var) )
+	{
+		Var *bare = IsA(arg1, Var) ? var1 : var2;
+		Var *expanded = IsA(arg1, Var) ? var2 : var1;
+
+		if ( ( bare->varno > expanded->varno ||
+		       ( bare->varno == expanded->varno && bare->varattno > expanded->varattno ) ) &&
+		     join_has_mirror(root, operator, bare, expanded, expand) )
+		{
+			POSTGIS_DEBUG(3, "mirror clause carries the selectivity, returning 1");
+			PG_RETURN_FLOAT8(1.0);
+		}
+	}
+
 	/* What are the Oids of our tables/relations? */
 	relid1 = getrelid(var1->varno, root->parse->rtable);
 	relid2 = getrelid(var2->varno, root->parse->rtable);
@@ -1166,7 +1533,7 @@ Datum gserialized_gist_joinsel(PG_FUNCTION_ARGS)
 		PG_RETURN_FLOAT8(DEFAULT_ND_JOINSEL);
 	}
 
-	selectivity = estimate_join_selectivity(stats1, stats2);
+	selectivity = estimate_join_selectivity(stats1, stats2, expand);
 	POSTGIS_DEBUGF(2, "got selectivity %g", selectivity);
 	
 	pfree(stats1);
@@ -1177,6 +1544,84 @@ Datum gserialized_gist_joinsel(PG_FUNCTION_ARGS)
 
 
 
+/**
+* Lay out the cell edges of each dimension of the histogram so that
+* cells are narrow where the sample features concentrate and wide where
+* there are few. The edges are equal steps of the distribution of
+* feature box centers blended with an even one, then spread so that
+* no cell is narrower than HISTOGRAM_UNIFORM_SHARE of an even cell.
+*/
+static void
+nd_stats_set_edges(ND_STATS *nd_stats, const ND_BOX **nd_boxes, int num_boxes)
+{
+	int d, i, k;
+	int ndims = (int)roundf(nd_stats->ndims);
+	float4 *centers = palloc(sizeof(float4) * Max(num_boxes, 1));
+
+	for ( d = 0; d < ndims; d++ )
+	{
+		float4 *edges = nd_stats_edges(nd_stats, d);
+		int size = (int)roundf(nd_stats->size[d]);
+		double smin = nd_stats->extent.min[d];
+		double smax = nd_stats->extent.max[d];
+		double width = smax - smin;
+		double gap = HISTOGRAM_UNIFORM_SHARE * width / size;
+		double share = HISTOGRAM_UNIFORM_SHARE;
+		int ncenters = 0;
+
+		/* Centers of the features the histogram will count */
+		for ( i = 0; i < num_boxes; i++ )
+		{
+			const ND_BOX *ndb = nd_boxes[i];
+			if ( ! ndb ) continue;
+			centers[ncenters++] = (ndb->min[d] + ndb->max[d]) / 2;
+		}
+		qsort(centers, ncenters, sizeof(float4), cmp_float);
+		if ( ! ncenters || width <= 0 )
+			share = 1.0;
+
+		edges[0] = smin;
+		edges[size] = smax;
+		for ( k = 1; k < size; k++ )
+		{
+			/* Bisect for where the blended distribution reaches k/size */
+			double target = (double)k / size;
+			double lo = smin, hi = smax;
+			for ( i = 0; i < 48; i++ )
+			{
+				double mid = (lo + hi) / 2;
+				double cdf = share * (mid - smin) / width;
+				if ( share < 1.0 )
+				{
+					/* Proportion of centers below mid */
+					int clo = 0, chi = ncenters;
+					while ( clo < chi )
+					{
+						int cmid = (clo + chi) / 2;
+						if ( centers[cmid] < mid )
+							clo = cmid + 1;
+						else
+							chi = cmid;
+					}
+					cdf += (1.0 - share) * clo / ncenters;
+				}
+				if ( cdf < target )
+					lo = mid;
+				else
+					hi = mid;
+			}
+			edges[k] = (lo + hi) / 2;
+		}
+
+		/* Keep a minimum width, spreading edges piled onto repeated coordinates */
+		for ( k = 1; k < size; k++ )
+			edges[k] = Max(edges[k], edges[k-1] + gap);
+		for ( k = size - 1; k > 0; k-- )
+			edges[k] = Min(edges[k], edges[k+1] - gap);
+	}
+	pfree(centers);
+}
+
 /**
  * The gserialized_analyze_nd sets this function as a 
  * callback on the stats object when called by the ANALYZE
@@ -1206,7 +1651,7 @@ compute_gserialized_stats_mode(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfu
 	int histogram_features = 0;        /* # rows that actually got counted in the histogram */
 
 	ND_STATS *nd_stats;                /* Our histogram */
-	size_t    nd_stats_size;           /* Size to allocate */
+	size_t    nd_stats_bytes;          /* Size to allocate */
 	
 	double total_width = 0;            /* # of bytes used by sample */
 	double total_sample_volume = 0;    /* Area/volume coverage of the sample */
@@ -1502,9 +1947,9 @@ compute_gserialized_stats_mode(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfu
 	 * Create the histogram (ND_STATS) in the stats memory context
 	 */
 	old_context = MemoryContextSwitchTo(stats->anl_context);
-	nd_stats_size = sizeof(ND_STATS) + ((histo_cells - 1) * sizeof(float4));
-	nd_stats = palloc(nd_stats_size);
-	memset(nd_stats, 0, nd_stats_size); /* Initialize all values to 0 */
+	nd_stats_bytes = nd_stats_size(ndims, histo_size);
+	nd_stats = palloc(nd_stats_bytes);
+	memset(nd_stats, 0, nd_stats_bytes); /* Initialize all values to 0 */
 	MemoryContextSwitchTo(old_context);
 
 	/* Initialize the #ND_STATS objects */
@@ -1513,10 +1958,14 @@ compute_gserialized_stats_mode(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfu
 	nd_stats->sample_features = sample_rows;
 	nd_stats->table_features = total_rows;
 	nd_stats->not_null_features = notnull_cnt;
+	nd_stats->histogram_cells = histo_cells;
 	/* Copy in the histogram dimensions */
 	for ( d = 0; d < ndims; d++ )
 		nd_stats->size[d] = histo_size[d];
 
+	/* Fit the cell edges to the sample */
+	nd_stats_set_edges(nd_stats, sample_boxes, notnull_cnt);
+
 	/*
 	 * Fourth scan:
 	 *  o fill histogram values with the proportion of
@@ -1538,9 +1987,6 @@ compute_gserialized_stats_mode(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfu
 		int d;
 		double num_cells = 0;
 		double tmp_volume = 1.0;
-		double min[ND_DIMS];
-		double max[ND_DIMS];
-		double cellsize[ND_DIMS];
 
 		nd_box = sample_boxes[i];
 		if ( ! nd_box ) continue; /* Skip Null'ed out hard deviants */
@@ -1560,9 +2006,6 @@ compute_gserialized_stats_mode(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfu
 		{
 			/* Initialize the starting values */
 			at[d] = nd_ibox.min[d];
-			min[d] = nd_stats->extent.min[d];
-			max[d] = nd_stats->extent.max[d];
-			cellsize[d] = (max[d] - min[d])/(nd_stats->size[d]);
 			
 			/* What's the volume (area) of this feature's box? */
 			tmp_volume *= (nd_box->max[d] - nd_box->min[d]);
@@ -1580,18 +2023,14 @@ compute_gserialized_stats_mode(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfu
 			ND_BOX nd_cell;
 			double ratio;
 			/* Create a box for this histogram cell */
-			for ( d = 0; d < nd_stats->ndims; d++ )
-			{
-				nd_cell.min[d] = min[d] + (at[d]+0) * cellsize[d];
-				nd_cell.max[d] = min[d] + (at[d]+1) * cellsize[d];
-			}
+			nd_stats_cell(nd_stats, at, &nd_cell);
 
 			/* 
 			 * If a feature box is completely inside one cell the ratio will be
 			 * 1.0. If a feature box is 50% in two cells, each cell will get
 			 * 0.5 added on.
 			 */
-			ratio = nd_box_ratio(&nd_cell, nd_box, nd_stats->ndims);
+			ratio = nd_box_feature_ratio(&nd_cell, nd_box, nd_stats->ndims);
 			nd_stats->value[nd_stats_value_index(nd_stats, at)] += ratio;
 			num_cells += ratio;
 			POSTGIS_DEBUGF(3, "               ratio (%.8g)  num_cells (%.8g)", ratio, num_cells);
@@ -1619,7 +2058,6 @@ compute_gserialized_stats_mode(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfu
 	}
 	
 	nd_stats->histogram_features = histogram_features;
-	nd_stats->histogram_cells = histo_cells;
 	nd_stats->cells_covered = total_cell_count;
 
 	/* Put this histogram data into the right slot/kind */
@@ -1638,7 +2076,7 @@ compute_gserialized_stats_mode(VacAttrStats *stats, AnalyzeAttrFetchFunc fetchfu
 	stats->stakind[stats_slot] = stats_kind;
 	stats->staop[stats_slot] = InvalidOid;
 	stats->stanumbers[stats_slot] = (float4*)nd_stats;
-	stats->numnumbers[stats_slot] = nd_stats_size/sizeof(float4);
+	stats->numnumbers[stats_slot] = nd_stats_bytes/sizeof(float4);
 	stats->stanullfrac = (float4)null_cnt/sample_rows;
 	stats->stawidth = total_width/notnull_cnt;
 	stats->stadistinct = -1.0;
@@ -1759,9 +2197,6 @@ estimate_selectivity(const GBOX *box, const ND_STATS *nd_stats, int mode)
 	ND_BOX nd_box;
 	ND_IBOX nd_ibox;
 	int at[ND_DIMS];
-	double cell_size[ND_DIMS];
-	double min[ND_DIMS];
-	double max[ND_DIMS];
 	double total_count = 0.0;
 	int ndims_max = Max(nd_stats->ndims, gbox_ndims(box));	
 //	int ndims_min = Min(nd_stats->ndims, gbox_ndims(box));	
@@ -1818,18 +2253,9 @@ estimate_selectivity(const GBOX *box, const ND_STATS *nd_stats, int mode)
 		return FALLBACK_ND_SEL;
 	}
 
-	/* Work out some measurements of the histogram */
+	/* Initialize the counter */
 	for ( d = 0; d < nd_stats->ndims; d++ )
-	{
-		/* Cell size in each dim */
-		min[d] = nd_stats->extent.min[d];
-		max[d] = nd_stats->extent.max[d];
-		cell_size[d] = (max[d] - min[d]) / nd_stats->size[d];
-		POSTGIS_DEBUGF(3, " cell_size[%d] : %.9g", d, cell_size[d]);
-		
-		/* Initialize the counter */
 		at[d] = nd_ibox.min[d];
-	}
 
 	/* Move through all the overlap values and sum them */
 	do 
@@ -1838,11 +2264,7 @@ estimate_selectivity(const GBOX *box, const ND_STATS *nd_stats, int mode)
 		ND_BOX nd_cell;
 		
 		/* We have to pro-rate partially overlapped cells. */
-		for ( d = 0; d < nd_stats->ndims; d++ )
-		{
-			nd_cell.min[d] = min[d] + (at[d]+0) * cell_size[d];
-			nd_cell.max[d] = min[d] + (at[d]+1) * cell_size[d];
-		}
+		nd_stats_cell(nd_stats, at, &nd_cell);
 
 		ratio = nd_box_ratio(&nd_box, &nd_cell, nd_stats->ndims);
 		cell_count = nd_stats->value[nd_stats_value_index(nd_stats, at)];
@@ -1977,7 +2399,7 @@ Datum _postgis_gserialized_joinsel(PG_FUNCTION_ARGS)
 	}
 
 	/* Do the estimation */
-	selectivity = estimate_join_selectivity(nd_stats1, nd_stats2);
+	selectivity = estimate_join_selectivity(nd_stats1, nd_stats2, 0.0);
 	
 	pfree(nd_stats1);
 	pfree(nd_stats2);
@@ -2031,7 +2453,7 @@ PG_FUNCTION_INFO_V1(gserialized_gist_sel);
 Datum gserialized_gist_sel(PG_FUNCTION_ARGS)
 {
 	PlannerInfo *root = (PlannerInfo *) PG_GETARG_POINTER(0);
-	/* Oid operator_oid = PG_GETARG_OID(1); */
+	Oid operator_oid = PG_GETARG_OID(1);
 	List *args = (List *) PG_GETARG_POINTER(2);
 	/* int varRelid = PG_GETARG_INT32(3); */
 	int mode = PG_GETARG_INT32(4);
@@ -2039,9 +2461,10 @@ Datum gserialized_gist_sel(PG_FUNCTION_ARGS)
 	Oid relid;
 	ND_STATS *nd_stats;
 
-	Node *other;
+	Node *other, *self_node;
 	Var *self;
 	GBOX search_box;
+	double expand = 0.0;
 	float8 selectivity = 0;
 	
 	POSTGIS_DEBUG(2, "gserialized_gist_sel called");
@@ -2066,12 +2489,12 @@ Datum gserialized_gist_sel(PG_FUNCTION_ARGS)
 	other = (Node *) linitial(args);
 	if ( ! IsA(other, Const) )
 	{
-		self = (Var *)other;
+		self_node = other;
 		other = (Node *) lsecond(args);
 	}
 	else
 	{
-		self = (Var *) lsecond(args);
+		self_node = (Node *) lsecond(args);
 	}
 
 	if ( ! IsA(other, Const) )
@@ -2083,17 +2506,15 @@ Datum gserialized_gist_sel(PG_FUNCTION_ARGS)
 	/*
 	* We don't have a nice <const> && <var> or <var> && <const> 
 	* situation here. <const> && <const> would probably get evaluated
-	* away by PgSQL earlier on. <func> && <const> is harder, and the
-	* case we get often is <const> && ST_Expand(<var>), which does 
-	* actually have a subtly different selectivity than a bae
-	* <const> && <var> call. It's calculatable though, by expanding
-	* every cell in the histgram appropriately.
+	* away by PgSQL earlier on. The <func> && <const> case we get 
+	* often is <const> && ST_Expand(<var>, d), from ST_DWithin, and 
+	* that selects the same rows as <var> && ST_Expand(<const>, d),
+	* so we grow the search box instead of every histogram cell.
 	* 
 	* Discussion: http://trac.osgeo.org/postgis/ticket/1828
-	*
-	* To do? Do variable selectivity based on the <func> node.
 	*/
-	if ( ! IsA(self, Var) )
+	self = expanded_var(root, self_node, &expand);
+	if ( ! self )
 	{
 		POSTGIS_DEBUG(3, " no bare variable argument ? - returning a moderate selectivity");
 		PG_RETURN_FLOAT8(FALLBACK_ND_SEL);
@@ -2105,6 +2526,18 @@ Datum gserialized_gist_sel(PG_FUNCTION_ARGS)
 		POSTGIS_DEBUG(3, "search box is EMPTY");
 		PG_RETURN_FLOAT8(0.0);
 	}
+
+	if ( ! IsA(self_node, Var) )
+	{
+		gbox_grow(&search_box, expand);
+
+		/* ST_DWithin also gave us <var> && <const>, which counts for both */
+		if ( restriction_has_mirror(root, operator_oid, self, &search_box) )
+		{
+			POSTGIS_DEBUG(3, " mirror clause carries the selectivity, returning 1");
+			PG_RETURN_FLOAT8(1.0);
+		}
+	}
 	POSTGIS_DEBUGF(4, " requested search box is: %s", gbox_to_string(&search_box));
 
 	/* Get pg_statistic row */
@@ -2127,10 +2560,180 @@ Datum gserialized_gist_sel(PG_FUNCTION_ARGS)
 
 
 
+/**
+* Union the keys on the root page of a GiST index into the x/y
+* bounds of the box. The root keys cover everything below them,
+* so a few page reads give the extent of the whole column (though
+* keys are not shrunk when rows are deleted, so it may be loose).
+* Returns LW_FAILURE for an empty index, or key types we do not know.
+*/
+static int
+gist_root_extent(Relation idx_rel, GBOX *gbox)
+{
+	HeapTuple type_tuple;
+	char key_type[NAMEDATALEN];
+	Buffer buffer;
+	Page page;
+	OffsetNumber offset, maxoff;
+	int nkeys = 0;
+	bool invalid = false;
+
+	/* Which of our key types is the index storing? */
+	type_tuple = SearchSysCache1(TYPEOID, ObjectIdGetDatum(get_atttype(RelationGetRelid(idx_rel), 1)));
+	if ( ! HeapTupleIsValid(type_tuple) )
+		return LW_FAILURE;
+	strncpy(key_type, NameStr(((Form_pg_type) GETSTRUCT(type_tuple))->typname), NAMEDATALEN);
+	ReleaseSysCache(type_tuple);
+
+	if ( strcmp(key_type, "box2df") && strcmp(key_type, "gidx") )
+		return LW_FAILURE;
+
+	if ( RelationGetNumberOfBlocks(idx_rel) <= GIST_ROOT_BLKNO )
+		return LW_FAILURE;
+
+	buffer = ReadBuffer(idx_rel, GIST_ROOT_BLKNO);
+	LockBuffer(buffer, GIST_SHARE);
+	page = (Page) BufferGetPage(buffer);
+	maxoff = PageGetMaxOffsetNumber(page);
+
+	for ( offset = FirstOffsetNumber; offset <= maxoff; offset = OffsetNumberNext(offset) )
+	{
+		IndexTuple ituple = (IndexTuple) PageGetItem(page, PageGetItemId(page, offset));
+		double xmin, xmax, ymin, ymax;
+		bool isnull;
+		Datum key;
+
+		/* Left behind by an interrupted page split, the union is incomplete */
+		if ( GistTupleIsInvalid(ituple) )
+		{
+			invalid = true;
+			break;
+		}
+
+		key = index_getattr(ituple, 1, RelationGetDescr(idx_rel), &isnull);
+		if ( isnull )
+			continue;
+
+		if ( ! strcmp(key_type, "box2df") )
+		{
+			BOX2DF *box = (BOX2DF*)DatumGetPointer(key);
+			xmin = box->xmin; xmax = box->xmax;
+			ymin = box->ymin; ymax = box->ymax;
+		}
+		else
+		{
+			GIDX *gidx = (GIDX*)PG_DETOAST_DATUM(key);
+			int ndims = GIDX_NDIMS(gidx);
+			if ( ndims >= 2 )
+			{
+				xmin = GIDX_GET_MIN(gidx, 0); xmax = GIDX_GET_MAX(gidx, 0);
+				ymin = GIDX_GET_MIN(gidx, 1); ymax = GIDX_GET_MAX(gidx, 1);
+			}
+			if ( (Pointer)gidx != DatumGetPointer(key) )
+				pfree(gidx);
+			if ( ndims < 2 )
+				continue;
+		}
+
+		/*
+		** Skip the NaN keys of EMPTY geometries (and of 2D pages holding
+		** nothing else), and any non-finite or inverted box, such as the
+		** uncompressed keys older releases stored for EMPTY and infinite
+		** geometries in 2D indexes. Those garbage boxes may also have
+		** been merged into the unions above them, which only a REINDEX
+		** clears.
+		*/
+		if ( ! finite(xmin) || ! finite(xmax) || ! finite(ymin) || ! finite(ymax) ||
+		     xmin > xmax || ymin > ymax )
+			continue;
+
+		if ( nkeys++ == 0 )
+		{
+			gbox->xmin = xmin; gbox->xmax = xmax;
+			gbox->ymin = ymin; gbox->ymax = ymax;
+		}
+		else
+		{
+			gbox->xmin = Min(gbox->xmin, xmin);
+			gbox->xmax = Max(gbox->xmax, xmax);
+			gbox->ymin = Min(gbox->ymin, ymin);
+			gbox->ymax = Max(gbox->ymax, ymax);
+		}
+	}
+
+	UnlockReleaseBuffer(buffer);
+
+	if ( invalid || ! nkeys )
+		return LW_FAILURE;
+
+	return LW_SUCCESS;
+}
+
+/**
+* Read the extent of a geometry column from the root page of a
+* GiST index on it, if there is one. Partial indexes only cover
+* some of the rows, and invalid ones (left by a failed CREATE INDEX
+* CONCURRENTLY) may miss some, so neither is used.
+*/
+static int
+pg_get_index_extent(const Oid table_oid, const text *att_text, GBOX *gbox)
+{
+	const char *att_name = text2cstring(att_text);
+	AttrNumber att_num;
+	Relation tbl_rel;
+	List *idx_list;
+	ListCell *lc;
+	int result = LW_FAILURE;
+	HeapTuple type_tuple;
+	bool is_geometry;
+
+	att_num = get_attnum(table_oid, att_name);
+	if  ( ! att_num )
+		elog(ERROR, "attribute \"%s\" does not exist", att_name);
+
+	/* Geography keys are geocentric, not the lon/lat we return */
+	type_tuple = SearchSysCache1(TYPEOID, ObjectIdGetDatum(get_atttype(table_oid, att_num)));
+	if ( ! HeapTupleIsValid(type_tuple) )
+		return LW_FAILURE;
+	is_geometry = ! strcmp(NameStr(((Form_pg_type) GETSTRUCT(type_tuple))->typname), "geometry");
+	ReleaseSysCache(type_tuple);
+	if ( ! is_geometry )
+		return LW_FAILURE;
+
+	tbl_rel = relation_open(table_oid, AccessShareLock);
+	idx_list = RelationGetIndexList(tbl_rel);
+
+	foreach(lc, idx_list)
+	{
+		Relation idx_rel = index_open(lfirst_oid(lc), AccessShareLock);
+
+		if ( idx_rel->rd_rel->relam == GIST_AM_OID &&
+		     idx_rel->rd_index->indnatts == 1 &&
+		     idx_rel->rd_index->indkey.values[0] == att_num &&
+		     idx_rel->rd_index->indisvalid &&
+		     idx_rel->rd_index->indisready &&
+		     heap_attisnull(idx_rel->rd_indextuple, Anum_pg_index_indpred) )
+		{
+			POSTGIS_DEBUGF(3, " reading root of index \"%s\"", RelationGetRelationName(idx_rel));
+			result = gist_root_extent(idx_rel, gbox);
+		}
+
+		index_close(idx_rel, AccessShareLock);
+		if ( result == LW_SUCCESS )
+			break;
+	}
+
+	list_free(idx_list);
+	relation_close(tbl_rel, AccessShareLock);
+	return result;
+}
+
 /**
  * Return the estimated extent of the table
  * looking at gathered statistics (or NULL if
- * no statistics have been gathered).
+ * no statistics have been gathered), or with
+ * a fourth argument of true, at the root page
+ * of a GiST index on the column.
  */
 PG_FUNCTION_INFO_V1(gserialized_estimated_extent);
 Datum gserialized_estimated_extent(PG_FUNCTION_ARGS)
@@ -2142,8 +2745,12 @@ Datum gserialized_estimated_extent(PG_FUNCTION_ARGS)
 	Oid tbl_oid;
 	ND_STATS *nd_stats;
 	GBOX *gbox;
+	bool use_index = false;
 
-	if ( PG_NARGS() == 3 )
+	if ( PG_NARGS() == 4 )
+		use_index = PG_GETARG_BOOL(3);
+
+	if ( PG_NARGS() == 3 || PG_NARGS() == 4 )
 	{
 		nsp = text2cstring(PG_GETARG_TEXT_P(0));
 		tbl = text2cstring(PG_GETARG_TEXT_P(1));
@@ -2165,6 +2772,16 @@ Datum gserialized_estimated_extent(PG_FUNCTION_ARGS)
 		PG_RETURN_NULL();
 	}
 
+	/* Construct the box */
+	gbox = palloc(sizeof(GBOX));
+	FLAGS_SET_GEODETIC(gbox->flags, 0);
+	FLAGS_SET_Z(gbox->flags, 0);
+	FLAGS_SET_M(gbox->flags, 0);
+
+	/* The index is always current, fall back to the stats without one */
+	if ( use_index && pg_get_index_extent(tbl_oid, col, gbox) == LW_SUCCESS )
+		PG_RETURN_POINTER(gbox);
+
 	/* Estimated extent only returns 2D bounds, so use mode 2 */
 	nd_stats = pg_get_nd_stats_by_name(tbl_oid, col, 2);
 	
@@ -2172,11 +2789,6 @@ Datum gserialized_estimated_extent(PG_FUNCTION_ARGS)
 	if ( ! nd_stats ) 
 		elog(ERROR, "stats for \"%s.%s\" do not exist", tbl, text2cstring(col));
 
-	/* Construct the box */
-	gbox = palloc(sizeof(GBOX));
-	FLAGS_SET_GEODETIC(gbox->flags, 0);
-	FLAGS_SET_Z(gbox->flags, 0);
-	FLAGS_SET_M(gbox->flags, 0);
 	gbox->xmin = nd_stats->extent.min[0];
 	gbox->xmax = nd_stats->extent.max[0];
 	gbox->ymin = nd_stats->extent.min[1];
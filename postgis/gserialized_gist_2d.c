@@ -36,6 +36,13 @@
 #include "gserialized_gist.h"	     /* For utility functions. */
 #include "liblwgeom_internal.h"  /* For MAXFLOAT */
 
+#include <math.h>
+#include <float.h> /* For FLT_MAX */
+
+#ifndef NAN
+#define NAN 0.0/0.0
+#endif
+
 /*
 ** When is a node split not so good? If more than 90% of the entries
 ** end up in one of the children.
@@ -124,12 +131,49 @@ static BOX2DF* box2df_copy(BOX2DF *b)
 
 
 
+/* An "empty" BOX2DF, with NaN bounds, is the key of an EMPTY
+   geometry, and the union of a page holding nothing but those */
+static inline bool box2df_is_empty(const BOX2DF *a)
+{
+	return isnan(a->xmin);
+}
+
+static inline void box2df_set_empty(BOX2DF *a)
+{
+	a->xmin = a->xmax = a->ymin = a->ymax = NAN;
+}
+
+/* Clamp infinite bounds to the largest floats */
+static inline void box2df_set_finite(BOX2DF *a)
+{
+	if ( ! finite(a->xmax) )
+		a->xmax = (a->xmax > 0 ? FLT_MAX : -FLT_MAX);
+	if ( ! finite(a->ymax) )
+		a->ymax = (a->ymax > 0 ? FLT_MAX : -FLT_MAX);
+	if ( ! finite(a->xmin) )
+		a->xmin = (a->xmin > 0 ? FLT_MAX : -FLT_MAX);
+	if ( ! finite(a->ymin) )
+		a->ymin = (a->ymin > 0 ? FLT_MAX : -FLT_MAX);
+}
+
 /* Enlarge b_union to contain b_new. If b_new contains more
    dimensions than b_union, expand b_union to contain those dimensions. */
 static void box2df_merge(BOX2DF *b_union, BOX2DF *b_new)
 {
 
 	POSTGIS_DEBUGF(5, "merging %s with %s", box2df_to_string(b_union), box2df_to_string(b_new));
+
+	/* Can't merge an empty into anything */
+	if ( box2df_is_empty(b_new) )
+		return;
+
+	/* Merge of empty and non-empty is the non-empty */
+	if ( box2df_is_empty(b_union) )
+	{
+		*b_union = *b_new;
+		return;
+	}
+
 	/* Adjust minimums */
 	b_union->xmin = Min(b_union->xmin, b_new->xmin);
 	b_union->ymin = Min(b_union->ymin, b_new->ymin);
@@ -167,7 +211,7 @@ static float box2df_size(const BOX2DF *a)
 {
 	float result;
 
-	if ( a == NULL ) 
+	if ( a == NULL || box2df_is_empty(a) )
 		return (float)0.0;
 		
 	if ( (a->xmax <= a->xmin) || (a->ymax <= a->ymin) )
@@ -194,10 +238,10 @@ static float box2df_union_size(const BOX2DF *a, const BOX2DF *b)
 		return 0.0;
 	}
 	
-	if ( a == NULL )
+	if ( a == NULL || box2df_is_empty(a) )
 		return box2df_size(b);
 
-	if ( b == NULL )
+	if ( b == NULL || box2df_is_empty(b) )
 		return box2df_size(a);
 
 	result = ((double)Max(a->xmax,b->xmax) - (double)Min(a->xmin,b->xmin)) * 
@@ -377,6 +421,7 @@ static double box2df_distance_leaf_centroid(const BOX2DF *a, const BOX2DF *b)
     return sqrt((a_x - b_x) * (a_x - b_x) + (a_y - b_y) * (a_y - b_y));
 }
 
+#if POSTGIS_PGSQL_VERSION < 95
 /**
 * Calculate the The node_box_edge->query_centroid distance 
 * between the boxes.
@@ -450,6 +495,7 @@ static double box2df_distance_node_centroid(const BOX2DF *node, const BOX2DF *qu
     
     return sqrt(d);
 }
+#endif
 
 /* Quick distance function */
 static inline double pt_distance(double ax, double ay, double bx, double by)
@@ -459,6 +505,9 @@ static inline double pt_distance(double ax, double ay, double bx, double by)
 
 /**
 * Calculate the box->box distance.
+* The differences are taken in double precision, a float result could
+* round up past the distance between the geometries the boxes bound,
+* and the KNN scan relies on this being a lower bound.
 */
 static double box2df_distance(const BOX2DF *a, const BOX2DF *b)
 {
@@ -473,7 +522,7 @@ static double box2df_distance(const BOX2DF *a, const BOX2DF *b)
 		if ( box2df_below(a, b) )
 			return pt_distance(a->xmax, a->ymax, b->xmin, b->ymin);
 		else
-			return b->xmin - a->xmax;
+			return (double)b->xmin - (double)a->xmax;
 	}
 	if ( box2df_right(a, b) )
 	{
@@ -482,7 +531,7 @@ static double box2df_distance(const BOX2DF *a, const BOX2DF *b)
 		if ( box2df_below(a, b) )
 			return pt_distance(a->xmin, a->ymax, b->xmax, b->ymin);
 		else
-			return a->xmin - b->xmax;
+			return (double)a->xmin - (double)b->xmax;
 	}
 	if ( box2df_above(a, b) )
 	{
@@ -491,7 +540,7 @@ static double box2df_distance(const BOX2DF *a, const BOX2DF *b)
 		if ( box2df_right(a, b) )
 			return pt_distance(a->xmin, a->ymin, b->xmax, b->ymax);
 		else
-			return a->ymin - b->ymax;
+			return (double)a->ymin - (double)b->ymax;
 	}
 	if ( box2df_below(a, b) )
 	{
@@ -500,7 +549,7 @@ static double box2df_distance(const BOX2DF *a, const BOX2DF *b)
 		if ( box2df_right(a, b) )
 			return pt_distance(a->xmin, a->ymax, b->xmax, b->ymin);
 		else
-			return b->ymin - a->ymax;
+			return (double)b->ymin - (double)a->ymax;
 	}
 	
 	return MAXFLOAT;
@@ -745,6 +794,11 @@ Datum gserialized_overbelow_2d(PG_FUNCTION_ARGS)
 
 /***********************************************************************
 * GiST Index  Support Functions
+*
+* There is no fetch function, so no index-only scans: a fetch has to
+* hand back the indexed geometry, and the keys are only float boxes of
+* it. Box-only work avoids the detoast another way, by reading a slice
+* of the datum (see gserialized_datum_peek_gbox_p).
 */
 
 /*
@@ -792,11 +846,21 @@ Datum gserialized_gist_compress_2d(PG_FUNCTION_ARGS)
 	/* Extract our index key from the GiST entry. */
 	result = gserialized_datum_get_box2df_p(entry_in->key, &bbox_out);
 
-	/* Is the bounding box valid (non-empty, non-infinite)? If not, return input uncompressed. */
-	if ( result == LW_FAILURE )
+	/*
+	** Is the bounding box valid (non-empty, non-NaN)? If not, use the
+	** "empty" key. Handing back the input uncompressed would store the
+	** start of the serialization as a box, and that would find its way
+	** into the unions of every page above it.
+	*/
+	if ( result == LW_FAILURE ||
+	     isnan(bbox_out.xmax) || isnan(bbox_out.xmin) ||
+	     isnan(bbox_out.ymax) || isnan(bbox_out.ymin) )
 	{
 		POSTGIS_DEBUG(4, "[GIST] empty geometry!");
-		PG_RETURN_POINTER(entry_in);
+		box2df_set_empty(&bbox_out);
+		gistentryinit(*entry_out, PointerGetDatum(box2df_copy(&bbox_out)),
+		              entry_in->rel, entry_in->page, entry_in->offset, FALSE);
+		PG_RETURN_POINTER(entry_out);
 	}
 
 	POSTGIS_DEBUGF(4, "[GIST] got entry_in->key: %s", box2df_to_string(&bbox_out));
@@ -806,7 +870,7 @@ Datum gserialized_gist_compress_2d(PG_FUNCTION_ARGS)
 	     ! finite(bbox_out.ymax) || ! finite(bbox_out.ymin) )
 	{
 		POSTGIS_DEBUG(4, "[GIST] infinite geometry!");
-		PG_RETURN_POINTER(entry_in);
+		box2df_set_finite(&bbox_out);
 	}
 
 	/* Enure bounding box has minimums below maximums. */
@@ -1006,6 +1070,13 @@ Datum gserialized_gist_consistent_2d(PG_FUNCTION_ARGS)
 		PG_RETURN_BOOL(FALSE);
 	}
 
+	/* EMPTY keys, and pages of nothing else, satisfy no box test */
+	if ( box2df_is_empty((BOX2DF*)DatumGetPointer(entry->key)) )
+	{
+		POSTGIS_DEBUG(4, "[GIST] empty index entry, returning false");
+		PG_RETURN_BOOL(FALSE);
+	}
+
 	/* Treat leaf node tests different from internal nodes */
 	if (GIST_LEAF(entry))
 	{
@@ -1048,10 +1119,13 @@ Datum gserialized_gist_distance_2d(PG_FUNCTION_ARGS)
 	BOX2DF *entry_box;
 	StrategyNumber strategy = (StrategyNumber) PG_GETARG_UINT16(2);
 	double distance;
+#if POSTGIS_PGSQL_VERSION >= 95
+	bool *recheck = (bool *) PG_GETARG_POINTER(4);
+#endif
 
 	POSTGIS_DEBUG(4, "[GIST] 'distance' function called");
 
-    /* We are using '13' as the gist distance-betweeen-centroids strategy number 
+    /* We are using '13' as the gist true-distance <-> strategy number 
     *  and '14' as the gist distance-between-boxes strategy number */
     if ( strategy != 13 && strategy != 14 ) {
         elog(ERROR, "unrecognized strategy number: %d", strategy);
@@ -1067,6 +1141,10 @@ Datum gserialized_gist_distance_2d(PG_FUNCTION_ARGS)
 
 	/* Get the entry box */
     entry_box = (BOX2DF*)DatumGetPointer(entry->key);
+
+	/* EMPTY keys go last, as the operators put EMPTY geometries */
+	if ( box2df_is_empty(entry_box) )
+		PG_RETURN_FLOAT8(MAXFLOAT);
 	
 	/* Box-style distance test */
 	if ( strategy == 14 )
@@ -1075,6 +1153,18 @@ Datum gserialized_gist_distance_2d(PG_FUNCTION_ARGS)
 		PG_RETURN_FLOAT8(distance);
 	}
 
+#if POSTGIS_PGSQL_VERSION >= 95
+	/*
+	** With KNN recheck available, <-> is the true minimum distance.
+	** The box distance is a lower bound on it for both nodes and
+	** leaves (keys are rounded outwards), so use it to drive the
+	** scan and have the executor recompute the exact distance of
+	** each leaf before returning it.
+	*/
+	distance = box2df_distance(entry_box, &query_box);
+	if (GIST_LEAF(entry))
+		*recheck = true;
+#else
 	/* Treat leaf node tests different from internal nodes */
 	if (GIST_LEAF(entry))
 	{
@@ -1086,6 +1176,7 @@ Datum gserialized_gist_distance_2d(PG_FUNCTION_ARGS)
 	    /* Calculate distance for internal nodes */
 		distance = (double)box2df_distance_node_centroid(entry_box, &query_box);
 	}
+#endif
 
 	PG_RETURN_FLOAT8(distance);
 }
@@ -1172,7 +1263,10 @@ Datum gserialized_gist_same_2d(PG_FUNCTION_ARGS)
 
 	POSTGIS_DEBUG(4, "[GIST] 'same' function called");
 
-	*result = box2df_equals(b1, b2);
+	if ( box2df_is_empty(b1) || box2df_is_empty(b2) )
+		*result = box2df_is_empty(b1) && box2df_is_empty(b2);
+	else
+		*result = box2df_equals(b1, b2);
 
 	PG_RETURN_POINTER(result);
 }
@@ -1184,6 +1278,13 @@ Datum gserialized_gist_same_2d(PG_FUNCTION_ARGS)
 static void
 adjustBox(BOX2DF *b, BOX2DF *addon)
 {
+	if (box2df_is_empty(addon))
+		return;
+	if (box2df_is_empty(b))
+	{
+		*b = *addon;
+		return;
+	}
 	if (b->xmax < addon->xmax)
 		b->xmax = addon->xmax;
 	if (b->xmin > addon->xmin)
@@ -1513,7 +1614,9 @@ common_entry_cmp(const void *i1, const void *i2)
  * 3) "Common entries" which can be placed to any of groups without affecting
  *	  of overlap along selected axis.
  *
- * The common entries are distributed by minimizing penalty.
+ * The common entries are distributed by minimizing penalty, and the
+ * "empty" keys of EMPTY geometries, which have no extent to split on,
+ * go to the smaller group.
  *
  * For details see:
  * "A new double sorting-based node splitting algorithm for R-tree", A. Korotkov
@@ -1532,34 +1635,55 @@ Datum gserialized_gist_picksplit_2d(PG_FUNCTION_ARGS)
 			   *leftBox,
 			   *rightBox;
 	int			dim,
-				commonEntriesCount;
+				commonEntriesCount,
+				emptyCount = 0;
 	SplitInterval *intervalsLower,
 			   *intervalsUpper;
 	CommonEntry *commonEntries;
-	int			nentries;
+	OffsetNumber *entries,
+			   *emptyEntries;
+	int			nentries,
+				n;
 	
 	POSTGIS_DEBUG(3, "[GIST] 'picksplit' entered");
 
 	memset(&context, 0, sizeof(ConsiderSplitContext));
 
 	maxoff = entryvec->n - 1;
-	nentries = context.entriesCount = maxoff - FirstOffsetNumber + 1;
-
-	/* Allocate arrays for intervals along axes */
-	intervalsLower = (SplitInterval *) palloc(nentries * sizeof(SplitInterval));
-	intervalsUpper = (SplitInterval *) palloc(nentries * sizeof(SplitInterval));
 
 	/*
-	 * Calculate the overall minimum bounding box over all the entries.
+	 * Set the "empty" keys aside, and calculate the overall minimum
+	 * bounding box over all the other entries.
 	 */
+	entries = (OffsetNumber *) palloc(entryvec->n * sizeof(OffsetNumber));
+	emptyEntries = (OffsetNumber *) palloc(entryvec->n * sizeof(OffsetNumber));
+	nentries = 0;
 	for (i = FirstOffsetNumber; i <= maxoff; i = OffsetNumberNext(i))
 	{
 		box = (BOX2DF *) DatumGetPointer(entryvec->vector[i].key);
-		if (i == FirstOffsetNumber)
+		if (box2df_is_empty(box))
+		{
+			emptyEntries[emptyCount++] = i;
+			continue;
+		}
+		if (nentries == 0)
 			context.boundingBox = *box;
 		else
 			adjustBox(&context.boundingBox, box);
+		entries[nentries++] = i;
 	}
+	context.entriesCount = nentries;
+
+	if (nentries < 2)
+	{
+		POSTGIS_DEBUG(4, "too few non-empty entries, trivial split");
+		fallbackSplit(entryvec, v);
+		PG_RETURN_POINTER(v);
+	}
+
+	/* Allocate arrays for intervals along axes */
+	intervalsLower = (SplitInterval *) palloc(nentries * sizeof(SplitInterval));
+	intervalsUpper = (SplitInterval *) palloc(nentries * sizeof(SplitInterval));
 	
 	POSTGIS_DEBUGF(4, "boundingBox is %s", box2df_to_string(
 														&context.boundingBox));
@@ -1576,18 +1700,18 @@ Datum gserialized_gist_picksplit_2d(PG_FUNCTION_ARGS)
 					i2;
 
 		/* Project each entry as an interval on the selected axis. */
-		for (i = FirstOffsetNumber; i <= maxoff; i = OffsetNumberNext(i))
+		for (n = 0; n < nentries; n++)
 		{
-			box = (BOX2DF *) DatumGetPointer(entryvec->vector[i].key);
+			box = (BOX2DF *) DatumGetPointer(entryvec->vector[entries[n]].key);
 			if (dim == 0)
 			{
-				intervalsLower[i - FirstOffsetNumber].lower = box->xmin;
-				intervalsLower[i - FirstOffsetNumber].upper = box->xmax;
+				intervalsLower[n].lower = box->xmin;
+				intervalsLower[n].upper = box->xmax;
 			}
 			else
 			{
-				intervalsLower[i - FirstOffsetNumber].lower = box->ymin;
-				intervalsLower[i - FirstOffsetNumber].upper = box->ymax;
+				intervalsLower[n].lower = box->ymin;
+				intervalsLower[n].upper = box->ymax;
 			}
 		}
 
@@ -1725,8 +1849,8 @@ Datum gserialized_gist_picksplit_2d(PG_FUNCTION_ARGS)
 	POSTGIS_DEBUGF(4, "split direction: %d", context.dim);
 	
 	/* Allocate vectors for results */
-	v->spl_left = (OffsetNumber *) palloc(nentries * sizeof(OffsetNumber));
-	v->spl_right = (OffsetNumber *) palloc(nentries * sizeof(OffsetNumber));
+	v->spl_left = (OffsetNumber *) palloc(entryvec->n * sizeof(OffsetNumber));
+	v->spl_right = (OffsetNumber *) palloc(entryvec->n * sizeof(OffsetNumber));
 	v->spl_nleft = 0;
 	v->spl_nright = 0;
 
@@ -1764,11 +1888,13 @@ Datum gserialized_gist_picksplit_2d(PG_FUNCTION_ARGS)
 	 * Distribute entries which can be distributed unambiguously, and collect
 	 * common entries.
 	 */
-	for (i = FirstOffsetNumber; i <= maxoff; i = OffsetNumberNext(i))
+	for (n = 0; n < nentries; n++)
 	{
 		float		lower,
 					upper;
 
+		i = entries[n];
+
 		/*
 		 * Get upper and lower bounds along selected axis.
 		 */
@@ -1870,6 +1996,18 @@ Datum gserialized_gist_picksplit_2d(PG_FUNCTION_ARGS)
 			}
 		}
 	}
+
+	/*
+	 * "Empty" keys do not change the unions, keep the groups balanced.
+	 */
+	for (n = 0; n < emptyCount; n++)
+	{
+		if (v->spl_nleft <= v->spl_nright)
+			v->spl_left[v->spl_nleft++] = emptyEntries[n];
+		else
+			v->spl_right[v->spl_nright++] = emptyEntries[n];
+	}
+
 	v->spl_ldatum = PointerGetDatum(leftBox);
 	v->spl_rdatum = PointerGetDatum(rightBox);
 	
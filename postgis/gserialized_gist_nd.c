@@ -27,11 +27,14 @@
 #include "access/itup.h"
 #include "access/skey.h"
 
+#include <math.h>
+
 #include "../postgis_config.h"
 
 #include "liblwgeom.h"         /* For standard geometry types. */
 #include "lwgeom_pg.h"       /* For debugging macros. */
 #include "gserialized_gist.h"	     /* For utility functions. */
+#include "liblwgeom_internal.h"  /* For MAXFLOAT */
 #include "geography.h"
 
 /*
@@ -40,6 +43,22 @@
 */
 #define LIMIT_RATIO 0.1
 
+/*
+** 0 == don't use it
+** 1 == use it
+*/
+#define KOROTKOV_SPLIT 1
+
+/*
+** Geocentric boxes live on the unit sphere. A geodesic on an earth
+** ellipsoid is at least as long as the angle it subtends times the
+** smallest radius of curvature, the meridian radius at the equator
+** (a(1-e^2), about 6335km for all of them), and that angle is at
+** least the chord. With some margin, this converts box distances
+** into lower bounds on spheroid distances.
+*/
+#define GEOG_KNN_MIN_RADIUS 6300000.0
+
 /*
 ** For debugging
 */
@@ -64,6 +83,10 @@ Datum gserialized_gist_penalty(PG_FUNCTION_ARGS);
 Datum gserialized_gist_picksplit(PG_FUNCTION_ARGS);
 Datum gserialized_gist_union(PG_FUNCTION_ARGS);
 Datum gserialized_gist_same(PG_FUNCTION_ARGS);
+Datum gserialized_gist_distance(PG_FUNCTION_ARGS);
+#if POSTGIS_PGSQL_VERSION >= 95
+Datum gserialized_gist_geog_distance(PG_FUNCTION_ARGS);
+#endif
 
 /*
 ** ND Operator prototypes
@@ -71,6 +94,7 @@ Datum gserialized_gist_same(PG_FUNCTION_ARGS);
 Datum gserialized_overlaps(PG_FUNCTION_ARGS);
 Datum gserialized_contains(PG_FUNCTION_ARGS);
 Datum gserialized_within(PG_FUNCTION_ARGS);
+Datum gserialized_distance_nd(PG_FUNCTION_ARGS);
 
 /*
 ** GIDX true/false test function type
@@ -249,6 +273,7 @@ static float gidx_union_volume(GIDX *a, GIDX *b)
 	return result;
 }
 
+#if KOROTKOV_SPLIT < 1
 /* Calculate the volume of the intersection of the boxes. */
 static float gidx_inter_volume(GIDX *a, GIDX *b)
 {
@@ -288,6 +313,7 @@ static float gidx_inter_volume(GIDX *a, GIDX *b)
 	POSTGIS_DEBUGF(5, "volume( %s intersection %s ) = %.12g", gidx_to_string(a), gidx_to_string(b), result);
 	return result;
 }
+#endif
 
 /*
 ** Overlapping GIDX box test.
@@ -418,6 +444,32 @@ static bool gidx_equals(GIDX *a, GIDX *b)
 	return TRUE;
 }
 
+/*
+** Distance between GIDX boxes, zero when they overlap. Only the
+** dimensions both boxes have are compared, so a 2D query orders a
+** 3D index by planar distance. Unknown boxes are infinitely far.
+*/
+static double gidx_distance(GIDX *a, GIDX *b)
+{
+	int i, ndims;
+	double sum = 0.0;
+
+	if ( gidx_is_unknown(a) || gidx_is_unknown(b) )
+		return MAXFLOAT;
+
+	ndims = Min(GIDX_NDIMS(a), GIDX_NDIMS(b));
+	for ( i = 0; i < ndims; i++ )
+	{
+		double d = 0.0;
+		if ( GIDX_GET_MAX(a,i) < GIDX_GET_MIN(b,i) )
+			d = (double)GIDX_GET_MIN(b,i) - GIDX_GET_MAX(a,i);
+		else if ( GIDX_GET_MAX(b,i) < GIDX_GET_MIN(a,i) )
+			d = (double)GIDX_GET_MIN(a,i) - GIDX_GET_MAX(b,i);
+		sum += d * d;
+	}
+	return sqrt(sum);
+}
+
 /**
 * Support function. Based on two datums return true if
 * they satisfy the predicate and false otherwise.
@@ -516,6 +568,28 @@ Datum gserialized_overlaps(PG_FUNCTION_ARGS)
 	PG_RETURN_BOOL(FALSE);
 }
 
+/*
+** '<<->>' operator function. Distance between the N-D boxes of two
+** geometries, NULL when either is EMPTY. The index computes exactly
+** this from its keys, so KNN scans need no recheck.
+*/
+PG_FUNCTION_INFO_V1(gserialized_distance_nd);
+Datum gserialized_distance_nd(PG_FUNCTION_ARGS)
+{
+	char boxmem1[GIDX_MAX_SIZE];
+	char boxmem2[GIDX_MAX_SIZE];
+	GIDX *gidx1 = (GIDX*)boxmem1;
+	GIDX *gidx2 = (GIDX*)boxmem2;
+
+	if ( gserialized_datum_get_gidx_p(PG_GETARG_DATUM(0), gidx1) == LW_FAILURE ||
+	     gserialized_datum_get_gidx_p(PG_GETARG_DATUM(1), gidx2) == LW_FAILURE )
+	{
+		PG_RETURN_NULL();
+	}
+
+	PG_RETURN_FLOAT8(gidx_distance(gidx1, gidx2));
+}
+
 /***********************************************************************
 * GiST Index  Support Functions
 */
@@ -748,6 +822,90 @@ Datum gserialized_gist_consistent(PG_FUNCTION_ARGS)
 }
 
 
+/*
+** GiST support function. Take in a query and an entry and return the
+** N-D box distance between them, for '<<->>' ordering. Keys of mixed
+** dimensionality are compared on the dimensions they share.
+*/
+PG_FUNCTION_INFO_V1(gserialized_gist_distance);
+Datum gserialized_gist_distance(PG_FUNCTION_ARGS)
+{
+	GISTENTRY *entry = (GISTENTRY*) PG_GETARG_POINTER(0);
+	StrategyNumber strategy = (StrategyNumber) PG_GETARG_UINT16(2);
+	char query_box_mem[GIDX_MAX_SIZE];
+	GIDX *query_box = (GIDX*)query_box_mem;
+	GIDX *entry_box;
+
+	POSTGIS_DEBUG(4, "[GIST] 'distance' function called");
+
+	/* We are using '13' as the gist box distance strategy number */
+	if ( strategy != 13 )
+	{
+		elog(ERROR, "unrecognized strategy number: %d", strategy);
+		PG_RETURN_FLOAT8(MAXFLOAT);
+	}
+
+	/* Null box should never make this far. */
+	if ( gserialized_datum_get_gidx_p(PG_GETARG_DATUM(1), query_box) == LW_FAILURE )
+	{
+		POSTGIS_DEBUG(4, "[GIST] null query_gbox_index!");
+		PG_RETURN_FLOAT8(MAXFLOAT);
+	}
+
+	/* Get the entry box */
+	entry_box = (GIDX*)DatumGetPointer(entry->key);
+
+	PG_RETURN_FLOAT8(gidx_distance(entry_box, query_box));
+}
+
+#if POSTGIS_PGSQL_VERSION >= 95
+/*
+** GiST support function for geography '<->' ordering. The geocentric
+** box distance, scaled to meters, bounds the spheroid distance from
+** below, and the executor rechecks leaves with geography_distance_knn.
+*/
+PG_FUNCTION_INFO_V1(gserialized_gist_geog_distance);
+Datum gserialized_gist_geog_distance(PG_FUNCTION_ARGS)
+{
+	GISTENTRY *entry = (GISTENTRY*) PG_GETARG_POINTER(0);
+	StrategyNumber strategy = (StrategyNumber) PG_GETARG_UINT16(2);
+	bool *recheck = (bool *) PG_GETARG_POINTER(4);
+	char query_box_mem[GIDX_MAX_SIZE];
+	GIDX *query_box = (GIDX*)query_box_mem;
+	GIDX *entry_box;
+	double distance;
+
+	POSTGIS_DEBUG(4, "[GIST] 'geog_distance' function called");
+
+	/* We are using '13' as the gist spheroid distance strategy number */
+	if ( strategy != 13 )
+	{
+		elog(ERROR, "unrecognized strategy number: %d", strategy);
+		PG_RETURN_FLOAT8(MAXFLOAT);
+	}
+
+	/* Null box should never make this far. */
+	if ( gserialized_datum_get_gidx_p(PG_GETARG_DATUM(1), query_box) == LW_FAILURE )
+	{
+		POSTGIS_DEBUG(4, "[GIST] null query_gbox_index!");
+		PG_RETURN_FLOAT8(MAXFLOAT);
+	}
+
+	/* Get the entry box */
+	entry_box = (GIDX*)DatumGetPointer(entry->key);
+
+	distance = gidx_distance(entry_box, query_box);
+	if ( distance < MAXFLOAT )
+		distance *= GEOG_KNN_MIN_RADIUS;
+
+	/* Leaves only have a bound, the exact distance is computed on recheck */
+	if (GIST_LEAF(entry))
+		*recheck = true;
+
+	PG_RETURN_FLOAT8(distance);
+}
+#endif
+
 /*
 ** GiST support function. Calculate the "penalty" cost of adding this entry into an existing entry.
 ** Calculate the change in volume of the old entry once the new entry is added.
@@ -856,42 +1014,6 @@ Datum gserialized_gist_same(PG_FUNCTION_ARGS)
 ** Utility function to add entries to the axis partition lists in the
 ** picksplit function.
 */
-static void gserialized_gist_picksplit_addlist(OffsetNumber *list, GIDX **box_union, GIDX *box_current, int *pos, int num)
-{
-	if ( *pos )
-		gidx_merge(box_union,  box_current);
-	else
-		memcpy((void*)(*box_union), (void*)box_current, VARSIZE(box_current));
-	list[*pos] = num;
-	(*pos)++;
-}
-
-/*
-** Utility function check whether the number of entries two halves of the
-** space constitute a "bad ratio" (poor balance).
-*/
-static int gserialized_gist_picksplit_badratio(int x, int y)
-{
-	POSTGIS_DEBUGF(4, "[GIST] checking split ratio (%d, %d)", x, y);
-	if ( (y == 0) || (((float)x / (float)y) < LIMIT_RATIO) ||
-	     (x == 0) || (((float)y / (float)x) < LIMIT_RATIO) )
-		return TRUE;
-
-	return FALSE;
-}
-
-static bool gserialized_gist_picksplit_badratios(int *pos, int dims)
-{
-	int i;
-	for ( i = 0; i < dims; i++ )
-	{
-		if ( gserialized_gist_picksplit_badratio(pos[2*i],pos[2*i+1]) == FALSE )
-			return FALSE;
-	}
-	return TRUE;
-}
-
-
 /*
 ** Where the picksplit algorithm cannot find any basis for splitting one way
 ** or another, we simply split the overflowing node in half.
@@ -956,6 +1078,627 @@ static void gserialized_gist_picksplit_fallback(GistEntryVector *entryvec, GIST_
 	v->spl_ldatum_exists = v->spl_rdatum_exists = false;
 }
 
+#if KOROTKOV_SPLIT > 0
+/*
+ * Represents information about an entry that can be placed to either group
+ * without affecting overlap over selected axis ("common entry").
+ */
+typedef struct
+{
+	/* Index of entry in the initial array */
+	int			index;
+	/* Delta between penalties of entry insertion into different groups */
+	float		delta;
+} CommonEntry;
+
+/*
+ * Context for gidx_consider_split. Contains information about currently
+ * selected split and some general information.
+ */
+typedef struct
+{
+	int			entriesCount;	/* total number of entries being split */
+
+	/* Information about currently selected split follows */
+
+	bool		first;			/* true if no split was selected yet */
+
+	float		leftUpper;		/* upper bound of left interval */
+	float		rightLower;		/* lower bound of right interval */
+
+	float4		ratio;
+	float4		overlap;
+	int			dim;			/* axis of this split */
+	float		range;			/* width of general MBR projection to the
+								 * selected axis */
+} ConsiderSplitContext;
+
+/*
+ * Interval represents projection of box to axis.
+ */
+typedef struct
+{
+	float		lower,
+				upper;
+} SplitInterval;
+
+/*
+ * Project a GIDX onto an axis. Boxes without that dimension sit at
+ * zero on it, as they do for the overlap test.
+ */
+static inline void
+gidx_axis_interval(GIDX *box, int dim, float *lower, float *upper)
+{
+	if (dim < GIDX_NDIMS(box))
+	{
+		*lower = GIDX_GET_MIN(box, dim);
+		*upper = GIDX_GET_MAX(box, dim);
+	}
+	else
+	{
+		*lower = *upper = 0.0;
+	}
+}
+
+/*
+ * Interval comparison function by lower bound of the interval;
+ */
+static int
+interval_cmp_lower(const void *i1, const void *i2)
+{
+	float		lower1 = ((const SplitInterval *) i1)->lower,
+				lower2 = ((const SplitInterval *) i2)->lower;
+
+	if (lower1 < lower2)
+		return -1;
+	else if (lower1 > lower2)
+		return 1;
+	else
+		return 0;
+}
+
+/*
+ * Interval comparison function by upper bound of the interval;
+ */
+static int
+interval_cmp_upper(const void *i1, const void *i2)
+{
+	float		upper1 = ((const SplitInterval *) i1)->upper,
+				upper2 = ((const SplitInterval *) i2)->upper;
+
+	if (upper1 < upper2)
+		return -1;
+	else if (upper1 > upper2)
+		return 1;
+	else
+		return 0;
+}
+
+/*
+ * Replace negative value with zero.
+ */
+static inline float
+non_negative(float val)
+{
+	if (val >= 0.0f)
+		return val;
+	else
+		return 0.0f;
+}
+
+/*
+ * Consider replacement of currently selected split with the better one.
+ * Same criteria as the 2D opclass, over any number of axes.
+ */
+static inline void
+gidx_consider_split(ConsiderSplitContext *context, int dimNum, float range,
+					float rightLower, int minLeftCount,
+					float leftUpper, int maxLeftCount)
+{
+	int			leftCount,
+				rightCount;
+	float4		ratio,
+				overlap;
+
+	POSTGIS_DEBUGF(5, "consider split: dimNum = %d, rightLower = %f, "
+		"minLeftCount = %d, leftUpper = %f, maxLeftCount = %d ",
+		dimNum, rightLower, minLeftCount, leftUpper, maxLeftCount);
+
+	/*
+	 * Calculate entries distribution ratio assuming most uniform distribution
+	 * of common entries.
+	 */
+	if (minLeftCount >= (context->entriesCount + 1) / 2)
+	{
+		leftCount = minLeftCount;
+	}
+	else
+	{
+		if (maxLeftCount <= context->entriesCount / 2)
+			leftCount = maxLeftCount;
+		else
+			leftCount = context->entriesCount / 2;
+	}
+	rightCount = context->entriesCount - leftCount;
+
+	/*
+	 * Ratio of split - quotient between size of lesser group and total
+	 * entries count.
+	 */
+	ratio = ((float4) Min(leftCount, rightCount)) /
+		((float4) context->entriesCount);
+
+	if (ratio > LIMIT_RATIO)
+	{
+		bool		selectthis = false;
+
+		overlap = (leftUpper - rightLower) / range;
+
+		/* If there is no previous selection, select this */
+		if (context->first)
+			selectthis = true;
+		else if (context->dim == dimNum)
+		{
+			/*
+			 * Within the same dimension, choose the new split if it has a
+			 * smaller overlap, or same overlap but better ratio.
+			 */
+			if (overlap < context->overlap ||
+				(overlap == context->overlap && ratio > context->ratio))
+				selectthis = true;
+		}
+		else
+		{
+			/*
+			 * Across dimensions, choose the new split if it has a smaller
+			 * *non-negative* overlap, or same *non-negative* overlap but
+			 * bigger range, which keeps the children closer to cubes. See
+			 * g_box_consider_split() in gserialized_gist_2d.c.
+			 */
+			if (non_negative(overlap) < non_negative(context->overlap) ||
+				(range > context->range &&
+				 non_negative(overlap) <= non_negative(context->overlap)))
+				selectthis = true;
+		}
+
+		if (selectthis)
+		{
+			/* save information about selected split */
+			context->first = false;
+			context->ratio = ratio;
+			context->range = range;
+			context->overlap = overlap;
+			context->rightLower = rightLower;
+			context->leftUpper = leftUpper;
+			context->dim = dimNum;
+			POSTGIS_DEBUG(5, "split selected");
+		}
+	}
+}
+
+/*
+ * Return increase of original GIDX volume by new GIDX volume insertion.
+ */
+static float
+gidx_penalty(GIDX *original, GIDX *new)
+{
+	return gidx_union_volume(original, new) - gidx_volume(original);
+}
+
+/*
+ * Compare common entries by their deltas.
+ */
+static int
+common_entry_cmp(const void *i1, const void *i2)
+{
+	float		delta1 = ((const CommonEntry *) i1)->delta,
+				delta2 = ((const CommonEntry *) i2)->delta;
+
+	if (delta1 < delta2)
+		return -1;
+	else if (delta1 > delta2)
+		return 1;
+	else
+		return 0;
+}
+
+/*
+ * --------------------------------------------------------------------------
+ * Double sorting split algorithm, generalized from the 2D opclass to
+ * GIDX keys of any dimensionality.
+ *
+ * Each entry is projected as an interval on every axis in turn, and the
+ * ways to split the intervals into two groups are considered, trying to
+ * minimize the overlap of the groups (see gidx_consider_split). The best
+ * split over all axes wins. Entries that fit in either group without
+ * adding overlap ("common entries") are then distributed by minimal
+ * volume penalty, and "unknown" (EMPTY) keys go to the smaller group.
+ *
+ * For details see:
+ * "A new double sorting-based node splitting algorithm for R-tree", A. Korotkov
+ * http://syrcose.ispras.ru/2011/files/SYRCoSE2011_Proceedings.pdf#page=36
+ * --------------------------------------------------------------------------
+ */
+PG_FUNCTION_INFO_V1(gserialized_gist_picksplit);
+Datum gserialized_gist_picksplit(PG_FUNCTION_ARGS)
+{
+	GistEntryVector *entryvec = (GistEntryVector *) PG_GETARG_POINTER(0);
+	GIST_SPLITVEC *v = (GIST_SPLITVEC *) PG_GETARG_POINTER(1);
+	OffsetNumber i,
+				maxoff;
+	ConsiderSplitContext context;
+	GIDX	   *box,
+			   *leftBox = NULL,
+			   *rightBox = NULL;
+	int			dim,
+				ndims = 0,
+				commonEntriesCount,
+				unknownCount = 0;
+	SplitInterval *intervalsLower,
+			   *intervalsUpper;
+	CommonEntry *commonEntries;
+	OffsetNumber *entries,
+			   *unknownEntries;
+	int			nentries,
+				n;
+
+	POSTGIS_DEBUG(3, "[GIST] 'picksplit' entered");
+
+	memset(&context, 0, sizeof(ConsiderSplitContext));
+
+	maxoff = entryvec->n - 1;
+
+	/*
+	 * Set the "unknown" keys aside, they have no extent to split on.
+	 * The known ones tell how many axes there are to consider.
+	 */
+	entries = (OffsetNumber *) palloc(entryvec->n * sizeof(OffsetNumber));
+	unknownEntries = (OffsetNumber *) palloc(entryvec->n * sizeof(OffsetNumber));
+	nentries = 0;
+	for (i = FirstOffsetNumber; i <= maxoff; i = OffsetNumberNext(i))
+	{
+		box = (GIDX *) DatumGetPointer(entryvec->vector[i].key);
+		if (gidx_is_unknown(box))
+		{
+			unknownEntries[unknownCount++] = i;
+		}
+		else
+		{
+			entries[nentries++] = i;
+			ndims = Max(ndims, GIDX_NDIMS(box));
+		}
+	}
+	context.entriesCount = nentries;
+
+	if (nentries < 2)
+	{
+		POSTGIS_DEBUG(4, "too few known entries, trivial split");
+		gserialized_gist_picksplit_fallback(entryvec, v);
+		PG_RETURN_POINTER(v);
+	}
+
+	/* Allocate arrays for intervals along axes */
+	intervalsLower = (SplitInterval *) palloc(nentries * sizeof(SplitInterval));
+	intervalsUpper = (SplitInterval *) palloc(nentries * sizeof(SplitInterval));
+
+	/*
+	 * Iterate over axes for optimal split searching.
+	 */
+	context.first = true;		/* nothing selected yet */
+	for (dim = 0; dim < ndims; dim++)
+	{
+		float		leftUpper,
+					rightLower,
+					range;
+		int			i1,
+					i2;
+
+		/* Project each entry as an interval on the selected axis. */
+		for (n = 0; n < nentries; n++)
+		{
+			box = (GIDX *) DatumGetPointer(entryvec->vector[entries[n]].key);
+			gidx_axis_interval(box, dim, &intervalsLower[n].lower,
+							   &intervalsLower[n].upper);
+		}
+
+		/*
+		 * Make two arrays of intervals: one sorted by lower bound and another
+		 * sorted by upper bound.
+		 */
+		memcpy(intervalsUpper, intervalsLower,
+			   sizeof(SplitInterval) * nentries);
+		qsort(intervalsLower, nentries, sizeof(SplitInterval),
+			  interval_cmp_lower);
+		qsort(intervalsUpper, nentries, sizeof(SplitInterval),
+			  interval_cmp_upper);
+
+		/* Width of the projection of all entries, nothing to split if none */
+		range = intervalsUpper[nentries - 1].upper - intervalsLower[0].lower;
+		if (!(range > 0.0))
+			continue;
+
+		/*
+		 * Iterate over lower bound of right group, finding smallest possible
+		 * upper bound of left group. See gserialized_gist_picksplit_2d()
+		 * for a worked example.
+		 */
+		i1 = 0;
+		i2 = 0;
+		rightLower = intervalsLower[i1].lower;
+		leftUpper = intervalsUpper[i2].lower;
+		while (true)
+		{
+			/*
+			 * Find next lower bound of right group.
+			 */
+			while (i1 < nentries && rightLower == intervalsLower[i1].lower)
+			{
+				leftUpper = Max(leftUpper, intervalsLower[i1].upper);
+				i1++;
+			}
+			if (i1 >= nentries)
+				break;
+			rightLower = intervalsLower[i1].lower;
+
+			/*
+			 * Find count of intervals which anyway should be placed to the
+			 * left group.
+			 */
+			while (i2 < nentries && intervalsUpper[i2].upper <= leftUpper)
+				i2++;
+
+			/*
+			 * Consider found split.
+			 */
+			gidx_consider_split(&context, dim, range,
+								rightLower, i1, leftUpper, i2);
+		}
+
+		/*
+		 * Iterate over upper bound of left group finding greates possible
+		 * lower bound of right group.
+		 */
+		i1 = nentries - 1;
+		i2 = nentries - 1;
+		rightLower = intervalsLower[i1].upper;
+		leftUpper = intervalsUpper[i2].upper;
+		while (true)
+		{
+			/*
+			 * Find next upper bound of left group.
+			 */
+			while (i2 >= 0 && leftUpper == intervalsUpper[i2].upper)
+			{
+				rightLower = Min(rightLower, intervalsUpper[i2].lower);
+				i2--;
+			}
+			if (i2 < 0)
+				break;
+			leftUpper = intervalsUpper[i2].upper;
+
+			/*
+			 * Find count of intervals which anyway should be placed to the
+			 * right group.
+			 */
+			while (i1 >= 0 && intervalsLower[i1].lower >= rightLower)
+				i1--;
+
+			/*
+			 * Consider found split.
+			 */
+			gidx_consider_split(&context, dim, range,
+								rightLower, i1 + 1, leftUpper, i2 + 1);
+		}
+	}
+
+	/*
+	 * If we failed to find any acceptable splits, use trivial split.
+	 */
+	if (context.first)
+	{
+		POSTGIS_DEBUG(4, "no acceptable splits, trivial split");
+		gserialized_gist_picksplit_fallback(entryvec, v);
+		PG_RETURN_POINTER(v);
+	}
+
+	POSTGIS_DEBUGF(4, "split direction: %d", context.dim);
+
+	/* Allocate vectors for results */
+	v->spl_left = (OffsetNumber *) palloc(entryvec->n * sizeof(OffsetNumber));
+	v->spl_right = (OffsetNumber *) palloc(entryvec->n * sizeof(OffsetNumber));
+	v->spl_nleft = 0;
+	v->spl_nright = 0;
+
+	/*
+	 * Allocate an array for "common entries" - entries which can be placed to
+	 * either group without affecting overlap along selected axis.
+	 */
+	commonEntriesCount = 0;
+	commonEntries = (CommonEntry *) palloc(nentries * sizeof(CommonEntry));
+
+	/* Helper macros to place an entry in the left or right group */
+#define PLACE_LEFT(box, off)					\
+	do {										\
+		if (v->spl_nleft > 0)					\
+			gidx_merge(&leftBox, box);			\
+		else									\
+			leftBox = gidx_copy(box);			\
+		v->spl_left[v->spl_nleft++] = off;		\
+	} while(0)
+
+#define PLACE_RIGHT(box, off)					\
+	do {										\
+		if (v->spl_nright > 0)					\
+			gidx_merge(&rightBox, box);			\
+		else									\
+			rightBox = gidx_copy(box);			\
+		v->spl_right[v->spl_nright++] = off;	\
+	} while(0)
+
+	/*
+	 * Distribute entries which can be distributed unambiguously, and collect
+	 * common entries.
+	 */
+	for (n = 0; n < nentries; n++)
+	{
+		float		lower,
+					upper;
+
+		/*
+		 * Get upper and lower bounds along selected axis.
+		 */
+		box = (GIDX *) DatumGetPointer(entryvec->vector[entries[n]].key);
+		gidx_axis_interval(box, context.dim, &lower, &upper);
+
+		if (upper <= context.leftUpper)
+		{
+			/* Fits to the left group */
+			if (lower >= context.rightLower)
+			{
+				/* Fits also to the right group, so "common entry" */
+				commonEntries[commonEntriesCount++].index = entries[n];
+			}
+			else
+			{
+				/* Doesn't fit to the right group, so join to the left group */
+				PLACE_LEFT(box, entries[n]);
+			}
+		}
+		else
+		{
+			/*
+			 * Each entry should fit on either left or right group. Since this
+			 * entry didn't fit on the left group, it better fit in the right
+			 * group.
+			 */
+			Assert(lower >= context.rightLower);
+
+			/* Doesn't fit to the left group, so join to the right group */
+			PLACE_RIGHT(box, entries[n]);
+		}
+	}
+
+	/*
+	 * Distribute "common entries", if any.
+	 */
+	if (commonEntriesCount > 0)
+	{
+		/*
+		 * Calculate minimum number of entries that must be placed in both
+		 * groups, to reach LIMIT_RATIO.
+		 */
+		int			m = ceil(LIMIT_RATIO * (double) nentries);
+
+		/*
+		 * Calculate delta between penalties of join "common entries" to
+		 * different groups. An empty group costs nothing to join.
+		 */
+		for (n = 0; n < commonEntriesCount; n++)
+		{
+			box = (GIDX *) DatumGetPointer(entryvec->vector[
+												commonEntries[n].index].key);
+			commonEntries[n].delta = Abs(
+				(v->spl_nleft > 0 ? gidx_penalty(leftBox, box) : 0.0) -
+				(v->spl_nright > 0 ? gidx_penalty(rightBox, box) : 0.0));
+		}
+
+		/*
+		 * Sort "common entries" by calculated deltas in order to distribute
+		 * the most ambiguous entries first.
+		 */
+		qsort(commonEntries, commonEntriesCount, sizeof(CommonEntry), common_entry_cmp);
+
+		/*
+		 * Distribute "common entries" between groups.
+		 */
+		for (n = 0; n < commonEntriesCount; n++)
+		{
+			box = (GIDX *) DatumGetPointer(entryvec->vector[
+												commonEntries[n].index].key);
+
+			/*
+			 * Check if we have to place this entry in either group to achieve
+			 * LIMIT_RATIO.
+			 */
+			if (v->spl_nleft + (commonEntriesCount - n) <= m)
+				PLACE_LEFT(box, commonEntries[n].index);
+			else if (v->spl_nright + (commonEntriesCount - n) <= m)
+				PLACE_RIGHT(box, commonEntries[n].index);
+			else if (v->spl_nleft == 0)
+				PLACE_LEFT(box, commonEntries[n].index);
+			else if (v->spl_nright == 0)
+				PLACE_RIGHT(box, commonEntries[n].index);
+			else
+			{
+				/* Otherwise select the group by minimal penalty */
+				if (gidx_penalty(leftBox, box) < gidx_penalty(rightBox, box))
+					PLACE_LEFT(box, commonEntries[n].index);
+				else
+					PLACE_RIGHT(box, commonEntries[n].index);
+			}
+		}
+	}
+
+	/*
+	 * "Unknown" keys do not change the unions, keep the groups balanced.
+	 */
+	for (n = 0; n < unknownCount; n++)
+	{
+		if (v->spl_nleft <= v->spl_nright)
+			v->spl_left[v->spl_nleft++] = unknownEntries[n];
+		else
+			v->spl_right[v->spl_nright++] = unknownEntries[n];
+	}
+
+#undef PLACE_LEFT
+#undef PLACE_RIGHT
+
+	v->spl_ldatum = PointerGetDatum(leftBox);
+	v->spl_rdatum = PointerGetDatum(rightBox);
+
+	POSTGIS_DEBUGF(4, "[GIST] spl_ldatum: %s", gidx_to_string(leftBox));
+	POSTGIS_DEBUGF(4, "[GIST] spl_rdatum: %s", gidx_to_string(rightBox));
+	POSTGIS_DEBUG(4, "[GIST] 'picksplit' completed");
+
+	PG_RETURN_POINTER(v);
+}
+
+#else /* !KOROTKOV_SPLIT */
+
+static void gserialized_gist_picksplit_addlist(OffsetNumber *list, GIDX **box_union, GIDX *box_current, int *pos, int num)
+{
+	if ( *pos )
+		gidx_merge(box_union,  box_current);
+	else
+		memcpy((void*)(*box_union), (void*)box_current, VARSIZE(box_current));
+	list[*pos] = num;
+	(*pos)++;
+}
+
+/*
+** Utility function check whether the number of entries two halves of the
+** space constitute a "bad ratio" (poor balance).
+*/
+static int gserialized_gist_picksplit_badratio(int x, int y)
+{
+	POSTGIS_DEBUGF(4, "[GIST] checking split ratio (%d, %d)", x, y);
+	if ( (y == 0) || (((float)x / (float)y) < LIMIT_RATIO) ||
+	     (x == 0) || (((float)y / (float)x) < LIMIT_RATIO) )
+		return TRUE;
+
+	return FALSE;
+}
+
+static bool gserialized_gist_picksplit_badratios(int *pos, int dims)
+{
+	int i;
+	for ( i = 0; i < dims; i++ )
+	{
+		if ( gserialized_gist_picksplit_badratio(pos[2*i],pos[2*i+1]) == FALSE )
+			return FALSE;
+	}
+	return TRUE;
+}
 
 
 static void gserialized_gist_picksplit_constructsplit(GIST_SPLITVEC *v, OffsetNumber *list1, int nlist1, GIDX **union1, OffsetNumber *list2, int nlist2, GIDX **union2)
@@ -1258,6 +2001,7 @@ Datum gserialized_gist_picksplit(PG_FUNCTION_ARGS)
 	PG_RETURN_POINTER(v);
 
 }
+#endif /* KOROTKOV_SPLIT */
 
 /*
 ** The GIDX key must be defined as a PostgreSQL type, even though it is only
@@ -367,7 +367,6 @@ Datum BOX2D_combine(PG_FUNCTION_ARGS)
 	Pointer box2d_ptr = PG_GETARG_POINTER(0);
 	Pointer geom_ptr = PG_GETARG_POINTER(1);
 	GBOX *a,*b;
-	GSERIALIZED *lwgeom;
 	GBOX box, *result;
 
 	if  ( (box2d_ptr == NULL) && (geom_ptr == NULL) )
@@ -379,9 +378,8 @@ Datum BOX2D_combine(PG_FUNCTION_ARGS)
 
 	if (box2d_ptr == NULL)
 	{
-		lwgeom = (GSERIALIZED *)PG_DETOAST_DATUM(PG_GETARG_DATUM(1));
 		/* empty geom would make getbox2d_p return NULL */
-		if ( ! gserialized_get_gbox_p(lwgeom, &box) ) PG_RETURN_NULL();
+		if ( ! gserialized_datum_peek_gbox_p(PG_GETARG_DATUM(1), &box, NULL) ) PG_RETURN_NULL();
 		memcpy(result, &box, sizeof(GBOX));
 		PG_RETURN_POINTER(result);
 	}
@@ -395,8 +393,8 @@ Datum BOX2D_combine(PG_FUNCTION_ARGS)
 
 	/*combine_bbox(BOX3D, geometry) => union(BOX3D, geometry->bvol) */
 
-	lwgeom = (GSERIALIZED *)PG_DETOAST_DATUM(PG_GETARG_DATUM(1));
-	if ( ! gserialized_get_gbox_p(lwgeom, &box) )
+	/* Only the box is needed, don't detoast the whole geometry for it */
+	if ( ! gserialized_datum_peek_gbox_p(PG_GETARG_DATUM(1), &box, NULL) )
 	{
 		/* must be the empty geom */
 		memcpy(result, (char *)PG_GETARG_DATUM(0), sizeof(GBOX));
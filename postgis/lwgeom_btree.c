@@ -15,6 +15,10 @@
  * Comparision function for use in Binary Tree searches
  * (ORDER BY, GROUP BY, DISTINCT)
  *
+ * Only the SRID and the bounding box take part in the comparisons,
+ * and both are read off the top of the serialization, so large
+ * geometries are not detoasted just to be sorted.
+ *
  ***********************************************************/
 
 #include "postgres.h"
@@ -44,30 +48,24 @@ Datum lwgeom_cmp(PG_FUNCTION_ARGS);
 PG_FUNCTION_INFO_V1(lwgeom_lt);
 Datum lwgeom_lt(PG_FUNCTION_ARGS)
 {
-	GSERIALIZED *geom1 = (GSERIALIZED *) PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
-	GSERIALIZED *geom2 = (GSERIALIZED *) PG_DETOAST_DATUM(PG_GETARG_DATUM(1));
 	GBOX box1;
 	GBOX box2;
+	int32_t srid1, srid2;
 
 	POSTGIS_DEBUG(2, "lwgeom_lt called");
 
-	if (gserialized_get_srid(geom1) != gserialized_get_srid(geom2))
+	gserialized_datum_peek_gbox_p(PG_GETARG_DATUM(0), &box1, &srid1);
+	gserialized_datum_peek_gbox_p(PG_GETARG_DATUM(1), &box2, &srid2);
+
+	if (srid1 != srid2)
 	{
 		elog(BTREE_SRID_MISMATCH_SEVERITY,
 		     "Operation on two GEOMETRIES with different SRIDs\n");
-		PG_FREE_IF_COPY(geom1, 0);
-		PG_FREE_IF_COPY(geom2, 1);
 		PG_RETURN_NULL();
 	}
 
 	POSTGIS_DEBUG(3, "lwgeom_lt passed getSRID test");
 
-	gserialized_get_gbox_p(geom1, &box1);
-	gserialized_get_gbox_p(geom2, &box2);
-
-	PG_FREE_IF_COPY(geom1, 0);
-	PG_FREE_IF_COPY(geom2, 1);
-
 	POSTGIS_DEBUG(3, "lwgeom_lt getbox2d_p passed");
 
 	if  ( ! FPeq(box1.xmin , box2.xmin) )
@@ -100,28 +98,22 @@ Datum lwgeom_lt(PG_FUNCTION_ARGS)
 PG_FUNCTION_INFO_V1(lwgeom_le);
 Datum lwgeom_le(PG_FUNCTION_ARGS)
 {
-	GSERIALIZED *geom1 = (GSERIALIZED *) PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
-	GSERIALIZED *geom2 = (GSERIALIZED *) PG_DETOAST_DATUM(PG_GETARG_DATUM(1));
 	GBOX box1;
 	GBOX box2;
+	int32_t srid1, srid2;
 
 	POSTGIS_DEBUG(2, "lwgeom_le called");
 
-	if (gserialized_get_srid(geom1) != gserialized_get_srid(geom2))
+	gserialized_datum_peek_gbox_p(PG_GETARG_DATUM(0), &box1, &srid1);
+	gserialized_datum_peek_gbox_p(PG_GETARG_DATUM(1), &box2, &srid2);
+
+	if (srid1 != srid2)
 	{
 		elog(BTREE_SRID_MISMATCH_SEVERITY,
 		     "Operation on two GEOMETRIES with different SRIDs\n");
-		PG_FREE_IF_COPY(geom1, 0);
-		PG_FREE_IF_COPY(geom2, 1);
 		PG_RETURN_NULL();
 	}
 
-	gserialized_get_gbox_p(geom1, &box1);
-	gserialized_get_gbox_p(geom2, &box2);
-
-	PG_FREE_IF_COPY(geom1, 0);
-	PG_FREE_IF_COPY(geom2, 1);
-
 	if  ( ! FPeq(box1.xmin , box2.xmin) )
 	{
 		if  (box1.xmin < box2.xmin)
@@ -164,32 +156,27 @@ Datum lwgeom_le(PG_FUNCTION_ARGS)
 PG_FUNCTION_INFO_V1(lwgeom_eq);
 Datum lwgeom_eq(PG_FUNCTION_ARGS)
 {
-	GSERIALIZED *geom1 = (GSERIALIZED *) PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
-	GSERIALIZED *geom2 = (GSERIALIZED *) PG_DETOAST_DATUM(PG_GETARG_DATUM(1));
 	GBOX box1;
 	GBOX box2;
+	int32_t srid1, srid2;
   bool empty1, empty2;
 	bool result;
 
 	POSTGIS_DEBUG(2, "lwgeom_eq called");
 
-	if (gserialized_get_srid(geom1) != gserialized_get_srid(geom2))
+	gbox_init(&box1);
+	gbox_init(&box2);
+	
+	empty1 = ( gserialized_datum_peek_gbox_p(PG_GETARG_DATUM(0), &box1, &srid1) == LW_FAILURE );
+	empty2 = ( gserialized_datum_peek_gbox_p(PG_GETARG_DATUM(1), &box2, &srid2) == LW_FAILURE );
+
+	if (srid1 != srid2)
 	{
 		elog(BTREE_SRID_MISMATCH_SEVERITY,
 		     "Operation on two GEOMETRIES with different SRIDs\n");
-		PG_FREE_IF_COPY(geom1, 0);
-		PG_FREE_IF_COPY(geom2, 1);
 		PG_RETURN_NULL();
 	}
 
-	gbox_init(&box1);
-	gbox_init(&box2);
-	
-	empty1 = ( gserialized_get_gbox_p(geom1, &box1) == LW_FAILURE );
-	empty2 = ( gserialized_get_gbox_p(geom2, &box2) == LW_FAILURE );
-	PG_FREE_IF_COPY(geom1, 0);
-	PG_FREE_IF_COPY(geom2, 1);
-
 	if  ( empty1 != empty2 ) 
 	{
     result = FALSE;
@@ -210,28 +197,22 @@ Datum lwgeom_eq(PG_FUNCTION_ARGS)
 PG_FUNCTION_INFO_V1(lwgeom_ge);
 Datum lwgeom_ge(PG_FUNCTION_ARGS)
 {
-	GSERIALIZED *geom1 = (GSERIALIZED *) PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
-	GSERIALIZED *geom2 = (GSERIALIZED *) PG_DETOAST_DATUM(PG_GETARG_DATUM(1));
 	GBOX box1;
 	GBOX box2;
+	int32_t srid1, srid2;
 
 	POSTGIS_DEBUG(2, "lwgeom_ge called");
 
-	if (gserialized_get_srid(geom1) != gserialized_get_srid(geom2))
+	gserialized_datum_peek_gbox_p(PG_GETARG_DATUM(0), &box1, &srid1);
+	gserialized_datum_peek_gbox_p(PG_GETARG_DATUM(1), &box2, &srid2);
+
+	if (srid1 != srid2)
 	{
 		elog(BTREE_SRID_MISMATCH_SEVERITY,
 		     "Operation on two GEOMETRIES with different SRIDs\n");
-		PG_FREE_IF_COPY(geom1, 0);
-		PG_FREE_IF_COPY(geom2, 1);
 		PG_RETURN_NULL();
 	}
 
-	gserialized_get_gbox_p(geom1, &box1);
-	gserialized_get_gbox_p(geom2, &box2);
-
-	PG_FREE_IF_COPY(geom1, 0);
-	PG_FREE_IF_COPY(geom2, 1);
-
 	if  ( ! FPeq(box1.xmin , box2.xmin) )
 	{
 		if  (box1.xmin > box2.xmin)
@@ -274,28 +255,22 @@ Datum lwgeom_ge(PG_FUNCTION_ARGS)
 PG_FUNCTION_INFO_V1(lwgeom_gt);
 Datum lwgeom_gt(PG_FUNCTION_ARGS)
 {
-	GSERIALIZED *geom1 = (GSERIALIZED *) PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
-	GSERIALIZED *geom2 = (GSERIALIZED *) PG_DETOAST_DATUM(PG_GETARG_DATUM(1));
 	GBOX box1;
 	GBOX box2;
+	int32_t srid1, srid2;
 
 	POSTGIS_DEBUG(2, "lwgeom_gt called");
 
-	if (gserialized_get_srid(geom1) != gserialized_get_srid(geom2))
+	gserialized_datum_peek_gbox_p(PG_GETARG_DATUM(0), &box1, &srid1);
+	gserialized_datum_peek_gbox_p(PG_GETARG_DATUM(1), &box2, &srid2);
+
+	if (srid1 != srid2)
 	{
 		elog(BTREE_SRID_MISMATCH_SEVERITY,
 		     "Operation on two GEOMETRIES with different SRIDs\n");
-		PG_FREE_IF_COPY(geom1, 0);
-		PG_FREE_IF_COPY(geom2, 1);
 		PG_RETURN_NULL();
 	}
 
-	gserialized_get_gbox_p(geom1, &box1);
-	gserialized_get_gbox_p(geom2, &box2);
-
-	PG_FREE_IF_COPY(geom1, 0);
-	PG_FREE_IF_COPY(geom2, 1);
-
 	if  ( ! FPeq(box1.xmin , box2.xmin) )
 	{
 		if  (box1.xmin > box2.xmin)
@@ -334,28 +309,22 @@ Datum lwgeom_gt(PG_FUNCTION_ARGS)
 PG_FUNCTION_INFO_V1(lwgeom_cmp);
 Datum lwgeom_cmp(PG_FUNCTION_ARGS)
 {
-	GSERIALIZED *geom1 = (GSERIALIZED *) PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
-	GSERIALIZED *geom2 = (GSERIALIZED *) PG_DETOAST_DATUM(PG_GETARG_DATUM(1));
 	GBOX box1;
 	GBOX box2;
+	int32_t srid1, srid2;
 
 	POSTGIS_DEBUG(2, "lwgeom_cmp called");
 
-	if (gserialized_get_srid(geom1) != gserialized_get_srid(geom2))
+	gserialized_datum_peek_gbox_p(PG_GETARG_DATUM(0), &box1, &srid1);
+	gserialized_datum_peek_gbox_p(PG_GETARG_DATUM(1), &box2, &srid2);
+
+	if (srid1 != srid2)
 	{
 		elog(BTREE_SRID_MISMATCH_SEVERITY,
 		     "Operation on two GEOMETRIES with different SRIDs\n");
-		PG_FREE_IF_COPY(geom1, 0);
-		PG_FREE_IF_COPY(geom2, 1);
 		PG_RETURN_NULL();
 	}
 
-	gserialized_get_gbox_p(geom1, &box1);
-	gserialized_get_gbox_p(geom2, &box2);
-
-	PG_FREE_IF_COPY(geom1, 0);
-	PG_FREE_IF_COPY(geom2, 1);
-
 	if  ( ! FPeq(box1.xmin , box2.xmin) )
 	{
 		if  (box1.xmin < box2.xmin)
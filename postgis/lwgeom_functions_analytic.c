@@ -16,6 +16,7 @@
 #include "liblwgeom_internal.h"
 #include "lwgeom_pg.h"
 #include "math.h"
+#include <limits.h>
 #include "lwgeom_rtree.h"
 #include "lwgeom_functions_analytic.h"
 
@@ -234,22 +235,7 @@ Datum LWGEOM_line_interpolate_point(PG_FUNCTION_ARGS)
 #define CHECK_RING_IS_CLOSE
 #define SAMEPOINT(a,b) ((a)->x==(b)->x&&(a)->y==(b)->y)
 
-typedef struct gridspec_t
-{
-	double ipx;
-	double ipy;
-	double ipz;
-	double ipm;
-	double xsize;
-	double ysize;
-	double zsize;
-	double msize;
-}
-gridspec;
-
-
 /* Forward declarations */
-LWGEOM *lwgeom_grid(LWGEOM *lwgeom, gridspec *grid);
 LWCOLLECTION *lwcollection_grid(LWCOLLECTION *coll, gridspec *grid);
 LWPOINT * lwpoint_grid(LWPOINT *point, gridspec *grid);
 LWPOLY * lwpoly_grid(LWPOLY *poly, gridspec *grid);
@@ -1169,6 +1155,124 @@ int point_in_multipolygon_rtree(RTREE_NODE **root, int polyCount, int *ringCount
 
 }
 
+static int
+ring_index_cmp(const void *a, const void *b)
+{
+	return *(const int*)a - *(const int*)b;
+}
+
+/*
+ * return -1 if point outside polygon
+ * return 0 if point on boundary
+ * return 1 if point inside polygon
+ *
+ * Same answers as point_in_multipolygon_rtree(), looked up in the grid
+ * for points in cells no edge passes through, otherwise computed from
+ * the edges of the cells between the point and the right of the grid.
+ */
+int point_in_multipolygon_grid(RTREE_GRID *grid, LWPOINT *point)
+{
+	int c, col, row, k, e, r, i, p;
+	int cell, ntouched, in_ring;
+	double side;
+	POINT2D pt;
+	RTREE_GRID_EDGE *edge;
+	int result = -1;
+
+	POSTGIS_DEBUGF(2, "point_in_multipolygon_grid called for %p %p.", grid, point);
+
+	getPoint2d_p(point->point, 0, &pt);
+
+	cell = RTreeGridCell(grid, &pt);
+	row = cell / grid->ncols;
+	col = cell % grid->ncols;
+
+	if ( grid->cellStates[cell] )
+	{
+		POSTGIS_DEBUGF(3, "point_in_multipolygon_grid: cell %d classified %d", cell, grid->cellStates[cell]);
+		return grid->cellStates[cell];
+	}
+
+	/* Stamps tell the edges and rings already seen by this call */
+	if ( grid->stamp == INT_MAX )
+	{
+		memset(grid->edgeStamp, 0, sizeof(int) * grid->nedges);
+		memset(grid->ringStamp, 0, sizeof(int) * grid->nrings);
+		grid->stamp = 0;
+	}
+	grid->stamp++;
+	ntouched = 0;
+
+	/* Winding numbers of the rings, as computed by point_in_ring_rtree() */
+	for ( c = col; c < grid->ncols; c++ )
+	{
+		cell = row * grid->ncols + c;
+		for ( k = grid->cellStart[cell]; k < grid->cellStart[cell+1]; k++ )
+		{
+			e = grid->cellEdges[k];
+			if ( grid->edgeStamp[e] == grid->stamp )
+				continue;
+			grid->edgeStamp[e] = grid->stamp;
+
+			edge = &(grid->edges[e]);
+			r = edge->ring;
+			if ( grid->ringStamp[r] != grid->stamp )
+			{
+				grid->ringStamp[r] = grid->stamp;
+				grid->ringWinding[r] = 0;
+				grid->ringOnEdge[r] = 0;
+				grid->ringsTouched[ntouched++] = r;
+			}
+			if ( grid->ringOnEdge[r] )
+				continue;
+
+			side = determineSide(&(edge->p1), &(edge->p2), &pt);
+			if ( side == 0.0 && isOnSegment(&(edge->p1), &(edge->p2), &pt) == 1 )
+				grid->ringOnEdge[r] = 1;
+			else if ( FP_CONTAINS_BOTTOM(edge->p1.y, pt.y, edge->p2.y) && side > 0 )
+				grid->ringWinding[r]++;
+			else if ( FP_CONTAINS_BOTTOM(edge->p2.y, pt.y, edge->p1.y) && side < 0 )
+				grid->ringWinding[r]--;
+		}
+	}
+
+	/*
+	 * Combine the rings in the order point_in_multipolygon_rtree() does,
+	 * rings the ray did not meet being outside.
+	 */
+	qsort(grid->ringsTouched, ntouched, sizeof(int), ring_index_cmp);
+	p = -1;
+	for ( i = 0; i < ntouched; i++ )
+	{
+		r = grid->ringsTouched[i];
+		in_ring = grid->ringOnEdge[r] ? 0 : (grid->ringWinding[r] ? 1 : -1);
+
+		if ( grid->ringPoly[r] != p )
+		{
+			/* if we have a positive result, we can short-circuit and return it */
+			if ( result == 1 )
+				return 1;
+
+			p = grid->ringPoly[r];
+			result = -1;
+			if ( r != grid->polyFirstRing[p] ) /* outside the exterior ring */
+				continue;
+			if ( in_ring == 0 ) /* on the boundary */
+				return 0;
+			result = in_ring;
+		}
+		else if ( result == 1 )
+		{
+			if ( in_ring == 1 ) /* inside a hole => outside the polygon */
+				result = -1;
+			else if ( in_ring == 0 ) /* on the edge of a hole */
+				return 0;
+		}
+	}
+
+	return result; /* -1 = outside, 0 = boundary, 1 = inside */
+}
+
 /*
  * return -1 iff point outside polygon
  * return 0 iff point on boundary
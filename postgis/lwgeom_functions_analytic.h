@@ -18,6 +18,25 @@
 
 int point_in_polygon_rtree(RTREE_NODE **root, int ringCount, LWPOINT *point);
 int point_in_multipolygon_rtree(RTREE_NODE **root, int polyCount, int *ringCounts, LWPOINT *point);
+int point_in_multipolygon_grid(RTREE_GRID *grid, LWPOINT *point);
 int point_in_polygon(LWPOLY *polygon, LWPOINT *point);
 int point_in_multipolygon(LWMPOLY *mpolygon, LWPOINT *pont);
 
+/*
+** Snapping to a grid, see ST_SnapToGrid.
+*/
+
+typedef struct gridspec_t
+{
+	double ipx;
+	double ipy;
+	double ipz;
+	double ipm;
+	double xsize;
+	double ysize;
+	double zsize;
+	double msize;
+}
+gridspec;
+
+LWGEOM *lwgeom_grid(LWGEOM *lwgeom, gridspec *grid);
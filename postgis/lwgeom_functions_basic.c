@@ -18,6 +18,7 @@
 
 #include "liblwgeom_internal.h"
 #include "lwgeom_pg.h"
+#include "lwgeom_rectree.h"
 
 #include <math.h>
 #include <float.h>
@@ -554,15 +555,27 @@ Datum LWGEOM_closestpoint(PG_FUNCTION_ARGS)
 	GSERIALIZED *geom1 = (GSERIALIZED*)PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
 	GSERIALIZED *geom2 = (GSERIALIZED*)PG_DETOAST_DATUM(PG_GETARG_DATUM(1));
 	LWGEOM *point;
-	LWGEOM *lwgeom1 = lwgeom_from_gserialized(geom1);
-	LWGEOM *lwgeom2 = lwgeom_from_gserialized(geom2);
+	LWGEOM *lwgeom1;
+	LWGEOM *lwgeom2;
 
-	if (lwgeom1->srid != lwgeom2->srid)
+	if (gserialized_get_srid(geom1) != gserialized_get_srid(geom2))
 	{
 		elog(ERROR,"Operation on two GEOMETRIES with different SRIDs\n");
 		PG_RETURN_NULL();
 	}
 
+	/* Repeated calls against the same geometry can use a cached edge tree */
+	if ( geometry_closestpoint_cache(fcinfo, geom1, geom2, &point) == LW_SUCCESS )
+	{
+		result = geometry_serialize(point);
+		lwgeom_free(point);
+		PG_FREE_IF_COPY(geom1, 0);
+		PG_FREE_IF_COPY(geom2, 1);
+		PG_RETURN_POINTER(result);
+	}
+
+	lwgeom1 = lwgeom_from_gserialized(geom1);
+	lwgeom2 = lwgeom_from_gserialized(geom2);
 	point = lw_dist2d_distancepoint(lwgeom1, lwgeom2, lwgeom1->srid, DIST_MIN);
 
 	if (lwgeom_is_empty(point))
@@ -588,15 +601,27 @@ Datum LWGEOM_shortestline2d(PG_FUNCTION_ARGS)
 	GSERIALIZED *geom1 = (GSERIALIZED*)PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
 	GSERIALIZED *geom2 = (GSERIALIZED*)PG_DETOAST_DATUM(PG_GETARG_DATUM(1));
 	LWGEOM *theline;
-	LWGEOM *lwgeom1 = lwgeom_from_gserialized(geom1);
-	LWGEOM *lwgeom2 = lwgeom_from_gserialized(geom2);
+	LWGEOM *lwgeom1;
+	LWGEOM *lwgeom2;
 
-	if (lwgeom1->srid != lwgeom2->srid)
+	if (gserialized_get_srid(geom1) != gserialized_get_srid(geom2))
 	{
 		elog(ERROR,"Operation on two GEOMETRIES with different SRIDs\n");
 		PG_RETURN_NULL();
 	}
 
+	/* Repeated calls against the same geometry can use a cached edge tree */
+	if ( geometry_shortestline_cache(fcinfo, geom1, geom2, &theline) == LW_SUCCESS )
+	{
+		result = geometry_serialize(theline);
+		lwgeom_free(theline);
+		PG_FREE_IF_COPY(geom1, 0);
+		PG_FREE_IF_COPY(geom2, 1);
+		PG_RETURN_POINTER(result);
+	}
+
+	lwgeom1 = lwgeom_from_gserialized(geom1);
+	lwgeom2 = lwgeom_from_gserialized(geom2);
 	theline = lw_dist2d_distanceline(lwgeom1, lwgeom2, lwgeom1->srid, DIST_MIN);
 	
 	if (lwgeom_is_empty(theline))
@@ -654,15 +679,25 @@ Datum LWGEOM_mindistance2d(PG_FUNCTION_ARGS)
 	double mindist;
 	GSERIALIZED *geom1 = (GSERIALIZED*)PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
 	GSERIALIZED *geom2 = (GSERIALIZED*)PG_DETOAST_DATUM(PG_GETARG_DATUM(1));
-	LWGEOM *lwgeom1 = lwgeom_from_gserialized(geom1);
-	LWGEOM *lwgeom2 = lwgeom_from_gserialized(geom2);
+	LWGEOM *lwgeom1;
+	LWGEOM *lwgeom2;
 
-	if (lwgeom1->srid != lwgeom2->srid)
+	if (gserialized_get_srid(geom1) != gserialized_get_srid(geom2))
 	{
 		elog(ERROR,"Operation on two GEOMETRIES with different SRIDs\n");
 		PG_RETURN_NULL();
 	}
 
+	/* Repeated calls against the same geometry can use a cached edge tree */
+	if ( geometry_distance_cache(fcinfo, geom1, geom2, &mindist) == LW_SUCCESS )
+	{
+		PG_FREE_IF_COPY(geom1, 0);
+		PG_FREE_IF_COPY(geom2, 1);
+		PG_RETURN_FLOAT8(mindist);
+	}
+
+	lwgeom1 = lwgeom_from_gserialized(geom1);
+	lwgeom2 = lwgeom_from_gserialized(geom2);
 	mindist = lwgeom_mindistance2d(lwgeom1, lwgeom2);
 
 	lwgeom_free(lwgeom1);
@@ -687,11 +722,12 @@ PG_FUNCTION_INFO_V1(LWGEOM_dwithin);
 Datum LWGEOM_dwithin(PG_FUNCTION_ARGS)
 {
 	double mindist;
+	int dwithin;
 	GSERIALIZED *geom1 = (GSERIALIZED*)PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
 	GSERIALIZED *geom2 = (GSERIALIZED*)PG_DETOAST_DATUM(PG_GETARG_DATUM(1));
 	double tolerance = PG_GETARG_FLOAT8(2);	
-	LWGEOM *lwgeom1 = lwgeom_from_gserialized(geom1);
-	LWGEOM *lwgeom2 = lwgeom_from_gserialized(geom2);
+	LWGEOM *lwgeom1;
+	LWGEOM *lwgeom2;
 
 	if ( tolerance < 0 )
 	{
@@ -699,14 +735,26 @@ Datum LWGEOM_dwithin(PG_FUNCTION_ARGS)
 		PG_RETURN_NULL();
 	}
 
-	if (lwgeom1->srid != lwgeom2->srid)
+	if (gserialized_get_srid(geom1) != gserialized_get_srid(geom2))
 	{
 		elog(ERROR,"Operation on two GEOMETRIES with different SRIDs\n");
 		PG_RETURN_NULL();
 	}
 
+	/* Repeated calls against the same geometry can use a cached edge tree */
+	if ( geometry_dwithin_cache(fcinfo, geom1, geom2, tolerance, &dwithin) == LW_SUCCESS )
+	{
+		PG_FREE_IF_COPY(geom1, 0);
+		PG_FREE_IF_COPY(geom2, 1);
+		PG_RETURN_BOOL(dwithin);
+	}
+
+	lwgeom1 = lwgeom_from_gserialized(geom1);
+	lwgeom2 = lwgeom_from_gserialized(geom2);
 	mindist = lwgeom_mindistance2d_tolerance(lwgeom1,lwgeom2,tolerance);
 
+	lwgeom_free(lwgeom1);
+	lwgeom_free(lwgeom2);
 	PG_FREE_IF_COPY(geom1, 0);
 	PG_FREE_IF_COPY(geom2, 1);
 	/*empty geometries cases should be right handled since return from underlying
@@ -2676,3 +2724,40 @@ Datum ST_FlipCoordinates(PG_FUNCTION_ARGS)
 
 	PG_RETURN_POINTER(output);
 }
+
+Datum ST_ClipByBox2D(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(ST_ClipByBox2D);
+Datum ST_ClipByBox2D(PG_FUNCTION_ARGS)
+{
+	GSERIALIZED *input = (GSERIALIZED *)PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
+	GBOX *clip = (GBOX *) PG_GETARG_POINTER(1);
+	GSERIALIZED *output;
+	LWGEOM *lwgeom_in, *lwgeom_out;
+	GBOX gbox;
+
+	/* Empty clips to empty */
+	if ( gserialized_get_gbox_p(input, &gbox) == LW_FAILURE )
+		PG_RETURN_POINTER(input);
+
+	/* All inside, nothing to clip */
+	if ( gbox.xmin >= clip->xmin && gbox.xmax <= clip->xmax &&
+	     gbox.ymin >= clip->ymin && gbox.ymax <= clip->ymax )
+		PG_RETURN_POINTER(input);
+
+	lwgeom_in = lwgeom_from_gserialized(input);
+
+	/* All outside, nothing left */
+	if ( ! gbox_overlaps_2d(&gbox, clip) )
+		lwgeom_out = lwgeom_construct_empty(lwgeom_in->type, lwgeom_in->srid,
+		                                    lwgeom_has_z(lwgeom_in), lwgeom_has_m(lwgeom_in));
+	else
+		lwgeom_out = lwgeom_clip_by_rect(lwgeom_in, clip->xmin, clip->ymin, clip->xmax, clip->ymax);
+
+	output = geometry_serialize(lwgeom_out);
+
+	lwgeom_free(lwgeom_out);
+	lwgeom_free(lwgeom_in);
+	PG_FREE_IF_COPY(input, 0);
+
+	PG_RETURN_POINTER(output);
+}
@@ -28,6 +28,7 @@
 #include "lwgeom_geos.h"
 #include "liblwgeom_internal.h"
 #include "lwgeom_rtree.h"
+#include "lwgeom_rectree.h"
 #include "lwgeom_geos_prepared.h" 
 
 
@@ -73,6 +74,7 @@ Datum ST_UnaryUnion(PG_FUNCTION_ARGS);
 Datum ST_Equals(PG_FUNCTION_ARGS);
 Datum ST_BuildArea(PG_FUNCTION_ARGS);
 Datum ST_DelaunayTriangles(PG_FUNCTION_ARGS);
+Datum ST_Subdivide(PG_FUNCTION_ARGS);
 
 Datum pgis_union_geometry_array(PG_FUNCTION_ARGS);
 
@@ -2035,7 +2037,11 @@ Datum contains(PG_FUNCTION_ARGS)
 
 		poly_cache = GetRtreeCache(fcinfo, geom1);
 
-		if ( poly_cache && poly_cache->ringIndices )
+		if ( poly_cache && poly_cache->grid )
+		{
+			result = point_in_multipolygon_grid(poly_cache->grid, point);
+		}
+		else if ( poly_cache && poly_cache->ringIndices )
 		{
 			result = point_in_multipolygon_rtree(poly_cache->ringIndices, poly_cache->polyCount, poly_cache->ringCounts, point);
 		}
@@ -2261,7 +2267,11 @@ Datum covers(PG_FUNCTION_ARGS)
 
 		poly_cache = GetRtreeCache(fcinfo, geom1);
 
-		if ( poly_cache && poly_cache->ringIndices )
+		if ( poly_cache && poly_cache->grid )
+		{
+			result = point_in_multipolygon_grid(poly_cache->grid, point);
+		}
+		else if ( poly_cache && poly_cache->ringIndices )
 		{
 			result = point_in_multipolygon_rtree(poly_cache->ringIndices, poly_cache->polyCount, poly_cache->ringCounts, point);
 		}
@@ -2416,7 +2426,11 @@ Datum coveredby(PG_FUNCTION_ARGS)
 
 		poly_cache = GetRtreeCache(fcinfo, geom2);
 
-		if ( poly_cache && poly_cache->ringIndices )
+		if ( poly_cache && poly_cache->grid )
+		{
+			result = point_in_multipolygon_grid(poly_cache->grid, point);
+		}
+		else if ( poly_cache && poly_cache->ringIndices )
 		{
 			result = point_in_multipolygon_rtree(poly_cache->ringIndices, poly_cache->polyCount, poly_cache->ringCounts, point);
 		}
@@ -2568,6 +2582,7 @@ Datum geos_intersects(PG_FUNCTION_ARGS)
 	LWGEOM *lwgeom;
 	RTREE_POLY_CACHE *poly_cache;
 	PrepGeomCache *prep_cache;
+	int tree_result;
 
 	geom1 = (GSERIALIZED *)PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
 	geom2 = (GSERIALIZED *)PG_DETOAST_DATUM(PG_GETARG_DATUM(1));
@@ -2621,7 +2636,11 @@ Datum geos_intersects(PG_FUNCTION_ARGS)
 
 		poly_cache = GetRtreeCache(fcinfo, serialized_poly);
 
-		if ( poly_cache && poly_cache->ringIndices )
+		if ( poly_cache && poly_cache->grid )
+		{
+			result = point_in_multipolygon_grid(poly_cache->grid, point);
+		}
+		else if ( poly_cache && poly_cache->ringIndices )
 		{
 			result = point_in_multipolygon_rtree(poly_cache->ringIndices, poly_cache->polyCount, poly_cache->ringCounts, point);
 		}
@@ -2654,6 +2673,19 @@ Datum geos_intersects(PG_FUNCTION_ARGS)
 		}
 	}
 
+	/*
+	 * short-circuit 3: if one argument is repeated from call to call,
+	 * the cached edge tree can tell disjoint arguments apart without
+	 * going through GEOS. Intersecting ones still go to the prepared
+	 * geometry below.
+	 */
+	if ( geometry_intersects_cache(fcinfo, geom1, geom2, &tree_result) == LW_SUCCESS )
+	{
+		PG_FREE_IF_COPY(geom1, 0);
+		PG_FREE_IF_COPY(geom2, 1);
+		PG_RETURN_BOOL(tree_result);
+	}
+
 	initGEOS(lwnotice, lwgeom_geos_error);
 	prep_cache = GetPrepGeomCache( fcinfo, geom1, geom2 );
 
@@ -3642,3 +3674,56 @@ Datum ST_Node(PG_FUNCTION_ARGS)
 #endif /* POSTGIS_GEOS_VERSION >= 33 */
 
 }
+
+/*
+ * Cut a geometry in pieces of at most max_vertices vertices,
+ * returned one per row, bar pieces that can't be cut further.
+ * The default budget of 256 vertices keeps 2D pieces well
+ * within a page, out of TOAST.
+ */
+typedef struct
+{
+	LWCOLLECTION *col;
+	int nextgeom;
+}
+SUBDIVIDESTATE;
+
+PG_FUNCTION_INFO_V1(ST_Subdivide);
+Datum ST_Subdivide(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	SUBDIVIDESTATE *state;
+	GSERIALIZED *result;
+
+	if ( SRF_IS_FIRSTCALL() )
+	{
+		MemoryContext oldcontext;
+		GSERIALIZED *geom;
+		LWGEOM *lwgeom;
+		int maxvertices = PG_GETARG_INT32(1);
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		geom = (GSERIALIZED *)PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
+		lwgeom = lwgeom_from_gserialized(geom);
+
+		state = lwalloc(sizeof(SUBDIVIDESTATE));
+		state->col = lwgeom_subdivide(lwgeom, maxvertices);
+		state->nextgeom = 0;
+		funcctx->user_fctx = state;
+
+		lwgeom_free(lwgeom);
+		PG_FREE_IF_COPY(geom, 0);
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	state = funcctx->user_fctx;
+
+	if ( ! state->col || state->nextgeom >= state->col->ngeoms )
+		SRF_RETURN_DONE(funcctx);
+
+	result = geometry_serialize(state->col->geoms[state->nextgeom++]);
+	SRF_RETURN_NEXT(funcctx, PointerGetDatum(result));
+}
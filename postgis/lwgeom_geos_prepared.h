@@ -28,23 +28,21 @@
 * Cache structure. We use GSERIALIZED as keys so no transformations
 * are needed before we memcmp them with other keys. We store the
 * size to avoid having to calculate the size every time.
-* The argnum gives the number of function arguments we are caching.
+* The argnum gives the function argument the cache was found for.
 * Intersects requires that both arguments be checked for cacheability,
 * while Contains only requires that the containing argument be checked.
 * Both the Geometry and the PreparedGeometry have to be cached,
 * because the PreparedGeometry contains a reference to the geometry.
 * 
-* Note that the first 6 entries are part of the common GeomCache
+* Note that the first 4 entries are part of the common GeomCache
 * structure and have to remain in order to allow the overall caching
 * system to share code (the cache checking code is common between
 * prepared geometry, circtrees, recttrees, and rtrees).
 */
 typedef struct {
 	int                         type;       // <GeomCache>
-	GSERIALIZED*                geom1;      // 
-	GSERIALIZED*                geom2;      // 
-	size_t                      geom1_size; // 
-	size_t                      geom2_size; // 
+	GSERIALIZED*                geom;       // 
+	size_t                      geom_size;  // 
 	int32                       argnum;     // </GeomCache>
 	MemoryContext               context_statement;
 	MemoryContext               context_callback;
@@ -16,6 +16,9 @@
 #include "utils/elog.h"
 #include "mb/pg_wchar.h"
 # include "lib/stringinfo.h" /* for binary input */
+#include "utils/array.h"
+#include "utils/lsyscache.h"
+#include "catalog/pg_type.h"
 
 #include "liblwgeom.h"
 #include "lwgeom_pg.h"
@@ -33,6 +36,9 @@ Datum parse_WKT_lwgeom(PG_FUNCTION_ARGS);
 Datum LWGEOM_recv(PG_FUNCTION_ARGS);
 Datum LWGEOM_send(PG_FUNCTION_ARGS);
 Datum LWGEOM_to_latlon(PG_FUNCTION_ARGS);
+Datum TWKBFromLWGEOM(PG_FUNCTION_ARGS);
+Datum TWKBFromLWGEOMArray(PG_FUNCTION_ARGS);
+Datum LWGEOMFromTWKB(PG_FUNCTION_ARGS);
 
 
 /*
@@ -400,6 +406,174 @@ Datum WKBFromLWGEOM(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * Precision argument, clamped to what fits an int8_t. Values out of
+ * range are left for lwgeom_to_twkb to reject.
+ */
+static int8_t
+twkb_precision_arg(FunctionCallInfo fcinfo, int argno)
+{
+	int32 prec;
+
+	if ( PG_NARGS() <= argno || PG_ARGISNULL(argno) )
+		return 0;
+	prec = PG_GETARG_INT32(argno);
+	return (int8_t)Max(-128, Min(127, prec));
+}
+
+/* Precision and variant arguments of ST_AsTWKB, from argument first on */
+static uint8_t
+twkb_args(FunctionCallInfo fcinfo, int first, int8_t *prec_xy, int8_t *prec_z, int8_t *prec_m)
+{
+	uint8_t variant = 0;
+
+	*prec_xy = twkb_precision_arg(fcinfo, first);
+	*prec_z = twkb_precision_arg(fcinfo, first + 1);
+	*prec_m = twkb_precision_arg(fcinfo, first + 2);
+	if ( PG_NARGS() > first + 3 && ! PG_ARGISNULL(first + 3) && PG_GETARG_BOOL(first + 3) )
+		variant |= TWKB_SIZE;
+	if ( PG_NARGS() > first + 4 && ! PG_ARGISNULL(first + 4) && PG_GETARG_BOOL(first + 4) )
+		variant |= TWKB_BBOX;
+
+	return variant;
+}
+
+/*
+ * TWKBFromLWGEOM(lwgeom, precision, precision_z, precision_m,
+ *                with_sizes, with_boxes) --> twkb
+ */
+PG_FUNCTION_INFO_V1(TWKBFromLWGEOM);
+Datum TWKBFromLWGEOM(PG_FUNCTION_ARGS)
+{
+	GSERIALIZED *geom = (GSERIALIZED*)PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
+	LWGEOM *lwgeom;
+	uint8_t *twkb;
+	size_t twkb_size;
+	uint8_t variant;
+	int8_t prec_xy, prec_z, prec_m;
+	bytea *result;
+
+	variant = twkb_args(fcinfo, 1, &prec_xy, &prec_z, &prec_m);
+
+	lwgeom = lwgeom_from_gserialized(geom);
+	twkb = lwgeom_to_twkb(lwgeom, variant, prec_xy, prec_z, prec_m, &twkb_size);
+	lwgeom_free(lwgeom);
+
+	result = palloc(twkb_size + VARHDRSZ);
+	memcpy(VARDATA(result), twkb, twkb_size);
+	SET_VARSIZE(result, twkb_size + VARHDRSZ);
+
+	pfree(twkb);
+	PG_FREE_IF_COPY(geom, 0);
+	PG_RETURN_BYTEA_P(result);
+}
+
+/*
+ * TWKBFromLWGEOMArray(lwgeom[], id[], precision, ...) --> twkb
+ * All the geometries go into one collection, each with its id.
+ * Elements where either the geometry or the id is NULL are skipped.
+ */
+PG_FUNCTION_INFO_V1(TWKBFromLWGEOMArray);
+Datum TWKBFromLWGEOMArray(PG_FUNCTION_ARGS)
+{
+	ArrayType *arr_geoms, *arr_ids;
+	Datum *geoms, *ids;
+	bool *geoms_null, *ids_null;
+	int ngeoms, nids, i;
+	int16 typlen;
+	bool typbyval;
+	char typalign;
+	LWCOLLECTION *col = NULL;
+	int64_t *idlist;
+	int count = 0;
+	uint8_t *twkb;
+	size_t twkb_size;
+	uint8_t variant;
+	int8_t prec_xy, prec_z, prec_m;
+	bytea *result;
+
+	if ( PG_ARGISNULL(0) || PG_ARGISNULL(1) )
+		PG_RETURN_NULL();
+
+	arr_geoms = PG_GETARG_ARRAYTYPE_P(0);
+	arr_ids = PG_GETARG_ARRAYTYPE_P(1);
+
+	if ( ARR_NDIM(arr_geoms) > 1 || ARR_NDIM(arr_ids) > 1 )
+		elog(ERROR, "ST_AsTWKB: arrays must be one-dimensional");
+
+	get_typlenbyvalalign(ARR_ELEMTYPE(arr_geoms), &typlen, &typbyval, &typalign);
+	deconstruct_array(arr_geoms, ARR_ELEMTYPE(arr_geoms), typlen, typbyval, typalign, &geoms, &geoms_null, &ngeoms);
+	deconstruct_array(arr_ids, INT8OID, sizeof(int64), FLOAT8PASSBYVAL, 'd', &ids, &ids_null, &nids);
+
+	if ( ngeoms != nids )
+		elog(ERROR, "ST_AsTWKB: geometries and ids arrays must be the same length");
+
+	idlist = palloc0(sizeof(int64_t) * (ngeoms ? ngeoms : 1));
+	for ( i = 0; i < ngeoms; i++ )
+	{
+		LWGEOM *lwgeom;
+		uint8_t coltype;
+
+		if ( geoms_null[i] || ids_null[i] )
+			continue;
+
+		lwgeom = lwgeom_from_gserialized((GSERIALIZED*)PG_DETOAST_DATUM(geoms[i]));
+
+		/* One type makes a multi-geometry, mixed types a collection */
+		coltype = lwtype_get_collectiontype(lwgeom->type);
+		if ( ! col )
+			col = lwcollection_construct_empty(coltype, lwgeom->srid, FLAGS_GET_Z(lwgeom->flags), FLAGS_GET_M(lwgeom->flags));
+		else if ( col->type != coltype )
+			col->type = COLLECTIONTYPE;
+
+		if ( FLAGS_GET_Z(lwgeom->flags) != FLAGS_GET_Z(col->flags) ||
+		     FLAGS_GET_M(lwgeom->flags) != FLAGS_GET_M(col->flags) )
+			elog(ERROR, "ST_AsTWKB: geometries must all have the same dimensions");
+
+		lwcollection_add_lwgeom(col, lwgeom);
+		idlist[count++] = DatumGetInt64(ids[i]);
+	}
+
+	if ( ! col )
+		PG_RETURN_NULL();
+
+	variant = twkb_args(fcinfo, 2, &prec_xy, &prec_z, &prec_m);
+	twkb = lwgeom_to_twkb_with_idlist(lwcollection_as_lwgeom(col), idlist, variant, prec_xy, prec_z, prec_m, &twkb_size);
+	lwcollection_free(col);
+	pfree(idlist);
+
+	result = palloc(twkb_size + VARHDRSZ);
+	memcpy(VARDATA(result), twkb, twkb_size);
+	SET_VARSIZE(result, twkb_size + VARHDRSZ);
+	pfree(twkb);
+
+	PG_RETURN_BYTEA_P(result);
+}
+
+/*
+ * LWGEOMFromTWKB(twkb) --> lwgeom
+ * TWKB has no SRID, the result has none either.
+ */
+PG_FUNCTION_INFO_V1(LWGEOMFromTWKB);
+Datum LWGEOMFromTWKB(PG_FUNCTION_ARGS)
+{
+	bytea *bytea_twkb = (bytea*)PG_GETARG_BYTEA_P(0);
+	GSERIALIZED *geom;
+	LWGEOM *lwgeom;
+	uint8_t *twkb = (uint8_t*)VARDATA(bytea_twkb);
+
+	lwgeom = lwgeom_from_twkb(twkb, VARSIZE(bytea_twkb)-VARHDRSZ, LW_PARSER_CHECK_ALL);
+
+	if ( lwgeom_needs_bbox(lwgeom) )
+		lwgeom_add_bbox(lwgeom);
+
+	geom = geometry_serialize(lwgeom);
+	lwgeom_free(lwgeom);
+	PG_FREE_IF_COPY(bytea_twkb, 0);
+	PG_RETURN_POINTER(geom);
+}
+
+
 /* puts a bbox inside the geometry */
 PG_FUNCTION_INFO_V1(LWGEOM_addBBOX);
 Datum LWGEOM_addBBOX(PG_FUNCTION_ARGS)
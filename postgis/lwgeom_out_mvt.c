@@ -0,0 +1,145 @@
+/**********************************************************************
+ *
+ * PostGIS - Spatial Types for PostgreSQL
+ * http://postgis.refractions.net
+ *
+ * This is free software; you can redistribute and/or modify it under
+ * the terms of the GNU General Public Licence. See the COPYING file.
+ *
+ **********************************************************************/
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "utils/lsyscache.h"
+#include "utils/syscache.h"
+
+#include "../postgis_config.h"
+#include "lwgeom_pg.h"
+#include "mvt.h"
+
+Datum ST_AsMVTGeom(PG_FUNCTION_ARGS);
+Datum pgis_asmvt_transfn(PG_FUNCTION_ARGS);
+Datum pgis_asmvt_finalfn(PG_FUNCTION_ARGS);
+
+/**
+ * ST_AsMVTGeom(geom, bounds, extent, buffer, clip_geom)
+ * The geometry in the coordinates of a tile covering bounds.
+ */
+PG_FUNCTION_INFO_V1(ST_AsMVTGeom);
+Datum ST_AsMVTGeom(PG_FUNCTION_ARGS)
+{
+	GSERIALIZED *geom_in = (GSERIALIZED *)PG_DETOAST_DATUM(PG_GETARG_DATUM(0));
+	GBOX *bounds = (GBOX *) PG_GETARG_POINTER(1);
+	int extent = PG_GETARG_INT32(2);
+	int buffer = PG_GETARG_INT32(3);
+	bool clip_geom = PG_GETARG_BOOL(4);
+	GSERIALIZED *geom_out;
+	LWGEOM *lwgeom_in, *lwgeom_out;
+
+	if ( extent <= 0 )
+		elog(ERROR, "%s: extent must be greater than 0", "ST_AsMVTGeom");
+	if ( buffer < 0 )
+		elog(ERROR, "%s: buffer cannot be negative", "ST_AsMVTGeom");
+
+	lwgeom_in = lwgeom_from_gserialized(geom_in);
+	lwgeom_out = mvt_geom(lwgeom_in, bounds, extent, buffer, clip_geom);
+	if ( ! lwgeom_out )
+		PG_RETURN_NULL();
+
+	geom_out = geometry_serialize(lwgeom_out);
+	lwgeom_free(lwgeom_out);
+	PG_FREE_IF_COPY(geom_in, 0);
+
+	PG_RETURN_POINTER(geom_out);
+}
+
+/**
+ * ST_AsMVT(row, name, extent, geom_name) transition function.
+ * The layer is built up in the aggregate memory context.
+ */
+PG_FUNCTION_INFO_V1(pgis_asmvt_transfn);
+Datum pgis_asmvt_transfn(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggcontext, oldcontext;
+	mvt_agg_context *ctx;
+
+	if ( ! AggCheckCallContext(fcinfo, &aggcontext) )
+		elog(ERROR, "%s called in non-aggregate context", "pgis_asmvt_transfn");
+
+	if ( PG_ARGISNULL(0) )
+	{
+		if ( ! type_is_rowtype(get_fn_expr_argtype(fcinfo->flinfo, 1)) )
+			elog(ERROR, "%s: parameter row must be a row type", "ST_AsMVT");
+
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+		ctx = palloc(sizeof(mvt_agg_context));
+		ctx->name = "default";
+		if ( PG_NARGS() > 2 && ! PG_ARGISNULL(2) )
+			ctx->name = text2cstring(PG_GETARG_TEXT_P(2));
+		ctx->extent = 4096;
+		if ( PG_NARGS() > 3 && ! PG_ARGISNULL(3) )
+		{
+			int extent = PG_GETARG_INT32(3);
+			if ( extent <= 0 )
+				elog(ERROR, "%s: extent must be greater than 0", "ST_AsMVT");
+			ctx->extent = extent;
+		}
+		ctx->geom_name = NULL;
+		if ( PG_NARGS() > 4 && ! PG_ARGISNULL(4) )
+			ctx->geom_name = text2cstring(PG_GETARG_TEXT_P(4));
+		/* Don't go by search_path, which may not include us */
+		ctx->geom_type = GetSysCacheOid2(TYPENAMENSP,
+		                 CStringGetDatum("geometry"),
+		                 ObjectIdGetDatum(get_func_namespace(fcinfo->flinfo->fn_oid)));
+		if ( ! OidIsValid(ctx->geom_type) )
+			elog(ERROR, "%s: could not find the geometry type", "ST_AsMVT");
+		mvt_agg_init_context(ctx);
+		MemoryContextSwitchTo(oldcontext);
+	}
+	else
+	{
+		ctx = (mvt_agg_context *) PG_GETARG_POINTER(0);
+	}
+
+	if ( PG_ARGISNULL(1) )
+		PG_RETURN_POINTER(ctx);
+
+	/* The column setup on the first row has to outlast it */
+	if ( ! ctx->tupdesc )
+	{
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+		mvt_agg_transfn(ctx, PG_GETARG_HEAPTUPLEHEADER(1));
+		MemoryContextSwitchTo(oldcontext);
+	}
+	else
+	{
+		mvt_agg_transfn(ctx, PG_GETARG_HEAPTUPLEHEADER(1));
+	}
+
+	PG_RETURN_POINTER(ctx);
+}
+
+/**
+ * ST_AsMVT final function, returns the encoded tile. No rows
+ * at all make an empty tile.
+ */
+PG_FUNCTION_INFO_V1(pgis_asmvt_finalfn);
+Datum pgis_asmvt_finalfn(PG_FUNCTION_ARGS)
+{
+	mvt_agg_context *ctx;
+	bytea *result;
+
+	if ( ! AggCheckCallContext(fcinfo, NULL) )
+		elog(ERROR, "%s called in non-aggregate context", "pgis_asmvt_finalfn");
+
+	if ( PG_ARGISNULL(0) )
+	{
+		result = palloc(VARHDRSZ);
+		SET_VARSIZE(result, VARHDRSZ);
+		PG_RETURN_BYTEA_P(result);
+	}
+
+	ctx = (mvt_agg_context *) PG_GETARG_POINTER(0);
+	result = mvt_agg_finalfn(ctx);
+	PG_RETURN_BYTEA_P(result);
+}
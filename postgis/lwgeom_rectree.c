@@ -0,0 +1,262 @@
+/**********************************************************************
+ *
+ * PostGIS - Spatial Types for PostgreSQL
+ * http://postgis.net
+ *
+ * This is free software; you can redistribute and/or modify it under
+ * the terms of the GNU General Public Licence. See the COPYING file.
+ *
+ **********************************************************************/
+
+#include "postgres.h"
+#include "fmgr.h"
+
+#include "../postgis_config.h"
+#include "lwgeom_rectree.h"
+
+
+/*
+* Planar counterpart of the CircTreeGeomCache in
+* geography_measurement_trees.c. When one argument stays the
+* same from call to call (the big polygon in a nested loop join)
+* we keep a RECT_NODE edge tree for it on the statement, and
+* only build a tree for the other, changing, argument.
+*/
+typedef struct {
+	int                         type;       // <GeomCache>
+	GSERIALIZED*                geom;       // 
+	size_t                      geom_size;  // 
+	int32                       argnum;     // </GeomCache>
+	RECT_NODE*                  index;
+	LWGEOM*                     lwgeom;     /* The tree points into these coordinates */
+} RectTreeGeomCache;
+
+
+
+/**
+* Builder, freeer and public accessor for cached RECT_NODE trees
+*/
+static int
+RectTreeBuilder(const LWGEOM* lwgeom, GeomCache* cache)
+{
+	RectTreeGeomCache* rect_cache = (RectTreeGeomCache*)cache;
+	LWGEOM* lwgeom_copy;
+	RECT_NODE* tree;
+
+	if ( rect_cache->index )
+	{
+		rect_tree_free(rect_cache->index);
+		rect_cache->index = 0;
+	}
+	if ( rect_cache->lwgeom )
+	{
+		lwgeom_free(rect_cache->lwgeom);
+		rect_cache->lwgeom = 0;
+	}
+
+	/* 
+	* The tree leaves reference the point arrays directly, so keep
+	* our own copy of the geometry in the cache memory context.
+	*/
+	lwgeom_copy = lwgeom_clone_deep(lwgeom);
+	tree = rect_tree_from_lwgeom(lwgeom_copy);
+	if ( ! tree )
+	{
+		lwgeom_free(lwgeom_copy);
+		return LW_FAILURE;
+	}
+
+	rect_cache->index = tree;
+	rect_cache->lwgeom = lwgeom_copy;
+	return LW_SUCCESS;
+}
+
+static int
+RectTreeFreer(GeomCache* cache)
+{
+	RectTreeGeomCache* rect_cache = (RectTreeGeomCache*)cache;
+	if ( rect_cache->index ) 
+	{
+		rect_tree_free(rect_cache->index);
+		rect_cache->index = 0;
+		rect_cache->argnum = 0;
+	}
+	if ( rect_cache->lwgeom )
+	{
+		lwgeom_free(rect_cache->lwgeom);
+		rect_cache->lwgeom = 0;
+	}
+	return LW_SUCCESS;
+}
+
+static GeomCache*
+RectTreeAllocator(void)
+{
+	RectTreeGeomCache* cache = palloc(sizeof(RectTreeGeomCache));
+	memset(cache, 0, sizeof(RectTreeGeomCache));
+	return (GeomCache*)cache;
+}
+
+static GeomCacheMethods RectTreeCacheMethods =
+{
+	RECT_CACHE_ENTRY,
+	RectTreeBuilder,
+	RectTreeFreer,
+	RectTreeAllocator
+};
+
+static RectTreeGeomCache*
+GetRectTreeGeomCache(FunctionCallInfoData* fcinfo, const GSERIALIZED* g1, const GSERIALIZED* g2)
+{
+	return (RectTreeGeomCache*)GetGeomCache(fcinfo, &RectTreeCacheMethods, g1, g2);
+}
+
+static int
+RectTreeIsArea(const LWGEOM* lwgeom)
+{
+	return lwgeom->type == POLYGONTYPE || lwgeom->type == MULTIPOLYGONTYPE;
+}
+
+/**
+* Planar distance between the two arguments using the cached tree,
+* stopping early once a distance of threshold or less is found.
+* If p1 and p2 are not NULL they are set to the closest pair found, 
+* p1 on the first argument and p2 on the second.
+* Returns LW_FAILURE when there is no cached tree to work with (first
+* call, cache miss, unsupported type), in which case the caller has
+* to do the calculation itself.
+*/
+static int
+RectTreeDistance(FunctionCallInfoData* fcinfo, const GSERIALIZED* g1, const GSERIALIZED* g2, double threshold, double* distance, POINT2D* p1, POINT2D* p2)
+{
+	RectTreeGeomCache* tree_cache = NULL;
+	RECT_NODE* tree;
+	LWGEOM* lwgeom;
+	POINT2D pt1, pt2;
+
+	Assert(distance);
+
+	/* Two points? Get outa here... */
+	if ( (gserialized_get_type(g1) == POINTTYPE) && (gserialized_get_type(g2) == POINTTYPE) )
+		return LW_FAILURE;
+
+	/* Fetch/build our cache, if appropriate, etc... */
+	tree_cache = GetRectTreeGeomCache(fcinfo, g1, g2);
+
+	if ( ! ( tree_cache && tree_cache->argnum && tree_cache->index ) )
+		return LW_FAILURE;
+
+	/* We need to dynamically build a tree for the uncached side of the function call */
+	if ( tree_cache->argnum == 1 )
+		lwgeom = lwgeom_from_gserialized(g2);
+	else if ( tree_cache->argnum == 2 )
+		lwgeom = lwgeom_from_gserialized(g1);
+	else
+	{
+		lwerror("RectTreeDistance failed! This will never happen!");
+		return LW_FAILURE;
+	}
+
+	tree = rect_tree_from_lwgeom(lwgeom);
+	if ( ! tree )
+	{
+		POSTGIS_DEBUG(3, "no tree for the uncached argument, RectTreeDistance returning LW_FAILURE");
+		lwgeom_free(lwgeom);
+		return LW_FAILURE;
+	}
+
+	/* Calculate edge/edge distance, keeping the pair in argument order */
+	if ( tree_cache->argnum == 1 )
+		*distance = rect_tree_closest_points(tree_cache->index, tree, threshold, &pt1, &pt2);
+	else
+		*distance = rect_tree_closest_points(tree, tree_cache->index, threshold, &pt1, &pt2);
+
+	/* Edges apart, but one side might still sit inside the other's area */
+	if ( *distance > threshold )
+	{
+		POINT2D inside;
+		if ( ( RectTreeIsArea(tree_cache->lwgeom) && rect_tree_area_contains_lwgeom_vertex(tree_cache->index, lwgeom, &inside) ) ||
+		     ( RectTreeIsArea(lwgeom) && rect_tree_area_contains_lwgeom_vertex(tree, tree_cache->lwgeom, &inside) ) )
+		{
+			POSTGIS_DEBUG(3, "one argument is inside the other's area, distance is zero");
+			*distance = 0.0;
+			pt1 = pt2 = inside;
+		}
+	}
+
+	if ( p1 ) *p1 = pt1;
+	if ( p2 ) *p2 = pt2;
+
+	rect_tree_free(tree);
+	lwgeom_free(lwgeom);
+	return LW_SUCCESS;
+}
+
+int
+geometry_distance_cache(FunctionCallInfoData* fcinfo, const GSERIALIZED* g1, const GSERIALIZED* g2, double* distance)
+{
+	return RectTreeDistance(fcinfo, g1, g2, 0.0, distance, NULL, NULL);
+}
+
+int
+geometry_dwithin_cache(FunctionCallInfoData* fcinfo, const GSERIALIZED* g1, const GSERIALIZED* g2, double tolerance, int* dwithin)
+{
+	double distance;
+
+	if ( RectTreeDistance(fcinfo, g1, g2, tolerance, &distance, NULL, NULL) == LW_FAILURE )
+		return LW_FAILURE;
+
+	*dwithin = (distance <= tolerance ? LW_TRUE : LW_FALSE);
+	return LW_SUCCESS;
+}
+
+/*
+* The edge trees can only prove the arguments apart, a zero distance is
+* left for GEOS to confirm, so this fails unless *intersects is LW_FALSE.
+*/
+int
+geometry_intersects_cache(FunctionCallInfoData* fcinfo, const GSERIALIZED* g1, const GSERIALIZED* g2, int* intersects)
+{
+	double distance;
+
+	if ( RectTreeDistance(fcinfo, g1, g2, 0.0, &distance, NULL, NULL) == LW_FAILURE )
+		return LW_FAILURE;
+
+	if ( distance == 0.0 )
+		return LW_FAILURE;
+
+	*intersects = LW_FALSE;
+	return LW_SUCCESS;
+}
+
+int
+geometry_closestpoint_cache(FunctionCallInfoData* fcinfo, const GSERIALIZED* g1, const GSERIALIZED* g2, LWGEOM** point)
+{
+	double distance;
+	POINT2D p1;
+
+	if ( RectTreeDistance(fcinfo, g1, g2, 0.0, &distance, &p1, NULL) == LW_FAILURE )
+		return LW_FAILURE;
+
+	*point = (LWGEOM*)lwpoint_make2d(gserialized_get_srid(g1), p1.x, p1.y);
+	return LW_SUCCESS;
+}
+
+int
+geometry_shortestline_cache(FunctionCallInfoData* fcinfo, const GSERIALIZED* g1, const GSERIALIZED* g2, LWGEOM** line)
+{
+	double distance;
+	POINT2D p1, p2;
+	LWPOINT* lwpoints[2];
+	int srid = gserialized_get_srid(g1);
+
+	if ( RectTreeDistance(fcinfo, g1, g2, 0.0, &distance, &p1, &p2) == LW_FAILURE )
+		return LW_FAILURE;
+
+	lwpoints[0] = lwpoint_make2d(srid, p1.x, p1.y);
+	lwpoints[1] = lwpoint_make2d(srid, p2.x, p2.y);
+	*line = (LWGEOM*)lwline_from_ptarray(srid, 2, lwpoints);
+	lwpoint_free(lwpoints[0]);
+	lwpoint_free(lwpoints[1]);
+	return LW_SUCCESS;
+}
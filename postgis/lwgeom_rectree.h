@@ -0,0 +1,14 @@
+#ifndef _LWGEOM_RECTREE_H
+#define _LWGEOM_RECTREE_H 1
+
+#include "liblwgeom_internal.h"
+#include "lwtree.h"
+#include "lwgeom_cache.h"
+
+int geometry_distance_cache(FunctionCallInfoData* fcinfo, const GSERIALIZED* g1, const GSERIALIZED* g2, double* distance);
+int geometry_dwithin_cache(FunctionCallInfoData* fcinfo, const GSERIALIZED* g1, const GSERIALIZED* g2, double tolerance, int* dwithin);
+int geometry_intersects_cache(FunctionCallInfoData* fcinfo, const GSERIALIZED* g1, const GSERIALIZED* g2, int* intersects);
+int geometry_closestpoint_cache(FunctionCallInfoData* fcinfo, const GSERIALIZED* g1, const GSERIALIZED* g2, LWGEOM** point);
+int geometry_shortestline_cache(FunctionCallInfoData* fcinfo, const GSERIALIZED* g1, const GSERIALIZED* g2, LWGEOM** line);
+
+#endif /* !defined _LWGEOM_RECTREE_H */
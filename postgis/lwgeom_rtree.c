@@ -10,6 +10,7 @@
  **********************************************************************/
 
 #include <assert.h>
+#include <math.h>
 
 #include "../postgis_config.h"
 #include "lwgeom_pg.h"
@@ -21,6 +22,7 @@
 
 /* Prototypes */
 static void RTreeFree(RTREE_NODE* root);
+static void RTreeGridFree(RTREE_GRID *grid);
 
 /**
 * Allocate a fresh clean RTREE_POLY_CACHE
@@ -63,20 +65,26 @@ RTreeCacheClear(RTREE_POLY_CACHE* cache)
 {
 	int g, r, i;
 	POSTGIS_DEBUGF(2, "RTreeCacheClear called for %p", cache);
-	i = 0;
-	for (g = 0; g < cache->polyCount; g++)
+	if ( cache->ringIndices )
 	{
-		for (r = 0; r < cache->ringCounts[g]; r++)
+		i = 0;
+		for (g = 0; g < cache->polyCount; g++)
 		{
-			RTreeFree(cache->ringIndices[i]);
-			i++;
+			for (r = 0; r < cache->ringCounts[g]; r++)
+			{
+				RTreeFree(cache->ringIndices[i]);
+				i++;
+			}
 		}
+		lwfree(cache->ringIndices);
 	}
-	lwfree(cache->ringIndices);
+	if ( cache->grid )
+		RTreeGridFree(cache->grid);
 	lwfree(cache->ringCounts);
 	cache->ringIndices = 0;
 	cache->ringCounts = 0;
 	cache->polyCount = 0;
+	cache->grid = 0;
 }
 
 
@@ -293,6 +301,374 @@ RTreeMergeMultiLines(LWMLINE *line1, LWMLINE *line2)
 }
 
 
+/*
+* Grids are only built for geometries with at least this many edges, smaller
+* ones keep using the ring trees.
+*/
+#define RTREE_GRID_MIN_EDGES 128
+/* Limits on the number of rows and columns of a grid */
+#define RTREE_GRID_MIN_SIZE 4
+#define RTREE_GRID_MAX_SIZE 256
+/* Average number of cells an edge may be listed in before the grid is coarsened */
+#define RTREE_GRID_CELLS_PER_EDGE 8
+
+/**
+* Returns the cell index of value along one axis of the grid, clamped
+* to [0, n-1].
+*/
+static int
+RTreeGridIndex(double value, double origin, double size, int n)
+{
+	double i = floor((value - origin) / size);
+
+	if ( ! (i >= 0) )
+		return 0;
+	if ( i >= n )
+		return n - 1;
+	return (int)i;
+}
+
+/**
+* Returns the index of the cell containing the point, or of the nearest
+* border cell for points off the grid.
+*/
+int
+RTreeGridCell(const RTREE_GRID *grid, const POINT2D *pt)
+{
+	return RTreeGridIndex(pt->y, grid->ymin, grid->cellHeight, grid->nrows) * grid->ncols +
+	       RTreeGridIndex(pt->x, grid->xmin, grid->cellWidth, grid->ncols);
+}
+
+/**
+* Computes the range of cells an edge is listed in. Winding tests accept
+* points up to FP_TOLERANCE beyond the ends of an edge in y, which along a
+* shallow edge may be far off in x, so the extent is widened accordingly.
+*/
+static void
+RTreeGridEdgeCells(const RTREE_GRID *grid, const RTREE_GRID_EDGE *edge, int *c0, int *c1, int *r0, int *r1)
+{
+	double xmin = FP_MIN(edge->p1.x, edge->p2.x);
+	double xmax = FP_MAX(edge->p1.x, edge->p2.x);
+	double ymin = FP_MIN(edge->p1.y, edge->p2.y) - 2 * FP_TOLERANCE;
+	double ymax = FP_MAX(edge->p1.y, edge->p2.y) + 2 * FP_TOLERANCE;
+	double dy = fabs(edge->p2.y - edge->p1.y);
+	double slack;
+
+	if ( dy > 0.0 )
+	{
+		slack = 2 * FP_TOLERANCE * (fabs(edge->p2.x - edge->p1.x) / dy);
+		xmin -= slack;
+		xmax += slack;
+	}
+
+	*c0 = RTreeGridIndex(xmin, grid->xmin, grid->cellWidth, grid->ncols);
+	*c1 = RTreeGridIndex(xmax, grid->xmin, grid->cellWidth, grid->ncols);
+	*r0 = RTreeGridIndex(ymin, grid->ymin, grid->cellHeight, grid->nrows);
+	*r1 = RTreeGridIndex(ymax, grid->ymin, grid->cellHeight, grid->nrows);
+}
+
+/**
+* Sets the grid dimensions to size x size cells over the given extent and
+* returns the number of edge entries the cells would hold.
+*/
+static double
+RTreeGridLayout(RTREE_GRID *grid, int size, double xmax, double ymax)
+{
+	int i, c0, c1, r0, r1;
+	double entries = 0;
+
+	grid->ncols = grid->nrows = size;
+	grid->cellWidth = (xmax - grid->xmin) / size;
+	grid->cellHeight = (ymax - grid->ymin) / size;
+
+	for ( i = 0; i < grid->nedges; i++ )
+	{
+		RTreeGridEdgeCells(grid, &(grid->edges[i]), &c0, &c1, &r0, &r1);
+		entries += (double)(c1 - c0 + 1) * (r1 - r0 + 1);
+	}
+	return entries;
+}
+
+/**
+* Classifies the cells of a row no edge passes through. Sweeping the row
+* from right to left, the edges met so far are those a horizontal ray cast
+* rightwards from the current cell crosses, which gives the winding number of
+* every ring around the cell. The geometry contains the cell if one of its
+* polygons contains it in its exterior ring and in none of its holes, as
+* in point_in_multipolygon_rtree().
+*/
+static void
+RTreeGridClassifyRow(RTREE_GRID *grid, int row, int *ringWinding, int *polyHoles, signed char *polyOuter)
+{
+	int c, k, e, r, p, in, was;
+	int inside = 0;
+	double y = grid->ymin + (row + 0.5) * grid->cellHeight;
+	RTREE_GRID_EDGE *edge;
+	int c0, c1, r0, r1;
+	int cell;
+
+	for ( c = grid->ncols - 1; c >= 0; c-- )
+	{
+		cell = row * grid->ncols + c;
+		if ( grid->cellStart[cell] == grid->cellStart[cell+1] )
+		{
+			grid->cellStates[cell] = inside > 0 ? 1 : -1;
+			continue;
+		}
+
+		grid->cellStates[cell] = 0;
+
+		/* Add the edges whose extent starts in this column */
+		for ( k = grid->cellStart[cell]; k < grid->cellStart[cell+1]; k++ )
+		{
+			e = grid->cellEdges[k];
+			edge = &(grid->edges[e]);
+			RTreeGridEdgeCells(grid, edge, &c0, &c1, &r0, &r1);
+			if ( c0 != c )
+				continue;
+
+			r = edge->ring;
+			p = grid->ringPoly[r];
+			was = polyOuter[p] && polyHoles[p] == 0;
+
+			if ( ringWinding[r] )
+			{
+				if ( r == grid->polyFirstRing[p] )
+					polyOuter[p] = 0;
+				else
+					polyHoles[p]--;
+			}
+			if ( FP_CONTAINS_BOTTOM(edge->p1.y, y, edge->p2.y) )
+				ringWinding[r]++;
+			else if ( FP_CONTAINS_BOTTOM(edge->p2.y, y, edge->p1.y) )
+				ringWinding[r]--;
+			if ( ringWinding[r] )
+			{
+				if ( r == grid->polyFirstRing[p] )
+					polyOuter[p] = 1;
+				else
+					polyHoles[p]++;
+			}
+
+			in = polyOuter[p] && polyHoles[p] == 0;
+			inside += in - was;
+		}
+	}
+
+	/* Reset the counters of the rings met, for the next row */
+	for ( c = 0; c < grid->ncols; c++ )
+	{
+		cell = row * grid->ncols + c;
+		for ( k = grid->cellStart[cell]; k < grid->cellStart[cell+1]; k++ )
+		{
+			r = grid->edges[grid->cellEdges[k]].ring;
+			p = grid->ringPoly[r];
+			ringWinding[r] = 0;
+			polyHoles[p] = 0;
+			polyOuter[p] = 0;
+		}
+	}
+}
+
+/**
+* Builds a grid over the rings of a polygon or multipolygon. Returns NULL
+* when the geometry is too small to benefit from one, when it has no area
+* extent, or when its edges would need too many cell entries.
+*/
+static RTREE_GRID*
+RTreeGridCreate(const LWGEOM *lwgeom)
+{
+	RTREE_GRID *grid;
+	LWPOLY **polys;
+	LWPOLY *poly;
+	LWPOLY *single;
+	POINTARRAY *pa;
+	RTREE_GRID_EDGE *edge;
+	int npolys, nrings, nedges;
+	int p, r, i, k, c, row, cell, size;
+	int c0, c1, r0, r1;
+	int fits;
+	double xmax, ymax, entries;
+	int *ringWinding, *polyHoles;
+	signed char *polyOuter;
+
+	if ( lwgeom->type == MULTIPOLYGONTYPE )
+	{
+		polys = ((LWMPOLY*)lwgeom)->geoms;
+		npolys = ((LWMPOLY*)lwgeom)->ngeoms;
+	}
+	else if ( lwgeom->type == POLYGONTYPE )
+	{
+		single = (LWPOLY*)lwgeom;
+		polys = &single;
+		npolys = 1;
+	}
+	else
+		return NULL;
+
+	nrings = nedges = 0;
+	for ( p = 0; p < npolys; p++ )
+	{
+		for ( r = 0; r < polys[p]->nrings; r++ )
+		{
+			if ( polys[p]->rings[r]->npoints > 1 )
+				nedges += polys[p]->rings[r]->npoints - 1;
+		}
+		nrings += polys[p]->nrings;
+	}
+
+	if ( nedges < RTREE_GRID_MIN_EDGES )
+		return NULL;
+
+	grid = lwalloc(sizeof(RTREE_GRID));
+	memset(grid, 0, sizeof(RTREE_GRID));
+	grid->npolys = npolys;
+	grid->nrings = nrings;
+	grid->polyFirstRing = lwalloc(sizeof(int) * npolys);
+	grid->ringPoly = lwalloc(sizeof(int) * nrings);
+	grid->edges = lwalloc(sizeof(RTREE_GRID_EDGE) * nedges);
+
+	/*
+	** Copy the edges, in the ring order of the trees. Zero length edges
+	** are ignored by the winding tests, so leave them out.
+	*/
+	grid->xmin = grid->ymin = xmax = ymax = 0;
+	i = 0;
+	for ( p = 0; p < npolys; p++ )
+	{
+		poly = polys[p];
+		grid->polyFirstRing[p] = i;
+		for ( r = 0; r < poly->nrings; r++, i++ )
+		{
+			grid->ringPoly[i] = p;
+			pa = poly->rings[r];
+			for ( k = 0; k < pa->npoints - 1; k++ )
+			{
+				edge = &(grid->edges[grid->nedges]);
+				getPoint2d_p(pa, k, &(edge->p1));
+				getPoint2d_p(pa, k+1, &(edge->p2));
+				if ( (edge->p2.x-edge->p1.x)*(edge->p2.x-edge->p1.x)+(edge->p2.y-edge->p1.y)*(edge->p2.y-edge->p1.y) < 1e-12*1e-12 )
+					continue;
+				edge->ring = i;
+				if ( grid->nedges == 0 )
+				{
+					grid->xmin = xmax = edge->p1.x;
+					grid->ymin = ymax = edge->p1.y;
+				}
+				grid->xmin = FP_MIN(grid->xmin, FP_MIN(edge->p1.x, edge->p2.x));
+				grid->ymin = FP_MIN(grid->ymin, FP_MIN(edge->p1.y, edge->p2.y));
+				xmax = FP_MAX(xmax, FP_MAX(edge->p1.x, edge->p2.x));
+				ymax = FP_MAX(ymax, FP_MAX(edge->p1.y, edge->p2.y));
+				grid->nedges++;
+			}
+		}
+	}
+
+	/* Coarsen the grid until the edges fit in the entry budget */
+	fits = LW_FALSE;
+	entries = 0;
+	size = ceil(sqrt(grid->nedges));
+	if ( size > RTREE_GRID_MAX_SIZE )
+		size = RTREE_GRID_MAX_SIZE;
+	if ( grid->nedges >= RTREE_GRID_MIN_EDGES && xmax > grid->xmin && ymax > grid->ymin )
+	{
+		for ( ; size >= RTREE_GRID_MIN_SIZE; size /= 2 )
+		{
+			entries = RTreeGridLayout(grid, size, xmax, ymax);
+			if ( entries <= (double)RTREE_GRID_CELLS_PER_EDGE * grid->nedges + size * size )
+			{
+				fits = LW_TRUE;
+				break;
+			}
+		}
+	}
+	if ( ! fits )
+	{
+		POSTGIS_DEBUG(3, "RTreeGridCreate falling back on ring trees");
+		lwfree(grid->edges);
+		lwfree(grid->ringPoly);
+		lwfree(grid->polyFirstRing);
+		lwfree(grid);
+		return NULL;
+	}
+
+	POSTGIS_DEBUGF(3, "RTreeGridCreate %d edges, %dx%d cells, %g entries", grid->nedges, size, size, entries);
+
+	/* List the edges of each cell */
+	grid->cellStart = lwalloc(sizeof(int) * (size * size + 1));
+	memset(grid->cellStart, 0, sizeof(int) * (size * size + 1));
+	grid->cellEdges = lwalloc(sizeof(int) * (size_t)entries);
+	grid->cellStates = lwalloc(size * size);
+
+	for ( i = 0; i < grid->nedges; i++ )
+	{
+		RTreeGridEdgeCells(grid, &(grid->edges[i]), &c0, &c1, &r0, &r1);
+		for ( row = r0; row <= r1; row++ )
+			for ( c = c0; c <= c1; c++ )
+				grid->cellStart[row * size + c + 1]++;
+	}
+	for ( cell = 0; cell < size * size; cell++ )
+		grid->cellStart[cell+1] += grid->cellStart[cell];
+
+	/* Fill the lists, using cellStart as the insertion points for now */
+	for ( i = 0; i < grid->nedges; i++ )
+	{
+		RTreeGridEdgeCells(grid, &(grid->edges[i]), &c0, &c1, &r0, &r1);
+		for ( row = r0; row <= r1; row++ )
+			for ( c = c0; c <= c1; c++ )
+				grid->cellEdges[grid->cellStart[row * size + c]++] = i;
+	}
+	for ( cell = size * size; cell > 0; cell-- )
+		grid->cellStart[cell] = grid->cellStart[cell-1];
+	grid->cellStart[0] = 0;
+
+	/* Classify the cells without edges */
+	ringWinding = lwalloc(sizeof(int) * nrings);
+	memset(ringWinding, 0, sizeof(int) * nrings);
+	polyHoles = lwalloc(sizeof(int) * npolys);
+	memset(polyHoles, 0, sizeof(int) * npolys);
+	polyOuter = lwalloc(npolys);
+	memset(polyOuter, 0, npolys);
+	for ( row = 0; row < size; row++ )
+		RTreeGridClassifyRow(grid, row, ringWinding, polyHoles, polyOuter);
+	lwfree(ringWinding);
+	lwfree(polyHoles);
+	lwfree(polyOuter);
+
+	/* Scratch space for the queries */
+	grid->stamp = 0;
+	grid->edgeStamp = lwalloc(sizeof(int) * grid->nedges);
+	memset(grid->edgeStamp, 0, sizeof(int) * grid->nedges);
+	grid->ringStamp = lwalloc(sizeof(int) * nrings);
+	memset(grid->ringStamp, 0, sizeof(int) * nrings);
+	grid->ringWinding = lwalloc(sizeof(int) * nrings);
+	grid->ringOnEdge = lwalloc(nrings);
+	grid->ringsTouched = lwalloc(sizeof(int) * nrings);
+
+	return grid;
+}
+
+/**
+* Frees a grid built by RTreeGridCreate().
+*/
+static void
+RTreeGridFree(RTREE_GRID *grid)
+{
+	lwfree(grid->cellStates);
+	lwfree(grid->cellStart);
+	lwfree(grid->cellEdges);
+	lwfree(grid->edges);
+	lwfree(grid->ringPoly);
+	lwfree(grid->polyFirstRing);
+	lwfree(grid->edgeStamp);
+	lwfree(grid->ringStamp);
+	lwfree(grid->ringWinding);
+	lwfree(grid->ringOnEdge);
+	lwfree(grid->ringsTouched);
+	lwfree(grid);
+}
+
+
 /**
 * Callback function sent into the GetGeomCache generic caching system. Given a
 * LWGEOM* this function builds and stores an RTREE_POLY_CACHE into the provided
@@ -333,18 +709,25 @@ RTreeBuilder(const LWGEOM* lwgeom, GeomCache* cache)
 			currentCache->ringCounts[i] = mpoly->geoms[i]->nrings;
 			nrings += mpoly->geoms[i]->nrings;
 		}
-		currentCache->ringIndices = lwalloc(sizeof(RTREE_NODE *) * nrings);
 		/*
-		** Load the array in geometry order, each outer ring followed by the inner rings
-                ** associated with that outer ring
+		** Large geometries get a grid, the others a tree per ring
 		*/
-                i = 0;
-		for ( p = 0; p < mpoly->ngeoms; p++ )
+		currentCache->grid = RTreeGridCreate(lwgeom);
+		if ( ! currentCache->grid )
 		{
-			for ( r = 0; r < mpoly->geoms[p]->nrings; r++ )
+			currentCache->ringIndices = lwalloc(sizeof(RTREE_NODE *) * nrings);
+			/*
+			** Load the array in geometry order, each outer ring followed by the inner rings
+			** associated with that outer ring
+			*/
+			i = 0;
+			for ( p = 0; p < mpoly->ngeoms; p++ )
 			{
-				currentCache->ringIndices[i] = RTreeCreate(mpoly->geoms[p]->rings[r]);
-				i++;
+				for ( r = 0; r < mpoly->geoms[p]->nrings; r++ )
+				{
+					currentCache->ringIndices[i] = RTreeCreate(mpoly->geoms[p]->rings[r]);
+					i++;
+				}
 			}
 		}
 		rtree_cache->index = currentCache;
@@ -357,13 +740,17 @@ RTreeBuilder(const LWGEOM* lwgeom, GeomCache* cache)
 		currentCache->polyCount = 1;
 		currentCache->ringCounts = lwalloc(sizeof(int));
 		currentCache->ringCounts[0] = poly->nrings;
-		/*
-		** Just load the rings on in order
-		*/
-		currentCache->ringIndices = lwalloc(sizeof(RTREE_NODE *) * poly->nrings);
-		for ( i = 0; i < poly->nrings; i++ )
+		currentCache->grid = RTreeGridCreate(lwgeom);
+		if ( ! currentCache->grid )
 		{
-			currentCache->ringIndices[i] = RTreeCreate(poly->rings[i]);
+			/*
+			** Just load the rings on in order
+			*/
+			currentCache->ringIndices = lwalloc(sizeof(RTREE_NODE *) * poly->nrings);
+			for ( i = 0; i < poly->nrings; i++ )
+			{
+				currentCache->ringIndices[i] = RTreeCreate(poly->rings[i]);
+			}
 		}
 		rtree_cache->index = currentCache;
 	}
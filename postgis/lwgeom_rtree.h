@@ -27,14 +27,62 @@ typedef struct rtree_node
 }
 RTREE_NODE;
 
+/**
+* An edge of a ring indexed by an RTREE_GRID, with the index of its ring
+* in the EIIEII order of point_in_multipolygon_rtree().
+*/
+typedef struct
+{
+	POINT2D p1;
+	POINT2D p2;
+	int ring;
+}
+RTREE_GRID_EDGE;
+
+/**
+* Regular grid over the extent of a (multi)polygon, used for fast P-i-P
+* tests by point_in_multipolygon_grid(). Cells no edge passes through are
+* classified once as inside (1) or outside (-1) of the geometry, the others
+* (0) list the edges whose extent overlaps them.
+*/
+typedef struct
+{
+	double xmin;
+	double ymin;
+	double cellWidth;
+	double cellHeight;
+	int ncols;
+	int nrows;
+	signed char *cellStates;
+	int *cellStart;              /* ncols*nrows+1 offsets into cellEdges */
+	int *cellEdges;
+	RTREE_GRID_EDGE *edges;
+	int nedges;
+	int *ringPoly;               /* polygon each ring belongs to */
+	int *polyFirstRing;          /* exterior ring of each polygon */
+	int nrings;
+	int npolys;
+	/* Scratch space of point_in_multipolygon_grid() */
+	int stamp;
+	int *edgeStamp;
+	int *ringStamp;
+	int *ringWinding;
+	signed char *ringOnEdge;
+	int *ringsTouched;
+}
+RTREE_GRID;
+
 /**
 * The tree structure used for fast P-i-P tests by point_in_multipolygon_rtree()
+* or, for polygons with many edges, the grid used by point_in_multipolygon_grid()
+* in place of the ring trees.
 */
 typedef struct
 {
 	RTREE_NODE **ringIndices;
 	int* ringCounts;
 	int polyCount;
+	RTREE_GRID *grid;
 }
 RTREE_POLY_CACHE;
 
@@ -42,10 +90,8 @@ RTREE_POLY_CACHE;
 
 typedef struct {
 	int                         type;       // <GeomCache>
-	GSERIALIZED*                geom1;      // 
-	GSERIALIZED*                geom2;      // 
-	size_t                      geom1_size; // 
-	size_t                      geom2_size; // 
+	GSERIALIZED*                geom;       // 
+	size_t                      geom_size;  // 
 	int32                       argnum;     // </GeomCache>
 	RTREE_POLY_CACHE*           index;
 } RTreeGeomCache;
@@ -57,6 +103,13 @@ typedef struct {
 LWMLINE *RTreeFindLineSegments(RTREE_NODE *root, double value);
 
 
+/**
+* Returns the index of the grid cell containing the point, border cells
+* standing for the area outside the grid.
+*/
+int RTreeGridCell(const RTREE_GRID *grid, const POINT2D *pt);
+
+
 /**
 * Checks for a cache hit against the provided geometry and returns
 * a pre-built index structure (RTREE_POLY_CACHE) if one exists. Otherwise
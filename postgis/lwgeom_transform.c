@@ -12,6 +12,11 @@
 
 #include "postgres.h"
 #include "fmgr.h"
+#include "funcapi.h"
+#include "catalog/pg_type.h" /* for INT4OID */
+#include "commands/trigger.h"
+#include "utils/array.h"
+#include "utils/inval.h"
 
 #include "../postgis_config.h"
 #include "liblwgeom.h"
@@ -21,6 +26,11 @@
 Datum transform(PG_FUNCTION_ARGS);
 Datum transform_geom(PG_FUNCTION_ARGS);
 Datum postgis_proj_version(PG_FUNCTION_ARGS);
+Datum postgis_proj_cache_invalidate(PG_FUNCTION_ARGS);
+Datum postgis_proj_cache_warm(PG_FUNCTION_ARGS);
+Datum postgis_proj_cache(PG_FUNCTION_ARGS);
+Datum postgis_cache_stats(PG_FUNCTION_ARGS);
+Datum postgis_cache_stats_reset(PG_FUNCTION_ARGS);
 
 
 
@@ -37,6 +47,7 @@ Datum transform(PG_FUNCTION_ARGS)
 	GSERIALIZED *result=NULL;
 	LWGEOM *lwgeom;
 	projPJ input_pj, output_pj;
+	int pair_kind;
 	int32 output_srid, input_srid;
 
 	output_srid = PG_GETARG_INT32(1);
@@ -62,7 +73,7 @@ Datum transform(PG_FUNCTION_ARGS)
 	if ( input_srid == output_srid )
 		PG_RETURN_POINTER(PG_GETARG_DATUM(0));
 
-	if ( GetProjectionsUsingFCInfo(fcinfo, input_srid, output_srid, &input_pj, &output_pj) == LW_FAILURE )
+	if ( GetProjectionPairUsingFCInfo(fcinfo, input_srid, output_srid, &input_pj, &output_pj, &pair_kind) == LW_FAILURE )
 	{
 		PG_FREE_IF_COPY(geom, 0);
 		elog(ERROR,"Failure reading projections from spatial_ref_sys.");
@@ -71,7 +82,7 @@ Datum transform(PG_FUNCTION_ARGS)
 	
 	/* now we have a geometry, and input/output PJ structs. */
 	lwgeom = lwgeom_from_gserialized(geom);
-	lwgeom_transform(lwgeom, input_pj, output_pj);
+	lwgeom_transform_kind(lwgeom, pair_kind, input_pj, output_pj);
 	lwgeom->srid = output_srid;
 
 	/* Re-compute bbox if input had one (COMPUTE_BBOX TAINTING) */
@@ -207,3 +218,229 @@ Datum postgis_proj_version(PG_FUNCTION_ARGS)
 	text *result = cstring2text(ver);
 	PG_RETURN_POINTER(result);
 }
+
+
+/**
+ * Statement level trigger on spatial_ref_sys. Raises a relcache
+ * invalidation for the table, which makes every backend (this one
+ * at once, the others when we commit) drop its cached projections.
+ */
+PG_FUNCTION_INFO_V1(postgis_proj_cache_invalidate);
+Datum postgis_proj_cache_invalidate(PG_FUNCTION_ARGS)
+{
+	TriggerData *trigdata = (TriggerData *) fcinfo->context;
+
+	if ( ! CALLED_AS_TRIGGER(fcinfo) )
+		elog(ERROR, "postgis_proj_cache_invalidate: not called by trigger manager");
+
+	CacheInvalidateRelcache(trigdata->tg_relation);
+
+	return PointerGetDatum(NULL);
+}
+
+/**
+ * postgis_proj_cache_warm( INT[] (srids) )
+ * Load the projections for the given SRIDs into the backend
+ * cache, so that the first transform() of a session does not
+ * pay for the spatial_ref_sys lookups. Returns the number of
+ * projections that were not cached yet.
+ */
+PG_FUNCTION_INFO_V1(postgis_proj_cache_warm);
+Datum postgis_proj_cache_warm(PG_FUNCTION_ARGS)
+{
+	ArrayType *array = PG_GETARG_ARRAYTYPE_P(0);
+	Datum *elems;
+	bool *nulls;
+	int nelems, i;
+	int loaded = 0;
+
+	if ( ARR_ELEMTYPE(array) != INT4OID )
+		elog(ERROR, "postgis_proj_cache_warm: integer array expected");
+
+	deconstruct_array(array, INT4OID, sizeof(int32), true, 'i', &elems, &nulls, &nelems);
+
+	for ( i = 0; i < nelems; i++ )
+	{
+		int32 srid;
+
+		if ( nulls[i] ) continue;
+
+		srid = DatumGetInt32(elems[i]);
+		if ( srid == SRID_UNKNOWN )
+			continue;
+
+		if ( LoadPROJ4Projection(srid) )
+			loaded++;
+	}
+
+	PG_RETURN_INT32(loaded);
+}
+
+typedef struct PROJCACHESTATE
+{
+	PROJ4CacheItem *items;
+	int nitems;
+	int idx;
+}
+PROJCACHESTATE;
+
+/**
+ * postgis_proj_cache()
+ * Return one (srid, proj4text, hits) row per projection held
+ * in the backend cache.
+ */
+PG_FUNCTION_INFO_V1(postgis_proj_cache);
+Datum postgis_proj_cache(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	PROJCACHESTATE *state;
+	MemoryContext oldcontext;
+	TupleDesc tupdesc;
+	HeapTuple tuple;
+	Datum values[3];
+	bool nulls[3] = {false, false, false};
+	PROJ4CacheItem *item;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		/* Snapshot the cache now, it may be flushed while we return rows */
+		state = palloc(sizeof(PROJCACHESTATE));
+		state->nitems = GetPROJ4CacheItems(&(state->items));
+		state->idx = 0;
+		funcctx->user_fctx = state;
+
+		if (get_call_result_type(fcinfo, 0, &tupdesc) != TYPEFUNC_COMPOSITE)
+		{
+			ereport(ERROR,
+			        (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			         errmsg("function returning record called in context "
+			                "that cannot accept type record")));
+		}
+		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	state = funcctx->user_fctx;
+
+	if ( state->idx >= state->nitems )
+		SRF_RETURN_DONE(funcctx);
+
+	item = &(state->items[state->idx++]);
+	values[0] = Int32GetDatum(item->srid);
+	values[1] = PointerGetDatum(cstring2text(item->proj4text));
+	values[2] = Int64GetDatum((int64) item->hits);
+
+	tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+	SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+}
+
+/* The caches reported by postgis_cache_stats(), the last one being PROJ */
+static const struct
+{
+	const char *name;
+	int entry_number;
+}
+CACHE_STATS_NAMES[] =
+{
+	{ "prepared", PREP_CACHE_ENTRY },
+	{ "rtree", RTREE_CACHE_ENTRY },
+	{ "circtree", CIRC_CACHE_ENTRY },
+	{ "recttree", RECT_CACHE_ENTRY },
+	{ "proj", -1 }
+};
+
+#define NUM_CACHE_STATS ((int) (sizeof(CACHE_STATS_NAMES) / sizeof(CACHE_STATS_NAMES[0])))
+
+/**
+ * postgis_cache_stats()
+ * Return one (cache, lookups, arg1_hits, arg2_hits, builds,
+ * build_failures, build_ms, bytes, evictions) row per cache
+ * type, with the counters of this backend. Before 9.5 the bytes
+ * of the geometry caches are NULL, see GetGeomCacheSet().
+ */
+PG_FUNCTION_INFO_V1(postgis_cache_stats);
+Datum postgis_cache_stats(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	MemoryContext oldcontext;
+	TupleDesc tupdesc;
+	HeapTuple tuple;
+	Datum values[9];
+	bool nulls[9] = {false, false, false, false, false, false, false, false, false};
+	CacheStats *stats;
+	int i;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		/* Snapshot the counters now, so the rows agree with each other */
+		stats = palloc(sizeof(CacheStats) * NUM_CACHE_STATS);
+		for ( i = 0; i < NUM_CACHE_STATS; i++ )
+		{
+			if ( CACHE_STATS_NAMES[i].entry_number < 0 )
+				stats[i] = proj4_cache_stats;
+			else
+				stats[i] = geom_cache_stats[CACHE_STATS_NAMES[i].entry_number];
+		}
+		funcctx->user_fctx = stats;
+		funcctx->max_calls = NUM_CACHE_STATS;
+
+		if (get_call_result_type(fcinfo, 0, &tupdesc) != TYPEFUNC_COMPOSITE)
+		{
+			ereport(ERROR,
+			        (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+			         errmsg("function returning record called in context "
+			                "that cannot accept type record")));
+		}
+		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+
+	if ( funcctx->call_cntr >= funcctx->max_calls )
+		SRF_RETURN_DONE(funcctx);
+
+	i = funcctx->call_cntr;
+	stats = &(((CacheStats *) funcctx->user_fctx)[i]);
+	values[0] = PointerGetDatum(cstring2text(CACHE_STATS_NAMES[i].name));
+	values[1] = Int64GetDatum((int64) stats->lookups);
+	values[2] = Int64GetDatum((int64) stats->hits[0]);
+	values[3] = Int64GetDatum((int64) stats->hits[1]);
+	values[4] = Int64GetDatum((int64) stats->builds);
+	values[5] = Int64GetDatum((int64) stats->build_failures);
+	values[6] = Float8GetDatum(stats->build_ms);
+	values[7] = Int64GetDatum(stats->bytes);
+#if POSTGIS_PGSQL_VERSION < 95
+	/* We can't take the keys off when the statement ends, so it only grows */
+	nulls[7] = ( CACHE_STATS_NAMES[i].entry_number >= 0 );
+#endif
+	values[8] = Int64GetDatum((int64) stats->evictions);
+
+	tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+	SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+}
+
+/**
+ * postgis_cache_stats_reset()
+ * Zero the counters of all the caches of this backend.
+ */
+PG_FUNCTION_INFO_V1(postgis_cache_stats_reset);
+Datum postgis_cache_stats_reset(PG_FUNCTION_ARGS)
+{
+	int i;
+
+	for ( i = 0; i < NUM_CACHE_ENTRIES; i++ )
+		CacheStatsReset(&(geom_cache_stats[i]));
+	CacheStatsReset(&proj4_cache_stats);
+
+	PG_RETURN_VOID();
+}
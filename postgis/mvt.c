@@ -0,0 +1,780 @@
+/**********************************************************************
+ *
+ * PostGIS - Spatial Types for PostgreSQL
+ * http://postgis.refractions.net
+ *
+ * This is free software; you can redistribute and/or modify it under
+ * the terms of the GNU General Public Licence. See the COPYING file.
+ *
+ **********************************************************************
+ *
+ * Mapbox Vector Tile output, following version 2.1 of the spec at
+ * https://github.com/mapbox/vector-tile-spec
+ *
+ * message Tile    { repeated Layer layers = 3; }
+ * message Layer   { required uint32 version = 15; required string name = 1;
+ *                   repeated Feature features = 2; repeated string keys = 3;
+ *                   repeated Value values = 4; optional uint32 extent = 5; }
+ * message Feature { optional uint64 id = 1; repeated uint32 tags = 2 [packed];
+ *                   optional GeomType type = 3; repeated uint32 geometry = 4 [packed]; }
+ * message Value   { string string_value = 1; float float_value = 2;
+ *                   double double_value = 3; int64 int_value = 4;
+ *                   uint64 uint_value = 5; sint64 sint_value = 6;
+ *                   bool bool_value = 7; }
+ *
+ **********************************************************************/
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "access/hash.h"
+#include "access/htup.h"
+#include "catalog/pg_type.h"
+#include "utils/lsyscache.h"
+#include "utils/typcache.h"
+
+#include <math.h>
+
+#include "../postgis_config.h"
+#include "liblwgeom_internal.h"
+#include "lwgeom_pg.h"
+#include "lwgeom_functions_analytic.h"
+#include "mvt.h"
+
+/* Protobuf wire types */
+#define PB_VARINT 0
+#define PB_FIXED64 1
+#define PB_BYTES 2
+#define PB_FIXED32 5
+
+/* Field numbers */
+#define TILE_LAYERS 3
+#define LAYER_NAME 1
+#define LAYER_FEATURES 2
+#define LAYER_KEYS 3
+#define LAYER_VALUES 4
+#define LAYER_EXTENT 5
+#define LAYER_VERSION 15
+#define FEATURE_TAGS 2
+#define FEATURE_TYPE 3
+#define FEATURE_GEOMETRY 4
+#define VALUE_STRING 1
+#define VALUE_FLOAT 2
+#define VALUE_DOUBLE 3
+#define VALUE_UINT 5
+#define VALUE_SINT 6
+#define VALUE_BOOL 7
+
+/* Geometry commands */
+#define MVT_MOVETO 1
+#define MVT_LINETO 2
+#define MVT_CLOSEPATH 7
+
+#define MVT_VERSION 2
+
+
+/*
+ * Protobuf encoding
+ */
+
+static void
+pb_varint(StringInfo buf, uint64 v)
+{
+	char b[10];
+	int n = 0;
+
+	while ( v >= 0x80 )
+	{
+		b[n++] = (char)(v | 0x80);
+		v >>= 7;
+	}
+	b[n++] = (char)v;
+	appendBinaryStringInfo(buf, b, n);
+}
+
+static void
+pb_key(StringInfo buf, int field, int wiretype)
+{
+	pb_varint(buf, (field << 3) | wiretype);
+}
+
+static void
+pb_bytes(StringInfo buf, int field, const char *data, int len)
+{
+	pb_key(buf, field, PB_BYTES);
+	pb_varint(buf, len);
+	appendBinaryStringInfo(buf, data, len);
+}
+
+static void
+pb_fixed(StringInfo buf, uint64 v, int nbytes)
+{
+	char b[8];
+	int i;
+
+	/* Always little-endian */
+	for ( i = 0; i < nbytes; i++ )
+		b[i] = (char)(v >> (8 * i));
+	appendBinaryStringInfo(buf, b, nbytes);
+}
+
+static inline uint32
+pb_zigzag32(int32 v)
+{
+	return ((uint32)v << 1) ^ (uint32)(v >> 31);
+}
+
+static inline uint64
+pb_zigzag64(int64 v)
+{
+	return ((uint64)v << 1) ^ (uint64)(v >> 63);
+}
+
+
+/*
+ * Geometry encoding. Coordinates are deltas from the cursor,
+ * which carries over from one part of a feature to the next.
+ */
+
+static void
+mvt_command(StringInfo buf, int id, uint32 count)
+{
+	pb_varint(buf, (id & 0x7) | (count << 3));
+}
+
+static void
+mvt_param(StringInfo buf, int32 *cursor, int32 x, int32 y)
+{
+	pb_varint(buf, pb_zigzag32(x - cursor[0]));
+	pb_varint(buf, pb_zigzag32(y - cursor[1]));
+	cursor[0] = x;
+	cursor[1] = y;
+}
+
+static void
+mvt_encode_points(const LWGEOM *geom, StringInfo buf, int32 *cursor)
+{
+	const LWCOLLECTION *col = (const LWCOLLECTION*)geom;
+	const LWGEOM * const *pts = &geom;
+	const POINT2D *p;
+	int i, n = 1, count = 0;
+
+	if ( geom->type == MULTIPOINTTYPE )
+	{
+		pts = (const LWGEOM * const *)col->geoms;
+		n = col->ngeoms;
+	}
+
+	for ( i = 0; i < n; i++ )
+		if ( ! lwgeom_is_empty(pts[i]) ) count++;
+	if ( ! count )
+		return;
+
+	mvt_command(buf, MVT_MOVETO, count);
+	for ( i = 0; i < n; i++ )
+	{
+		if ( lwgeom_is_empty(pts[i]) )
+			continue;
+		p = getPoint2d_cp(((const LWPOINT*)pts[i])->point, 0);
+		mvt_param(buf, cursor, (int32)rint(p->x), (int32)rint(p->y));
+	}
+}
+
+/*
+ * A line, or a polygon ring when ring is 1 (shell) or -1 (hole).
+ * Repeated points are skipped, as the spec doesn't allow zero moves,
+ * and rings are turned to the way the spec wants them to wind.
+ * Returns LW_FALSE if nothing is left to write.
+ */
+static int
+mvt_encode_ptarray(const POINTARRAY *pa, int ring, StringInfo buf, int32 *cursor)
+{
+	int32 *xy = palloc(2 * sizeof(int32) * pa->npoints);
+	const POINT2D *p;
+	int i, n = 0;
+
+	for ( i = 0; i < pa->npoints; i++ )
+	{
+		int32 x, y;
+		p = getPoint2d_cp(pa, i);
+		x = (int32)rint(p->x);
+		y = (int32)rint(p->y);
+		if ( n && xy[2*n-2] == x && xy[2*n-1] == y )
+			continue;
+		xy[2*n] = x;
+		xy[2*n+1] = y;
+		n++;
+	}
+
+	if ( ring )
+	{
+		double area = 0.0;
+
+		/* ClosePath brings it back to the start */
+		if ( n > 1 && xy[0] == xy[2*n-2] && xy[1] == xy[2*n-1] )
+			n--;
+		if ( n < 3 )
+		{
+			pfree(xy);
+			return LW_FALSE;
+		}
+
+		for ( i = 0; i < n; i++ )
+		{
+			int j = (i + 1) % n;
+			area += (double)xy[2*i] * xy[2*j+1] - (double)xy[2*j] * xy[2*i+1];
+		}
+		if ( area == 0.0 )
+		{
+			pfree(xy);
+			return LW_FALSE;
+		}
+
+		/* Shells wind to a positive area in tile space, holes negative */
+		if ( (area > 0.0) != (ring > 0) )
+		{
+			for ( i = 0; i < n / 2; i++ )
+			{
+				int32 tx = xy[2*i], ty = xy[2*i+1];
+				xy[2*i] = xy[2*(n-1-i)];
+				xy[2*i+1] = xy[2*(n-1-i)+1];
+				xy[2*(n-1-i)] = tx;
+				xy[2*(n-1-i)+1] = ty;
+			}
+		}
+	}
+	else if ( n < 2 )
+	{
+		pfree(xy);
+		return LW_FALSE;
+	}
+
+	mvt_command(buf, MVT_MOVETO, 1);
+	mvt_param(buf, cursor, xy[0], xy[1]);
+	mvt_command(buf, MVT_LINETO, n - 1);
+	for ( i = 1; i < n; i++ )
+		mvt_param(buf, cursor, xy[2*i], xy[2*i+1]);
+	if ( ring )
+		mvt_command(buf, MVT_CLOSEPATH, 1);
+
+	pfree(xy);
+	return LW_TRUE;
+}
+
+static void
+mvt_encode_poly(const LWPOLY *poly, StringInfo buf, int32 *cursor)
+{
+	int i;
+
+	/* Holes only go with a shell */
+	if ( poly->nrings == 0 || ! mvt_encode_ptarray(poly->rings[0], 1, buf, cursor) )
+		return;
+
+	for ( i = 1; i < poly->nrings; i++ )
+		mvt_encode_ptarray(poly->rings[i], -1, buf, cursor);
+}
+
+/**
+ * Write the geometry of a feature, as the packed command integers
+ * without their field key, and return its type. MVT_UNKNOWN means
+ * nothing of the geometry was left to write.
+ */
+mvt_geom_type
+mvt_encode_geometry(const LWGEOM *geom, StringInfo buf)
+{
+	const LWCOLLECTION *col = (const LWCOLLECTION*)geom;
+	int32 cursor[2] = {0, 0};
+	int start = buf->len;
+	mvt_geom_type type;
+	int i;
+
+	switch ( geom->type )
+	{
+	case POINTTYPE:
+	case MULTIPOINTTYPE:
+		mvt_encode_points(geom, buf, cursor);
+		type = MVT_POINT;
+		break;
+	case LINETYPE:
+		mvt_encode_ptarray(((const LWLINE*)geom)->points, 0, buf, cursor);
+		type = MVT_LINESTRING;
+		break;
+	case MULTILINETYPE:
+		for ( i = 0; i < col->ngeoms; i++ )
+			mvt_encode_ptarray(((const LWLINE*)col->geoms[i])->points, 0, buf, cursor);
+		type = MVT_LINESTRING;
+		break;
+	case POLYGONTYPE:
+		mvt_encode_poly((const LWPOLY*)geom, buf, cursor);
+		type = MVT_POLYGON;
+		break;
+	case MULTIPOLYGONTYPE:
+		for ( i = 0; i < col->ngeoms; i++ )
+			mvt_encode_poly((const LWPOLY*)col->geoms[i], buf, cursor);
+		type = MVT_POLYGON;
+		break;
+	default:
+		elog(ERROR, "%s: unsupported geometry type: %s", "ST_AsMVT", lwtype_name(geom->type));
+		return MVT_UNKNOWN;
+	}
+
+	return buf->len > start ? type : MVT_UNKNOWN;
+}
+
+
+/*
+ * Tile geometry preparation
+ */
+
+/* Drop rings that snapping flattened, and polygons left without a shell */
+static int
+mvt_poly_clean(LWPOLY *poly)
+{
+	int i, n = 0;
+
+	if ( poly->nrings == 0 || ptarray_signed_area(poly->rings[0]) == 0.0 )
+		return LW_FALSE;
+
+	for ( i = 0; i < poly->nrings; i++ )
+	{
+		if ( i == 0 || ptarray_signed_area(poly->rings[i]) != 0.0 )
+			poly->rings[n++] = poly->rings[i];
+		else
+			ptarray_free(poly->rings[i]);
+	}
+	poly->nrings = n;
+	return LW_TRUE;
+}
+
+static LWGEOM *
+mvt_drop_degenerate(LWGEOM *geom)
+{
+	LWCOLLECTION *col;
+	int i, n = 0;
+
+	switch ( geom->type )
+	{
+	case POLYGONTYPE:
+		if ( mvt_poly_clean((LWPOLY*)geom) )
+			return geom;
+		lwgeom_free(geom);
+		return NULL;
+	case MULTIPOLYGONTYPE:
+		col = (LWCOLLECTION*)geom;
+		for ( i = 0; i < col->ngeoms; i++ )
+		{
+			if ( mvt_poly_clean((LWPOLY*)col->geoms[i]) )
+				col->geoms[n++] = col->geoms[i];
+			else
+				lwgeom_free(col->geoms[i]);
+		}
+		col->ngeoms = n;
+		if ( n )
+			return geom;
+		lwgeom_free(geom);
+		return NULL;
+	default:
+		return geom;
+	}
+}
+
+/**
+ * Bring a geometry into the coordinate space of a tile covering
+ * bounds, running from 0 to extent in x and y with y pointing down.
+ * Parts further than buffer tile units out of the tile are clipped
+ * away if clip_geom is set; lwgeom_clip_by_rect is used, so concave
+ * polygons cut in pieces stay joined along the edge of the buffer,
+ * out of sight. Coordinates are snapped to integers, and parts that
+ * collapse are dropped. Returns NULL if nothing is left.
+ */
+LWGEOM *
+mvt_geom(LWGEOM *lwgeom, const GBOX *bounds, uint32 extent, uint32 buffer, bool clip_geom)
+{
+	double width = bounds->xmax - bounds->xmin;
+	double height = bounds->ymax - bounds->ymin;
+	LWGEOM *geom, *tmp;
+	AFFINE affine;
+	gridspec grid;
+	GBOX gbox, clip;
+
+	if ( width <= 0 || height <= 0 )
+		elog(ERROR, "%s: bounds width and height must be positive", "ST_AsMVTGeom");
+
+	if ( lwgeom_is_empty(lwgeom) )
+		return NULL;
+
+	/* Tiles are flat and straight */
+	if ( lwgeom_has_arc(lwgeom) )
+	{
+		tmp = lwgeom_segmentize(lwgeom, 32);
+		geom = lwgeom_force_2d(tmp);
+		lwgeom_free(tmp);
+	}
+	else
+	{
+		geom = lwgeom_force_2d(lwgeom);
+	}
+
+	/* A feature has one type, keep the parts of the highest dimension */
+	if ( geom->type == COLLECTIONTYPE )
+	{
+		static const int types[] = { POINTTYPE, LINETYPE, POLYGONTYPE };
+		int dim = lwgeom_dimension(geom);
+		if ( dim < 0 || dim > 2 )
+			return NULL;
+		geom = (LWGEOM*)lwcollection_extract((LWCOLLECTION*)geom, types[dim]);
+	}
+
+	if ( lwgeom_calculate_gbox(geom, &gbox) == LW_FAILURE )
+		return NULL;
+
+	if ( clip_geom )
+	{
+		clip = *bounds;
+		clip.flags = gbox.flags;
+		clip.xmin -= width * buffer / extent;
+		clip.xmax += width * buffer / extent;
+		clip.ymin -= height * buffer / extent;
+		clip.ymax += height * buffer / extent;
+
+		if ( ! gbox_overlaps_2d(&gbox, &clip) )
+			return NULL;
+
+		if ( gbox.xmin < clip.xmin || gbox.xmax > clip.xmax ||
+		     gbox.ymin < clip.ymin || gbox.ymax > clip.ymax )
+		{
+			geom = lwgeom_clip_by_rect(geom, clip.xmin, clip.ymin, clip.xmax, clip.ymax);
+			if ( lwgeom_is_empty(geom) )
+				return NULL;
+		}
+	}
+
+	/* Clockwise shells turn counter-clockwise once y is flipped */
+	lwgeom_force_clockwise(geom);
+
+	memset(&affine, 0, sizeof(AFFINE));
+	affine.afac = extent / width;
+	affine.efac = -(extent / height);
+	affine.ifac = 1;
+	affine.xoff = -bounds->xmin * affine.afac;
+	affine.yoff = bounds->ymax * extent / height;
+	lwgeom_affine(geom, &affine);
+
+	memset(&grid, 0, sizeof(gridspec));
+	grid.xsize = 1;
+	grid.ysize = 1;
+	geom = lwgeom_grid(geom, &grid);
+	if ( ! geom || lwgeom_is_empty(geom) )
+		return NULL;
+
+	/* Points snapped together may stay, only lines and rings shrink */
+	if ( lwgeom_get_type(geom) != POINTTYPE && lwgeom_get_type(geom) != MULTIPOINTTYPE )
+	{
+		tmp = lwgeom_remove_repeated_points(geom);
+		lwgeom_free(geom);
+		geom = mvt_drop_degenerate(tmp);
+	}
+	if ( ! geom || lwgeom_is_empty(geom) )
+		return NULL;
+
+	/* The SRID no longer applies to tile coordinates */
+	lwgeom_set_srid(geom, SRID_UNKNOWN);
+	lwgeom_drop_bbox(geom);
+	return geom;
+}
+
+
+/*
+ * Layer building
+ */
+
+/**
+ * Set up the context for a layer; name, extent, geom_name
+ * and geom_type must be filled in first.
+ */
+void
+mvt_agg_init_context(mvt_agg_context *ctx)
+{
+	ctx->tupdesc = NULL;
+	ctx->geom_index = -1;
+	ctx->out_funcs = NULL;
+	ctx->typids = NULL;
+	initStringInfo(&ctx->features);
+	initStringInfo(&ctx->values);
+	ctx->nvalues = 0;
+	ctx->nslots = 64;
+	ctx->slots = palloc0(ctx->nslots * sizeof(mvt_value_slot));
+	ctx->tags = NULL;
+	ctx->nfeatures = 0;
+}
+
+/* Work out the columns from the first row */
+static void
+mvt_agg_init_columns(mvt_agg_context *ctx, HeapTupleHeader rec)
+{
+	TupleDesc tupdesc;
+	int i, natts;
+
+	tupdesc = lookup_rowtype_tupdesc(HeapTupleHeaderGetTypeId(rec), HeapTupleHeaderGetTypMod(rec));
+	ctx->tupdesc = CreateTupleDescCopy(tupdesc);
+	ReleaseTupleDesc(tupdesc);
+
+	natts = ctx->tupdesc->natts;
+	ctx->out_funcs = palloc0(natts * sizeof(FmgrInfo));
+	ctx->typids = palloc0(natts * sizeof(Oid));
+	ctx->tags = palloc(2 * natts * sizeof(uint32));
+
+	for ( i = 0; i < natts; i++ )
+	{
+		Form_pg_attribute attr = ctx->tupdesc->attrs[i];
+		Oid foutoid;
+		bool typisvarlena;
+
+		if ( attr->attisdropped )
+			continue;
+
+		ctx->typids[i] = getBaseType(attr->atttypid);
+		getTypeOutputInfo(attr->atttypid, &foutoid, &typisvarlena);
+		fmgr_info(foutoid, &ctx->out_funcs[i]);
+
+		if ( ctx->geom_index < 0 && ctx->typids[i] == ctx->geom_type &&
+		     ( ! ctx->geom_name || strcmp(NameStr(attr->attname), ctx->geom_name) == 0 ) )
+			ctx->geom_index = i;
+	}
+
+	if ( ctx->geom_index < 0 )
+	{
+		if ( ctx->geom_name )
+			elog(ERROR, "%s: could not find geometry column \"%s\"", "ST_AsMVT", ctx->geom_name);
+		else
+			elog(ERROR, "%s: could not find a geometry column", "ST_AsMVT");
+	}
+}
+
+/* Index of a value in the layer, adding it if it is new */
+static uint32
+mvt_add_value(mvt_agg_context *ctx, const char *data, int len)
+{
+	uint32 hash = DatumGetUInt32(hash_any((const unsigned char *) data, len));
+	uint32 mask, i;
+	mvt_value_slot *slot;
+
+	/* Keep the table at most half full */
+	if ( 2 * (ctx->nvalues + 1) > ctx->nslots )
+	{
+		uint32 nold = ctx->nslots;
+		mvt_value_slot *old = palloc(nold * sizeof(mvt_value_slot));
+
+		memcpy(old, ctx->slots, nold * sizeof(mvt_value_slot));
+		ctx->nslots *= 2;
+		ctx->slots = repalloc(ctx->slots, ctx->nslots * sizeof(mvt_value_slot));
+		memset(ctx->slots, 0, ctx->nslots * sizeof(mvt_value_slot));
+		mask = ctx->nslots - 1;
+		for ( i = 0; i < nold; i++ )
+		{
+			uint32 j;
+			if ( ! old[i].len )
+				continue;
+			for ( j = old[i].hash & mask; ctx->slots[j].len; j = (j + 1) & mask )
+				;
+			ctx->slots[j] = old[i];
+		}
+		pfree(old);
+	}
+
+	mask = ctx->nslots - 1;
+	for ( i = hash & mask; ctx->slots[i].len; i = (i + 1) & mask )
+	{
+		slot = &ctx->slots[i];
+		if ( slot->hash == hash && slot->len == len &&
+		     memcmp(ctx->values.data + slot->offset, data, len) == 0 )
+			return slot->index;
+	}
+
+	slot = &ctx->slots[i];
+	slot->hash = hash;
+	slot->offset = ctx->values.len;
+	slot->len = len;
+	slot->index = ctx->nvalues++;
+	appendBinaryStringInfo(&ctx->values, data, len);
+	return slot->index;
+}
+
+/* Write a column value as a Layer.values entry */
+static void
+mvt_encode_value(mvt_agg_context *ctx, int i, Datum datum, StringInfo buf)
+{
+	StringInfoData val;
+	int64 iv;
+
+	initStringInfo(&val);
+	switch ( ctx->typids[i] )
+	{
+	case BOOLOID:
+		pb_key(&val, VALUE_BOOL, PB_VARINT);
+		pb_varint(&val, DatumGetBool(datum) ? 1 : 0);
+		break;
+	case INT2OID:
+	case INT4OID:
+	case INT8OID:
+		if ( ctx->typids[i] == INT2OID )
+			iv = DatumGetInt16(datum);
+		else if ( ctx->typids[i] == INT4OID )
+			iv = DatumGetInt32(datum);
+		else
+			iv = DatumGetInt64(datum);
+		if ( iv >= 0 )
+		{
+			pb_key(&val, VALUE_UINT, PB_VARINT);
+			pb_varint(&val, (uint64)iv);
+		}
+		else
+		{
+			pb_key(&val, VALUE_SINT, PB_VARINT);
+			pb_varint(&val, pb_zigzag64(iv));
+		}
+		break;
+	case FLOAT4OID:
+	{
+		union { float4 f; uint32 u; } fv;
+		fv.f = DatumGetFloat4(datum);
+		pb_key(&val, VALUE_FLOAT, PB_FIXED32);
+		pb_fixed(&val, fv.u, 4);
+		break;
+	}
+	case FLOAT8OID:
+	{
+		union { float8 f; uint64 u; } dv;
+		dv.f = DatumGetFloat8(datum);
+		pb_key(&val, VALUE_DOUBLE, PB_FIXED64);
+		pb_fixed(&val, dv.u, 8);
+		break;
+	}
+	default:
+	{
+		char *str = OutputFunctionCall(&ctx->out_funcs[i], datum);
+		pb_bytes(&val, VALUE_STRING, str, strlen(str));
+		pfree(str);
+		break;
+	}
+	}
+
+	pb_bytes(buf, LAYER_VALUES, val.data, val.len);
+	pfree(val.data);
+}
+
+/**
+ * Add a row to the layer: its geometry (already in tile coordinates)
+ * becomes a feature, and its other non-null columns the feature's tags.
+ * Rows without a geometry, or whose geometry is all degenerate, are
+ * skipped.
+ */
+void
+mvt_agg_transfn(mvt_agg_context *ctx, HeapTupleHeader rec)
+{
+	HeapTupleData tuple;
+	StringInfoData geombuf, buf;
+	GSERIALIZED *gser;
+	LWGEOM *lwgeom;
+	mvt_geom_type type;
+	Datum datum;
+	bool isnull;
+	int i, key, ntags = 0;
+
+	if ( ! ctx->tupdesc )
+		mvt_agg_init_columns(ctx, rec);
+
+	tuple.t_len = HeapTupleHeaderGetDatumLength(rec);
+	ItemPointerSetInvalid(&(tuple.t_self));
+	tuple.t_tableOid = InvalidOid;
+	tuple.t_data = rec;
+
+	datum = heap_getattr(&tuple, ctx->geom_index + 1, ctx->tupdesc, &isnull);
+	if ( isnull )
+		return;
+
+	gser = (GSERIALIZED*)PG_DETOAST_DATUM(datum);
+	lwgeom = lwgeom_from_gserialized(gser);
+	initStringInfo(&geombuf);
+	type = mvt_encode_geometry(lwgeom, &geombuf);
+	lwgeom_free(lwgeom);
+	if ( type == MVT_UNKNOWN )
+		return;
+
+	initStringInfo(&buf);
+	for ( i = 0, key = 0; i < ctx->tupdesc->natts; i++ )
+	{
+		if ( ctx->tupdesc->attrs[i]->attisdropped || i == ctx->geom_index )
+			continue;
+
+		datum = heap_getattr(&tuple, i + 1, ctx->tupdesc, &isnull);
+		if ( ! isnull )
+		{
+			resetStringInfo(&buf);
+			mvt_encode_value(ctx, i, datum, &buf);
+			ctx->tags[ntags++] = key;
+			ctx->tags[ntags++] = mvt_add_value(ctx, buf.data, buf.len);
+		}
+		key++;
+	}
+
+	/* Tags, packed */
+	resetStringInfo(&buf);
+	for ( i = 0; i < ntags; i++ )
+		pb_varint(&buf, ctx->tags[i]);
+
+	{
+		StringInfoData feature;
+		initStringInfo(&feature);
+		if ( ntags )
+			pb_bytes(&feature, FEATURE_TAGS, buf.data, buf.len);
+		pb_key(&feature, FEATURE_TYPE, PB_VARINT);
+		pb_varint(&feature, type);
+		pb_bytes(&feature, FEATURE_GEOMETRY, geombuf.data, geombuf.len);
+		pb_bytes(&ctx->features, LAYER_FEATURES, feature.data, feature.len);
+		pfree(feature.data);
+	}
+
+	pfree(buf.data);
+	pfree(geombuf.data);
+	ctx->nfeatures++;
+}
+
+/**
+ * The finished tile, holding the one layer.
+ */
+bytea *
+mvt_agg_finalfn(mvt_agg_context *ctx)
+{
+	StringInfoData layer, tile;
+	bytea *result;
+	int i;
+
+	initStringInfo(&layer);
+	pb_bytes(&layer, LAYER_NAME, ctx->name, strlen(ctx->name));
+	appendBinaryStringInfo(&layer, ctx->features.data, ctx->features.len);
+	if ( ctx->tupdesc )
+	{
+		for ( i = 0; i < ctx->tupdesc->natts; i++ )
+		{
+			Form_pg_attribute attr = ctx->tupdesc->attrs[i];
+			if ( attr->attisdropped || i == ctx->geom_index )
+				continue;
+			pb_bytes(&layer, LAYER_KEYS, NameStr(attr->attname), strlen(NameStr(attr->attname)));
+		}
+	}
+	appendBinaryStringInfo(&layer, ctx->values.data, ctx->values.len);
+	pb_key(&layer, LAYER_EXTENT, PB_VARINT);
+	pb_varint(&layer, ctx->extent);
+	pb_key(&layer, LAYER_VERSION, PB_VARINT);
+	pb_varint(&layer, MVT_VERSION);
+
+	initStringInfo(&tile);
+	pb_bytes(&tile, TILE_LAYERS, layer.data, layer.len);
+	pfree(layer.data);
+
+	result = palloc(VARHDRSZ + tile.len);
+	SET_VARSIZE(result, VARHDRSZ + tile.len);
+	memcpy(VARDATA(result), tile.data, tile.len);
+	pfree(tile.data);
+	return result;
+}
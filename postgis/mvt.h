@@ -0,0 +1,74 @@
+/**********************************************************************
+ *
+ * PostGIS - Spatial Types for PostgreSQL
+ * http://postgis.refractions.net
+ *
+ * This is free software; you can redistribute and/or modify it under
+ * the terms of the GNU General Public Licence. See the COPYING file.
+ *
+ **********************************************************************
+ *
+ * Mapbox Vector Tile (version 2) output. The protobuf messages are
+ * few and simple enough to be written out by hand.
+ *
+ **********************************************************************/
+
+#ifndef _MVT_H
+#define _MVT_H 1
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "access/htup.h"
+#include "access/tupdesc.h"
+#include "lib/stringinfo.h"
+
+#include "liblwgeom.h"
+
+/** Geometry types of the vector tile spec */
+typedef enum
+{
+	MVT_UNKNOWN = 0,
+	MVT_POINT = 1,
+	MVT_LINESTRING = 2,
+	MVT_POLYGON = 3
+} mvt_geom_type;
+
+/** A distinct feature property value, as the encoded Value message */
+typedef struct
+{
+	uint32 hash;
+	uint32 offset;  /* into mvt_agg_context.values */
+	uint32 len;
+	uint32 index;   /* place in the layer's values */
+} mvt_value_slot;
+
+/** State of the ST_AsMVT aggregate, building one layer */
+typedef struct
+{
+	char *name;           /* layer name */
+	uint32 extent;        /* tile coordinates run from 0 to extent */
+	char *geom_name;      /* geometry column, or NULL for the first one */
+	Oid geom_type;        /* geometry type, the one of our own schema */
+
+	TupleDesc tupdesc;    /* row shape, set up on the first row */
+	int geom_index;       /* column the geometry comes from */
+	FmgrInfo *out_funcs;  /* text output of each column */
+	Oid *typids;          /* base type of each column */
+
+	StringInfoData features;  /* encoded Feature messages */
+	StringInfoData values;    /* encoded Value messages, deduplicated */
+	uint32 nvalues;
+	mvt_value_slot *slots;    /* hash of values, open addressing */
+	uint32 nslots;
+
+	uint32 *tags;         /* scratch for the tags of one feature */
+	int nfeatures;
+} mvt_agg_context;
+
+LWGEOM *mvt_geom(LWGEOM *geom, const GBOX *bounds, uint32 extent, uint32 buffer, bool clip_geom);
+mvt_geom_type mvt_encode_geometry(const LWGEOM *geom, StringInfo buf);
+void mvt_agg_init_context(mvt_agg_context *ctx);
+void mvt_agg_transfn(mvt_agg_context *ctx, HeapTupleHeader rec);
+bytea *mvt_agg_finalfn(mvt_agg_context *ctx);
+
+#endif /* !defined _MVT_H */
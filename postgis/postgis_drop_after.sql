@@ -142,3 +142,10 @@ DROP FUNCTION IF EXISTS geography_gist_join_selectivity(internal, oid, internal,
 
 DROP FUNCTION IF EXISTS ST_AsBinary(text); -- deprecated in 2.0
 DROP FUNCTION IF EXISTS postgis_uses_stats(); -- deprecated in 2.0
+
+-- (Re)create the trigger keeping backend projection caches in sync
+-- with spatial_ref_sys, as upgrades don't carry over new triggers
+DROP TRIGGER IF EXISTS spatial_ref_sys_proj_cache ON spatial_ref_sys;
+CREATE TRIGGER spatial_ref_sys_proj_cache
+	AFTER INSERT OR UPDATE OR DELETE OR TRUNCATE ON spatial_ref_sys
+	FOR EACH STATEMENT EXECUTE PROCEDURE postgis_proj_cache_invalidate();
@@ -20,6 +20,7 @@
 
 #include "lwgeom_log.h"
 #include "lwgeom_pg.h"
+#include "lwgeom_cache.h"
 #include "geos_c.h"
 #include "lwgeom_backend_api.h"
 
@@ -93,6 +94,22 @@ _PG_init(void)
    );
 #endif
 
+  DefineCustomIntVariable(
+    "postgis.geom_cache_size", /* name */
+    "Sets the number of geometries cached per function call site.", /* short_desc */
+    "Functions using prepared geometries or edge trees keep this many geometries and their indexes per statement.", /* long_desc */
+    &geom_cache_size, /* valueAddr */
+    GEOM_CACHE_SIZE_DEFAULT, /* bootValue */
+    GEOM_CACHE_SIZE_MIN, GEOM_CACHE_SIZE_MAX, /* min-max */
+    PGC_USERSET, /* GucContext context */
+    0, /* int flags */
+#if POSTGIS_PGSQL_VERSION >= 91
+    NULL, /* GucIntCheckHook check_hook */
+#endif
+    NULL, /* GucIntAssignHook assign_hook */
+    NULL  /* GucShowHook show_hook */
+   );
+
     /* install PostgreSQL handlers */
     pg_install_lwgeom_handlers();
 
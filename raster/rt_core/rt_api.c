@@ -32,6 +32,7 @@
 #include <stdio.h>  /* for printf (default message handler) */
 #include <stdarg.h> /* for va_list, va_start etc */
 #include <string.h> /* for memcpy and strlen */
+#include <ctype.h> /* for isdigit and isalpha */
 #include <assert.h>
 #include <time.h> /* for time */
 #include "rt_api.h"
@@ -14516,6 +14517,1710 @@ rt_raster_iterator(
 	return ES_NONE;
 }
 
+/******************************************************************************
+* rt_mapexpr_compile()
+******************************************************************************/
+
+/*
+ * Native evaluator for the subset of SQL used by the expression variants
+ * of ST_MapAlgebra.  Types are resolved the way PostgreSQL resolves them
+ * (int4 keywords and literals, float8 keywords, decimal literals as
+ * numeric) and anything outside of the subset, including any operation
+ * that PostgreSQL would run as numeric arithmetic, makes the compiler
+ * give up so that the caller keeps using SPI.
+ */
+
+typedef enum {
+	_RTI_MAPEXPR_T_NULL = 0, /* untyped NULL literal */
+	_RTI_MAPEXPR_T_INT,      /* int4 */
+	_RTI_MAPEXPR_T_NUMERIC,  /* decimal literal, exact once cast to float8 */
+	_RTI_MAPEXPR_T_FLOAT,    /* float8 */
+	_RTI_MAPEXPR_T_BOOL
+} _rti_mapexpr_type;
+
+typedef enum {
+	_RTI_MAPEXPR_CONST = 0,
+	_RTI_MAPEXPR_KW,
+	_RTI_MAPEXPR_TOFLOAT,
+	_RTI_MAPEXPR_TOINT,
+	_RTI_MAPEXPR_NEG,
+	_RTI_MAPEXPR_ADD,
+	_RTI_MAPEXPR_SUB,
+	_RTI_MAPEXPR_MUL,
+	_RTI_MAPEXPR_DIV,
+	_RTI_MAPEXPR_MOD,
+	_RTI_MAPEXPR_POW,
+	_RTI_MAPEXPR_EQ,
+	_RTI_MAPEXPR_NE,
+	_RTI_MAPEXPR_LT,
+	_RTI_MAPEXPR_LE,
+	_RTI_MAPEXPR_GT,
+	_RTI_MAPEXPR_GE,
+	_RTI_MAPEXPR_AND,
+	_RTI_MAPEXPR_OR,
+	_RTI_MAPEXPR_NOT,
+	_RTI_MAPEXPR_ISNULL,
+	_RTI_MAPEXPR_ISNOTNULL,
+	_RTI_MAPEXPR_CASE, /* args: else, cond, result, cond, result, ... */
+	_RTI_MAPEXPR_COALESCE,
+	_RTI_MAPEXPR_GREATEST,
+	_RTI_MAPEXPR_LEAST,
+	_RTI_MAPEXPR_FUNC
+} _rti_mapexpr_op;
+
+typedef enum {
+	_RTI_MAPEXPR_F_ABS = 0,
+	_RTI_MAPEXPR_F_SQRT,
+	_RTI_MAPEXPR_F_CBRT,
+	_RTI_MAPEXPR_F_EXP,
+	_RTI_MAPEXPR_F_LN,
+	_RTI_MAPEXPR_F_LOG,
+	_RTI_MAPEXPR_F_FLOOR,
+	_RTI_MAPEXPR_F_CEIL,
+	_RTI_MAPEXPR_F_ROUND,
+	_RTI_MAPEXPR_F_TRUNC,
+	_RTI_MAPEXPR_F_SIGN,
+	_RTI_MAPEXPR_F_SIN,
+	_RTI_MAPEXPR_F_COS,
+	_RTI_MAPEXPR_F_TAN,
+	_RTI_MAPEXPR_F_ASIN,
+	_RTI_MAPEXPR_F_ACOS,
+	_RTI_MAPEXPR_F_ATAN,
+	_RTI_MAPEXPR_F_ATAN2,
+	_RTI_MAPEXPR_F_DEGREES,
+	_RTI_MAPEXPR_F_RADIANS,
+	_RTI_MAPEXPR_F_POWER
+} _rti_mapexpr_func;
+
+/* SQL functions understood by the compiler */
+static const struct {
+	const char *name;
+	_rti_mapexpr_func func;
+	int nargs;
+	int hasnumeric; /* a numeric overload exists, so numeric args are not coerced */
+} _rti_mapexpr_funcs[] = {
+	{"abs", _RTI_MAPEXPR_F_ABS, 1, 1},
+	{"sqrt", _RTI_MAPEXPR_F_SQRT, 1, 1},
+	{"cbrt", _RTI_MAPEXPR_F_CBRT, 1, 0},
+	{"exp", _RTI_MAPEXPR_F_EXP, 1, 1},
+	{"ln", _RTI_MAPEXPR_F_LN, 1, 1},
+	{"log", _RTI_MAPEXPR_F_LOG, 1, 1},
+	{"floor", _RTI_MAPEXPR_F_FLOOR, 1, 1},
+	{"ceil", _RTI_MAPEXPR_F_CEIL, 1, 1},
+	{"ceiling", _RTI_MAPEXPR_F_CEIL, 1, 1},
+	{"round", _RTI_MAPEXPR_F_ROUND, 1, 1},
+	{"trunc", _RTI_MAPEXPR_F_TRUNC, 1, 1},
+	{"sign", _RTI_MAPEXPR_F_SIGN, 1, 1},
+	{"sin", _RTI_MAPEXPR_F_SIN, 1, 0},
+	{"cos", _RTI_MAPEXPR_F_COS, 1, 0},
+	{"tan", _RTI_MAPEXPR_F_TAN, 1, 0},
+	{"asin", _RTI_MAPEXPR_F_ASIN, 1, 0},
+	{"acos", _RTI_MAPEXPR_F_ACOS, 1, 0},
+	{"atan", _RTI_MAPEXPR_F_ATAN, 1, 0},
+	{"atan2", _RTI_MAPEXPR_F_ATAN2, 2, 0},
+	{"degrees", _RTI_MAPEXPR_F_DEGREES, 1, 0},
+	{"radians", _RTI_MAPEXPR_F_RADIANS, 1, 0},
+	{"power", _RTI_MAPEXPR_F_POWER, 2, 1},
+	{"pow", _RTI_MAPEXPR_F_POWER, 2, 1},
+	{NULL, 0, 0, 0}
+};
+
+typedef struct _rti_mapexpr_node_t* _rti_mapexpr_node;
+struct _rti_mapexpr_node_t {
+	_rti_mapexpr_op op;
+	_rti_mapexpr_type type;
+
+	/* constant value, keyword index or function id */
+	double dval;
+	int32_t ival;
+	int isnull;
+
+	int nargs;
+	_rti_mapexpr_node *args;
+};
+
+struct rt_mapexpr_t {
+	_rti_mapexpr_node root;
+
+	int kwcount;
+	const double *kwval;
+	const int *kwnull;
+};
+
+typedef struct {
+	double dval;
+	int32_t ival; /* also holds BOOL */
+	int isnull;
+} _rti_mapexpr_value;
+
+/* tokenizer and parser state */
+typedef enum {
+	_RTI_MAPEXPR_TOK_END = 0,
+	_RTI_MAPEXPR_TOK_NUMBER,
+	_RTI_MAPEXPR_TOK_KW,
+	_RTI_MAPEXPR_TOK_IDENT,
+	_RTI_MAPEXPR_TOK_OP,
+	_RTI_MAPEXPR_TOK_LPAREN,
+	_RTI_MAPEXPR_TOK_RPAREN,
+	_RTI_MAPEXPR_TOK_COMMA,
+	_RTI_MAPEXPR_TOK_CAST,
+	_RTI_MAPEXPR_TOK_INVALID
+} _rti_mapexpr_token;
+
+typedef struct {
+	const char *pos;
+
+	_rti_mapexpr_token tok;
+	char text[64];
+	int kwidx;
+
+	int kwcount;
+	char **kw;
+	const int *kwisint;
+} _rti_mapexpr_parser;
+
+#define _RTI_MAPEXPR_OPCHARS "+-*/<>=~!@#%^&|`?"
+
+static void
+_rti_mapexpr_node_destroy(_rti_mapexpr_node node) {
+	int i;
+
+	if (node == NULL)
+		return;
+
+	for (i = 0; i < node->nargs; i++)
+		_rti_mapexpr_node_destroy(node->args[i]);
+	if (node->args != NULL)
+		rtdealloc(node->args);
+	rtdealloc(node);
+}
+
+static _rti_mapexpr_node
+_rti_mapexpr_node_new(_rti_mapexpr_op op, _rti_mapexpr_type type, int nargs) {
+	_rti_mapexpr_node node = rtalloc(sizeof(struct _rti_mapexpr_node_t));
+	if (node == NULL)
+		return NULL;
+
+	memset(node, 0, sizeof(struct _rti_mapexpr_node_t));
+	node->op = op;
+	node->type = type;
+
+	if (nargs > 0) {
+		node->args = rtalloc(sizeof(_rti_mapexpr_node) * nargs);
+		if (node->args == NULL) {
+			rtdealloc(node);
+			return NULL;
+		}
+		memset(node->args, 0, sizeof(_rti_mapexpr_node) * nargs);
+	}
+	node->nargs = nargs;
+
+	return node;
+}
+
+static _rti_mapexpr_node
+_rti_mapexpr_node_append(_rti_mapexpr_node node, _rti_mapexpr_node arg) {
+	_rti_mapexpr_node *args = rtrealloc(node->args, sizeof(_rti_mapexpr_node) * (node->nargs + 1));
+	if (args == NULL) {
+		_rti_mapexpr_node_destroy(arg);
+		_rti_mapexpr_node_destroy(node);
+		return NULL;
+	}
+
+	node->args = args;
+	node->args[node->nargs++] = arg;
+	return node;
+}
+
+static void
+_rti_mapexpr_next(_rti_mapexpr_parser *p) {
+	const char *start;
+	int len;
+	int i;
+
+	while (*p->pos == ' ' || *p->pos == '\t' || *p->pos == '\n' || *p->pos == '\r' || *p->pos == '\f')
+		p->pos++;
+
+	start = p->pos;
+	p->text[0] = '\0';
+	p->kwidx = -1;
+
+	if (*p->pos == '\0') {
+		p->tok = _RTI_MAPEXPR_TOK_END;
+		return;
+	}
+
+	/* keyword placeholder */
+	if (*p->pos == '[') {
+		while (*p->pos != '\0' && *p->pos != ']')
+			p->pos++;
+		if (*p->pos == ']') p->pos++;
+
+		len = p->pos - start;
+		for (i = 0; i < p->kwcount; i++) {
+			if ((int) strlen(p->kw[i]) == len && strncmp(start, p->kw[i], len) == 0) {
+				p->tok = _RTI_MAPEXPR_TOK_KW;
+				p->kwidx = i;
+				return;
+			}
+		}
+
+		p->tok = _RTI_MAPEXPR_TOK_INVALID;
+		return;
+	}
+
+	/* number: digits [. digits] [e [+-] digits] */
+	if (isdigit((unsigned char) *p->pos) || (*p->pos == '.' && isdigit((unsigned char) p->pos[1]))) {
+		while (isdigit((unsigned char) *p->pos)) p->pos++;
+		if (*p->pos == '.') {
+			p->pos++;
+			while (isdigit((unsigned char) *p->pos)) p->pos++;
+		}
+		if (
+			(*p->pos == 'e' || *p->pos == 'E') && (
+				isdigit((unsigned char) p->pos[1]) ||
+				((p->pos[1] == '+' || p->pos[1] == '-') && isdigit((unsigned char) p->pos[2]))
+			)
+		) {
+			p->pos += 2;
+			while (isdigit((unsigned char) *p->pos)) p->pos++;
+		}
+
+		/* trailing junk like 1abc is not a number */
+		if (isalpha((unsigned char) *p->pos) || *p->pos == '_') {
+			p->tok = _RTI_MAPEXPR_TOK_INVALID;
+			return;
+		}
+
+		len = p->pos - start;
+		if (len >= (int) sizeof(p->text)) {
+			p->tok = _RTI_MAPEXPR_TOK_INVALID;
+			return;
+		}
+		memcpy(p->text, start, len);
+		p->text[len] = '\0';
+		p->tok = _RTI_MAPEXPR_TOK_NUMBER;
+		return;
+	}
+
+	/* unquoted identifier, folded to lower case */
+	if (isalpha((unsigned char) *p->pos) || *p->pos == '_') {
+		while (isalnum((unsigned char) *p->pos) || *p->pos == '_')
+			p->pos++;
+
+		len = p->pos - start;
+		if (len >= (int) sizeof(p->text)) {
+			p->tok = _RTI_MAPEXPR_TOK_INVALID;
+			return;
+		}
+		for (i = 0; i < len; i++)
+			p->text[i] = tolower((unsigned char) start[i]);
+		p->text[len] = '\0';
+		p->tok = _RTI_MAPEXPR_TOK_IDENT;
+		return;
+	}
+
+	switch (*p->pos) {
+		case '(':
+			p->pos++;
+			p->tok = _RTI_MAPEXPR_TOK_LPAREN;
+			return;
+		case ')':
+			p->pos++;
+			p->tok = _RTI_MAPEXPR_TOK_RPAREN;
+			return;
+		case ',':
+			p->pos++;
+			p->tok = _RTI_MAPEXPR_TOK_COMMA;
+			return;
+		case ':':
+			if (p->pos[1] == ':') {
+				p->pos += 2;
+				p->tok = _RTI_MAPEXPR_TOK_CAST;
+				return;
+			}
+			p->tok = _RTI_MAPEXPR_TOK_INVALID;
+			return;
+	}
+
+	/* operator, split the way the PostgreSQL lexer does */
+	if (strchr(_RTI_MAPEXPR_OPCHARS, *p->pos) != NULL) {
+		int special = 0;
+
+		while (*p->pos != '\0' && strchr(_RTI_MAPEXPR_OPCHARS, *p->pos) != NULL)
+			p->pos++;
+		len = p->pos - start;
+
+		/* comments */
+		for (i = 0; i < len - 1; i++) {
+			if ((start[i] == '-' && start[i + 1] == '-') || (start[i] == '/' && start[i + 1] == '*')) {
+				p->tok = _RTI_MAPEXPR_TOK_INVALID;
+				return;
+			}
+		}
+
+		/* a multi-char operator may only end in + or - if it has one of ~!@#%^&|`? */
+		for (i = 0; i < len; i++) {
+			if (strchr("~!@#%^&|`?", start[i]) != NULL) {
+				special = 1;
+				break;
+			}
+		}
+		if (!special) {
+			while (len > 1 && (start[len - 1] == '+' || start[len - 1] == '-'))
+				len--;
+		}
+		p->pos = start + len;
+
+		if (len >= (int) sizeof(p->text)) {
+			p->tok = _RTI_MAPEXPR_TOK_INVALID;
+			return;
+		}
+		memcpy(p->text, start, len);
+		p->text[len] = '\0';
+		p->tok = _RTI_MAPEXPR_TOK_OP;
+		return;
+	}
+
+	p->tok = _RTI_MAPEXPR_TOK_INVALID;
+}
+
+static int
+_rti_mapexpr_isop(_rti_mapexpr_parser *p, const char *op) {
+	return p->tok == _RTI_MAPEXPR_TOK_OP && strcmp(p->text, op) == 0;
+}
+
+static int
+_rti_mapexpr_isident(_rti_mapexpr_parser *p, const char *ident) {
+	return p->tok == _RTI_MAPEXPR_TOK_IDENT && strcmp(p->text, ident) == 0;
+}
+
+static int
+_rti_mapexpr_iscmp(_rti_mapexpr_parser *p) {
+	return (
+		_rti_mapexpr_isop(p, "=") || _rti_mapexpr_isop(p, "<>") || _rti_mapexpr_isop(p, "!=") ||
+		_rti_mapexpr_isop(p, "<") || _rti_mapexpr_isop(p, "<=") ||
+		_rti_mapexpr_isop(p, ">") || _rti_mapexpr_isop(p, ">=")
+	);
+}
+
+/* numeric types only, BOOL does not take part in arithmetic */
+static int
+_rti_mapexpr_isnumber(_rti_mapexpr_type type) {
+	return type == _RTI_MAPEXPR_T_INT || type == _RTI_MAPEXPR_T_NUMERIC || type == _RTI_MAPEXPR_T_FLOAT;
+}
+
+/* wrap node so that it evaluates to FLOAT */
+static _rti_mapexpr_node
+_rti_mapexpr_tofloat(_rti_mapexpr_node node) {
+	_rti_mapexpr_node cast;
+
+	if (node == NULL)
+		return NULL;
+
+	switch (node->type) {
+		case _RTI_MAPEXPR_T_FLOAT:
+			return node;
+		/* NULL literals and numeric constants are already held as double */
+		case _RTI_MAPEXPR_T_NULL:
+		case _RTI_MAPEXPR_T_NUMERIC:
+			node->type = _RTI_MAPEXPR_T_FLOAT;
+			return node;
+		case _RTI_MAPEXPR_T_INT:
+			cast = _rti_mapexpr_node_new(_RTI_MAPEXPR_TOFLOAT, _RTI_MAPEXPR_T_FLOAT, 1);
+			if (cast == NULL) {
+				_rti_mapexpr_node_destroy(node);
+				return NULL;
+			}
+			cast->args[0] = node;
+			return cast;
+		default:
+			_rti_mapexpr_node_destroy(node);
+			return NULL;
+	}
+}
+
+/*
+ * Common type of a set of arguments as chosen by PostgreSQL for CASE,
+ * COALESCE, GREATEST and LEAST.  Returns -1 if not supported.
+ */
+static int
+_rti_mapexpr_common_type(_rti_mapexpr_node *args, int nargs, int step) {
+	int hasint = 0;
+	int hasnumeric = 0;
+	int hasfloat = 0;
+	int hasbool = 0;
+	int i;
+
+	for (i = 0; i < nargs; i += step) {
+		switch (args[i]->type) {
+			case _RTI_MAPEXPR_T_NULL:
+				break;
+			case _RTI_MAPEXPR_T_INT:
+				hasint = 1;
+				break;
+			case _RTI_MAPEXPR_T_NUMERIC:
+				hasnumeric = 1;
+				break;
+			case _RTI_MAPEXPR_T_FLOAT:
+				hasfloat = 1;
+				break;
+			case _RTI_MAPEXPR_T_BOOL:
+				hasbool = 1;
+				break;
+		}
+	}
+
+	if (hasbool) {
+		if (hasint || hasnumeric || hasfloat)
+			return -1;
+		return _RTI_MAPEXPR_T_BOOL;
+	}
+	if (hasfloat)
+		return _RTI_MAPEXPR_T_FLOAT;
+	if (hasnumeric) {
+		/* int4 and numeric would be resolved as numeric */
+		if (hasint)
+			return -1;
+		return _RTI_MAPEXPR_T_NUMERIC;
+	}
+	if (hasint)
+		return _RTI_MAPEXPR_T_INT;
+
+	return _RTI_MAPEXPR_T_NULL;
+}
+
+/* coerce all args of node to type */
+static int
+_rti_mapexpr_coerce_args(_rti_mapexpr_node node, int first, int step, _rti_mapexpr_type type) {
+	int i;
+
+	for (i = first; i < node->nargs; i += step) {
+		if (node->args[i]->type == type)
+			continue;
+		if (node->args[i]->type == _RTI_MAPEXPR_T_NULL) {
+			node->args[i]->type = type;
+			continue;
+		}
+		if (type != _RTI_MAPEXPR_T_FLOAT)
+			return 0;
+
+		node->args[i] = _rti_mapexpr_tofloat(node->args[i]);
+		if (node->args[i] == NULL)
+			return 0;
+	}
+
+	return 1;
+}
+
+static _rti_mapexpr_node _rti_mapexpr_parse_or(_rti_mapexpr_parser *p);
+
+/* build a binary node, resolving operand types */
+static _rti_mapexpr_node
+_rti_mapexpr_binary(_rti_mapexpr_op op, _rti_mapexpr_node left, _rti_mapexpr_node right) {
+	_rti_mapexpr_node node = NULL;
+	int type;
+	int iscmp = (op >= _RTI_MAPEXPR_EQ && op <= _RTI_MAPEXPR_GE);
+
+	if (left == NULL || right == NULL) {
+		_rti_mapexpr_node_destroy(left);
+		_rti_mapexpr_node_destroy(right);
+		return NULL;
+	}
+
+	/* boolean connectives */
+	if (op == _RTI_MAPEXPR_AND || op == _RTI_MAPEXPR_OR) {
+		if (
+			(left->type != _RTI_MAPEXPR_T_BOOL && left->type != _RTI_MAPEXPR_T_NULL) ||
+			(right->type != _RTI_MAPEXPR_T_BOOL && right->type != _RTI_MAPEXPR_T_NULL)
+		) {
+			type = -1;
+		}
+		else
+			type = _RTI_MAPEXPR_T_BOOL;
+	}
+	/* bool = bool */
+	else if (iscmp && (left->type == _RTI_MAPEXPR_T_BOOL || right->type == _RTI_MAPEXPR_T_BOOL)) {
+		if (
+			(left->type != _RTI_MAPEXPR_T_BOOL && left->type != _RTI_MAPEXPR_T_NULL) ||
+			(right->type != _RTI_MAPEXPR_T_BOOL && right->type != _RTI_MAPEXPR_T_NULL)
+		) {
+			type = -1;
+		}
+		else
+			type = _RTI_MAPEXPR_T_BOOL;
+	}
+	/* NULL op NULL has no operator to resolve to */
+	else if (left->type == _RTI_MAPEXPR_T_NULL && right->type == _RTI_MAPEXPR_T_NULL)
+		type = iscmp ? _RTI_MAPEXPR_T_BOOL : -1;
+	else if (
+		(!_rti_mapexpr_isnumber(left->type) && left->type != _RTI_MAPEXPR_T_NULL) ||
+		(!_rti_mapexpr_isnumber(right->type) && right->type != _RTI_MAPEXPR_T_NULL)
+	) {
+		type = -1;
+	}
+	else {
+		_rti_mapexpr_node args[2];
+		args[0] = left;
+		args[1] = right;
+		type = _rti_mapexpr_common_type(args, 2, 1);
+
+		/* numeric arithmetic is not exact in double precision */
+		if (type == _RTI_MAPEXPR_T_NUMERIC)
+			type = -1;
+		/* int4 ^ int4 is float8 ^ float8 */
+		else if (op == _RTI_MAPEXPR_POW)
+			type = _RTI_MAPEXPR_T_FLOAT;
+		/* there is no float8 % float8 */
+		else if (op == _RTI_MAPEXPR_MOD && type != _RTI_MAPEXPR_T_INT)
+			type = -1;
+	}
+
+	if (type < 0) {
+		_rti_mapexpr_node_destroy(left);
+		_rti_mapexpr_node_destroy(right);
+		return NULL;
+	}
+
+	node = _rti_mapexpr_node_new(op, iscmp ? _RTI_MAPEXPR_T_BOOL : type, 2);
+	if (node == NULL) {
+		_rti_mapexpr_node_destroy(left);
+		_rti_mapexpr_node_destroy(right);
+		return NULL;
+	}
+	node->args[0] = left;
+	node->args[1] = right;
+
+	/* comparisons carry the operand type in ival */
+	if (iscmp) {
+		if (type == _RTI_MAPEXPR_T_NULL)
+			type = _RTI_MAPEXPR_T_BOOL;
+		node->ival = type;
+	}
+
+	if (!_rti_mapexpr_coerce_args(node, 0, 1, type)) {
+		_rti_mapexpr_node_destroy(node);
+		return NULL;
+	}
+
+	return node;
+}
+
+/* type name after :: or AS */
+static int
+_rti_mapexpr_parse_typename(_rti_mapexpr_parser *p) {
+	int type = -1;
+
+	if (p->tok != _RTI_MAPEXPR_TOK_IDENT)
+		return -1;
+
+	if (
+		_rti_mapexpr_isident(p, "int") ||
+		_rti_mapexpr_isident(p, "integer") ||
+		_rti_mapexpr_isident(p, "int4")
+	) {
+		type = _RTI_MAPEXPR_T_INT;
+	}
+	else if (_rti_mapexpr_isident(p, "float8") || _rti_mapexpr_isident(p, "float"))
+		type = _RTI_MAPEXPR_T_FLOAT;
+	else if (_rti_mapexpr_isident(p, "double")) {
+		_rti_mapexpr_next(p);
+		if (!_rti_mapexpr_isident(p, "precision"))
+			return -1;
+		type = _RTI_MAPEXPR_T_FLOAT;
+	}
+	else
+		return -1;
+
+	_rti_mapexpr_next(p);
+
+	/* float(p) and friends */
+	if (p->tok == _RTI_MAPEXPR_TOK_LPAREN)
+		return -1;
+
+	return type;
+}
+
+static _rti_mapexpr_node
+_rti_mapexpr_cast(_rti_mapexpr_node node, int type) {
+	_rti_mapexpr_node cast;
+
+	if (node == NULL || type < 0) {
+		_rti_mapexpr_node_destroy(node);
+		return NULL;
+	}
+
+	if ((int) node->type == type)
+		return node;
+	if (node->type == _RTI_MAPEXPR_T_NULL) {
+		node->type = type;
+		return node;
+	}
+
+	if (type == _RTI_MAPEXPR_T_FLOAT)
+		return _rti_mapexpr_tofloat(node);
+
+	/* float8 to int4, numeric rounds differently so is left to SPI */
+	if (type == _RTI_MAPEXPR_T_INT && node->type == _RTI_MAPEXPR_T_FLOAT) {
+		cast = _rti_mapexpr_node_new(_RTI_MAPEXPR_TOINT, _RTI_MAPEXPR_T_INT, 1);
+		if (cast == NULL) {
+			_rti_mapexpr_node_destroy(node);
+			return NULL;
+		}
+		cast->args[0] = node;
+		return cast;
+	}
+
+	_rti_mapexpr_node_destroy(node);
+	return NULL;
+}
+
+/* argument list of a function call, current token is ( */
+static _rti_mapexpr_node
+_rti_mapexpr_parse_args(_rti_mapexpr_parser *p, _rti_mapexpr_node node) {
+	_rti_mapexpr_node arg;
+
+	_rti_mapexpr_next(p);
+	if (p->tok == _RTI_MAPEXPR_TOK_RPAREN) {
+		_rti_mapexpr_next(p);
+		return node;
+	}
+
+	while (1) {
+		arg = _rti_mapexpr_parse_or(p);
+		if (arg == NULL) {
+			_rti_mapexpr_node_destroy(node);
+			return NULL;
+		}
+		node = _rti_mapexpr_node_append(node, arg);
+		if (node == NULL)
+			return NULL;
+
+		if (p->tok == _RTI_MAPEXPR_TOK_COMMA) {
+			_rti_mapexpr_next(p);
+			continue;
+		}
+		if (p->tok != _RTI_MAPEXPR_TOK_RPAREN) {
+			_rti_mapexpr_node_destroy(node);
+			return NULL;
+		}
+		_rti_mapexpr_next(p);
+		return node;
+	}
+}
+
+static _rti_mapexpr_node
+_rti_mapexpr_parse_function(_rti_mapexpr_parser *p, const char *name) {
+	_rti_mapexpr_node node = NULL;
+	int type;
+	int i;
+
+	/* variadic conditional expressions */
+	if (!strcmp(name, "coalesce") || !strcmp(name, "greatest") || !strcmp(name, "least")) {
+		_rti_mapexpr_op op = _RTI_MAPEXPR_COALESCE;
+		if (!strcmp(name, "greatest"))
+			op = _RTI_MAPEXPR_GREATEST;
+		else if (!strcmp(name, "least"))
+			op = _RTI_MAPEXPR_LEAST;
+
+		node = _rti_mapexpr_node_new(op, _RTI_MAPEXPR_T_NULL, 0);
+		if (node == NULL)
+			return NULL;
+		node = _rti_mapexpr_parse_args(p, node);
+		if (node == NULL)
+			return NULL;
+
+		type = _rti_mapexpr_common_type(node->args, node->nargs, 1);
+		if (
+			node->nargs < 1 || type < 0 ||
+			(op != _RTI_MAPEXPR_COALESCE && type == _RTI_MAPEXPR_T_BOOL) ||
+			!_rti_mapexpr_coerce_args(node, 0, 1, type)
+		) {
+			_rti_mapexpr_node_destroy(node);
+			return NULL;
+		}
+		node->type = type;
+
+		return node;
+	}
+
+	if (!strcmp(name, "pi")) {
+		_rti_mapexpr_next(p);
+		if (p->tok != _RTI_MAPEXPR_TOK_RPAREN)
+			return NULL;
+		_rti_mapexpr_next(p);
+
+		node = _rti_mapexpr_node_new(_RTI_MAPEXPR_CONST, _RTI_MAPEXPR_T_FLOAT, 0);
+		if (node != NULL)
+			node->dval = M_PI;
+		return node;
+	}
+
+	for (i = 0; _rti_mapexpr_funcs[i].name != NULL; i++) {
+		if (!strcmp(name, _rti_mapexpr_funcs[i].name))
+			break;
+	}
+	if (_rti_mapexpr_funcs[i].name == NULL) {
+		RASTER_DEBUGF(3, "function %s() not supported", name);
+		return NULL;
+	}
+
+	node = _rti_mapexpr_node_new(_RTI_MAPEXPR_FUNC, _RTI_MAPEXPR_T_FLOAT, 0);
+	if (node == NULL)
+		return NULL;
+	node->ival = _rti_mapexpr_funcs[i].func;
+
+	node = _rti_mapexpr_parse_args(p, node);
+	if (node == NULL)
+		return NULL;
+	if (node->nargs != _rti_mapexpr_funcs[i].nargs) {
+		_rti_mapexpr_node_destroy(node);
+		return NULL;
+	}
+
+	for (type = 0; type < node->nargs; type++) {
+		/* NULL arguments are ambiguous, numeric arguments pick the numeric overload */
+		if (
+			!_rti_mapexpr_isnumber(node->args[type]->type) || (
+				_rti_mapexpr_funcs[i].hasnumeric &&
+				node->args[type]->type == _RTI_MAPEXPR_T_NUMERIC
+			)
+		) {
+			_rti_mapexpr_node_destroy(node);
+			return NULL;
+		}
+	}
+
+	/* abs(int4) stays int4, everything else is float8 */
+	if (node->ival == _RTI_MAPEXPR_F_ABS && node->args[0]->type == _RTI_MAPEXPR_T_INT) {
+		node->type = _RTI_MAPEXPR_T_INT;
+		return node;
+	}
+
+	if (!_rti_mapexpr_coerce_args(node, 0, 1, _RTI_MAPEXPR_T_FLOAT)) {
+		_rti_mapexpr_node_destroy(node);
+		return NULL;
+	}
+
+	return node;
+}
+
+/* searched CASE, current token is CASE */
+static _rti_mapexpr_node
+_rti_mapexpr_parse_case(_rti_mapexpr_parser *p) {
+	_rti_mapexpr_node node;
+	_rti_mapexpr_node arg;
+	int type;
+
+	/* args[0] is the ELSE branch, set once it is known */
+	node = _rti_mapexpr_node_new(_RTI_MAPEXPR_CASE, _RTI_MAPEXPR_T_NULL, 1);
+	if (node == NULL)
+		return NULL;
+
+	_rti_mapexpr_next(p);
+
+	/* simple CASE is not supported */
+	if (!_rti_mapexpr_isident(p, "when")) {
+		_rti_mapexpr_node_destroy(node);
+		return NULL;
+	}
+
+	while (_rti_mapexpr_isident(p, "when")) {
+		_rti_mapexpr_next(p);
+		arg = _rti_mapexpr_parse_or(p);
+		if (arg == NULL || (arg->type != _RTI_MAPEXPR_T_BOOL && arg->type != _RTI_MAPEXPR_T_NULL)) {
+			_rti_mapexpr_node_destroy(arg);
+			_rti_mapexpr_node_destroy(node);
+			return NULL;
+		}
+		arg->type = _RTI_MAPEXPR_T_BOOL;
+		if ((node = _rti_mapexpr_node_append(node, arg)) == NULL)
+			return NULL;
+
+		if (!_rti_mapexpr_isident(p, "then")) {
+			_rti_mapexpr_node_destroy(node);
+			return NULL;
+		}
+		_rti_mapexpr_next(p);
+		arg = _rti_mapexpr_parse_or(p);
+		if (arg == NULL) {
+			_rti_mapexpr_node_destroy(node);
+			return NULL;
+		}
+		if ((node = _rti_mapexpr_node_append(node, arg)) == NULL)
+			return NULL;
+	}
+
+	if (_rti_mapexpr_isident(p, "else")) {
+		_rti_mapexpr_next(p);
+		node->args[0] = _rti_mapexpr_parse_or(p);
+	}
+	else {
+		node->args[0] = _rti_mapexpr_node_new(_RTI_MAPEXPR_CONST, _RTI_MAPEXPR_T_NULL, 0);
+		if (node->args[0] != NULL)
+			node->args[0]->isnull = 1;
+	}
+	if (node->args[0] == NULL || !_rti_mapexpr_isident(p, "end")) {
+		_rti_mapexpr_node_destroy(node);
+		return NULL;
+	}
+	_rti_mapexpr_next(p);
+
+	/* result type from the ELSE and THEN branches */
+	type = _rti_mapexpr_common_type(node->args, node->nargs, 2);
+	if (type < 0 || !_rti_mapexpr_coerce_args(node, 0, 2, type)) {
+		_rti_mapexpr_node_destroy(node);
+		return NULL;
+	}
+	node->type = type;
+
+	return node;
+}
+
+static _rti_mapexpr_node
+_rti_mapexpr_parse_primary(_rti_mapexpr_parser *p) {
+	_rti_mapexpr_node node = NULL;
+
+	switch (p->tok) {
+		case _RTI_MAPEXPR_TOK_NUMBER: {
+			node = _rti_mapexpr_node_new(_RTI_MAPEXPR_CONST, _RTI_MAPEXPR_T_NUMERIC, 0);
+			if (node == NULL)
+				return NULL;
+
+			node->dval = strtod(p->text, NULL);
+			if (isinf(node->dval)) {
+				_rti_mapexpr_node_destroy(node);
+				return NULL;
+			}
+
+			/* integer literals that fit in int4 are int4 */
+			if (strpbrk(p->text, ".eE") == NULL) {
+				if (node->dval > INT32_MAX) {
+					/* int8 or numeric */
+					_rti_mapexpr_node_destroy(node);
+					return NULL;
+				}
+				node->type = _RTI_MAPEXPR_T_INT;
+				node->ival = (int32_t) node->dval;
+			}
+
+			_rti_mapexpr_next(p);
+			return node;
+		}
+		case _RTI_MAPEXPR_TOK_KW:
+			node = _rti_mapexpr_node_new(
+				_RTI_MAPEXPR_KW,
+				p->kwisint[p->kwidx] ? _RTI_MAPEXPR_T_INT : _RTI_MAPEXPR_T_FLOAT,
+				0
+			);
+			if (node == NULL)
+				return NULL;
+			node->ival = p->kwidx;
+
+			_rti_mapexpr_next(p);
+			return node;
+		case _RTI_MAPEXPR_TOK_LPAREN:
+			_rti_mapexpr_next(p);
+			node = _rti_mapexpr_parse_or(p);
+			if (node == NULL)
+				return NULL;
+			if (p->tok != _RTI_MAPEXPR_TOK_RPAREN) {
+				_rti_mapexpr_node_destroy(node);
+				return NULL;
+			}
+			_rti_mapexpr_next(p);
+			return node;
+		case _RTI_MAPEXPR_TOK_IDENT:
+			break;
+		default:
+			return NULL;
+	}
+
+	if (_rti_mapexpr_isident(p, "null")) {
+		node = _rti_mapexpr_node_new(_RTI_MAPEXPR_CONST, _RTI_MAPEXPR_T_NULL, 0);
+		if (node == NULL)
+			return NULL;
+		node->isnull = 1;
+
+		_rti_mapexpr_next(p);
+		return node;
+	}
+	else if (_rti_mapexpr_isident(p, "true") || _rti_mapexpr_isident(p, "false")) {
+		node = _rti_mapexpr_node_new(_RTI_MAPEXPR_CONST, _RTI_MAPEXPR_T_BOOL, 0);
+		if (node == NULL)
+			return NULL;
+		node->ival = _rti_mapexpr_isident(p, "true");
+
+		_rti_mapexpr_next(p);
+		return node;
+	}
+	else if (_rti_mapexpr_isident(p, "case"))
+		return _rti_mapexpr_parse_case(p);
+	else if (_rti_mapexpr_isident(p, "cast")) {
+		_rti_mapexpr_next(p);
+		if (p->tok != _RTI_MAPEXPR_TOK_LPAREN)
+			return NULL;
+		_rti_mapexpr_next(p);
+
+		node = _rti_mapexpr_parse_or(p);
+		if (node == NULL)
+			return NULL;
+		if (!_rti_mapexpr_isident(p, "as")) {
+			_rti_mapexpr_node_destroy(node);
+			return NULL;
+		}
+		_rti_mapexpr_next(p);
+
+		node = _rti_mapexpr_cast(node, _rti_mapexpr_parse_typename(p));
+		if (node == NULL)
+			return NULL;
+		if (p->tok != _RTI_MAPEXPR_TOK_RPAREN) {
+			_rti_mapexpr_node_destroy(node);
+			return NULL;
+		}
+		_rti_mapexpr_next(p);
+		return node;
+	}
+	else {
+		char name[sizeof(p->text)];
+		strcpy(name, p->text);
+
+		_rti_mapexpr_next(p);
+		if (p->tok != _RTI_MAPEXPR_TOK_LPAREN) {
+			RASTER_DEBUGF(3, "identifier %s not supported", name);
+			return NULL;
+		}
+
+		return _rti_mapexpr_parse_function(p, name);
+	}
+}
+
+/* primary [:: typename]... */
+static _rti_mapexpr_node
+_rti_mapexpr_parse_postfix(_rti_mapexpr_parser *p) {
+	_rti_mapexpr_node node = _rti_mapexpr_parse_primary(p);
+
+	while (node != NULL && p->tok == _RTI_MAPEXPR_TOK_CAST) {
+		_rti_mapexpr_next(p);
+		node = _rti_mapexpr_cast(node, _rti_mapexpr_parse_typename(p));
+	}
+
+	return node;
+}
+
+/* unary minus binds tighter than ^ */
+static _rti_mapexpr_node
+_rti_mapexpr_parse_unary(_rti_mapexpr_parser *p) {
+	_rti_mapexpr_node node = NULL;
+	_rti_mapexpr_node neg = NULL;
+
+	if (_rti_mapexpr_isop(p, "+")) {
+		_rti_mapexpr_next(p);
+		node = _rti_mapexpr_parse_unary(p);
+		if (node != NULL && !_rti_mapexpr_isnumber(node->type)) {
+			_rti_mapexpr_node_destroy(node);
+			return NULL;
+		}
+		return node;
+	}
+	if (!_rti_mapexpr_isop(p, "-"))
+		return _rti_mapexpr_parse_postfix(p);
+
+	_rti_mapexpr_next(p);
+	node = _rti_mapexpr_parse_unary(p);
+	if (node == NULL)
+		return NULL;
+	if (!_rti_mapexpr_isnumber(node->type)) {
+		_rti_mapexpr_node_destroy(node);
+		return NULL;
+	}
+
+	/* negated numeric literal is still an exact literal */
+	if (node->op == _RTI_MAPEXPR_CONST && node->type == _RTI_MAPEXPR_T_NUMERIC) {
+		node->dval = -node->dval;
+		return node;
+	}
+
+	neg = _rti_mapexpr_node_new(_RTI_MAPEXPR_NEG, node->type, 1);
+	if (neg == NULL) {
+		_rti_mapexpr_node_destroy(node);
+		return NULL;
+	}
+	neg->args[0] = node;
+
+	return neg;
+}
+
+static _rti_mapexpr_node
+_rti_mapexpr_parse_pow(_rti_mapexpr_parser *p) {
+	_rti_mapexpr_node node = _rti_mapexpr_parse_unary(p);
+
+	while (node != NULL && _rti_mapexpr_isop(p, "^")) {
+		_rti_mapexpr_next(p);
+		node = _rti_mapexpr_binary(_RTI_MAPEXPR_POW, node, _rti_mapexpr_parse_unary(p));
+	}
+
+	return node;
+}
+
+static _rti_mapexpr_node
+_rti_mapexpr_parse_mul(_rti_mapexpr_parser *p) {
+	_rti_mapexpr_node node = _rti_mapexpr_parse_pow(p);
+	_rti_mapexpr_op op;
+
+	while (node != NULL) {
+		if (_rti_mapexpr_isop(p, "*"))
+			op = _RTI_MAPEXPR_MUL;
+		else if (_rti_mapexpr_isop(p, "/"))
+			op = _RTI_MAPEXPR_DIV;
+		else if (_rti_mapexpr_isop(p, "%"))
+			op = _RTI_MAPEXPR_MOD;
+		else
+			break;
+
+		_rti_mapexpr_next(p);
+		node = _rti_mapexpr_binary(op, node, _rti_mapexpr_parse_pow(p));
+	}
+
+	return node;
+}
+
+static _rti_mapexpr_node
+_rti_mapexpr_parse_add(_rti_mapexpr_parser *p) {
+	_rti_mapexpr_node node = _rti_mapexpr_parse_mul(p);
+	_rti_mapexpr_op op;
+
+	while (node != NULL) {
+		if (_rti_mapexpr_isop(p, "+"))
+			op = _RTI_MAPEXPR_ADD;
+		else if (_rti_mapexpr_isop(p, "-"))
+			op = _RTI_MAPEXPR_SUB;
+		else
+			break;
+
+		_rti_mapexpr_next(p);
+		node = _rti_mapexpr_binary(op, node, _rti_mapexpr_parse_mul(p));
+	}
+
+	return node;
+}
+
+/*
+ * comparison or IS [NOT] NULL.  The relative precedence of these changed
+ * between PostgreSQL releases, so chaining them is left to SPI
+ */
+static _rti_mapexpr_node
+_rti_mapexpr_parse_cmp(_rti_mapexpr_parser *p) {
+	_rti_mapexpr_node node = _rti_mapexpr_parse_add(p);
+	_rti_mapexpr_node test = NULL;
+	_rti_mapexpr_op op;
+
+	if (node == NULL)
+		return NULL;
+
+	if (_rti_mapexpr_isident(p, "is")) {
+		op = _RTI_MAPEXPR_ISNULL;
+
+		_rti_mapexpr_next(p);
+		if (_rti_mapexpr_isident(p, "not")) {
+			op = _RTI_MAPEXPR_ISNOTNULL;
+			_rti_mapexpr_next(p);
+		}
+		if (!_rti_mapexpr_isident(p, "null")) {
+			_rti_mapexpr_node_destroy(node);
+			return NULL;
+		}
+		_rti_mapexpr_next(p);
+
+		test = _rti_mapexpr_node_new(op, _RTI_MAPEXPR_T_BOOL, 1);
+		if (test == NULL) {
+			_rti_mapexpr_node_destroy(node);
+			return NULL;
+		}
+		test->args[0] = node;
+		node = test;
+	}
+	else if (_rti_mapexpr_iscmp(p)) {
+		if (_rti_mapexpr_isop(p, "="))
+			op = _RTI_MAPEXPR_EQ;
+		else if (_rti_mapexpr_isop(p, "<>") || _rti_mapexpr_isop(p, "!="))
+			op = _RTI_MAPEXPR_NE;
+		else if (_rti_mapexpr_isop(p, "<"))
+			op = _RTI_MAPEXPR_LT;
+		else if (_rti_mapexpr_isop(p, "<="))
+			op = _RTI_MAPEXPR_LE;
+		else if (_rti_mapexpr_isop(p, ">"))
+			op = _RTI_MAPEXPR_GT;
+		else
+			op = _RTI_MAPEXPR_GE;
+
+		_rti_mapexpr_next(p);
+		node = _rti_mapexpr_binary(op, node, _rti_mapexpr_parse_add(p));
+		if (node == NULL)
+			return NULL;
+	}
+
+	if (_rti_mapexpr_isident(p, "is") || _rti_mapexpr_iscmp(p)) {
+		_rti_mapexpr_node_destroy(node);
+		return NULL;
+	}
+
+	return node;
+}
+
+static _rti_mapexpr_node
+_rti_mapexpr_parse_not(_rti_mapexpr_parser *p) {
+	_rti_mapexpr_node node = NULL;
+	_rti_mapexpr_node arg = NULL;
+
+	if (!_rti_mapexpr_isident(p, "not"))
+		return _rti_mapexpr_parse_cmp(p);
+
+	_rti_mapexpr_next(p);
+	arg = _rti_mapexpr_parse_not(p);
+	if (arg == NULL)
+		return NULL;
+	if (arg->type != _RTI_MAPEXPR_T_BOOL && arg->type != _RTI_MAPEXPR_T_NULL) {
+		_rti_mapexpr_node_destroy(arg);
+		return NULL;
+	}
+	arg->type = _RTI_MAPEXPR_T_BOOL;
+
+	node = _rti_mapexpr_node_new(_RTI_MAPEXPR_NOT, _RTI_MAPEXPR_T_BOOL, 1);
+	if (node == NULL) {
+		_rti_mapexpr_node_destroy(arg);
+		return NULL;
+	}
+	node->args[0] = arg;
+
+	return node;
+}
+
+static _rti_mapexpr_node
+_rti_mapexpr_parse_and(_rti_mapexpr_parser *p) {
+	_rti_mapexpr_node node = _rti_mapexpr_parse_not(p);
+
+	while (node != NULL && _rti_mapexpr_isident(p, "and")) {
+		_rti_mapexpr_next(p);
+		node = _rti_mapexpr_binary(_RTI_MAPEXPR_AND, node, _rti_mapexpr_parse_not(p));
+	}
+
+	return node;
+}
+
+static _rti_mapexpr_node
+_rti_mapexpr_parse_or(_rti_mapexpr_parser *p) {
+	_rti_mapexpr_node node = _rti_mapexpr_parse_and(p);
+
+	while (node != NULL && _rti_mapexpr_isident(p, "or")) {
+		_rti_mapexpr_next(p);
+		node = _rti_mapexpr_binary(_RTI_MAPEXPR_OR, node, _rti_mapexpr_parse_and(p));
+	}
+
+	return node;
+}
+
+/* PostgreSQL float8 comparison, NaN sorts above everything else */
+static int
+_rti_mapexpr_float_cmp(double a, double b) {
+	if (isnan(a))
+		return isnan(b) ? 0 : 1;
+	if (isnan(b))
+		return -1;
+	if (a > b)
+		return 1;
+	if (a < b)
+		return -1;
+	return 0;
+}
+
+/* compare two values of type, returns -1, 0 or 1 */
+static int
+_rti_mapexpr_value_cmp(_rti_mapexpr_type type, _rti_mapexpr_value *a, _rti_mapexpr_value *b) {
+	if (type == _RTI_MAPEXPR_T_INT || type == _RTI_MAPEXPR_T_BOOL)
+		return (a->ival > b->ival) - (a->ival < b->ival);
+	return _rti_mapexpr_float_cmp(a->dval, b->dval);
+}
+
+/*
+ * Evaluate node.  Returns 0 where PostgreSQL would raise an error, so that
+ * the caller can hand the pixel to SPI.
+ */
+static int
+_rti_mapexpr_eval_node(rt_mapexpr mexpr, _rti_mapexpr_node node, _rti_mapexpr_value *rtn) {
+	_rti_mapexpr_value a;
+	_rti_mapexpr_value b;
+	int64_t l;
+	double d;
+	int i;
+
+	rtn->isnull = 0;
+	rtn->dval = 0;
+	rtn->ival = 0;
+
+	switch (node->op) {
+		case _RTI_MAPEXPR_CONST:
+			rtn->dval = node->dval;
+			rtn->ival = node->ival;
+			rtn->isnull = node->isnull;
+			return 1;
+		case _RTI_MAPEXPR_KW:
+			if (mexpr->kwnull != NULL && mexpr->kwnull[node->ival]) {
+				rtn->isnull = 1;
+				return 1;
+			}
+			if (node->type == _RTI_MAPEXPR_T_INT)
+				rtn->ival = (int32_t) mexpr->kwval[node->ival];
+			else
+				rtn->dval = mexpr->kwval[node->ival];
+			return 1;
+		case _RTI_MAPEXPR_TOFLOAT:
+			if (!_rti_mapexpr_eval_node(mexpr, node->args[0], &a))
+				return 0;
+			rtn->isnull = a.isnull;
+			rtn->dval = (double) a.ival;
+			return 1;
+		case _RTI_MAPEXPR_TOINT:
+			if (!_rti_mapexpr_eval_node(mexpr, node->args[0], &a))
+				return 0;
+			rtn->isnull = a.isnull;
+			if (a.isnull)
+				return 1;
+			d = rint(a.dval);
+			if (isnan(d) || d < INT32_MIN || d > INT32_MAX)
+				return 0;
+			rtn->ival = (int32_t) d;
+			return 1;
+		case _RTI_MAPEXPR_NEG:
+			if (!_rti_mapexpr_eval_node(mexpr, node->args[0], &a))
+				return 0;
+			rtn->isnull = a.isnull;
+			if (a.isnull)
+				return 1;
+			if (node->type == _RTI_MAPEXPR_T_INT) {
+				if (a.ival == INT32_MIN)
+					return 0;
+				rtn->ival = -a.ival;
+			}
+			else
+				rtn->dval = -a.dval;
+			return 1;
+		case _RTI_MAPEXPR_ADD:
+		case _RTI_MAPEXPR_SUB:
+		case _RTI_MAPEXPR_MUL:
+		case _RTI_MAPEXPR_DIV:
+		case _RTI_MAPEXPR_MOD:
+		case _RTI_MAPEXPR_POW:
+			if (
+				!_rti_mapexpr_eval_node(mexpr, node->args[0], &a) ||
+				!_rti_mapexpr_eval_node(mexpr, node->args[1], &b)
+			) {
+				return 0;
+			}
+			if (a.isnull || b.isnull) {
+				rtn->isnull = 1;
+				return 1;
+			}
+
+			/* int4 arithmetic with PostgreSQL overflow checks */
+			if (node->type == _RTI_MAPEXPR_T_INT) {
+				switch (node->op) {
+					case _RTI_MAPEXPR_ADD:
+						l = (int64_t) a.ival + b.ival;
+						break;
+					case _RTI_MAPEXPR_SUB:
+						l = (int64_t) a.ival - b.ival;
+						break;
+					case _RTI_MAPEXPR_MUL:
+						l = (int64_t) a.ival * b.ival;
+						break;
+					case _RTI_MAPEXPR_DIV:
+						if (b.ival == 0)
+							return 0;
+						l = (int64_t) a.ival / b.ival;
+						break;
+					default:
+						if (b.ival == 0)
+							return 0;
+						/* INT_MIN % -1 is 0 */
+						l = (b.ival == -1) ? 0 : a.ival % b.ival;
+						break;
+				}
+				if (l < INT32_MIN || l > INT32_MAX)
+					return 0;
+				rtn->ival = (int32_t) l;
+				return 1;
+			}
+
+			/* float8 arithmetic with PostgreSQL overflow and underflow checks */
+			switch (node->op) {
+				case _RTI_MAPEXPR_ADD:
+					d = a.dval + b.dval;
+					break;
+				case _RTI_MAPEXPR_SUB:
+					d = a.dval - b.dval;
+					break;
+				case _RTI_MAPEXPR_MUL:
+					d = a.dval * b.dval;
+					if (d == 0 && a.dval != 0 && b.dval != 0)
+						return 0;
+					break;
+				case _RTI_MAPEXPR_DIV:
+					if (b.dval == 0)
+						return 0;
+					d = a.dval / b.dval;
+					if (d == 0 && a.dval != 0)
+						return 0;
+					break;
+				default:
+					if (a.dval == 0 && b.dval < 0)
+						return 0;
+					if (a.dval < 0 && floor(b.dval) != b.dval)
+						return 0;
+					d = pow(a.dval, b.dval);
+					if (d == 0 && a.dval != 0)
+						return 0;
+					break;
+			}
+			if (isinf(d) && !isinf(a.dval) && !isinf(b.dval))
+				return 0;
+			rtn->dval = d;
+			return 1;
+		case _RTI_MAPEXPR_EQ:
+		case _RTI_MAPEXPR_NE:
+		case _RTI_MAPEXPR_LT:
+		case _RTI_MAPEXPR_LE:
+		case _RTI_MAPEXPR_GT:
+		case _RTI_MAPEXPR_GE:
+			if (
+				!_rti_mapexpr_eval_node(mexpr, node->args[0], &a) ||
+				!_rti_mapexpr_eval_node(mexpr, node->args[1], &b)
+			) {
+				return 0;
+			}
+			if (a.isnull || b.isnull) {
+				rtn->isnull = 1;
+				return 1;
+			}
+
+			i = _rti_mapexpr_value_cmp(node->ival, &a, &b);
+			switch (node->op) {
+				case _RTI_MAPEXPR_EQ:
+					rtn->ival = (i == 0);
+					break;
+				case _RTI_MAPEXPR_NE:
+					rtn->ival = (i != 0);
+					break;
+				case _RTI_MAPEXPR_LT:
+					rtn->ival = (i < 0);
+					break;
+				case _RTI_MAPEXPR_LE:
+					rtn->ival = (i <= 0);
+					break;
+				case _RTI_MAPEXPR_GT:
+					rtn->ival = (i > 0);
+					break;
+				default:
+					rtn->ival = (i >= 0);
+					break;
+			}
+			return 1;
+		/* three-valued logic, evaluated left to right with short-circuit */
+		case _RTI_MAPEXPR_AND:
+		case _RTI_MAPEXPR_OR:
+			if (!_rti_mapexpr_eval_node(mexpr, node->args[0], &a))
+				return 0;
+			if (!a.isnull && a.ival == (node->op == _RTI_MAPEXPR_OR)) {
+				rtn->ival = a.ival;
+				return 1;
+			}
+			if (!_rti_mapexpr_eval_node(mexpr, node->args[1], &b))
+				return 0;
+			if (!b.isnull && b.ival == (node->op == _RTI_MAPEXPR_OR)) {
+				rtn->ival = b.ival;
+				return 1;
+			}
+			rtn->isnull = a.isnull || b.isnull;
+			rtn->ival = a.ival;
+			return 1;
+		case _RTI_MAPEXPR_NOT:
+			if (!_rti_mapexpr_eval_node(mexpr, node->args[0], &a))
+				return 0;
+			rtn->isnull = a.isnull;
+			rtn->ival = !a.ival;
+			return 1;
+		case _RTI_MAPEXPR_ISNULL:
+		case _RTI_MAPEXPR_ISNOTNULL:
+			if (!_rti_mapexpr_eval_node(mexpr, node->args[0], &a))
+				return 0;
+			rtn->ival = (node->op == _RTI_MAPEXPR_ISNULL) ? a.isnull : !a.isnull;
+			return 1;
+		case _RTI_MAPEXPR_CASE:
+			for (i = 1; i < node->nargs; i += 2) {
+				if (!_rti_mapexpr_eval_node(mexpr, node->args[i], &a))
+					return 0;
+				if (!a.isnull && a.ival)
+					return _rti_mapexpr_eval_node(mexpr, node->args[i + 1], rtn);
+			}
+			return _rti_mapexpr_eval_node(mexpr, node->args[0], rtn);
+		case _RTI_MAPEXPR_COALESCE:
+			for (i = 0; i < node->nargs; i++) {
+				if (!_rti_mapexpr_eval_node(mexpr, node->args[i], rtn))
+					return 0;
+				if (!rtn->isnull)
+					return 1;
+			}
+			return 1;
+		/* all arguments are evaluated, NULLs are ignored */
+		case _RTI_MAPEXPR_GREATEST:
+		case _RTI_MAPEXPR_LEAST:
+			rtn->isnull = 1;
+			for (i = 0; i < node->nargs; i++) {
+				if (!_rti_mapexpr_eval_node(mexpr, node->args[i], &a))
+					return 0;
+				if (a.isnull)
+					continue;
+				if (
+					rtn->isnull || (
+						node->op == _RTI_MAPEXPR_GREATEST ?
+							_rti_mapexpr_value_cmp(node->type, &a, rtn) > 0 :
+							_rti_mapexpr_value_cmp(node->type, &a, rtn) < 0
+					)
+				) {
+					*rtn = a;
+				}
+			}
+			return 1;
+		case _RTI_MAPEXPR_FUNC:
+			if (!_rti_mapexpr_eval_node(mexpr, node->args[0], &a))
+				return 0;
+			if (node->nargs > 1) {
+				if (!_rti_mapexpr_eval_node(mexpr, node->args[1], &b))
+					return 0;
+				if (b.isnull) a.isnull = 1;
+			}
+			else
+				b.dval = 0;
+			if (a.isnull) {
+				rtn->isnull = 1;
+				return 1;
+			}
+
+			switch (node->ival) {
+				case _RTI_MAPEXPR_F_ABS:
+					if (node->type == _RTI_MAPEXPR_T_INT) {
+						if (a.ival == INT32_MIN)
+							return 0;
+						rtn->ival = abs(a.ival);
+						return 1;
+					}
+					d = fabs(a.dval);
+					break;
+				case _RTI_MAPEXPR_F_SQRT:
+					if (a.dval < 0)
+						return 0;
+					d = sqrt(a.dval);
+					break;
+				case _RTI_MAPEXPR_F_CBRT:
+					d = cbrt(a.dval);
+					break;
+				case _RTI_MAPEXPR_F_EXP:
+					d = exp(a.dval);
+					if (d == 0 && !isinf(a.dval))
+						return 0;
+					break;
+				case _RTI_MAPEXPR_F_LN:
+				case _RTI_MAPEXPR_F_LOG:
+					if (a.dval <= 0)
+						return 0;
+					d = (node->ival == _RTI_MAPEXPR_F_LN) ? log(a.dval) : log10(a.dval);
+					break;
+				case _RTI_MAPEXPR_F_FLOOR:
+					d = floor(a.dval);
+					break;
+				case _RTI_MAPEXPR_F_CEIL:
+					d = ceil(a.dval);
+					break;
+				/* float8 round() is rint(), ties go to even */
+				case _RTI_MAPEXPR_F_ROUND:
+					d = rint(a.dval);
+					break;
+				case _RTI_MAPEXPR_F_TRUNC:
+					d = (a.dval >= 0) ? floor(a.dval) : -floor(-a.dval);
+					break;
+				case _RTI_MAPEXPR_F_SIGN:
+					d = (a.dval > 0) ? 1 : ((a.dval < 0) ? -1 : 0);
+					break;
+				case _RTI_MAPEXPR_F_SIN:
+				case _RTI_MAPEXPR_F_COS:
+				case _RTI_MAPEXPR_F_TAN:
+					if (isinf(a.dval))
+						return 0;
+					if (node->ival == _RTI_MAPEXPR_F_SIN)
+						d = sin(a.dval);
+					else if (node->ival == _RTI_MAPEXPR_F_COS)
+						d = cos(a.dval);
+					else
+						d = tan(a.dval);
+					break;
+				case _RTI_MAPEXPR_F_ASIN:
+				case _RTI_MAPEXPR_F_ACOS:
+					if (a.dval < -1 || a.dval > 1)
+						return 0;
+					d = (node->ival == _RTI_MAPEXPR_F_ASIN) ? asin(a.dval) : acos(a.dval);
+					break;
+				case _RTI_MAPEXPR_F_ATAN:
+					d = atan(a.dval);
+					break;
+				case _RTI_MAPEXPR_F_ATAN2:
+					d = atan2(a.dval, b.dval);
+					break;
+				case _RTI_MAPEXPR_F_DEGREES:
+					d = a.dval * (180.0 / M_PI);
+					if (d == 0 && a.dval != 0)
+						return 0;
+					break;
+				case _RTI_MAPEXPR_F_RADIANS:
+					d = a.dval * (M_PI / 180.0);
+					if (d == 0 && a.dval != 0)
+						return 0;
+					break;
+				case _RTI_MAPEXPR_F_POWER:
+					if (a.dval == 0 && b.dval < 0)
+						return 0;
+					if (a.dval < 0 && floor(b.dval) != b.dval)
+						return 0;
+					d = pow(a.dval, b.dval);
+					if (d == 0 && a.dval != 0)
+						return 0;
+					break;
+				default:
+					return 0;
+			}
+
+			/* overflow or domain error */
+			if (isinf(d) && !isinf(a.dval) && !isinf(b.dval))
+				return 0;
+			if (isnan(d) && !isnan(a.dval) && !isnan(b.dval))
+				return 0;
+
+			rtn->dval = d;
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Compile a map algebra expression for native evaluation
+ *
+ * @param expr : the expression as given to ST_MapAlgebra, without the
+ * "SELECT (" and ")::double precision" wrapper
+ * @param kwcount : number of keywords in kw
+ * @param kw : keywords such as "[rast]" or "[rast.x]"
+ * @param kwisint : for each keyword, non-zero if its SQL type is integer
+ * (pixel positions) and zero if it is double precision (pixel values)
+ *
+ * @return compiled expression or NULL if the expression uses SQL that
+ * cannot be evaluated natively
+ */
+rt_mapexpr
+rt_mapexpr_compile(const char *expr, int kwcount, char **kw, const int *kwisint) {
+	_rti_mapexpr_parser p;
+	_rti_mapexpr_node root = NULL;
+	rt_mapexpr mexpr = NULL;
+
+	assert(NULL != expr);
+
+	p.pos = expr;
+	p.kwcount = kwcount;
+	p.kw = kw;
+	p.kwisint = kwisint;
+	_rti_mapexpr_next(&p);
+
+	root = _rti_mapexpr_parse_or(&p);
+	if (root == NULL) {
+		RASTER_DEBUGF(3, "Expression %s cannot be compiled", expr);
+		return NULL;
+	}
+
+	/* trailing input or no cast from boolean to double precision */
+	if (p.tok != _RTI_MAPEXPR_TOK_END || root->type == _RTI_MAPEXPR_T_BOOL) {
+		RASTER_DEBUGF(3, "Expression %s cannot be compiled", expr);
+		_rti_mapexpr_node_destroy(root);
+		return NULL;
+	}
+
+	mexpr = rtalloc(sizeof(struct rt_mapexpr_t));
+	if (mexpr == NULL) {
+		rterror("rt_mapexpr_compile: Unable to allocate memory for compiled expression");
+		_rti_mapexpr_node_destroy(root);
+		return NULL;
+	}
+
+	mexpr->root = root;
+	mexpr->kwcount = kwcount;
+	mexpr->kwval = NULL;
+	mexpr->kwnull = NULL;
+
+	RASTER_DEBUGF(3, "Expression %s compiled", expr);
+	return mexpr;
+}
+
+/**
+ * Evaluate a compiled map algebra expression
+ *
+ * @param mexpr : expression returned by rt_mapexpr_compile()
+ * @param kwval : value of each keyword
+ * @param kwnull : for each keyword, non-zero if it is NULL. May be NULL
+ * @param value : result of the expression cast to double precision
+ * @param isnull : set to non-zero if the result is NULL
+ *
+ * @return 1 on success, 0 if PostgreSQL would raise an error for these
+ * values (e.g. division by zero) and the caller should evaluate them
+ * through SQL instead
+ */
+int
+rt_mapexpr_eval(
+	rt_mapexpr mexpr,
+	const double *kwval, const int *kwnull,
+	double *value, int *isnull
+) {
+	_rti_mapexpr_value rtn;
+
+	assert(NULL != mexpr);
+
+	mexpr->kwval = kwval;
+	mexpr->kwnull = kwnull;
+
+	if (!_rti_mapexpr_eval_node(mexpr, mexpr->root, &rtn))
+		return 0;
+
+	*isnull = rtn.isnull;
+	if (rtn.isnull)
+		*value = 0;
+	else if (mexpr->root->type == _RTI_MAPEXPR_T_INT)
+		*value = rtn.ival;
+	else
+		*value = rtn.dval;
+
+	return 1;
+}
+
+/**
+ * Free a compiled map algebra expression
+ *
+ * @param mexpr : expression returned by rt_mapexpr_compile()
+ */
+void
+rt_mapexpr_destroy(rt_mapexpr mexpr) {
+	if (mexpr == NULL)
+		return;
+
+	_rti_mapexpr_node_destroy(mexpr->root);
+	rtdealloc(mexpr);
+}
+
 /******************************************************************************
 * rt_raster_perimeter()
 ******************************************************************************/
@@ -148,6 +148,8 @@ typedef struct rt_iterator_arg_t* rt_iterator_arg;
 typedef struct rt_colormap_entry_t* rt_colormap_entry;
 typedef struct rt_colormap_t* rt_colormap;
 
+typedef struct rt_mapexpr_t* rt_mapexpr;
+
 /* envelope information */
 typedef struct {
 	double MinX;
@@ -1958,6 +1960,51 @@ rt_raster_iterator(
 	rt_raster *rtnraster
 );
 
+/**
+ * Compile a map algebra expression into a tree that can be evaluated
+ * natively for each pixel instead of through SPI.  Only a subset of
+ * SQL is supported: int4 and float8 arithmetic, comparisons, boolean
+ * operators, searched CASE, casts to integer and double precision and
+ * common math functions.
+ *
+ * @param expr : the expression as given to ST_MapAlgebra
+ * @param kwcount : number of keywords in kw
+ * @param kw : keywords such as "[rast]" or "[rast.x]"
+ * @param kwisint : for each keyword, non-zero if its SQL type is integer
+ *
+ * @return compiled expression or NULL if expr cannot be evaluated natively
+ */
+rt_mapexpr rt_mapexpr_compile(
+	const char *expr,
+	int kwcount, char **kw, const int *kwisint
+);
+
+/**
+ * Evaluate a compiled map algebra expression
+ *
+ * @param mexpr : expression returned by rt_mapexpr_compile()
+ * @param kwval : value of each keyword
+ * @param kwnull : for each keyword, non-zero if it is NULL. May be NULL
+ * @param value : result of the expression cast to double precision
+ * @param isnull : set to non-zero if the result is NULL
+ *
+ * @return 1 on success, 0 if SQL would raise an error for these values
+ * (e.g. division by zero) and the expression should be evaluated through
+ * SQL instead
+ */
+int rt_mapexpr_eval(
+	rt_mapexpr mexpr,
+	const double *kwval, const int *kwnull,
+	double *value, int *isnull
+);
+
+/**
+ * Free a compiled map algebra expression
+ *
+ * @param mexpr : expression returned by rt_mapexpr_compile()
+ */
+void rt_mapexpr_destroy(rt_mapexpr mexpr);
+
 /**
  * Returns a new raster with up to four 8BUI bands (RGBA) from
  * applying a colormap to the user-specified band of the
@@ -6448,6 +6448,10 @@ Datum RASTER_mapAlgebraExpr(PG_FUNCTION_ARGS)
     enum KEYWORDS { kVAL=0, kX=1, kY=2 };
     char *argkw[] = {"[rast]", "[rast.x]", "[rast.y]"};
     Oid argkwtypes[] = { FLOAT8OID, INT4OID, INT4OID };
+    int argkwisint[] = { 0, 1, 1 };
+    double argkwval[3] = {0};
+    rt_mapexpr mexpr = NULL;
+    int mexprnull = 0;
     int argcount = 0;
     Oid argtype[] = { FLOAT8OID, INT4OID, INT4OID };
     uint8_t argpos[3] = {0};
@@ -6888,6 +6892,18 @@ Datum RASTER_mapAlgebraExpr(PG_FUNCTION_ARGS)
         newexpr = rtpg_strreplace(initexpr, "[rast.val]", "[rast]", NULL);
         pfree(initexpr); initexpr=newexpr;
 
+        /**
+         * Compile the expression so that pixels can be computed without
+         * an executor round trip. The prepared plan is still needed for
+         * expressions or values the compiler leaves to SQL
+         **/
+        newexpr = rtpg_strreplace(expression, "[rast.val]", "[rast]", NULL);
+        mexpr = rt_mapexpr_compile(newexpr, argkwcount, argkw, argkwisint);
+        pfree(newexpr);
+
+        POSTGIS_RT_DEBUGF(3, "RASTER_mapAlgebraExpr: expression %s natively",
+            mexpr != NULL ? "evaluated" : "not evaluated");
+
         sprintf(place,"$1");
         for (i = 0, j = 1; i < argkwcount; i++) {
             len = 0;
@@ -6980,71 +6996,86 @@ Datum RASTER_mapAlgebraExpr(PG_FUNCTION_ARGS)
             if (ret == ES_NONE && FLT_NEQ(r, newnodatavalue)) {
                 if (skipcomputation == 0) {
                     if (initexpr != NULL) {
-                        /* Reset the null arg flags. */
-                        memset(nulls, 'n', argcount);
-
-                        for (i = 0; i < argkwcount; i++) {
-                            idx = argpos[i];
-                            if (idx < 1) continue;
-                            idx--;
-
-                            if (i == kX ) {
-                                /* x is 0 based index, but SQL expects 1 based index */
-                                values[idx] = Int32GetDatum(x+1);
-                                nulls[idx] = ' ';
-                            }
-                            else if (i == kY) {
-                                /* y is 0 based index, but SQL expects 1 based index */
-                                values[idx] = Int32GetDatum(y+1);
-                                nulls[idx] = ' ';
+                        argkwval[kVAL] = r;
+                        /* x and y are 0 based index, but SQL expects 1 based index */
+                        argkwval[kX] = x + 1;
+                        argkwval[kY] = y + 1;
+
+                        if (mexpr != NULL && rt_mapexpr_eval(mexpr, argkwval, NULL, &newval, &mexprnull)) {
+                            if (mexprnull) {
+                                POSTGIS_RT_DEBUGF(3, "Expression for pixel %d,%d (value %g) evaluated to NULL, skip setting", x+1,y+1,r);
+                                newval = newinitialvalue;
                             }
-                            else if (i == kVAL ) {
-                                values[idx] = Float8GetDatum(r);
-                                nulls[idx] = ' ';
+                        }
+                        /* Not compiled or the value is left to SQL */
+                        else {
+                            /* Reset the null arg flags. */
+                            memset(nulls, 'n', argcount);
+
+                            for (i = 0; i < argkwcount; i++) {
+                                idx = argpos[i];
+                                if (idx < 1) continue;
+                                idx--;
+
+                                if (i == kX ) {
+                                    /* x is 0 based index, but SQL expects 1 based index */
+                                    values[idx] = Int32GetDatum(x+1);
+                                    nulls[idx] = ' ';
+                                }
+                                else if (i == kY) {
+                                    /* y is 0 based index, but SQL expects 1 based index */
+                                    values[idx] = Int32GetDatum(y+1);
+                                    nulls[idx] = ' ';
+                                }
+                                else if (i == kVAL ) {
+                                    values[idx] = Float8GetDatum(r);
+                                    nulls[idx] = ' ';
+                                }
+
                             }
 
-                        }
+                            ret = SPI_execute_plan(spi_plan, values, nulls, FALSE, 0);
+                            if (ret != SPI_OK_SELECT || SPI_tuptable == NULL ||
+                                    SPI_processed != 1) {
+                                elog(ERROR, "RASTER_mapAlgebraExpr: Error executing prepared plan."
+                                        " Aborting");
 
-                        ret = SPI_execute_plan(spi_plan, values, nulls, FALSE, 0);
-                        if (ret != SPI_OK_SELECT || SPI_tuptable == NULL ||
-                                SPI_processed != 1) {
-                            elog(ERROR, "RASTER_mapAlgebraExpr: Error executing prepared plan."
-                                    " Aborting");
+                                if (SPI_tuptable)
+                                    SPI_freetuptable(tuptable);
 
-                            if (SPI_tuptable)
-                                SPI_freetuptable(tuptable);
+                                SPI_freeplan(spi_plan);
+                                SPI_finish();
 
-                            SPI_freeplan(spi_plan);
-                            SPI_finish();
+                                rt_mapexpr_destroy(mexpr);
+                                pfree(values);
+                                pfree(nulls);
+                                pfree(initexpr);
 
-                            pfree(values);
-                            pfree(nulls);
-                            pfree(initexpr);
+                                rt_raster_destroy(raster);
+                                PG_FREE_IF_COPY(pgraster, 0);
+                                rt_raster_destroy(newrast);
 
-                            rt_raster_destroy(raster);
-                            PG_FREE_IF_COPY(pgraster, 0);
-                            rt_raster_destroy(newrast);
+                                PG_RETURN_NULL();
+                            }
 
-                            PG_RETURN_NULL();
-                        }
+                            tupdesc = SPI_tuptable->tupdesc;
+                            tuptable = SPI_tuptable;
 
-                        tupdesc = SPI_tuptable->tupdesc;
-                        tuptable = SPI_tuptable;
+                            tuple = tuptable->vals[0];
+                            datum = SPI_getbinval(tuple, tupdesc, 1, &isnull);
+                            if ( SPI_result == SPI_ERROR_NOATTRIBUTE ) {
+                                POSTGIS_RT_DEBUGF(3, "Expression for pixel %d,%d (value %g) errored, skip setting", x+1,y+1,r);
+                                newval = newinitialvalue;
+                            }
+                            else if ( isnull ) {
+                                POSTGIS_RT_DEBUGF(3, "Expression for pixel %d,%d (value %g) evaluated to NULL, skip setting", x+1,y+1,r);
+                                newval = newinitialvalue;
+                            } else {
+                                newval = DatumGetFloat8(datum);
+                            }
 
-                        tuple = tuptable->vals[0];
-                        datum = SPI_getbinval(tuple, tupdesc, 1, &isnull);
-                        if ( SPI_result == SPI_ERROR_NOATTRIBUTE ) {
-                            POSTGIS_RT_DEBUGF(3, "Expression for pixel %d,%d (value %g) errored, skip setting", x+1,y+1,r);
-                            newval = newinitialvalue;
+                            SPI_freetuptable(tuptable);
                         }
-                        else if ( isnull ) {
-                            POSTGIS_RT_DEBUGF(3, "Expression for pixel %d,%d (value %g) evaluated to NULL, skip setting", x+1,y+1,r);
-                            newval = newinitialvalue;
-                        } else {
-                            newval = DatumGetFloat8(datum);
-                        }
-
-                        SPI_freetuptable(tuptable);
                     }
 
                     else
@@ -7065,6 +7096,7 @@ Datum RASTER_mapAlgebraExpr(PG_FUNCTION_ARGS)
         SPI_freeplan(spi_plan);
         SPI_finish();
 
+        rt_mapexpr_destroy(mexpr);
         pfree(values);
         pfree(nulls);
         pfree(initexpr);
@@ -16676,6 +16708,9 @@ typedef struct {
 		uint32_t spi_argcount;
 		uint8_t *spi_argpos;
 
+		/* natively evaluated expression, spi_plan is the fallback */
+		rt_mapexpr mexpr;
+
 		int hasval;
 		double val;
 	} expr[3];
@@ -16722,6 +16757,7 @@ static rtpg_nmapalgebraexpr_arg rtpg_nmapalgebraexpr_arg_init(int cnt, char **kw
 	for (i = 0; i < arg->callback.exprcount; i++) {
 		arg->callback.expr[i].spi_plan = NULL;
 		arg->callback.expr[i].spi_argcount = 0;
+		arg->callback.expr[i].mexpr = NULL;
 		arg->callback.expr[i].spi_argpos = palloc(cnt * sizeof(uint8_t));
 		if (arg->callback.expr[i].spi_argpos == NULL) {
 			elog(ERROR, "rtpg_nmapalgebraexpr_arg_init: Unable to allocate memory for spi_argpos");
@@ -16746,6 +16782,7 @@ static void rtpg_nmapalgebraexpr_arg_destroy(rtpg_nmapalgebraexpr_arg arg) {
 	for (i = 0; i < arg->callback.exprcount; i++) {
 		if (arg->callback.expr[i].spi_plan)
 			SPI_freeplan(arg->callback.expr[i].spi_plan);
+		rt_mapexpr_destroy(arg->callback.expr[i].mexpr);
 		if (arg->callback.kw.count)
 			pfree(arg->callback.expr[i].spi_argpos);
 	}
@@ -16844,114 +16881,133 @@ static int rtpg_nmapalgebraexpr_callback(
 		}
 	}
 
-	/* run prepared plan */
+	/* evaluate expression, natively if possible or else with prepared plan */
 	if (plan != NULL) {
-		Datum values[12];
-		bool nulls[12];
-		int err = 0;
-
-		TupleDesc tupdesc;
-		SPITupleTable *tuptable = NULL;
-		HeapTuple tuple;
-		Datum datum;
-		bool isnull = FALSE;
-
-		POSTGIS_RT_DEBUGF(4, "Running plan %d", id);
-
-		/* init values and nulls */
-		memset(values, (Datum) NULL, sizeof(Datum) * callback->kw.count);
-		memset(nulls, FALSE, sizeof(bool) * callback->kw.count);
-
-		if (callback->expr[id].spi_argcount) {
-			int idx = 0;
-
-			for (i = 0; i < callback->kw.count; i++) {
-				idx = callback->expr[id].spi_argpos[i];
-				if (idx < 1) continue;
-				idx--; /* 1-based now 0-based */
-
-				switch (i) {
-					/* [rast.x] */
-					case 0:
-						values[idx] = Int32GetDatum(arg->src_pixel[0][0] + 1);
-						break;
-					/* [rast.y] */
-					case 1:
-						values[idx] = Int32GetDatum(arg->src_pixel[0][1] + 1);
-						break;
-					/* [rast.val] */
-					case 2:
-					/* [rast] */
-					case 3:
-						if (!arg->nodata[0][0][0])
-							values[idx] = Float8GetDatum(arg->values[0][0][0]);
-						else
-							nulls[idx] = TRUE;
-						break;
+		double kwval[12];
+		int kwnull[12];
+		double result = 0;
+		int resultnull = 0;
+
+		/* values of keywords */
+		for (i = 0; i < callback->kw.count; i++) {
+			kwval[i] = 0;
+			kwnull[i] = 0;
+
+			switch (i) {
+				/* [rast.x] */
+				case 0:
+				/* [rast1.x] */
+				case 4:
+					kwval[i] = arg->src_pixel[0][0] + 1;
+					break;
+				/* [rast.y] */
+				case 1:
+				/* [rast1.y] */
+				case 5:
+					kwval[i] = arg->src_pixel[0][1] + 1;
+					break;
+				/* [rast.val] */
+				case 2:
+				/* [rast] */
+				case 3:
+				/* [rast1.val] */
+				case 6:
+				/* [rast1] */
+				case 7:
+					if (!arg->nodata[0][0][0])
+						kwval[i] = arg->values[0][0][0];
+					else
+						kwnull[i] = 1;
+					break;
 
-					/* [rast1.x] */
-					case 4:
-						values[idx] = Int32GetDatum(arg->src_pixel[0][0] + 1);
-						break;
-					/* [rast1.y] */
-					case 5:
-						values[idx] = Int32GetDatum(arg->src_pixel[0][1] + 1);
-						break;
-					/* [rast1.val] */
-					case 6:
-					/* [rast1] */
-					case 7:
-						if (!arg->nodata[0][0][0])
-							values[idx] = Float8GetDatum(arg->values[0][0][0]);
-						else
-							nulls[idx] = TRUE;
-						break;
+				/* [rast2.x] */
+				case 8:
+					kwval[i] = arg->src_pixel[1][0] + 1;
+					break;
+				/* [rast2.y] */
+				case 9:
+					kwval[i] = arg->src_pixel[1][1] + 1;
+					break;
+				/* [rast2.val] */
+				case 10:
+				/* [rast2] */
+				case 11:
+					if (!arg->nodata[1][0][0])
+						kwval[i] = arg->values[1][0][0];
+					else
+						kwnull[i] = 1;
+					break;
+			}
+		}
 
-					/* [rast2.x] */
-					case 8:
-						values[idx] = Int32GetDatum(arg->src_pixel[1][0] + 1);
-						break;
-					/* [rast2.y] */
-					case 9:
-						values[idx] = Int32GetDatum(arg->src_pixel[1][1] + 1);
-						break;
-					/* [rast2.val] */
-					case 10:
-					/* [rast2] */
-					case 11:
-						if (!arg->nodata[1][0][0])
-							values[idx] = Float8GetDatum(arg->values[1][0][0]);
-						else
-							nulls[idx] = TRUE;
-						break;
+		if (
+			callback->expr[id].mexpr == NULL ||
+			!rt_mapexpr_eval(callback->expr[id].mexpr, kwval, kwnull, &result, &resultnull)
+		) {
+			Datum values[12];
+			bool nulls[12];
+			int err = 0;
+
+			TupleDesc tupdesc;
+			SPITupleTable *tuptable = NULL;
+			HeapTuple tuple;
+			Datum datum;
+			bool isnull = FALSE;
+
+			POSTGIS_RT_DEBUGF(4, "Running plan %d", id);
+
+			/* init values and nulls */
+			memset(values, (Datum) NULL, sizeof(Datum) * callback->kw.count);
+			memset(nulls, FALSE, sizeof(bool) * callback->kw.count);
+
+			if (callback->expr[id].spi_argcount) {
+				int idx = 0;
+
+				for (i = 0; i < callback->kw.count; i++) {
+					idx = callback->expr[id].spi_argpos[i];
+					if (idx < 1) continue;
+					idx--; /* 1-based now 0-based */
+
+					/* positions are INT4, everything else is FLOAT8 */
+					if (kwnull[i])
+						nulls[idx] = TRUE;
+					else if (i % 4 < 2)
+						values[idx] = Int32GetDatum((int32_t) kwval[i]);
+					else
+						values[idx] = Float8GetDatum(kwval[i]);
 				}
+			}
 
+			/* run prepared plan */
+			err = SPI_execute_plan(plan, values, nulls, TRUE, 1);
+			if (err != SPI_OK_SELECT || SPI_tuptable == NULL || SPI_processed != 1) {
+				elog(ERROR, "rtpg_nmapalgebraexpr_callback: Unexpected error when running prepared statement %d", id);
+				return 0;
 			}
-		}
 
-		/* run prepared plan */
-		err = SPI_execute_plan(plan, values, nulls, TRUE, 1);
-		if (err != SPI_OK_SELECT || SPI_tuptable == NULL || SPI_processed != 1) {
-			elog(ERROR, "rtpg_nmapalgebraexpr_callback: Unexpected error when running prepared statement %d", id);
-			return 0;
-		}
+			/* get output of prepared plan */
+			tupdesc = SPI_tuptable->tupdesc;
+			tuptable = SPI_tuptable;
+			tuple = tuptable->vals[0];
 
-		/* get output of prepared plan */
-		tupdesc = SPI_tuptable->tupdesc;
-		tuptable = SPI_tuptable;
-		tuple = tuptable->vals[0];
+			datum = SPI_getbinval(tuple, tupdesc, 1, &isnull);
+			if (SPI_result == SPI_ERROR_NOATTRIBUTE) {
+				elog(ERROR, "rtpg_nmapalgebraexpr_callback: Unable to get result of prepared statement %d", id);
+				if (SPI_tuptable) SPI_freetuptable(tuptable);
+				return 0;
+			}
+
+			if (!isnull) {
+				result = DatumGetFloat8(datum);
+				POSTGIS_RT_DEBUG(4, "Getting value from Datum");
+			}
+			resultnull = isnull;
 
-		datum = SPI_getbinval(tuple, tupdesc, 1, &isnull);
-		if (SPI_result == SPI_ERROR_NOATTRIBUTE) {
-			elog(ERROR, "rtpg_nmapalgebraexpr_callback: Unable to get result of prepared statement %d", id);
 			if (SPI_tuptable) SPI_freetuptable(tuptable);
-			return 0;
 		}
 
-		if (!isnull) {
-			*value = DatumGetFloat8(datum);
-			POSTGIS_RT_DEBUG(4, "Getting value from Datum");
-		}
+		if (!resultnull)
+			*value = result;
 		else {
 			/* 2 raster, check nodatanodataval */
 			if (arg->rasters > 1) {
@@ -16968,8 +17024,6 @@ static int rtpg_nmapalgebraexpr_callback(
 					*nodata = 1;
 			}
 		}
-
-		if (SPI_tuptable) SPI_freetuptable(tuptable);
 	}
 
 	POSTGIS_RT_DEBUGF(4, "(value, nodata) = (%f, %d)", *value, *nodata);
@@ -17020,6 +17074,12 @@ Datum RASTER_nMapAlgebraExpr(PG_FUNCTION_ARGS)
 		"[rast2.val]",
 		"[rast2]"
 	};
+	/* positions are INT4, everything else is FLOAT8 */
+	int argkwisint[] = {
+		1, 1, 0, 0,
+		1, 1, 0, 0,
+		1, 1, 0, 0
+	};
 
 	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();
@@ -17149,6 +17209,11 @@ Datum RASTER_nMapAlgebraExpr(PG_FUNCTION_ARGS)
 		expr = text_to_cstring(PG_GETARG_TEXT_P(exprpos[i]));
 		POSTGIS_RT_DEBUGF(3, "raw expr of argument #%d: %s", exprpos[i], expr);
 
+		/* compile for native evaluation, the prepared plan handles the rest */
+		arg->callback.expr[i].mexpr = rt_mapexpr_compile(expr, argkwcount, argkw, argkwisint);
+		POSTGIS_RT_DEBUGF(3, "expression parameter %d %s natively", exprpos[i],
+			arg->callback.expr[i].mexpr != NULL ? "evaluated" : "not evaluated");
+
 		for (j = 0, k = 1; j < argkwcount; j++) {
 			/* attempt to replace keyword with placeholder */
 			len = 0;
@@ -17230,6 +17295,9 @@ Datum RASTER_nMapAlgebraExpr(PG_FUNCTION_ARGS)
 		/* no args, just execute query */
 		else {
 			POSTGIS_RT_DEBUGF(3, "expression parameter %d has no args, simply executing", exprpos[i]);
+			rt_mapexpr_destroy(arg->callback.expr[i].mexpr);
+			arg->callback.expr[i].mexpr = NULL;
+
 			err = SPI_execute(sql, TRUE, 0);
 			pfree(sql);
 
@@ -1175,11 +1175,108 @@ static void test_raster_colormap() {
 	cu_free_raster(raster);
 }
 
+static void test_mapexpr() {
+	char *kw[] = {"[rast.x]", "[rast.y]", "[rast]", "[rast2]"};
+	int kwisint[] = {1, 1, 0, 0};
+	double kwval[] = {3, 4, 2.5, 0};
+	int kwnull[] = {0, 0, 0, 1};
+	rt_mapexpr mexpr = NULL;
+	double value = 0;
+	int isnull = 0;
+	int i;
+
+	/* expressions and their values for the keyword values above */
+	struct {
+		const char *expr;
+		double value;
+		int isnull;
+	} tests[] = {
+		{"[rast] * 2 + 1", 6, 0},
+		{"[rast.x] / 2", 1, 0}, /* int4 division */
+		{"[rast.x] / 2.", 1.5, -1}, /* numeric, left to SPI */
+		{"[rast] / 2", 1.25, 0},
+		{"[rast.x] % 2", 1, 0},
+		{"-2 ^ 2", 4, 0},
+		{"2 ^ 3 ^ 2", 64, 0},
+		{"[rast] ^ [rast.x]", 15.625, 0},
+		{"CASE WHEN [rast] > 2 THEN 10 ELSE 20 END", 10, 0},
+		{"CASE WHEN [rast] > 3 THEN 10 END", 0, 1},
+		{"case when [rast.x] <> [rast.y] and not [rast] < 0 then 0.5 else [rast] end", 0.5, 0},
+		{"[rast2] + 1", 0, 1},
+		{"coalesce([rast2], [rast.y])", 4, 0},
+		{"greatest([rast2], [rast], 1)", 2.5, 0},
+		{"least([rast.x], [rast.y])", 3, 0},
+		{"[rast2] IS NULL", 0, -1}, /* boolean result */
+		{"CASE WHEN [rast2] IS NULL THEN -1 ELSE 1 END", -1, 0},
+		{"round(2.5)", 0, -1}, /* numeric overload */
+		{"round([rast])", 2, 0}, /* float8 round is rint */
+		{"[rast]::integer", 2, 0},
+		{"CAST([rast.x] AS double precision) / 2", 1.5, 0},
+		{"sqrt([rast.x] * 3)", 3, 0},
+		{"abs(-[rast.y])", 4, 0},
+		{"power([rast.x], 2) + ln(1) + log(100)", 11, 0},
+		{"atan2(0, -1) = pi()", 0, -1},
+		{"CASE WHEN atan2(0, -1) = pi() THEN 1 ELSE 0 END", 1, 0},
+		{"[rast]*-1", -2.5, 0},
+		{"2^-1", 0, -1}, /* ^- is a single operator */
+		{"[rast] -- comment", 0, -1},
+		{"random() * [rast]", 0, -1},
+		{"[rast] < [rast.x] < 5", 0, -1},
+		{"[rast.x] + [rast9]", 0, -1},
+		{"'1' || [rast]", 0, -1},
+		{NULL, 0, 0}
+	};
+
+	for (i = 0; tests[i].expr != NULL; i++) {
+		mexpr = rt_mapexpr_compile(tests[i].expr, 4, kw, kwisint);
+		if (tests[i].isnull < 0) {
+			CU_ASSERT(mexpr == NULL);
+			rt_mapexpr_destroy(mexpr);
+			continue;
+		}
+
+		CU_ASSERT(mexpr != NULL);
+		if (mexpr == NULL)
+			continue;
+
+		CU_ASSERT_EQUAL(rt_mapexpr_eval(mexpr, kwval, kwnull, &value, &isnull), 1);
+		CU_ASSERT_EQUAL(isnull, tests[i].isnull);
+		if (!isnull)
+			CU_ASSERT_DOUBLE_EQUAL(value, tests[i].value, DBL_EPSILON);
+
+		rt_mapexpr_destroy(mexpr);
+	}
+
+	/* errors are left to SPI */
+	mexpr = rt_mapexpr_compile("[rast] / ([rast.x] - 3)", 4, kw, kwisint);
+	CU_ASSERT(mexpr != NULL);
+	CU_ASSERT_EQUAL(rt_mapexpr_eval(mexpr, kwval, kwnull, &value, &isnull), 0);
+	rt_mapexpr_destroy(mexpr);
+
+	mexpr = rt_mapexpr_compile("[rast.x] * 2147483647", 4, kw, kwisint);
+	CU_ASSERT(mexpr != NULL);
+	CU_ASSERT_EQUAL(rt_mapexpr_eval(mexpr, kwval, kwnull, &value, &isnull), 0);
+	rt_mapexpr_destroy(mexpr);
+
+	mexpr = rt_mapexpr_compile("sqrt([rast] - 10)", 4, kw, kwisint);
+	CU_ASSERT(mexpr != NULL);
+	CU_ASSERT_EQUAL(rt_mapexpr_eval(mexpr, kwval, kwnull, &value, &isnull), 0);
+	rt_mapexpr_destroy(mexpr);
+
+	/* unevaluated branches do not raise errors */
+	mexpr = rt_mapexpr_compile("CASE WHEN [rast.x] = 3 THEN 0 ELSE 1 / ([rast.x] - 3) END", 4, kw, kwisint);
+	CU_ASSERT(mexpr != NULL);
+	CU_ASSERT_EQUAL(rt_mapexpr_eval(mexpr, kwval, kwnull, &value, &isnull), 1);
+	CU_ASSERT_DOUBLE_EQUAL(value, 0, DBL_EPSILON);
+	rt_mapexpr_destroy(mexpr);
+}
+
 /* register tests */
 CU_TestInfo mapalgebra_tests[] = {
 	PG_TEST(test_raster_iterator),
 	PG_TEST(test_band_reclass),
 	PG_TEST(test_raster_colormap),
+	PG_TEST(test_mapexpr),
 	CU_TEST_INFO_NULL
 };
 CU_SuiteInfo mapalgebra_suite = {"mapalgebra",  NULL,  NULL, mapalgebra_tests};
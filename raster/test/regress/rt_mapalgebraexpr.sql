@@ -153,6 +153,14 @@ SELECT 'T12',
     '[rast.x]'
   ) AS rast; 
 
+-- Natively evaluated expressions keep SQL semantics
+SELECT 'T13.1', ST_Value(ST_MapAlgebraExpr(ST_TestRaster(0, 0, 10), 1, NULL, '[rast.x] / 2 + [rast] ^ 2'), 3, 1);
+SELECT 'T13.2',
+  ST_Value(rast, 7, 1),
+  ST_Value(rast, 2, 1)
+  FROM ST_MapAlgebraExpr(ST_TestRaster(0, 0, 10), 1, NULL, 'CASE WHEN [rast.x] > 5 THEN round([rast] / 4) ELSE 0 END') AS rast;
+SELECT 'T13.3', ST_Value(ST_MapAlgebraExpr(ST_TestRaster(0, 0, 10), 1, NULL, '[rast.x] * 2147483647'), 3, 1);
+
 DROP FUNCTION ST_TestRaster(ulx float8, uly float8, val float8);
 DROP FUNCTION raster_plus_twenty(pixel FLOAT, VARIADIC args TEXT[]);
 DROP FUNCTION raster_plus_arg1(pixel FLOAT, VARIADIC args TEXT[]);
@@ -0,0 +1,27 @@
+-- ST_ClipByBox2D
+
+SELECT 1, ST_AsText(ST_ClipByBox2D('MULTIPOINT(0 0,5 5,15 5,10 10)'::geometry, 'BOX(0 0,10 10)'::box2d));
+SELECT 2, ST_AsText(ST_ClipByBox2D('LINESTRING(-5 5,5 5,5 15,8 15,8 -5)'::geometry, 'BOX(0 0,10 10)'::box2d));
+SELECT 3, ST_AsText(ST_ClipByBox2D('POLYGON((5 5,15 5,5 15,5 5))'::geometry, 'BOX(0 0,10 10)'::box2d));
+SELECT 4, ST_AsText(ST_ClipByBox2D('POLYGON((-5 -5,15 -5,15 15,-5 15,-5 -5),(2 2,2 4,4 4,4 2,2 2),(8 -2,8 2,12 2,12 -2,8 -2))'::geometry, 'BOX(0 0,10 10)'::box2d));
+
+-- All inside, all outside
+SELECT 5, ST_AsEWKT(ST_ClipByBox2D('SRID=4326;LINESTRING(1 1,2 2)'::geometry, 'BOX(0 0,10 10)'::box2d));
+SELECT 6, ST_AsEWKT(ST_ClipByBox2D('SRID=4326;LINESTRING(20 20,30 30)'::geometry, 'BOX(0 0,10 10)'::box2d));
+SELECT 7, ST_AsText(ST_ClipByBox2D('POLYGON EMPTY'::geometry, 'BOX(0 0,10 10)'::box2d));
+
+-- Collections keep what is left of their parts
+SELECT 8, ST_AsText(ST_ClipByBox2D('GEOMETRYCOLLECTION(POINT(5 5),LINESTRING(-5 5,15 5),POINT(20 20))'::geometry, 'BOX(0 0,10 10)'::box2d));
+
+-- ST_Intersection with a rectangle gives the same as before
+SELECT 9, ST_AsText(ST_Intersection('LINESTRING(-5 5,15 5)'::geometry, ST_MakeEnvelope(0, 0, 10, 10)));
+SELECT 10, ST_AsText(ST_Intersection(ST_MakeEnvelope(0, 0, 10, 10), 'MULTIPOINT(5 5,15 5)'::geometry));
+SELECT 11, ST_AsText(ST_Intersection('POINT(15 5)'::geometry, ST_MakeEnvelope(0, 0, 10, 10)));
+SELECT 12, ST_Equals(ST_Intersection(g, e), 'POLYGON((5 5,10 5,10 10,5 10,5 5))')
+FROM ( SELECT 'POLYGON((5 5,15 5,5 15,5 5))'::geometry AS g, ST_MakeEnvelope(0, 0, 10, 10) AS e ) AS f;
+-- Concave polygons are still cut into valid pieces
+SELECT 13, ST_NumGeometries(g), ST_IsValid(g), ST_Area(g)
+FROM ( SELECT ST_Intersection('POLYGON((0 0,10 0,10 10,8 10,8 2,2 2,2 10,0 10,0 0))'::geometry, ST_MakeEnvelope(0, 5, 10, 10)) AS g ) AS f;
+-- Linework inside the rectangle is still noded and cleaned by GEOS
+SELECT 14, ST_GeometryType(ST_Intersection('LINESTRING(1 1,3 3,1 3,3 1)'::geometry, ST_MakeEnvelope(0, 0, 10, 10)));
+SELECT 15, ST_AsText(ST_Intersection(ST_MakeEnvelope(0, 0, 10, 10), 'LINESTRING(1 1,1 1,2 2)'::geometry));
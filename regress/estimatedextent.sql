@@ -0,0 +1,28 @@
+-- Points from 0 0 to 10 10, analyzed before any more are loaded
+CREATE TABLE ee_test AS
+	SELECT ST_MakePoint(i, j) AS g
+	FROM generate_series(0, 10) i, generate_series(0, 10) j;
+ANALYZE ee_test;
+INSERT INTO ee_test SELECT ST_MakePoint(100, 50 + i) FROM generate_series(0, 500) i;
+-- An EMPTY must not stretch the unions of a multi-page index
+INSERT INTO ee_test VALUES ('POINT EMPTY');
+
+-- No index, the statistics are used
+SELECT 'ee_noindex', ST_EstimatedExtent('public', 'ee_test', 'g', true)::text = ST_EstimatedExtent('public', 'ee_test', 'g')::text;
+
+-- A partial index does not cover every row, the statistics are used
+CREATE INDEX ee_test_part_idx ON ee_test USING gist (g) WHERE ST_X(g) < 50;
+SELECT 'ee_partial', ST_EstimatedExtent('public', 'ee_test', 'g', true)::text = ST_EstimatedExtent('public', 'ee_test', 'g')::text;
+DROP INDEX ee_test_part_idx;
+
+-- The index root covers the rows loaded after ANALYZE
+CREATE INDEX ee_test_idx ON ee_test USING gist (g);
+SELECT 'ee_2d', ST_EstimatedExtent('public', 'ee_test', 'g', true);
+SELECT 'ee_stats', ST_EstimatedExtent('public', 'ee_test', 'g', false)::text = ST_EstimatedExtent('public', 'ee_test', 'g')::text;
+DROP INDEX ee_test_idx;
+
+CREATE INDEX ee_test_idx ON ee_test USING gist (g gist_geometry_ops_nd);
+SELECT 'ee_nd', ST_EstimatedExtent('public', 'ee_test', 'g', true);
+DROP INDEX ee_test_idx;
+
+DROP TABLE ee_test;
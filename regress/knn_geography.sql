@@ -0,0 +1,20 @@
+-- Geography index ordering by spheroid distance
+CREATE TABLE knn_geography_test AS
+	SELECT i AS id, ST_MakePoint(i, 0)::geography AS geog
+	FROM generate_series(-179, 179) i
+	UNION ALL
+	SELECT 1000, 'LINESTRING(10 1,11 1)'::geography
+	UNION ALL
+	SELECT 2000, 'POINT EMPTY'::geography;
+
+CREATE INDEX knn_geography_test_idx ON knn_geography_test USING gist (geog);
+ANALYZE knn_geography_test;
+SET enable_seqscan = off;
+
+SELECT 'knn1', id FROM knn_geography_test ORDER BY geog <-> 'POINT(10.2 0.1)'::geography LIMIT 4;
+SELECT 'knn2', id FROM knn_geography_test ORDER BY geog <-> 'POINT(-179.9 0)'::geography LIMIT 2;
+SELECT 'knn3', count(*) FROM (SELECT id FROM knn_geography_test ORDER BY geog <-> 'POINT(0 0)'::geography) foo;
+SELECT 'knn4', round(geog <-> 'POINT(1 0)'::geography) = round(ST_Distance(geog, 'POINT(1 0)'::geography)) FROM knn_geography_test WHERE id = 0;
+
+RESET enable_seqscan;
+DROP TABLE knn_geography_test;
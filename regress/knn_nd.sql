@@ -0,0 +1,19 @@
+-- N-D GiST index ordering by box distance
+CREATE TABLE knn_nd_test AS
+	SELECT i AS id, ST_MakePoint(i % 10, i / 10 % 10, i / 100) AS geom
+	FROM generate_series(0, 999) i
+	UNION ALL
+	SELECT 2000, 'POINT EMPTY'::geometry;
+
+CREATE INDEX knn_nd_test_idx ON knn_nd_test USING gist (geom gist_geometry_ops_nd);
+ANALYZE knn_nd_test;
+SET enable_seqscan = off;
+
+SELECT 'knn1', id, round((geom <<->> 'POINT(2.2 3.3 4.4)'::geometry)::numeric, 3) FROM knn_nd_test ORDER BY geom <<->> 'POINT(2.2 3.3 4.4)'::geometry, id LIMIT 3;
+-- Missing dimensions are not compared
+SELECT 'knn2', id, round((geom <<->> 'POINT(2.2 3.3)'::geometry)::numeric, 3) FROM knn_nd_test ORDER BY geom <<->> 'POINT(2.2 3.3)'::geometry, id LIMIT 3;
+SELECT 'knn3', count(*) FROM (SELECT id FROM knn_nd_test ORDER BY geom <<->> 'POINT(0 0 0)'::geometry) foo;
+SELECT 'knn4', geom <<->> 'POINT(0 0 0)'::geometry IS NULL FROM knn_nd_test WHERE id = 2000;
+
+RESET enable_seqscan;
+DROP TABLE knn_nd_test;
@@ -0,0 +1,19 @@
+-- Index ordering by true distance, boxes alone get these wrong
+CREATE TABLE knn_recheck_test AS
+	SELECT 1 AS id, 'LINESTRING(0 0,100 100)'::geometry AS geom
+	UNION ALL
+	SELECT 2, 'POINT(80 1)'::geometry
+	UNION ALL
+	SELECT 3, 'POLYGON((0 10,100 10,100 110,0 110,0 10))'::geometry
+	UNION ALL
+	SELECT 1000 + i, ST_MakePoint(1000 + i, 1000)
+	FROM generate_series(0, 999) i;
+
+CREATE INDEX knn_recheck_test_idx ON knn_recheck_test USING gist (geom);
+ANALYZE knn_recheck_test;
+SET enable_seqscan = off;
+
+SELECT 'knn1', id, round((geom <-> 'POINT(90 1)'::geometry)::numeric, 3) FROM knn_recheck_test ORDER BY geom <-> 'POINT(90 1)'::geometry LIMIT 3;
+
+RESET enable_seqscan;
+DROP TABLE knn_recheck_test;
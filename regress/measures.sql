@@ -261,3 +261,8 @@ select 'emptyCollectionArea', st_area('GEOMETRYCOLLECTION EMPTY');
 
 -- 
 select 'spheroidLength1', round(st_length_spheroid('MULTILINESTRING((-118.584 38.374,-118.583 38.5),(-71.05957 42.3589 , -71.061 43))'::geometry,'SPHEROID["GRS_1980",6378137,298.257222101]'::spheroid)::numeric,5);
+
+-- Repeated polygon, rows after the first are answered from its cached edge tree
+select 'closest_cache', i, st_astext(st_closestpoint('POLYGON((0 0,0 10,10 10,10 0,0 0),(4 4,4 6,6 6,6 4,4 4))'::geometry, p)),
+  st_astext(st_shortestline(p, 'POLYGON((0 0,0 10,10 10,10 0,0 0),(4 4,4 6,6 6,6 4,4 4))'::geometry))
+from ( values (1, 'POINT(12 5)'::geometry), (2, 'POINT(5 4.5)'), (3, 'POINT(2 3)'), (4, 'LINESTRING(12 1,14 3)') ) as v(i, p) order by i;
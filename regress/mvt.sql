@@ -0,0 +1,28 @@
+-- ST_AsMVTGeom
+SELECT 'PG1', ST_AsText(ST_AsMVTGeom('POINT(25 17)'::geometry, ST_MakeBox2D(ST_Point(0, 0), ST_Point(4096, 4096)), 4096, 0, false));
+SELECT 'PG2', ST_AsText(ST_AsMVTGeom('POLYGON((0 0,10 0,10 5,0 5,0 0))'::geometry, 'BOX(0 0,10 10)'::box2d, 10, 0, true));
+SELECT 'PG3', ST_AsText(ST_AsMVTGeom('LINESTRING(-5 5,15 5)'::geometry, 'BOX(0 0,10 10)'::box2d, 10, 0, true));
+SELECT 'PG4', ST_AsText(ST_AsMVTGeom('LINESTRING(-5 5,15 5)'::geometry, 'BOX(0 0,10 10)'::box2d, 10, 2, true));
+SELECT 'PG5', ST_AsText(ST_AsMVTGeom('LINESTRING(-5 5,15 5)'::geometry, 'BOX(0 0,10 10)'::box2d, 10, 0, false));
+-- Snapped away, or out of the tile
+SELECT 'PG6', ST_AsMVTGeom('POLYGON((0 0,0.1 0,0.1 0.1,0 0))'::geometry, 'BOX(0 0,4096 4096)'::box2d) IS NULL;
+SELECT 'PG7', ST_AsMVTGeom('POLYGON((0 0,10 0,10 0.2,0 0.2,0 0))'::geometry, 'BOX(0 0,10 10)'::box2d, 10, 0, true) IS NULL;
+SELECT 'PG8', ST_AsMVTGeom('LINESTRING(20 20,30 30)'::geometry, 'BOX(0 0,10 10)'::box2d, 10, 0, true) IS NULL;
+-- Collections keep their highest dimension, SRID is dropped
+SELECT 'PG9', ST_AsText(ST_AsMVTGeom('GEOMETRYCOLLECTION(POINT(1 1),LINESTRING(0 0,5 5))'::geometry, 'BOX(0 0,10 10)'::box2d, 10, 0, true));
+SELECT 'PG10', ST_AsEWKT(ST_AsMVTGeom('SRID=3857;MULTIPOINT(1 1,5 5)'::geometry, 'BOX(0 0,10 10)'::box2d, 10, 0, true));
+SELECT 'PG11', ST_AsMVTGeom('POINT(1 1)'::geometry, 'BOX(0 0,10 10)'::box2d, 0, 0, true);
+SELECT 'PG12', ST_AsMVTGeom('POINT(1 1)'::geometry, 'BOX(0 0,10 10)'::box2d, 10, -1, true);
+
+-- ST_AsMVT
+SELECT 'TG1', encode(ST_AsMVT(q, 'test', 4096, 'geom'), 'base64') FROM (
+	SELECT 1 AS c1, ST_AsMVTGeom(ST_GeomFromText('POINT(25 17)'), ST_MakeBox2D(ST_Point(0, 0), ST_Point(4096, 4096)), 4096, 0, false) AS geom
+) AS q;
+SELECT 'TG2', encode(ST_AsMVT(q), 'base64') FROM (VALUES
+	(-1, 'a'::text, 'LINESTRING(0 0,10 0,10 10)'::geometry, 1.5::float8),
+	(2, 'a', 'POLYGON((0 0,10 0,10 10,0 10,0 0),(2 2,2 4,4 4,4 2,2 2))', NULL),
+	(3, 'b', NULL, 2.0)
+) AS q(c1, name, geom, d);
+SELECT 'TG3', length(ST_AsMVT(q)) FROM (SELECT 1 AS c1, 'POINT(1 1)'::geometry AS geom WHERE false) AS q;
+SELECT 'TG4', ST_AsMVT(q, 'test', 4096, 'nogeom') FROM (SELECT 1 AS c1, 'POINT(1 1)'::geometry AS geom) AS q;
+SELECT 'TG5', ST_AsMVT(q) FROM (SELECT 1 AS c1) AS q;
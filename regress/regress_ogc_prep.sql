@@ -296,3 +296,39 @@ SELECT 'covers311', ST_Covers('POLYGON((0 0, 0 10, 10 10, 10 0, 0 0))', p) FROM
 ('LINESTRING(1 10, 10 10, 10 8)'),('LINESTRING(1 10, 10 10, 10 8)'),('LINESTRING(1 10, 10 10, 10 8)')
 ) AS v(p);
 
+
+-- Alternating polygons on one side must each keep their own cached index
+SET postgis.geom_cache_size = 2;
+SELECT c, ST_Intersects(p, l), ST_Contains(p, l), ST_Distance(p, l), ST_DWithin(p, l, 5) FROM ( VALUES 
+(1, 'POLYGON((0 0, 0 10, 10 10, 10 0, 0 0))'::geometry, 'LINESTRING(5 5, 6 6)'::geometry),
+(2, 'POLYGON((20 0, 20 10, 30 10, 30 0, 20 0))', 'LINESTRING(5 5, 6 6)'),
+(3, 'POLYGON((0 0, 0 10, 10 10, 10 0, 0 0))', 'LINESTRING(25 5, 26 6)'),
+(4, 'POLYGON((20 0, 20 10, 30 10, 30 0, 20 0))', 'LINESTRING(25 5, 26 6)'),
+(5, 'POLYGON((0 0, 0 10, 10 10, 10 0, 0 0))', 'LINESTRING(10 5, 15 5)'),
+(6, 'POLYGON((20 0, 20 10, 30 10, 30 0, 20 0))', 'LINESTRING(10 5, 15 5)'),
+(7, 'POLYGON((0 0, 0 10, 10 10, 10 0, 0 0))', 'LINESTRING(5 5, 6 6)'),
+(8, 'POLYGON((20 0, 20 10, 30 10, 30 0, 20 0))', 'LINESTRING(25 5, 26 6)')
+) AS v(c,p,l) ORDER BY c;
+RESET postgis.geom_cache_size;
+
+-- The point-in-polygon index is built on the second call and then reused
+SELECT 'cache_reset', postgis_cache_stats_reset() IS NOT NULL;
+SELECT 'cache_rtree', count(*) FROM generate_series(1, 9) i WHERE ST_Intersects('POLYGON((0 0, 0 10, 10 10, 10 0, 0 0))'::geometry, ST_MakePoint(i, i));
+SELECT 'cache_rtree_stats', lookups, arg1_hits, arg2_hits, builds, build_failures, evictions FROM postgis_cache_stats() WHERE cache = 'rtree';
+SELECT 'cache_names', array_to_string(array_agg(cache), ',') FROM postgis_cache_stats();
+
+-- Repeated polygon, the cached edge tree only rejects disjoint lines, GEOS answers the others
+SELECT 'intersects_tree', c, ST_Intersects('POLYGON((0 0, 0 10, 10 10, 10 0, 0 0), (4 4, 4 6, 6 6, 6 4, 4 4))'::geometry, l) FROM ( VALUES
+(1, 'LINESTRING(10 10, 12 12)'::geometry),
+(2, 'LINESTRING(10.000001 10, 12 12)'),
+(3, 'LINESTRING(-1 5, 11 5)'),
+(4, 'LINESTRING(4.5 4.5, 5.5 5.5)'),
+(5, 'LINESTRING(4 5, 5 5)'),
+(6, 'LINESTRING(20 20, 30 30)'),
+(7, 'LINESTRING(10 10, 12 12)')
+) AS v(c,l) ORDER BY c;
+
+-- Polygons with many edges are answered from a cell grid, which must agree with the uncached tests
+SELECT 'pip_grid', sum(ST_Intersects(g, p)::int), sum(ST_Contains(g, p)::int), sum(ST_Covers(g, p)::int), sum(ST_Within(p, g)::int), sum(ST_CoveredBy(p, g)::int)
+FROM ( SELECT ST_Segmentize('MULTIPOLYGON(((0 0, 0 100, 100 100, 100 0, 0 0), (40 40, 60 40, 60 60, 40 60, 40 40)), ((45 45, 45 55, 55 55, 55 45, 45 45)), ((200 0, 200 100, 300 100, 300 0, 200 0)))'::geometry, 0.5) AS g ) AS mp,
+     ( SELECT ST_MakePoint(x, y) AS p FROM generate_series(-1, 301) x, generate_series(-1, 101) y ) AS pts;
@@ -7,6 +7,8 @@
 INSERT INTO "spatial_ref_sys" ("srid","auth_name","auth_srid","srtext","proj4text") VALUES (100001,'EPSG',100001,'PROJCS["WGS 84 / UTM zone 33N",GEOGCS["WGS 84",DATUM["WGS_1984",SPHEROID["WGS 84",6378137,298.257223563,AUTHORITY["EPSG","7030"]],AUTHORITY["EPSG","6326"]],PRIMEM["Greenwich",0,AUTHORITY["EPSG","8901"]],UNIT["degree",0.01745329251994328,AUTHORITY["EPSG","9122"]],AUTHORITY["EPSG","1000002"]],PROJECTION["Transverse_Mercator"],PARAMETER["latitude_of_origin",0],PARAMETER["central_meridian",15],PARAMETER["scale_factor",0.9996],PARAMETER["false_easting",500000],PARAMETER["false_northing",0],UNIT["metre",1,AUTHORITY["EPSG","9001"]],AUTHORITY["EPSG","100001"]]','+proj=utm +zone=33 +ellps=WGS84 +datum=WGS84 +units=m +no_defs ');
 --- EPSG 100002 : WGS 84
 INSERT INTO "spatial_ref_sys" ("srid","auth_name","auth_srid","srtext","proj4text") VALUES (100002,'EPSG',100002,'GEOGCS["WGS 84",DATUM["WGS_1984",SPHEROID["WGS 84",6378137,298.257223563,AUTHORITY["EPSG","7030"]],AUTHORITY["EPSG","6326"]],PRIMEM["Greenwich",0,AUTHORITY["EPSG","8901"]],UNIT["degree",0.01745329251994328,AUTHORITY["EPSG","9122"]],AUTHORITY["EPSG","100002"]]','+proj=longlat +ellps=WGS84 +datum=WGS84 +no_defs ');
+--- EPSG 100003 : WGS 84 / Pseudo-Mercator
+INSERT INTO "spatial_ref_sys" ("srid","auth_name","auth_srid","srtext","proj4text") VALUES (100003,'EPSG',100003,'PROJCS["WGS 84 / Pseudo-Mercator",GEOGCS["WGS 84",DATUM["WGS_1984",SPHEROID["WGS 84",6378137,298.257223563,AUTHORITY["EPSG","7030"]],AUTHORITY["EPSG","6326"]],PRIMEM["Greenwich",0,AUTHORITY["EPSG","8901"]],UNIT["degree",0.0174532925199433,AUTHORITY["EPSG","9122"]],AUTHORITY["EPSG","4326"]],PROJECTION["Mercator_1SP"],PARAMETER["central_meridian",0],PARAMETER["scale_factor",1],PARAMETER["false_easting",0],PARAMETER["false_northing",0],UNIT["metre",1,AUTHORITY["EPSG","9001"]],AXIS["X",EAST],AXIS["Y",NORTH],EXTENSION["PROJ4","+proj=merc +a=6378137 +b=6378137 +lat_ts=0.0 +lon_0=0.0 +x_0=0.0 +y_0=0 +k=1.0 +units=m +nadgrids=@null +wktext  +no_defs"],AUTHORITY["EPSG","100003"]]','+proj=merc +a=6378137 +b=6378137 +lat_ts=0.0 +lon_0=0.0 +x_0=0.0 +y_0=0 +k=1.0 +units=m +nadgrids=@null +wktext  +no_defs');
 
 -- Repeat all tests with the new function names.
 --- test #0: NULL values
@@ -36,5 +38,29 @@ SELECT ST_transform(ST_GeomFromEWKT('SRID=0;POINT(0 0)'),100002);
 --- test #8: Transforming to same SRID
 SELECT 8,ST_AsEWKT(ST_transform(ST_GeomFromEWKT('SRID=100002;POINT(0 0)'),100002));
 
+--- test #9: warming the backend cache only loads what is not there yet
+SELECT 9,postgis_proj_cache_warm(ARRAY[100001,100002,999000]);
+
+--- test #10: changes to spatial_ref_sys are seen by the cache
+UPDATE spatial_ref_sys SET proj4text = '+proj=utm +zone=32 +ellps=WGS84 +datum=WGS84 +units=m +no_defs ' WHERE srid = 100001;
+SELECT 10,ST_Equals(ST_transform(ST_GeomFromEWKT('SRID=100002;POINT(16 48)'),100001), postgis_transform_geometry(ST_GeomFromEWKT('SRID=100002;POINT(16 48)'),'+proj=longlat +ellps=WGS84 +datum=WGS84 +no_defs ','+proj=utm +zone=32 +ellps=WGS84 +datum=WGS84 +units=m +no_defs ',100001));
+
+--- test #11: the update flushed the whole cache
+SELECT 11,srid,hits > 0 FROM postgis_proj_cache() ORDER BY srid;
+
+--- test #12: lon/lat to web mercator
+SELECT 12,round(ST_X(g)::numeric,2),round(ST_Y(g)::numeric,2) FROM (SELECT ST_transform(ST_GeomFromEWKT('SRID=100002;POINT(16 48)'),100003) AS g) AS f;
+
+--- test #13: same with longitude wrapping and Z left alone
+SELECT 13,round(ST_X(p)::numeric,2),round(ST_Y(p)::numeric,2),ST_Z(p) FROM (SELECT ST_PointN(ST_transform(ST_GeomFromEWKT('SRID=100002;LINESTRING(16 48 10, 190 -33.5 20)'),100003),2) AS p) AS f;
+
+--- test #14: and back
+SELECT 14,round(ST_X(p)::numeric,8),round(ST_Y(p)::numeric,8),ST_Z(p) FROM (SELECT ST_PointN(ST_transform(ST_transform(ST_GeomFromEWKT('SRID=100002;LINESTRING(16 48 10, 190 -33.5 20)'),100003),100002),2) AS p) AS f;
+
+--- test #15: cache counters, each lookup is either a hit or a build
+SELECT 15,postgis_cache_stats_reset() IS NOT NULL;
+SELECT 16,count(ST_transform(ST_SetSRID(ST_MakePoint(16, 48 + i), 100002), 100001)) FROM generate_series(1, 3) i;
+SELECT 17,lookups,arg1_hits + arg2_hits + builds = lookups FROM postgis_cache_stats() WHERE cache = 'proj';
+
 DELETE FROM spatial_ref_sys WHERE srid >= 100000;
 
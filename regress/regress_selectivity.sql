@@ -47,6 +47,50 @@ select 'selectivity_09', 'estimated', _postgis_selectivity('regular_overdots','g
 select 'selectivity_10', 'actual', 1;
 select 'selectivity_09', 'estimated', _postgis_selectivity('regular_overdots','g','LINESTRING(0 0, 12 12)');
 
+-- Features packed into three small cities and a sparse grid elsewhere
+create table clustered_dots as
+select st_makepoint(c.x + (i % 30) / 3.0, c.y + (i / 30) / 3.0) as g
+from (values (100, 200), (700, 300), (400, 900)) c(x, y), generate_series(0, 899) i
+union all
+select st_makepoint(i * 50, j * 50) from generate_series(0, 19) i, generate_series(0, 19) j;
+analyze clustered_dots;
+
+-- Cells fitted to the cities estimate a box inside one to within a factor of two
+select 'selectivity_11', count(*) from clustered_dots where g && 'LINESTRING(100 200, 105 205)';
+select 'selectivity_12', _postgis_selectivity('clustered_dots','g','LINESTRING(100 200, 105 205)')
+  between 0.5 * 257.0/3100.0 and 2 * 257.0/3100.0;
+drop table clustered_dots;
+
+-- Planner row estimates, for predicates the stats have to be grown for
+create or replace function estimated_rows(q text) returns integer as
+$$
+declare
+  r text;
+begin
+  for r in execute 'explain ' || q loop
+    return substring(r from ' rows=([0-9]+) ')::integer;
+  end loop;
+end;
+$$ language plpgsql;
+
+-- <const> && ST_Expand(<var>) estimates as <var> && ST_Expand(<const>)
+select 'dwithin_01', estimated_rows('select * from regular_overdots where ''POINT(3 3)''::geometry && ST_Expand(g, 1)')
+  = estimated_rows('select * from regular_overdots where g && ST_Expand(''POINT(3 3)''::geometry, 1)');
+select 'dwithin_02', abs(estimated_rows('select * from regular_overdots where ''POINT(3 3)''::geometry && ST_Expand(g, 1)')
+  - 2127 * _postgis_selectivity('regular_overdots','g','LINESTRING(2 2, 4 4)')) <= 1;
+
+-- ST_DWithin counts its mirrored box tests once
+select 'dwithin_03', estimated_rows('select * from regular_overdots where ST_DWithin(g, ''POINT(3 3)'', 1)')
+  = estimated_rows('select * from regular_overdots where g && ST_Expand(''POINT(3 3)''::geometry, 1) and _ST_DWithin(g, ''POINT(3 3)'', 1)');
+
+-- Joins on an expanded column grow the histogram cells
+select 'dwithin_04', estimated_rows('select * from regular_overdots a, regular_overdots b where a.g && ST_Expand(b.g, 2)')
+  > estimated_rows('select * from regular_overdots a, regular_overdots b where a.g && b.g');
+select 'dwithin_05', estimated_rows('select * from regular_overdots a, regular_overdots b where ST_DWithin(a.g, b.g, 2)')
+  = estimated_rows('select * from regular_overdots a, regular_overdots b where a.g && ST_Expand(b.g, 2) and _ST_DWithin(a.g, b.g, 2)');
+
+drop function estimated_rows(text);
+
 -- Clean
 drop table if exists regular_overdots;
 
@@ -0,0 +1,33 @@
+-- ST_Subdivide
+
+-- A 129 vertices polygon, cut in pieces of up to 10 vertices
+WITH p AS ( SELECT ST_Buffer('POINT(0 0)'::geometry, 10, 32) AS g )
+SELECT 1, count(*) > 1, max(ST_NPoints(s.g)) <= 10,
+       abs(sum(ST_Area(s.g)) - (SELECT ST_Area(g) FROM p)) < 1e-6
+FROM ( SELECT ST_Subdivide(g, 10) AS g FROM p ) AS s;
+
+-- Points are shared out, none lost, none made up
+SELECT 2, sum(ST_NPoints(g)), max(ST_NPoints(g)) <= 8
+FROM ST_Subdivide((SELECT ST_Collect(ST_MakePoint(i % 10, i / 10)) FROM generate_series(0, 99) AS i), 8) AS g;
+
+-- Small geometries come back as they are
+SELECT 3, ST_AsEWKT(g) FROM ST_Subdivide('SRID=4326;LINESTRING(0 0,1 1,2 0)'::geometry) AS g;
+
+-- Collections are exploded
+SELECT 4, ST_AsText(g) FROM ST_Subdivide('GEOMETRYCOLLECTION(POINT(0 0),POLYGON((0 0,0 1,1 1,0 0)))'::geometry) AS g ORDER BY 2;
+
+-- Lines keep their length
+WITH l AS ( SELECT ST_MakeLine(ST_MakePoint(i, i % 2) ORDER BY i) AS g FROM generate_series(0, 99) AS i )
+SELECT 5, max(ST_NPoints(s.g)) <= 10,
+       abs(sum(ST_Length(s.g)) - (SELECT ST_Length(g) FROM l)) < 1e-9
+FROM ( SELECT ST_Subdivide(g, 10) AS g FROM l ) AS s;
+
+-- Empties give nothing
+SELECT 6, count(*) FROM ST_Subdivide('POLYGON EMPTY'::geometry) AS g;
+
+-- Too small a budget
+SELECT 7, ST_Subdivide('LINESTRING(0 0,1 1)'::geometry, 4);
+
+-- Coincident vertices can't be split, their piece goes over budget
+SELECT 8, count(*), max(ST_NPoints(g))
+FROM ST_Subdivide((SELECT ST_Collect(ST_MakePoint(i / 12, i / 12)) FROM generate_series(0, 12) AS i), 8) AS g;
@@ -0,0 +1,31 @@
+-- The btree operators and ST_Combine_BBox(box2d, geometry) read boxes and
+-- SRIDs from a slice of the datum. EXTERNAL storage keeps the long lines
+-- out of line and uncompressed, so the slice is all that gets fetched.
+CREATE TABLE toast_bbox (id int, g geometry);
+ALTER TABLE toast_bbox ALTER COLUMN g SET STORAGE EXTERNAL;
+
+-- A long line with a stored box
+INSERT INTO toast_bbox SELECT 1, ST_SetSRID(ST_MakeLine(ARRAY(
+	SELECT ST_MakePoint(i, i % 7) FROM generate_series(0, 3999) i)), 4326);
+-- A long line without one, detoasted in full to compute the box
+INSERT INTO toast_bbox SELECT 2, postgis_dropbbox(ST_SetSRID(ST_MakeLine(ARRAY(
+	SELECT ST_MakePoint(i + 10, i % 7 - 5) FROM generate_series(0, 3999) i)), 4326));
+-- Short boxless values, boxes read from their coordinates
+INSERT INTO toast_bbox VALUES (3, 'SRID=4326;POINT(-5 2)');
+INSERT INTO toast_bbox VALUES (4, postgis_dropbbox('SRID=4326;LINESTRING(20 20,30 30)'));
+
+SELECT 'toasted', pg_relation_size(reltoastrelid) > 0 FROM pg_class WHERE relname = 'toast_bbox';
+SELECT 'hasbbox', id, postgis_hasbbox(g) FROM toast_bbox ORDER BY id;
+
+SELECT 'combine', id, ST_Combine_BBox(NULL::box2d, g) FROM toast_bbox ORDER BY id;
+SELECT 'extent', ST_Extent(g) FROM toast_bbox;
+
+SELECT 'order', id FROM toast_bbox ORDER BY g;
+SELECT 'lt', a.id, b.id FROM toast_bbox a, toast_bbox b WHERE a.g < b.g ORDER BY 2, 3;
+SELECT 'eq', a.id, b.id FROM toast_bbox a, toast_bbox b WHERE a.g = b.g ORDER BY 2, 3;
+SELECT 'distinct', count(DISTINCT g) FROM toast_bbox;
+
+-- The SRID of the toasted line comes from the slice too
+SELECT 'srid', count(*) FROM toast_bbox WHERE g = 'SRID=3857;POINT(-5 2)'::geometry;
+
+DROP TABLE toast_bbox;
@@ -0,0 +1,26 @@
+-- ST_AsTWKB
+SELECT 'T1', encode(ST_AsTWKB('POINT(1 2)'::geometry), 'hex');
+SELECT 'T2', encode(ST_AsTWKB('POINT(1.25 -2.5)'::geometry, 1), 'hex');
+SELECT 'T3', encode(ST_AsTWKB('LINESTRING(1 1,5 5)'::geometry, 0, 0, 0, true, true), 'hex');
+SELECT 'T4', encode(ST_AsTWKB('POINT EMPTY'::geometry), 'hex');
+
+-- Many geometries with ids
+SELECT 'T5', encode(ST_AsTWKB(ARRAY['POINT(0 0)'::geometry, 'POINT(1 1)'], ARRAY[10, 20]::bigint[]), 'hex');
+SELECT 'T6', encode(ST_AsTWKB(ARRAY['POINT(1 1)'::geometry, 'LINESTRING(1 1,2 2)'], ARRAY[10, 20]::bigint[], 0, 0, 0, false, true), 'hex');
+SELECT 'T7', encode(ST_AsTWKB(ARRAY['POINT(0 0)'::geometry, NULL, 'POINT(1 1)'], ARRAY[10, 15, 20]::bigint[]), 'hex');
+
+-- ST_GeomFromTWKB
+SELECT 'T8', ST_AsText(ST_GeomFromTWKB(ST_AsTWKB('POLYGON((0 0,10 0,10 10,0 10,0 0),(2 2,2 4,4 4,4 2,2 2))'::geometry)));
+SELECT 'T9', ST_AsEWKT(ST_GeomFromTWKB(ST_AsTWKB('SRID=4326;LINESTRING(0.12 0.34,5.67 8.91)'::geometry, 1)));
+SELECT 'T10', ST_AsText(ST_GeomFromTWKB(ST_AsTWKB('POINT(1 2 3.14159)'::geometry, 0, 2)));
+SELECT 'T11', ST_AsText(ST_GeomFromTWKB(ST_AsTWKB(ARRAY['POINT(1 1)'::geometry, 'LINESTRING(1 1,2 2)'], ARRAY[10, 20]::bigint[], 0, 0, 0, true, true)));
+
+-- Size against WKB
+SELECT 'T12', length(ST_AsBinary(g)), length(ST_AsTWKB(g, 2))
+FROM (SELECT ST_MakeLine(ST_MakePoint(i * 0.01, i * 0.02)) AS g FROM generate_series(1, 100) AS i) AS foo;
+
+-- Errors
+SELECT 'T13', ST_AsTWKB('POINT(1 1)'::geometry, 8);
+SELECT 'T14', ST_AsTWKB(ARRAY['POINT(0 0)'::geometry], ARRAY[1, 2]::bigint[]);
+SELECT 'T15', ST_GeomFromTWKB(decode('02007f0202', 'hex'));
+SELECT 'T16', ST_GeomFromTWKB(decode('0200010202', 'hex'));
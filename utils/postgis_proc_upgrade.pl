@@ -64,6 +64,12 @@ my $objs = {
 			"geography" => 1,
 			"gidx" => 1
 		}
+	},
+ 	"201" => { 
+		"operators" => {
+			"geometry <<->>" => 1,
+			"geography <->" => 1
+		}
 	}
 };
 
@@ -195,6 +201,17 @@ while(<INPUT>)
 		}
 	}
 
+	# DO blocks are written to be re-runnable, pass them through.
+	if ( /^do\s*\$\$/i )
+	{
+		print $_;
+		while(<INPUT>)
+		{
+			print $_;
+			last if /^\$\$;/;
+		}
+	}
+
 	# This code handles casts by dropping and recreating them.
 	if ( /^create cast\s+\(\s*(\w+)\s+as\s+(\w+)\)/i )
 	{
@@ -206,7 +223,21 @@ while(<INPUT>)
 	}
 
 	# This code handles aggregates by dropping and recreating them.
-	if ( /^create aggregate\s+(\S+)\s*\(/i )
+	# Aggregates of several arguments list them after the name.
+	if ( /^create aggregate\s+(\w+)\s*\(([^\)]*)\)\s*\(/i )
+	{
+		my $aggname = $1;
+		my $aggtype = $2;
+		my $def = $_;
+		while(<INPUT>)
+		{
+			$def .= $_;
+			last if /\);/;
+		}
+		print "DROP AGGREGATE IF EXISTS $aggname($aggtype);\n";
+		print $def;
+	}
+	elsif ( /^create aggregate\s+(\S+)\s*\(/i )
 	{
 		my $aggname = $1;
 		my $aggtype = 'unknown';
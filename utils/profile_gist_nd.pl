@@ -0,0 +1,181 @@
+#!/usr/bin/perl -w
+
+# $Id$
+#
+# Index pages touched per query by the N-D GiST opclasses.
+#
+# Builds a 3D point cloud indexed with gist_geometry_ops_nd and a
+# set of geography points, then runs the same random box queries
+# against both and reports the average number of index pages each
+# one read (the Buffers of the Bitmap Index Scan node). Run it once
+# per build to compare picksplit strategies: queries are seeded, so
+# successive runs see the same data and the same windows.
+#
+
+use Pg;
+
+$VERBOSE = 0;
+$ROWS = 200000;
+$QUERIES = 500;
+$KEEP = 0;
+
+sub usage
+{
+	local($me) = `basename $0`;
+	chop($me);
+	print STDERR "$me [-v] [-keep] [-rows <rows>] [-queries <queries>]\n";
+}
+
+for ($i=0; $i<@ARGV; $i++)
+{
+	if ( $ARGV[$i] eq '-v' )
+	{
+		$VERBOSE++;
+	}
+	elsif ( $ARGV[$i] eq '-keep' )
+	{
+		$KEEP=1;
+	}
+	elsif ( $ARGV[$i] eq '-rows' )
+	{
+		$ROWS = $ARGV[++$i];
+	}
+	elsif ( $ARGV[$i] eq '-queries' )
+	{
+		$QUERIES = $ARGV[++$i];
+	}
+	else
+	{
+		print STDERR "Unknown option $ARGV[$i]:\n";
+		usage();
+		exit(1);
+	}
+}
+
+#connect
+$conn = Pg::connectdb("");
+if ( $conn->status != PGRES_CONNECTION_OK ) {
+        print STDERR $conn->errorMessage;
+	exit(1);
+}
+
+run_command('SET client_min_messages = warning');
+run_command('SELECT setseed(0.5)');
+
+print "Building tables with $ROWS rows\n";
+
+run_command('DROP TABLE IF EXISTS profile_gist_nd_cloud');
+run_command('CREATE TABLE profile_gist_nd_cloud AS '.
+	'SELECT ST_MakePoint(random()*1000, random()*1000, random()*10) AS geom '.
+	"FROM generate_series(1, $ROWS)");
+run_command('CREATE INDEX profile_gist_nd_cloud_idx ON profile_gist_nd_cloud '.
+	'USING gist (geom gist_geometry_ops_nd)');
+
+run_command('DROP TABLE IF EXISTS profile_gist_nd_geog');
+run_command('CREATE TABLE profile_gist_nd_geog AS '.
+	'SELECT ST_MakePoint(random()*360-180, degrees(asin(random()*2-1)))::geography AS geog '.
+	"FROM generate_series(1, $ROWS)");
+run_command('CREATE INDEX profile_gist_nd_geog_idx ON profile_gist_nd_geog '.
+	'USING gist (geog)');
+
+run_command('VACUUM ANALYZE profile_gist_nd_cloud');
+run_command('VACUUM ANALYZE profile_gist_nd_geog');
+
+# Only look at index pages
+run_command('SET enable_seqscan = off');
+run_command('SET enable_indexscan = off');
+
+print "\n  index\t\tpages\trows\tpages/query\n";
+print "----------------------------------------------------\n";
+
+srand(1);
+($pages, $rows) = (0, 0);
+for ($i=0; $i<$QUERIES; $i++)
+{
+	local($x) = rand(1000);
+	local($y) = rand(1000);
+	local($z) = rand(10);
+	local($p, $r) = index_pages('SELECT 1 FROM profile_gist_nd_cloud WHERE geom &&& '.
+		"ST_MakeLine(ST_MakePoint($x-10,$y-10,$z-0.5),ST_MakePoint($x+10,$y+10,$z+0.5))");
+	$pages += $p;
+	$rows += $r;
+}
+report('cloud', $pages, $rows);
+
+srand(1);
+($pages, $rows) = (0, 0);
+for ($i=0; $i<$QUERIES; $i++)
+{
+	local($x) = rand(360) - 180;
+	local($y) = rand(170) - 85;
+	local($p, $r) = index_pages('SELECT 1 FROM profile_gist_nd_geog WHERE geog && '.
+		"ST_Buffer('POINT($x $y)'::geography, 50000)");
+	$pages += $p;
+	$rows += $r;
+}
+report('geography', $pages, $rows);
+
+if ( ! $KEEP )
+{
+	run_command('DROP TABLE profile_gist_nd_cloud');
+	run_command('DROP TABLE profile_gist_nd_geog');
+}
+
+
+##################################################################
+
+sub run_command
+{
+	local($query) = shift;
+	local($res);
+
+	print "$query\n" if ($VERBOSE > 1);
+	$res = $conn->exec($query);
+	if ( $res->resultStatus != PGRES_COMMAND_OK &&
+	     $res->resultStatus != PGRES_TUPLES_OK )  {
+		print STDERR $conn->errorMessage;
+		exit(1);
+	}
+	return $res;
+}
+
+sub report
+{
+	local($name, $pages, $rows) = @_;
+
+	print "  $name\t".$pages."\t".$rows."\t".
+		(int($pages/$QUERIES*100)/100)."\n";
+}
+
+#
+# Pages read by the Bitmap Index Scan of a query, and rows it found
+#
+sub index_pages
+{
+	local($query) = shift;
+	local($res, $row, $in_index);
+	local($pages, $rows) = (0, 0);
+
+	$res = run_command('EXPLAIN (ANALYZE, BUFFERS) '.$query);
+	$in_index = 0;
+	while ( ($row=$res->fetchrow()) )
+	{
+		if ( $row =~ /Bitmap Index Scan.*actual .* rows=([0-9]+) /)
+		{
+			$rows += $1;
+			$in_index = 1;
+			next;
+		}
+		next unless $in_index;
+		if ( $row =~ /Buffers: shared(.*)$/ )
+		{
+			local($buffers) = $1;
+			$pages += $1 if ( $buffers =~ /hit=([0-9]+)/ );
+			$pages += $1 if ( $buffers =~ /read=([0-9]+)/ );
+			$in_index = 0;
+		}
+	}
+	print "$query: $pages pages, $rows rows\n" if ($VERBOSE);
+
+	return ($pages, $rows);
+}